@@ -0,0 +1,137 @@
+#define _XOPEN_SOURCE 700 // For nftw
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include "bench.h"
+
+uint64_t bench_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+void latency_init(LatencyRecorder *recorder, size_t expected) {
+    recorder->samples = expected ? malloc(expected * sizeof(uint64_t)) : NULL;
+    recorder->capacity = recorder->samples ? expected : 0;
+    recorder->count = 0;
+}
+
+void latency_record(LatencyRecorder *recorder, uint64_t ns) {
+    if (recorder->count == recorder->capacity) {
+        size_t capacity = recorder->capacity ? recorder->capacity * 2 : 1024;
+        uint64_t *samples = realloc(recorder->samples, capacity * sizeof(uint64_t));
+        if (!samples) return;
+        recorder->samples = samples;
+        recorder->capacity = capacity;
+    }
+    recorder->samples[recorder->count++] = ns;
+}
+
+void latency_merge(LatencyRecorder *recorder, const LatencyRecorder *other) {
+    for (size_t i = 0; i < other->count; i++) latency_record(recorder, other->samples[i]);
+}
+
+void latency_reset(LatencyRecorder *recorder) {
+    recorder->count = 0;
+}
+
+void latency_free(LatencyRecorder *recorder) {
+    free(recorder->samples);
+    recorder->samples = NULL;
+    recorder->count = recorder->capacity = 0;
+}
+
+static int compare_samples(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Latency at quantile q of samples already sorted
+static uint64_t sorted_percentile(const LatencyRecorder *recorder, double q) {
+    if (recorder->count == 0) return 0;
+    return recorder->samples[(size_t)(q * (double)(recorder->count - 1) + 0.5)];
+}
+
+void bench_report(FILE *out, const char *bench, long n, LatencyRecorder *recorder,
+                  double seconds, const char *extra) {
+    qsort(recorder->samples, recorder->count, sizeof(uint64_t), compare_samples);
+    uint64_t p50 = sorted_percentile(recorder, 0.50);
+    uint64_t p99 = sorted_percentile(recorder, 0.99);
+    uint64_t p999 = sorted_percentile(recorder, 0.999);
+    uint64_t max = recorder->count ? recorder->samples[recorder->count - 1] : 0;
+    const char *label = getenv("BENCH_LABEL"); // e.g. the commit, to tell runs apart
+    fprintf(out, "{%s%s%s\"bench\":\"%s\",\"n\":%ld,\"ops\":%zu,\"seconds\":%.6f,\"ops_per_sec\":%.1f,"
+                 "\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu%s%s}\n",
+            label ? "\"label\":\"" : "", label ? label : "", label ? "\"," : "",
+            bench, n, recorder->count, seconds, seconds > 0 ? (double)recorder->count / seconds : 0.0,
+            (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)p999,
+            (unsigned long long)max, extra ? "," : "", extra ? extra : "");
+    fflush(out);
+}
+
+int bench_enter_scratch_dir(char *dir, size_t size) {
+    const char *base = getenv("TMPDIR");
+    if (!base || !*base) base = "/tmp";
+    if (snprintf(dir, size, "%s/cerver_bench.XXXXXX", base) >= (int)size) {
+        fprintf(stderr, "Error: Scratch directory path too long\n");
+        return -1;
+    }
+    if (!mkdtemp(dir)) {
+        perror("Failed to create scratch directory");
+        return -1;
+    }
+    if (chdir(dir) != 0) {
+        perror("Failed to enter scratch directory");
+        return -1;
+    }
+    return 0;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)st; (void)type; (void)ftw;
+    return remove(path);
+}
+
+void bench_remove_scratch_dir(const char *dir) {
+    if (chdir("/") != 0) return;
+    if (nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS) != 0) {
+        fprintf(stderr, "Warning: Could not remove scratch directory %s\n", dir);
+    }
+}
+
+FILE *bench_results_stream(int quiet) {
+    fflush(stdout);
+    int results_fd = dup(STDOUT_FILENO);
+    FILE *results = results_fd >= 0 ? fdopen(results_fd, "w") : NULL;
+    if (!results) {
+        perror("Failed to open the results stream");
+        return stdout;
+    }
+    int log_fd = quiet ? open("/dev/null", O_WRONLY) : dup(STDERR_FILENO);
+    if (log_fd >= 0) {
+        dup2(log_fd, STDOUT_FILENO);
+        close(log_fd);
+    }
+    return results;
+}
+
+int bench_parse_list(const char *text, long *values, int max) {
+    int count = 0;
+    while (*text) {
+        char *end;
+        long value = strtol(text, &end, 10);
+        if (end == text || value <= 0 || count == max) return -1;
+        // Allow K and M suffixes: 10K, 1M
+        if (*end == 'K' || *end == 'k') { value *= 1000; end++; }
+        else if (*end == 'M' || *end == 'm') { value *= 1000000; end++; }
+        values[count++] = value;
+        if (*end == ',') end++;
+        else if (*end) return -1;
+        text = end;
+    }
+    return count;
+}
@@ -0,0 +1,63 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// --- Benchmark Support ---
+// Shared by the micro-benchmarks and the HTTP load generator. Every result is
+// written as one JSON object per line, so runs of different commits can be
+// collected into a file and compared with standard tools:
+//   {"bench":"search_key","n":1000000,"ops":1000000,"seconds":0.41,
+//    "ops_per_sec":2439024,"p50_ns":310,"p99_ns":820,"p999_ns":2100, ...}
+// with a leading "label" member when BENCH_LABEL is set (e.g. to the commit).
+
+// Per-operation latencies in nanoseconds, grown as samples are added
+typedef struct {
+    uint64_t *samples;
+    size_t count;
+    size_t capacity;
+} LatencyRecorder;
+
+// Monotonic clock in nanoseconds
+uint64_t bench_now_ns(void);
+
+// Start an empty recorder with room for about expected samples
+void latency_init(LatencyRecorder *recorder, size_t expected);
+
+// Add one latency (dropped if memory runs out)
+void latency_record(LatencyRecorder *recorder, uint64_t ns);
+
+// Append every sample of other to recorder
+void latency_merge(LatencyRecorder *recorder, const LatencyRecorder *other);
+
+// Forget the samples but keep the memory
+void latency_reset(LatencyRecorder *recorder);
+
+void latency_free(LatencyRecorder *recorder);
+
+// Writes a result line: the recorded operations over seconds, their latency
+// percentiles (sorting the samples), and extra (already formatted JSON
+// members such as "\"concurrency\":8", or NULL)
+void bench_report(FILE *out, const char *bench, long n, LatencyRecorder *recorder,
+                  double seconds, const char *extra);
+
+// Creates a scratch directory under $TMPDIR (or /tmp) and makes it the
+// working directory, so tables land in <dir>/scaffolded_resources. Returns 0,
+// or -1 on failure; the path is copied to dir.
+int bench_enter_scratch_dir(char *dir, size_t size);
+
+// Removes the scratch directory made by bench_enter_scratch_dir
+void bench_remove_scratch_dir(const char *dir);
+
+// Keeps the results on the original stdout and sends what the server and
+// storage layers print to /dev/null (quiet) or stderr. Returns the stream
+// results are written to.
+FILE *bench_results_stream(int quiet);
+
+// Parses a comma separated list of positive numbers into values (at most
+// max). Returns how many were parsed, or -1 if the list is malformed.
+int bench_parse_list(const char *text, long *values, int max);
+
+#endif // BENCH_H
@@ -0,0 +1,570 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "bench.h"
+#include "../server/http_server.h"
+#include "../database/rdbms.h"
+#include "../models/model_setup.h"
+#include "../routes/scaffold_routes.h"
+
+// Closed-loop HTTP load generator: each client keeps one persistent
+// connection and sends its next request as soon as the previous response
+// arrives, so the offered load follows the server's speed. Requests are
+// drawn from a view:update:create:delete mix against the "benchitem"
+// resource (id:int,name:string,price:float,count:int). Views and updates hit
+// the preloaded rows; deletes only remove rows the client created itself, so
+// the preloaded set stays intact across concurrency levels.
+//
+// By default the server runs in this process on a scratch directory;
+// --connect sends the load to a running cerver instead (scaffold benchitem
+// with the attributes above first; --rows must not exceed the rows it holds).
+//
+// Usage: load_gen [--concurrency LIST] [--duration S] [--warmup S]
+//                 [--mix V:U:C:D] [--rows N] [--port N] [--loops N]
+//                 [--workers N] [--shards N] [--connect HOST:PORT] [--verbose]
+
+#define MAX_LEVELS 16
+#define RESOURCE "benchitem"
+#define DEFAULT_PORT "3900"
+#define RESPONSE_BUFFER_SIZE 65536
+
+enum { OP_VIEW, OP_UPDATE, OP_CREATE, OP_DELETE, OP_COUNT };
+static const char *op_names[OP_COUNT] = { "http_view", "http_update", "http_create", "http_delete" };
+
+typedef struct {
+    long levels[MAX_LEVELS];    // Concurrency levels, run in order
+    int level_count;
+    double duration;            // Measured seconds per level
+    double warmup;              // Unmeasured seconds before each level
+    int mix[OP_COUNT];          // Percentages of each operation
+    char mix_text[32];
+    long rows;                  // Rows preloaded (in process) or assumed present (--connect)
+    char host[128];
+    char port[16];
+    int external;               // Load a running server instead of starting one
+    int loops;                  // In-process server event loops (0: one per CPU)
+    int workers;                // In-process server workers (0: one per CPU)
+    int shards;                 // In-process table shards (1: unpartitioned)
+    int verbose;
+} LoadOptions;
+
+typedef struct {
+    int index;
+    pthread_t thread;
+    uint64_t rng;
+    int socket;
+    char *buffer;               // Response bytes
+    size_t buffer_capacity;
+    LatencyRecorder latencies[OP_COUNT];
+    long errors[OP_COUNT];
+    long connections;           // Connections opened (the server closes them after a number of requests)
+    int *owned;                 // Ids this client created and has not deleted (a stack)
+    long owned_count;
+    long owned_capacity;
+} Client;
+
+static LoadOptions options;
+static struct addrinfo *server_address;
+static volatile int measuring;  // Clients record latencies while set
+static volatile int stopping;   // Clients finish their request and exit
+static long next_id;            // Next id a create uses (atomic)
+static FILE *results;
+
+static uint64_t next_random(Client *client) {
+    client->rng ^= client->rng >> 12;
+    client->rng ^= client->rng << 25;
+    client->rng ^= client->rng >> 27;
+    return client->rng * 2685821657736338717ull;
+}
+
+// --- Connection ---
+
+static int open_connection(void) {
+    int fd = socket(server_address->ai_family, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, server_address->ai_addr, server_address->ai_addrlen) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int send_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return -1;
+        data += sent;
+        length -= (size_t)sent;
+    }
+    return 0;
+}
+
+// Reads more of the response into the client's buffer after used bytes
+static ssize_t receive_more(Client *client, size_t used) {
+    if (used + 1 >= client->buffer_capacity) {
+        size_t capacity = client->buffer_capacity * 2;
+        char *buffer = realloc(client->buffer, capacity);
+        if (!buffer) return -1;
+        client->buffer = buffer;
+        client->buffer_capacity = capacity;
+    }
+    ssize_t received;
+    do {
+        received = recv(client->socket, client->buffer + used, client->buffer_capacity - used - 1, 0);
+    } while (received < 0 && errno == EINTR);
+    return received;
+}
+
+// Finds the end of a chunked body starting at body, or returns NULL if it is incomplete
+static const char *chunked_end(const char *body, const char *end) {
+    while (body < end) {
+        const char *line_end = memchr(body, '\n', end - body);
+        if (!line_end) return NULL;
+        unsigned long size = strtoul(body, NULL, 16);
+        body = line_end + 1;
+        if (size == 0) {
+            // Skip trailers up to the blank line
+            while (1) {
+                line_end = memchr(body, '\n', end - body);
+                if (!line_end) return NULL;
+                int blank = line_end == body || (line_end == body + 1 && *body == '\r');
+                body = line_end + 1;
+                if (blank) return body;
+            }
+        }
+        if ((size_t)(end - body) < size + 2) return NULL;
+        body += size + 2;
+    }
+    return NULL;
+}
+
+// Reads one complete response. Returns its status code, or -1 if the
+// connection failed; *keep_open is cleared when the server closes it.
+static int read_response(Client *client, int *keep_open) {
+    size_t used = 0;
+    const char *header_end = NULL;
+    while (!header_end) {
+        ssize_t received = receive_more(client, used);
+        if (received <= 0) return -1;
+        used += (size_t)received;
+        client->buffer[used] = '\0';
+        header_end = strstr(client->buffer, "\r\n\r\n");
+    }
+    int status = atoi(client->buffer + 9); // "HTTP/1.1 200"
+    const char *body = header_end + 4;
+    size_t header_length = (size_t)(body - client->buffer);
+
+    long content_length = -1;
+    int chunked = 0;
+    *keep_open = 1;
+    for (const char *line = strstr(client->buffer, "\r\n") + 2; line < header_end; ) {
+        const char *line_end = strstr(line, "\r\n");
+        const char *chunked_token = strstr(line, "chunked");
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            content_length = atol(line + 15);
+        } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && chunked_token && chunked_token < line_end) {
+            chunked = 1;
+        } else if (strncasecmp(line, "Connection:", 11) == 0 && strncasecmp(line + 11, " close", 6) == 0) {
+            *keep_open = 0;
+        }
+        line = line_end + 2;
+    }
+
+    while (1) {
+        body = client->buffer + header_length; // The buffer may have moved
+        const char *end = client->buffer + used;
+        if (chunked) {
+            if (chunked_end(body, end)) break;
+        } else if (content_length >= 0) {
+            if ((long)(end - body) >= content_length) break;
+        } else {
+            *keep_open = 0; // Unframed body: ends when the server closes
+        }
+        ssize_t received = receive_more(client, used);
+        if (received < 0) return -1;
+        if (received == 0) {
+            if (chunked || content_length >= 0) return -1;
+            break;
+        }
+        used += (size_t)received;
+        client->buffer[used] = '\0';
+    }
+    return status;
+}
+
+// Sends a request and reads its response, reconnecting once if the server
+// closed the persistent connection. Returns the status code, or -1.
+static int exchange(Client *client, const char *request, size_t length) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (client->socket < 0) {
+            client->socket = open_connection();
+            if (client->socket < 0) return -1;
+            client->connections++;
+        }
+        int keep_open = 0;
+        int status = send_all(client->socket, request, length) == 0 ? read_response(client, &keep_open) : -1;
+        if (status < 0 || !keep_open) {
+            close(client->socket);
+            client->socket = -1;
+        }
+        if (status >= 0) return status;
+    }
+    return -1;
+}
+
+// --- Operations ---
+
+static int pick_operation(Client *client) {
+    int roll = (int)(next_random(client) % 100);
+    for (int op = 0; op < OP_COUNT; op++) {
+        if (roll < options.mix[op]) return op;
+        roll -= options.mix[op];
+    }
+    return OP_VIEW;
+}
+
+static void push_owned(Client *client, int id) {
+    if (client->owned_count == client->owned_capacity) {
+        long capacity = client->owned_capacity ? client->owned_capacity * 2 : 1024;
+        int *owned = realloc(client->owned, capacity * sizeof(int));
+        if (!owned) return; // The row is just never deleted
+        client->owned = owned;
+        client->owned_capacity = capacity;
+    }
+    client->owned[client->owned_count++] = id;
+}
+
+// Builds the request of an operation into request and returns its length
+static int build_request(Client *client, int *op, char *request, size_t size, int *created_id) {
+    char body[160];
+    int id = (int)(next_random(client) % (uint64_t)options.rows) + 1;
+    *created_id = 0;
+    if (*op == OP_DELETE && client->owned_count == 0) *op = OP_CREATE; // Nothing of ours to delete yet
+
+    switch (*op) {
+    case OP_VIEW:
+        return snprintf(request, size, "GET /" RESOURCE "/%d HTTP/1.1\r\nHost: %s\r\n\r\n", id, options.host);
+    case OP_UPDATE: {
+        int body_length = snprintf(body, sizeof(body), "{\"name\": \"updated-%d\", \"count\": %d}",
+                                   id, (int)(next_random(client) % 1000));
+        return snprintf(request, size, "PATCH /" RESOURCE "/%d HTTP/1.1\r\nHost: %s\r\n"
+                        "Content-Type: application/json\r\nContent-Length: %d\r\n\r\n%s",
+                        id, options.host, body_length, body);
+    }
+    case OP_CREATE: {
+        *created_id = (int)__atomic_fetch_add(&next_id, 1, __ATOMIC_RELAXED);
+        int body_length = snprintf(body, sizeof(body),
+                                   "{\"id\": %d, \"name\": \"created-%d\", \"price\": 9.99, \"count\": 1}",
+                                   *created_id, *created_id);
+        return snprintf(request, size, "POST /" RESOURCE " HTTP/1.1\r\nHost: %s\r\n"
+                        "Content-Type: application/json\r\nContent-Length: %d\r\n\r\n%s",
+                        options.host, body_length, body);
+    }
+    default:
+        id = client->owned[--client->owned_count];
+        return snprintf(request, size, "DELETE /" RESOURCE "/%d HTTP/1.1\r\nHost: %s\r\n\r\n", id, options.host);
+    }
+}
+
+static void *client_main(void *arg) {
+    Client *client = arg;
+    char request[512];
+    while (!stopping) {
+        int op = pick_operation(client);
+        int created_id;
+        int length = build_request(client, &op, request, sizeof(request), &created_id);
+        int recording = measuring;
+        uint64_t start = bench_now_ns();
+        int status = exchange(client, request, (size_t)length);
+        uint64_t elapsed = bench_now_ns() - start;
+        int ok = status >= 200 && status < 300;
+        if (ok && created_id) push_owned(client, created_id);
+        if (recording && measuring) {
+            latency_record(&client->latencies[op], elapsed);
+            if (!ok) client->errors[op]++;
+        }
+        if (status < 0) usleep(1000); // Server gone or refusing: don't spin
+    }
+    return NULL;
+}
+
+// --- Levels ---
+
+static void sleep_seconds(double seconds) {
+    if (seconds > 0) usleep((useconds_t)(seconds * 1e6));
+}
+
+static int run_level(long concurrency) {
+    Client *clients = calloc(concurrency, sizeof(Client));
+    if (!clients) {
+        perror("Failed to allocate clients");
+        return -1;
+    }
+    measuring = 0;
+    stopping = 0;
+    long started = 0;
+    for (; started < concurrency; started++) {
+        Client *client = &clients[started];
+        client->index = (int)started;
+        client->rng = 0x9E3779B97F4A7C15ull ^ ((uint64_t)(started + 1) * 0xBF58476D1CE4E5B9ull);
+        client->socket = -1;
+        client->buffer_capacity = RESPONSE_BUFFER_SIZE;
+        client->buffer = malloc(client->buffer_capacity);
+        for (int op = 0; op < OP_COUNT; op++) latency_init(&client->latencies[op], 4096);
+        if (!client->buffer || pthread_create(&client->thread, NULL, client_main, client) != 0) {
+            fprintf(stderr, "Error: Failed to start client %ld\n", started);
+            free(client->buffer);
+            for (int op = 0; op < OP_COUNT; op++) latency_free(&client->latencies[op]);
+            break;
+        }
+    }
+
+    sleep_seconds(options.warmup);
+    uint64_t start = bench_now_ns();
+    measuring = 1;
+    sleep_seconds(options.duration);
+    measuring = 0;
+    double seconds = (double)(bench_now_ns() - start) / 1e9;
+    stopping = 1;
+
+    LatencyRecorder merged[OP_COUNT], all;
+    long errors[OP_COUNT] = { 0 }, total_errors = 0, connections = 0;
+    latency_init(&all, 0);
+    for (int op = 0; op < OP_COUNT; op++) latency_init(&merged[op], 0);
+    for (long i = 0; i < started; i++) {
+        Client *client = &clients[i];
+        pthread_join(client->thread, NULL);
+        for (int op = 0; op < OP_COUNT; op++) {
+            latency_merge(&merged[op], &client->latencies[op]);
+            latency_merge(&all, &client->latencies[op]);
+            errors[op] += client->errors[op];
+            latency_free(&client->latencies[op]);
+        }
+        connections += client->connections;
+        if (client->socket >= 0) close(client->socket);
+        free(client->buffer);
+        free(client->owned);
+    }
+    free(clients);
+
+    char extra[160];
+    for (int op = 0; op < OP_COUNT; op++) {
+        total_errors += errors[op];
+        if (merged[op].count == 0) continue;
+        snprintf(extra, sizeof(extra), "\"concurrency\":%ld,\"mix\":\"%s\",\"errors\":%ld",
+                 concurrency, options.mix_text, errors[op]);
+        bench_report(results, op_names[op], options.rows, &merged[op], seconds, extra);
+        latency_free(&merged[op]);
+    }
+    snprintf(extra, sizeof(extra), "\"concurrency\":%ld,\"mix\":\"%s\",\"errors\":%ld,\"connections\":%ld",
+             concurrency, options.mix_text, total_errors, connections);
+    bench_report(results, "http_all", options.rows, &all, seconds, extra);
+    latency_free(&all);
+    return started == concurrency ? 0 : -1;
+}
+
+// --- In-Process Server ---
+
+static Field bench_fields[] = {
+    { "id", "int", 1, 0, NULL, NULL },
+    { "name", "string", 0, 0, NULL, NULL },
+    { "price", "float", 0, 0, NULL, NULL },
+    { "count", "int", 0, 0, NULL, NULL },
+};
+
+static void *server_main(void *arg) {
+    start_server_with_config(arg);
+    return NULL;
+}
+
+// Inserts the rows the views and updates work on, in batches
+static int preload_rows(Model *model, long rows) {
+    enum { BATCH = 10000 };
+    char ***batch = malloc(BATCH * sizeof(char **));
+    char (*text)[4][32] = malloc(BATCH * sizeof(*text));
+    char **values = malloc(BATCH * 4 * sizeof(char *));
+    int status = batch && text && values ? 0 : -1;
+    for (long first = 1; status == 0 && first <= rows; first += BATCH) {
+        int count = (int)(rows - first + 1 < BATCH ? rows - first + 1 : BATCH);
+        for (int i = 0; i < count; i++) {
+            long id = first + i;
+            snprintf(text[i][0], 32, "%ld", id);
+            snprintf(text[i][1], 32, "item-%ld", id);
+            snprintf(text[i][2], 32, "%ld.%02ld", id % 1000, id % 100);
+            snprintf(text[i][3], 32, "%ld", id % 50);
+            for (int f = 0; f < 4; f++) values[i * 4 + f] = text[i][f];
+            batch[i] = &values[i * 4];
+        }
+        if (insert_model_rows(model, batch, count) != count) status = -1;
+    }
+    free(batch);
+    free(text);
+    free(values);
+    return status;
+}
+
+static int start_local_server(pthread_t *thread, ServerConfig *config) {
+    if (db_system_init("bench_db") != 0) return -1;
+    db_set_row_cache(ROW_CACHE_DEFAULT_ENTRIES);
+    if (db_set_table_shards(options.shards) != 0) return -1;
+    if (db_set_durability(WAL_DURABILITY_BATCH, WAL_DEFAULT_FLUSH_INTERVAL_US) != 0) return -1;
+    Model *model = register_model(RESOURCE, bench_fields, 4);
+    if (!model || preload_rows(model, options.rows) != 0) {
+        fprintf(stderr, "Error: Failed to create and preload the " RESOURCE " table\n");
+        return -1;
+    }
+    register_model_routes(RESOURCE);
+    setup_routes();
+
+    server_config_defaults(config);
+    config->port = atoi(options.port);
+    config->event_loops = options.loops;
+    config->worker_threads = options.workers;
+    if (pthread_create(thread, NULL, server_main, config) != 0) {
+        perror("Failed to start the server thread");
+        return -1;
+    }
+    // Wait until it accepts connections
+    for (int i = 0; i < 100; i++) {
+        int fd = open_connection();
+        if (fd >= 0) {
+            close(fd);
+            return 0;
+        }
+        usleep(50000);
+    }
+    fprintf(stderr, "Error: The server did not start listening on port %s\n", options.port);
+    return -1;
+}
+
+// --- Options ---
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--concurrency LIST] [--duration S] [--warmup S] [--mix V:U:C:D] "
+            "[--rows N] [--port N] [--loops N] [--workers N] [--shards N] [--connect HOST:PORT] [--verbose]\n",
+            program);
+}
+
+static int parse_mix(const char *text) {
+    int total = 0;
+    if (sscanf(text, "%d:%d:%d:%d", &options.mix[0], &options.mix[1], &options.mix[2], &options.mix[3]) != 4) return -1;
+    for (int op = 0; op < OP_COUNT; op++) {
+        if (options.mix[op] < 0) return -1;
+        total += options.mix[op];
+    }
+    if (total != 100) return -1;
+    snprintf(options.mix_text, sizeof(options.mix_text), "%d:%d:%d:%d",
+             options.mix[0], options.mix[1], options.mix[2], options.mix[3]);
+    return 0;
+}
+
+static int parse_options(int argc, char *argv[]) {
+    options.level_count = bench_parse_list("1,8,64", options.levels, MAX_LEVELS);
+    options.duration = 5;
+    options.warmup = 1;
+    parse_mix("80:10:5:5");
+    options.rows = 10000;
+    options.shards = 1;
+    snprintf(options.host, sizeof(options.host), "127.0.0.1");
+    snprintf(options.port, sizeof(options.port), DEFAULT_PORT);
+    for (int i = 1; i < argc; i++) {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--verbose") == 0) {
+            options.verbose = 1;
+            continue; // Takes no value
+        }
+        int valid = value != NULL;
+        if (valid && strcmp(argv[i], "--concurrency") == 0) {
+            options.level_count = bench_parse_list(value, options.levels, MAX_LEVELS);
+            valid = options.level_count > 0;
+        } else if (valid && strcmp(argv[i], "--duration") == 0) {
+            options.duration = atof(value);
+            valid = options.duration > 0;
+        } else if (valid && strcmp(argv[i], "--warmup") == 0) {
+            options.warmup = atof(value);
+            valid = options.warmup >= 0;
+        } else if (valid && strcmp(argv[i], "--mix") == 0) {
+            valid = parse_mix(value) == 0;
+        } else if (valid && strcmp(argv[i], "--rows") == 0) {
+            options.rows = atol(value);
+            valid = options.rows > 0 && options.rows < 1000000000;
+        } else if (valid && strcmp(argv[i], "--port") == 0) {
+            snprintf(options.port, sizeof(options.port), "%s", value);
+        } else if (valid && strcmp(argv[i], "--loops") == 0) {
+            options.loops = atoi(value);
+        } else if (valid && strcmp(argv[i], "--workers") == 0) {
+            options.workers = atoi(value);
+        } else if (valid && strcmp(argv[i], "--shards") == 0) {
+            options.shards = atoi(value);
+            valid = options.shards >= 1 && options.shards <= MAX_TABLE_SHARDS;
+        } else if (valid && strcmp(argv[i], "--connect") == 0) {
+            const char *colon = strrchr(value, ':');
+            valid = colon && colon > value && (size_t)(colon - value) < sizeof(options.host);
+            if (valid) {
+                snprintf(options.host, sizeof(options.host), "%.*s", (int)(colon - value), value);
+                snprintf(options.port, sizeof(options.port), "%s", colon + 1);
+                options.external = 1;
+            }
+        } else {
+            valid = 0;
+        }
+        if (!valid) {
+            usage(argv[0]);
+            return -1;
+        }
+        i++; // Skip the option value
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (parse_options(argc, argv) != 0) return 2;
+    results = bench_results_stream(!options.verbose);
+
+    struct addrinfo hints = { 0 };
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int lookup = getaddrinfo(options.host, options.port, &hints, &server_address);
+    if (lookup != 0) {
+        fprintf(stderr, "Error: Cannot resolve %s:%s: %s\n", options.host, options.port, gai_strerror(lookup));
+        return 1;
+    }
+
+    char scratch[256];
+    pthread_t server_thread;
+    ServerConfig config;
+    if (!options.external) {
+        if (bench_enter_scratch_dir(scratch, sizeof(scratch)) != 0) return 1;
+        if (start_local_server(&server_thread, &config) != 0) {
+            bench_remove_scratch_dir(scratch);
+            return 1;
+        }
+    }
+    // Creates start above anything the preload or an earlier run may have left
+    next_id = options.external ? 1000000000L + (long)(getpid() % 1000) * 1000000L : options.rows + 1;
+
+    int status = 0;
+    for (int i = 0; i < options.level_count; i++) {
+        if (run_level(options.levels[i]) != 0) status = 1;
+    }
+
+    if (!options.external) {
+        stop_server();
+        pthread_join(server_thread, NULL);
+        db_system_shutdown();
+        bench_remove_scratch_dir(scratch);
+    }
+    freeaddrinfo(server_address);
+    return status;
+}
@@ -0,0 +1,345 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "../server/http_server.h"
+#include "../utils/json.h"
+#include "../controllers/scaffold_controller.h"
+#include "../database/logical/database.h"
+#include "../database/physical/b_plus_tree.h"
+
+// Micro-benchmarks of the storage engine and request parsing. Each operation
+// is timed on its own, so the results include about 20-40 ns of clock reads
+// per operation; compare runs of the same build flags.
+//
+// Usage: micro_bench [--sizes LIST] [--rows LIST] [--iterations N]
+//                    [--only btree|table|parse] [--verbose]
+
+#define MAX_SIZES 16
+#define DEFAULT_SIZES "1K,10K,100K,1M"
+#define DEFAULT_ROWS "1K,10K,100K"
+#define DEFAULT_ITERATIONS 200000
+
+typedef struct {
+    long sizes[MAX_SIZES];      // Key counts of the B+ tree benchmarks
+    int size_count;
+    long rows[MAX_SIZES];       // Row counts of the table benchmarks
+    int row_count;
+    long iterations;            // Operations of each parser benchmark
+    const char *only;           // Suite to run, NULL for all
+    int verbose;                // Let the storage layer print to stderr
+} MicroOptions;
+
+static FILE *results;
+
+// xorshift64*, so every run visits the keys in the same order
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t next_random(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ull;
+}
+
+static void shuffle(int *keys, long n) {
+    for (long i = n - 1; i > 0; i--) {
+        long j = (long)(next_random() % (uint64_t)(i + 1));
+        int swap = keys[i];
+        keys[i] = keys[j];
+        keys[j] = swap;
+    }
+}
+
+// Keys 1..n in random order, or NULL if out of memory
+static int *shuffled_keys(long n) {
+    int *keys = malloc(n * sizeof(int));
+    if (!keys) {
+        perror("Failed to allocate benchmark keys");
+        return NULL;
+    }
+    for (long i = 0; i < n; i++) keys[i] = (int)(i + 1);
+    shuffle(keys, n);
+    return keys;
+}
+
+static double seconds_since(uint64_t start) {
+    return (double)(bench_now_ns() - start) / 1e9;
+}
+
+// --- B+ Tree ---
+
+static int bench_tree(long n, LatencyRecorder *latencies) {
+    int *keys = shuffled_keys(n);
+    if (!keys) return -1;
+    char path[64];
+    snprintf(path, sizeof(path), "bench_%ld.idx", n);
+    BPlusTree *tree = open_tree(path);
+    if (!tree) {
+        free(keys);
+        return -1;
+    }
+
+    latency_reset(latencies);
+    uint64_t start = bench_now_ns();
+    for (long i = 0; i < n; i++) {
+        uint64_t t0 = bench_now_ns();
+        insert_key(tree, keys[i], (long)keys[i] * 64);
+        latency_record(latencies, bench_now_ns() - t0);
+    }
+    double seconds = seconds_since(start);
+    char extra[64];
+    snprintf(extra, sizeof(extra), "\"height\":%d", tree_height(tree));
+    bench_report(results, "bpt_insert_key", n, latencies, seconds, extra);
+
+    shuffle(keys, n);
+    long missing = 0;
+    latency_reset(latencies);
+    start = bench_now_ns();
+    for (long i = 0; i < n; i++) {
+        uint64_t t0 = bench_now_ns();
+        long offset = search_key(tree, keys[i]);
+        latency_record(latencies, bench_now_ns() - t0);
+        if (offset != (long)keys[i] * 64) missing++;
+    }
+    seconds = seconds_since(start);
+    snprintf(extra, sizeof(extra), "\"missing\":%ld", missing);
+    bench_report(results, "bpt_search_key", n, latencies, seconds, extra);
+
+    shuffle(keys, n);
+    latency_reset(latencies);
+    start = bench_now_ns();
+    for (long i = 0; i < n; i++) {
+        uint64_t t0 = bench_now_ns();
+        delete_key(tree, keys[i]);
+        latency_record(latencies, bench_now_ns() - t0);
+    }
+    seconds = seconds_since(start);
+    bench_report(results, "bpt_delete_key", n, latencies, seconds, NULL);
+
+    destroy_tree(tree);
+    remove(path);
+    free(keys);
+    return missing == 0 ? 0 : -1;
+}
+
+// --- Table Rows ---
+
+// Fills the values of row key (buffers of 32 bytes); version changes the payload
+static void fill_row(char **values, int key, int version) {
+    snprintf(values[0], 32, "%d", key);
+    snprintf(values[1], 32, "item-%d-v%d", key, version);
+    snprintf(values[2], 32, "%d.%02d", key % 1000, version % 100);
+    snprintf(values[3], 32, "%d", key * 7 + version);
+}
+
+static int bench_rows(Database *db, long n, LatencyRecorder *latencies) {
+    char *columns[] = { "id", "name", "price", "count" };
+    char *types[] = { "int", "string", "float", "int" };
+    char table_name[64];
+    snprintf(table_name, sizeof(table_name), "bench_rows_%ld", n);
+    Table *table = create_table(db, table_name, columns, types, 4);
+    if (!table) return -1;
+
+    int *keys = shuffled_keys(n);
+    if (!keys) return -1;
+    char buffers[4][32];
+    char *values[4] = { buffers[0], buffers[1], buffers[2], buffers[3] };
+    long failed = 0;
+
+    latency_reset(latencies);
+    uint64_t start = bench_now_ns();
+    for (long i = 0; i < n; i++) {
+        fill_row(values, keys[i], 0);
+        uint64_t t0 = bench_now_ns();
+        long offset = insert_row(table, keys[i], values);
+        latency_record(latencies, bench_now_ns() - t0);
+        if (offset < 0) failed++;
+    }
+    double seconds = seconds_since(start);
+    bench_report(results, "insert_row", n, latencies, seconds, NULL);
+
+    shuffle(keys, n);
+    latency_reset(latencies);
+    start = bench_now_ns();
+    for (long i = 0; i < n; i++) {
+        uint64_t t0 = bench_now_ns();
+        char **row = read_row(table, keys[i]);
+        latency_record(latencies, bench_now_ns() - t0);
+        if (!row) {
+            failed++;
+            continue;
+        }
+        for (int c = 0; c < table->column_count; c++) free(row[c]);
+        free(row);
+    }
+    seconds = seconds_since(start);
+    bench_report(results, "read_row", n, latencies, seconds, NULL);
+
+    shuffle(keys, n);
+    latency_reset(latencies);
+    start = bench_now_ns();
+    for (long i = 0; i < n; i++) {
+        fill_row(values, keys[i], 1);
+        uint64_t t0 = bench_now_ns();
+        long offset = update_row(table, keys[i], values);
+        latency_record(latencies, bench_now_ns() - t0);
+        if (offset < 0) failed++;
+    }
+    seconds = seconds_since(start);
+    bench_report(results, "update_row", n, latencies, seconds, NULL);
+
+    free(keys);
+    if (failed) fprintf(stderr, "Error: %ld row operations failed on %s\n", failed, table_name);
+    return failed ? -1 : 0;
+}
+
+// --- Request Parsing ---
+
+static const char sample_body[] =
+    "{\"id\": 4711, \"name\": \"A \\\"quoted\\\" item\", \"price\": 19.99, \"count\": 3}";
+
+static int name_slot(void *context, const char *name, size_t length) {
+    (void)context;
+    static const char *names[] = { "id", "name", "price", "count" };
+    for (int i = 0; i < 4; i++) {
+        if (strlen(names[i]) == length && memcmp(names[i], name, length) == 0) return i;
+    }
+    return -1;
+}
+
+static int bench_parse(long iterations, LatencyRecorder *latencies) {
+    char request_text[512];
+    int request_length = snprintf(request_text, sizeof(request_text),
+        "POST /items HTTP/1.1\r\nHost: localhost:3000\r\nUser-Agent: micro_bench\r\n"
+        "Accept: */*\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n\r\n%s",
+        strlen(sample_body), sample_body);
+    char buffer[sizeof(request_text) + 1]; // Parsing needs a writable byte past the request
+    long failed = 0;
+
+    latency_reset(latencies);
+    uint64_t start = bench_now_ns();
+    for (long i = 0; i < iterations; i++) {
+        memcpy(buffer, request_text, request_length); // The parser works in place
+        uint64_t t0 = bench_now_ns();
+        HttpRequest *request = parse_request(buffer, request_length);
+        latency_record(latencies, bench_now_ns() - t0);
+        if (!request) failed++;
+        free_request(request);
+    }
+    double seconds = seconds_since(start);
+    bench_report(results, "parse_request", iterations, latencies, seconds, NULL);
+
+    latency_reset(latencies);
+    start = bench_now_ns();
+    for (long i = 0; i < iterations; i++) {
+        uint64_t t0 = bench_now_ns();
+        char *price = parse_json_field(sample_body, "price");
+        latency_record(latencies, bench_now_ns() - t0);
+        if (!price) failed++;
+        free(price);
+    }
+    seconds = seconds_since(start);
+    bench_report(results, "parse_json_field", iterations, latencies, seconds, NULL);
+
+    latency_reset(latencies);
+    start = bench_now_ns();
+    for (long i = 0; i < iterations; i++) {
+        char *values[4] = { NULL };
+        uint64_t t0 = bench_now_ns();
+        int status = json_parse_object(sample_body, sizeof(sample_body) - 1, name_slot, NULL, values, 4, NULL);
+        latency_record(latencies, bench_now_ns() - t0);
+        if (status != 0) failed++;
+        for (int f = 0; f < 4; f++) free(values[f]);
+    }
+    seconds = seconds_since(start);
+    bench_report(results, "json_parse_object", iterations, latencies, seconds, NULL);
+
+    return failed ? -1 : 0;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--sizes LIST] [--rows LIST] [--iterations N] "
+            "[--only btree|table|parse] [--verbose]\n"
+            "LIST is comma separated and takes K and M suffixes, e.g. 1K,10K,100K,1M,10M\n", program);
+}
+
+static int parse_options(int argc, char *argv[], MicroOptions *options) {
+    options->size_count = bench_parse_list(DEFAULT_SIZES, options->sizes, MAX_SIZES);
+    options->row_count = bench_parse_list(DEFAULT_ROWS, options->rows, MAX_SIZES);
+    options->iterations = DEFAULT_ITERATIONS;
+    options->only = NULL;
+    options->verbose = 0;
+    for (int i = 1; i < argc; i++) {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--verbose") == 0) {
+            options->verbose = 1;
+            continue; // Takes no value
+        }
+        int valid = value != NULL;
+        if (valid && strcmp(argv[i], "--sizes") == 0) {
+            options->size_count = bench_parse_list(value, options->sizes, MAX_SIZES);
+            valid = options->size_count > 0;
+        } else if (valid && strcmp(argv[i], "--rows") == 0) {
+            options->row_count = bench_parse_list(value, options->rows, MAX_SIZES);
+            valid = options->row_count > 0;
+        } else if (valid && strcmp(argv[i], "--iterations") == 0) {
+            options->iterations = atol(value);
+            valid = options->iterations > 0;
+        } else if (valid && strcmp(argv[i], "--only") == 0) {
+            options->only = value;
+            valid = strcmp(value, "btree") == 0 || strcmp(value, "table") == 0 || strcmp(value, "parse") == 0;
+        } else {
+            valid = 0;
+        }
+        if (!valid) {
+            usage(argv[0]);
+            return -1;
+        }
+        i++; // Skip the option value
+    }
+    return 0;
+}
+
+static int selected(const MicroOptions *options, const char *suite) {
+    return !options->only || strcmp(options->only, suite) == 0;
+}
+
+int main(int argc, char *argv[]) {
+    MicroOptions options;
+    if (parse_options(argc, argv, &options) != 0) return 2;
+    results = bench_results_stream(!options.verbose);
+
+    char scratch[256];
+    if (bench_enter_scratch_dir(scratch, sizeof(scratch)) != 0) return 1;
+
+    LatencyRecorder latencies;
+    latency_init(&latencies, 1 << 20);
+    int status = 0;
+
+    if (selected(&options, "btree")) {
+        for (int i = 0; i < options.size_count; i++) {
+            if (bench_tree(options.sizes[i], &latencies) != 0) status = 1;
+        }
+    }
+    if (selected(&options, "table")) {
+        Database *db = create_database("bench");
+        if (!db) {
+            status = 1;
+        } else {
+            db->row_cache_entries = 0; // Rows are read through read_row, which the cache does not cover
+            for (int i = 0; i < options.row_count; i++) {
+                if (bench_rows(db, options.rows[i], &latencies) != 0) status = 1;
+            }
+            destroy_database(db);
+        }
+    }
+    if (selected(&options, "parse")) {
+        if (bench_parse(options.iterations, &latencies) != 0) status = 1;
+    }
+
+    latency_free(&latencies);
+    bench_remove_scratch_dir(scratch);
+    if (status) fprintf(stderr, "Error: Some benchmark operations failed\n");
+    return status;
+}
@@ -5,311 +5,538 @@
 #include <limits.h>
 #include "scaffold_controller.h"
 #include "../utils/path_utils.h"
+#include "../utils/json.h"
+#include "../utils/log.h"
 #include "../models/scaffold_model.h"
 #include "../models/model_setup.h"
 #include "../database/application/orm.h"
 #include "../database/physical/b_plus_tree.h"
 
 #define MAX_MODEL_NAME 100
-#define MAX_JSON_SIZE 4096
-#define MAX_INDEX_JSON_SIZE 65536   /* 64 KB for list responses */
+#define INDEX_CHUNK_SIZE 16384      /* List responses are produced about this much at a time */
 
-// Create a success result
-ControllerResult* create_success_result(const char *message, void *data, int data_size) {
-    ControllerResult *result = malloc(sizeof(ControllerResult));
+// Allocate a result and a copy of its message, in arena or with malloc
+static ControllerResult* make_result(Arena *arena, int success, const char *message, void *data, int data_size) {
+    ControllerResult *result = arena ? arena_alloc(arena, sizeof(ControllerResult)) : malloc(sizeof(ControllerResult));
     if (!result) return NULL;
-    result->success = 1;
-    result->message = message ? strdup(message) : NULL;
+    result->success = success;
+    result->message = !message ? NULL : arena ? arena_strdup(arena, message) : strdup(message);
     result->data = data;
     result->data_size = data_size;
+    result->arena = arena;
+    result->encoded = 0;
     return result;
 }
 
+// Create a success result
+ControllerResult* create_success_result(const char *message, void *data, int data_size) {
+    return make_result(NULL, 1, message, data, data_size);
+}
+
 // Create an error result
 ControllerResult* create_error_result(const char *message) {
-    ControllerResult *result = malloc(sizeof(ControllerResult));
-    if (!result) return NULL;
-    result->success = 0;
-    result->message = message ? strdup(message) : NULL;
-    result->data = NULL;
-    result->data_size = 0;
-    return result;
+    return make_result(NULL, 0, message, NULL, 0);
 }
 
 // Free a controller result
 void free_controller_result(ControllerResult *result) {
-    if (!result) return;
+    if (!result || result->arena) return;
     if (result->message) free(result->message);
+    free(result->data);
     free(result);
 }
 
-// Utility: Trim whitespace from a string
-char* trim_whitespace(char *str) {
-    if (!str) return NULL;
-    while(isspace((unsigned char)*str)) str++;
-    if(*str == 0) return str;
-    char *end = str + strlen(str) - 1;
-    while(end > str && isspace((unsigned char)*end)) end--;
-    *(end+1) = '\0';
-    return str;
+// JsonSlotLookup over a model's fields: a member's slot is its field index
+static int field_slot(void *context, const char *name, size_t length) {
+    return model_field_index_len(context, name, length);
+}
+
+// Member name lookup for a model's JSON: the generated one if it has a codec
+static JsonSlotLookup slot_lookup(Model *schema) {
+    return schema->codec && schema->codec->field_slot ? schema->codec->field_slot : field_slot;
+}
+
+// Field name lookup of parse_json_field
+static int name_slot(void *context, const char *name, size_t length) {
+    const char *field_name = context;
+    return strncmp(field_name, name, length) == 0 && field_name[length] == '\0' ? 0 : -1;
 }
 
-// Utility: Parse a JSON field from a JSON string
+// Utility: Parse a JSON field from a JSON object (malloc'd value, NULL if absent or malformed)
 char* parse_json_field(const char *json, const char *field_name) {
     if (!json || !field_name) return NULL;
+    char *value;
+    if (json_parse_object(json, strlen(json), name_slot, (void*)field_name, &value, 1, NULL) != 0) return NULL;
+    return value;
+}
 
-    char field_search[256];
-    snprintf(field_search, sizeof(field_search), "\"%s\":", field_name);
-
-    const char *field_pos = strstr(json, field_search);
-    if (!field_pos) return NULL;
-
-    field_pos += strlen(field_search);
-    while (isspace(*field_pos)) field_pos++;
-
-    if (*field_pos == '"') {
-        field_pos++;
-        const char *end_quote = strchr(field_pos, '"');
-        if (!end_quote) return NULL;
-        size_t value_len = end_quote - field_pos;
-        char *value = malloc(value_len + 1);
-        if (!value) return NULL;
-        strncpy(value, field_pos, value_len);
-        value[value_len] = '\0';
-        return value;
-    } else if (isdigit(*field_pos) || *field_pos == '-' ||
-               strncmp(field_pos, "true", 4) == 0 ||
-               strncmp(field_pos, "false", 5) == 0 ||
-               strncmp(field_pos, "null", 4) == 0) {
-        const char *end_value = field_pos;
-        while (*end_value && *end_value != ',' && *end_value != '}' && *end_value != ']') {
-            end_value++;
-        }
-        size_t value_len = end_value - field_pos;
-        char *value = malloc(value_len + 1);
-        if (!value) return NULL;
-        strncpy(value, field_pos, value_len);
-        value[value_len] = '\0';
-        return trim_whitespace(value);
+// Parse a JSON object body in one pass into one value per field of the model
+// (NULL where absent), in arena or malloc'd. Returns NULL if it is malformed.
+static char** parse_instance_fields(Model *schema, const char *data, Arena *arena) {
+    char **values = arena ? arena_alloc(arena, (schema->field_count + 1) * sizeof(char*))
+                          : calloc(schema->field_count + 1, sizeof(char*));
+    if (!values) return NULL;
+    if (json_parse_object(data, strlen(data), slot_lookup(schema), schema, values, schema->field_count, arena) != 0) {
+        if (!arena) free(values);
+        return NULL;
     }
+    return values;
+}
 
-    return NULL;
+// Free the result of parse_instance_fields (no-op in an arena)
+static void free_instance_fields(Model *schema, char **values, Arena *arena) {
+    if (arena || !values) return;
+    for (int i = 0; i < schema->field_count; i++) free(values[i]);
+    free(values);
 }
 
 // Generate a JSON response
 char* generate_json_response(int success, const char *message, const char *data) {
-    char *json = malloc(MAX_JSON_SIZE);
-    if (!json) return NULL;
-    strcpy(json, "{");
-    sprintf(json + strlen(json), "\"status\": \"%s\"", success ? "success" : "error");
-    if (message) sprintf(json + strlen(json), ", \"message\": \"%s\"", message);
-    if (data)    sprintf(json + strlen(json), ", \"data\": %s", data);
-    strcat(json, "}");
-    return json;
+    JsonWriter writer;
+    json_writer_init(&writer, NULL, 64 + (message ? strlen(message) : 0) + (data ? strlen(data) : 0));
+    json_write_raw(&writer, "{\"status\": ", 11);
+    json_write_string(&writer, success ? "success" : "error", success ? 7 : 5);
+    if (message) {
+        json_write_raw(&writer, ", \"message\": ", 13);
+        json_write_string(&writer, message, strlen(message));
+    }
+    if (data) {
+        json_write_raw(&writer, ", \"data\": ", 10);
+        json_write_raw(&writer, data, strlen(data));
+    }
+    json_write_raw(&writer, "}", 1);
+    return json_writer_finish(&writer);
 }
 
-// Internal helper: serialise a ModelInstance to a JSON object string.
-// Returns a malloc'd string — caller must free.
-static char* build_instance_json(Model *schema, ModelInstance *instance) {
-    char *json = malloc(MAX_JSON_SIZE);
-    if (!json) return NULL;
-    strcpy(json, "{");
+// Append one instance (or row) as a JSON object of string values, with the
+// model's generated writer if it has one, else from its encoded member names
+static void write_instance_json(JsonWriter *writer, Model *schema, char **values) {
+    if (schema->codec && schema->codec->write_json) {
+        schema->codec->write_json(writer, values);
+        return;
+    }
     for (int i = 0; i < schema->field_count; i++) {
-        char field_buf[512];
-        snprintf(field_buf, sizeof(field_buf), "\"%s\": \"%s\"",
-                 schema->fields[i].name,
-                 instance->data[i] ? instance->data[i] : "");
-        strcat(json, field_buf);
-        if (i < schema->field_count - 1) strcat(json, ", ");
+        const char *value = values[i] ? values[i] : "";
+        json_write_raw(writer, schema->json_keys[i], schema->json_key_lengths[i]);
+        json_write_string(writer, value, strlen(value));
     }
-    strcat(json, "}");
-    return json;
+    json_write_raw(writer, "}", 1);
 }
 
-// Controller function to list all resources (index action)
-ControllerResult* indx(const char *model_name) {
-    printf("Listing all %s resources...\n", model_name);
-
-    Model *schema = find_model_by_name(model_name);
-    if (!schema || !schema->table_ref) {
-        return create_error_result("Model not found or not initialised");
+// Internal helper: serialise a ModelInstance to a JSON object string, sized
+// up front so it is usually written without growing.
+// Returns a string in arena, or a malloc'd one the caller must free.
+static char* build_instance_json(Model *schema, ModelInstance *instance, Arena *arena) {
+    size_t estimate = 2;
+    for (int i = 0; i < schema->field_count; i++) {
+        size_t key_length = schema->codec ? 0 : schema->json_key_lengths[i];
+        estimate += key_length + (instance->data[i] ? strlen(instance->data[i]) : 0) + 2;
     }
+    if (schema->codec) estimate += schema->codec->json_overhead;
+    JsonWriter writer;
+    json_writer_init(&writer, arena, estimate + 1);
+    write_instance_json(&writer, schema, instance->data);
+    return json_writer_finish(&writer);
+}
+
+// Cursor over a page of a model's rows, serialised as one JSON array a chunk
+// at a time. Each chunk is one scan_rows pass starting after the last key sent,
+// so no lock is held between chunks and memory stays at about one chunk.
+struct IndexCursor {
+    Model *schema;
+    int next_key;       // Smallest key not yet sent
+    int remaining;      // Rows left to send, or -1 for no limit
+    int stage;          // 0: "[" not sent, 1: sending rows, 2: "]" sent
+    int rows_sent;
+    int filter_column;  // Column to match, or -1 to list every row
+    char *filter_value;
+    JsonWriter chunk;   // Current chunk, reused across calls
+};
+
+// scan_rows callback: serialise one row like build_instance_json; stops the
+// scan once the chunk is full or the page is complete
+static int cursor_add_row(void *context, int primary_key, char **values) {
+    IndexCursor *cursor = context;
+
+    if (cursor->rows_sent > 0) json_write_raw(&cursor->chunk, ", ", 2);
+    write_instance_json(&cursor->chunk, cursor->schema, values);
+    if (cursor->chunk.failed) return 1;
+
+    cursor->rows_sent++;
+    if (cursor->remaining > 0) cursor->remaining--;
+    if (primary_key == INT_MAX) cursor->remaining = 0; // Nothing can follow the largest key
+    cursor->next_key = primary_key + (primary_key < INT_MAX);
+    return cursor->remaining == 0 || cursor->chunk.length >= INDEX_CHUNK_SIZE;
+}
 
-    // Collect all primary keys from the B+ tree leaf list
-    int count = 0;
-    int *keys = collect_all_keys(schema->table_ref->primary_index, &count);
+// Open a cursor over up to limit rows (limit < 0: all) with primary key > after
+IndexCursor* index_cursor_open(Model *schema, int after, int limit) {
+    if (!schema || !schema->table_ref) return NULL;
+
+    IndexCursor *cursor = calloc(1, sizeof(IndexCursor));
+    if (!cursor) return NULL;
+    cursor->schema = schema;
+    cursor->next_key = after < INT_MAX ? after + 1 : INT_MAX;
+    cursor->remaining = (after == INT_MAX || limit == 0) ? 0 : limit;
+    cursor->filter_column = -1;
+    json_writer_init(&cursor->chunk, NULL, INDEX_CHUNK_SIZE * 2);
+    return cursor;
+}
 
-    char *json = malloc(MAX_INDEX_JSON_SIZE);
-    if (!json) {
-        if (keys) free(keys);
-        return create_error_result("Memory allocation failed");
+// Restrict a cursor to rows whose field equals value
+int index_cursor_filter(IndexCursor *cursor, const char *field_name, const char *value) {
+    int column = model_field_index(cursor->schema, field_name);
+    if (column < 0) return -1;
+    char *copy = strdup(value);
+    if (!copy) return -1;
+    free(cursor->filter_value);
+    cursor->filter_value = copy;
+    cursor->filter_column = column;
+    return 0;
+}
+
+// Produce the next chunk of the JSON array; NULL once it is complete
+const char* index_cursor_next(IndexCursor *cursor, size_t *length) {
+    cursor->chunk.length = 0;
+    if (cursor->stage == 0) {
+        cursor->stage = 1;
+        json_write_raw(&cursor->chunk, "[", 1);
     }
-    strcpy(json, "[");
+    if (cursor->stage == 1) {
+        int rows_before = cursor->rows_sent;
+        Table *table = cursor->schema->table_ref;
+        int scanned = 0;
+        if (cursor->remaining != 0) {
+            scanned = cursor->filter_column < 0
+                      ? scan_rows(table, cursor->next_key, INT_MAX, cursor_add_row, cursor)
+                      : scan_rows_where(table, cursor->filter_column, cursor->filter_value,
+                                        cursor->next_key, INT_MAX, cursor_add_row, cursor);
+        }
+        if (scanned < 0 || cursor->chunk.failed) return NULL;
+        // A scan that stopped short of the chunk size found no more rows
+        if (cursor->remaining == 0 || cursor->rows_sent == rows_before || cursor->chunk.length < INDEX_CHUNK_SIZE) {
+            cursor->stage = 2;
+            json_write_raw(&cursor->chunk, "]", 1);
+            if (cursor->chunk.failed) return NULL;
+        }
+        *length = cursor->chunk.length;
+        return cursor->chunk.data;
+    }
+    return NULL;
+}
 
-    for (int i = 0; i < count; i++) {
-        ModelInstance *instance = find_model_by_primary_key(schema, keys[i]);
-        if (!instance) continue;
+// Free a cursor
+void index_cursor_close(IndexCursor *cursor) {
+    if (!cursor) return;
+    free(cursor->filter_value);
+    json_writer_free(&cursor->chunk);
+    free(cursor);
+}
 
-        char *obj = build_instance_json(schema, instance);
-        free_model_instance(instance);
+// Controller function to list all resources (index action). The whole array
+// is built in memory; the HTTP route streams it with an IndexCursor instead.
+ControllerResult* indx(Model *schema, Arena *arena) {
+    if (!schema) return make_result(arena, 0, "Model not found", NULL, 0);
+    LOG_DEBUG("Listing all %s resources...", schema->name);
 
-        if (obj) {
-            if (i > 0) strcat(json, ", ");
-            // Guard against overflow
-            if (strlen(json) + strlen(obj) + 4 < MAX_INDEX_JSON_SIZE) {
-                strcat(json, obj);
-            }
-            free(obj);
-        }
+    IndexCursor *cursor = index_cursor_open(schema, INT_MIN, -1);
+    if (!cursor) {
+        return make_result(arena, 0, "Model not found or not initialised", NULL, 0);
     }
 
-    strcat(json, "]");
-    if (keys) free(keys);
+    char *json = NULL;
+    size_t json_length = 0;
+    const char *chunk;
+    size_t chunk_length;
+    while ((chunk = index_cursor_next(cursor, &chunk_length)) != NULL) {
+        char *grown = realloc(json, json_length + chunk_length + 1);
+        if (!grown) {
+            free(json);
+            index_cursor_close(cursor);
+            return make_result(arena, 0, "Memory allocation failed", NULL, 0);
+        }
+        json = grown;
+        memcpy(json + json_length, chunk, chunk_length);
+        json_length += chunk_length;
+        json[json_length] = '\0';
+    }
+    index_cursor_close(cursor);
+    if (!json) return make_result(arena, 0, "Failed to list resources", NULL, 0);
+    if (arena) {
+        char *copy = arena_strndup(arena, json, json_length);
+        free(json);
+        if (!copy) return make_result(arena, 0, "Memory allocation failed", NULL, 0);
+        json = copy;
+    }
 
-    return create_success_result("Resources retrieved successfully", json, strlen(json));
+    return make_result(arena, 1, "Resources retrieved successfully", json, json_length);
 }
 
 // Controller function to view a single resource (view action)
-ControllerResult* view(const char *model_name, int id) {
-    printf("Viewing %s with ID %d...\n", model_name, id);
-
-    if (id <= 0) return create_error_result("Invalid resource ID");
-
-    Model *schema = find_model_by_name(model_name);
-    if (!schema) return create_error_result("Model not found");
+ControllerResult* view(Model *schema, int id, Arena *arena) {
+    if (!schema) return make_result(arena, 0, "Model not found", NULL, 0);
+    LOG_DEBUG("Viewing %s with ID %d...", schema->name, id);
+
+    if (id <= 0) return make_result(arena, 0, "Invalid resource ID", NULL, 0);
+
+    // A cached row is served as rendered, without reading or serialising it
+    RowCache *cache = schema->table_ref ? schema->table_ref->row_cache : NULL;
+    uint64_t ticket = 0;
+    if (cache) {
+        size_t cached_length;
+        char *cached = row_cache_get(cache, id, arena, &cached_length, &ticket);
+        if (cached) return make_result(arena, 1, "Resource retrieved successfully", cached, (int)cached_length);
+    }
 
-    ModelInstance *instance = find_model_by_primary_key(schema, id);
-    if (!instance) return create_error_result("Resource not found");
+    ModelInstance *instance = find_model_by_primary_key_in_arena(schema, id, arena);
+    if (!instance) return make_result(arena, 0, "Resource not found", NULL, 0);
 
-    char *json = build_instance_json(schema, instance);
+    char *json = build_instance_json(schema, instance, arena);
     free_model_instance(instance);
 
-    if (!json) return create_error_result("Failed to serialise resource");
-    return create_success_result("Resource retrieved successfully", json, strlen(json));
+    if (!json) return make_result(arena, 0, "Failed to serialise resource", NULL, 0);
+    size_t length = strlen(json);
+    if (cache) row_cache_put(cache, id, json, length, ticket);
+    return make_result(arena, 1, "Resource retrieved successfully", json, length);
 }
 
-// Controller function to create a new resource (create action)
-ControllerResult* create(const char *model_name, char *data) {
-    printf("Creating new %s...\n", model_name);
+// Controller function to view a single resource in a compressed encoding
+ControllerResult* view_encoded(Model *schema, int id, ContentEncoding encoding, Arena *arena) {
+    RowCache *cache = schema && schema->table_ref ? schema->table_ref->row_cache : NULL;
+    if (encoding == CONTENT_ENCODING_IDENTITY || id <= 0) return view(schema, id, arena);
+
+    // Only the gzip'd form is cached; deflate is compressed on every read
+    uint64_t ticket = 0;
+    if (cache && encoding == CONTENT_ENCODING_GZIP) {
+        size_t cached_length;
+        char *cached = row_cache_get_encoded(cache, id, arena, &cached_length, &ticket);
+        if (cached) {
+            ControllerResult *result = make_result(arena, 1, "Resource retrieved successfully", cached,
+                                                   (int)cached_length);
+            if (result) result->encoded = 1;
+            return result;
+        }
+    }
 
-    if (!data || data[0] != '{') return create_error_result("Invalid JSON data");
+    ControllerResult *result = view(schema, id, arena);
+    if (!result || !result->success || (size_t)result->data_size < compression_min_size()) return result;
+    char *compressed;
+    size_t compressed_length;
+    if (compress_buffer(encoding, result->data, result->data_size, arena, &compressed, &compressed_length) != 0) {
+        return result;
+    }
+    if (cache && encoding == CONTENT_ENCODING_GZIP) {
+        row_cache_put_encoded(cache, id, compressed, compressed_length, ticket);
+    }
+    if (!arena) free(result->data);
+    result->data = compressed;
+    result->data_size = (int)compressed_length;
+    result->encoded = 1;
+    return result;
+}
 
-    Model *schema = find_model_by_name(model_name);
-    if (!schema) return create_error_result("Model not found");
+// Controller function to create a new resource (create action)
+ControllerResult* create(Model *schema, char *data, Arena *arena) {
+    if (!schema) return make_result(arena, 0, "Model not found", NULL, 0);
+    LOG_DEBUG("Creating new %s...", schema->name);
 
-    ModelInstance *instance = create_new_instance(schema);
-    if (!instance) return create_error_result("Failed to allocate instance");
+    if (!data) return make_result(arena, 0, "Invalid JSON data", NULL, 0);
 
     // Parse every field defined in the schema from the incoming JSON
+    char **values = parse_instance_fields(schema, data, arena);
+    if (!values) return make_result(arena, 0, "Invalid JSON data", NULL, 0);
+
+    ModelInstance *instance = create_instance_in_arena(schema, arena);
+    if (!instance) {
+        free_instance_fields(schema, values, arena);
+        return make_result(arena, 0, "Failed to allocate instance", NULL, 0);
+    }
     for (int i = 0; i < schema->field_count; i++) {
-        char *value = parse_json_field(data, schema->fields[i].name);
-        if (value) {
-            set_instance_field(instance, i, value);
-            free(value);
-        }
+        if (values[i]) set_instance_field(instance, i, values[i]);
     }
+    free_instance_fields(schema, values, arena);
 
     if (save_model_instance(instance) != 0) {
         free_model_instance(instance);
-        return create_error_result("Failed to save resource");
+        return make_result(arena, 0, "Failed to save resource", NULL, 0);
     }
 
-    char *json = build_instance_json(schema, instance);
+    char *json = build_instance_json(schema, instance, arena);
     free_model_instance(instance);
 
-    if (!json) return create_error_result("Failed to serialise resource");
-    return create_success_result("Resource created successfully", json, strlen(json));
+    if (!json) return make_result(arena, 0, "Failed to serialise resource", NULL, 0);
+    return make_result(arena, 1, "Resource created successfully", json, strlen(json));
+}
+
+// Rows parsed by bulk_create, one value array per row
+typedef struct {
+    Model *schema;
+    Arena *arena;
+    char ***rows;
+    int count;
+    int capacity;
+} BulkRows;
+
+// JsonElementCallback of bulk_create: parse one JSON object into the next row
+static int bulk_add_row(void *context, const char *element, size_t length) {
+    BulkRows *bulk = context;
+    if (bulk->count == bulk->capacity) {
+        int capacity = bulk->capacity ? bulk->capacity * 2 : 64;
+        char ***grown = bulk->arena
+            ? arena_realloc(bulk->arena, bulk->rows, bulk->capacity * sizeof(char**), capacity * sizeof(char**))
+            : realloc(bulk->rows, capacity * sizeof(char**));
+        if (!grown) return -1;
+        bulk->rows = grown;
+        bulk->capacity = capacity;
+    }
+    int field_count = bulk->schema->field_count;
+    char **values = bulk->arena ? arena_alloc(bulk->arena, (field_count + 1) * sizeof(char*))
+                                : calloc(field_count + 1, sizeof(char*));
+    if (!values) return -1;
+    if (json_parse_object(element, length, slot_lookup(bulk->schema), bulk->schema, values, field_count,
+                          bulk->arena) != 0) {
+        if (!bulk->arena) free(values);
+        return -1;
+    }
+    bulk->rows[bulk->count++] = values;
+    return 0;
+}
+
+// Parse a bulk body: a JSON array of objects, or NDJSON (one object per
+// line, blank lines ignored). Returns 0, or -1 if it is malformed.
+static int parse_bulk_rows(BulkRows *bulk, const char *data) {
+    const char *p = data;
+    while (isspace((unsigned char)*p)) p++;
+    if (*p == '[') return json_parse_array(p, strlen(p), bulk_add_row, bulk) < 0 ? -1 : 0;
+
+    while (*p) {
+        const char *line_end = strchr(p, '\n');
+        if (!line_end) line_end = p + strlen(p);
+        const char *q = p;
+        while (q < line_end && isspace((unsigned char)*q)) q++;
+        if (q < line_end && bulk_add_row(bulk, q, (size_t)(line_end - q)) != 0) return -1;
+        p = *line_end ? line_end + 1 : line_end;
+    }
+    return 0;
+}
+
+// Free the rows of a malloc'd BulkRows (no-op in an arena)
+static void free_bulk_rows(BulkRows *bulk) {
+    if (bulk->arena) return;
+    for (int i = 0; i < bulk->count; i++) free_instance_fields(bulk->schema, bulk->rows[i], NULL);
+    free(bulk->rows);
+}
+
+// Controller function to create many resources in one batch (bulk create action)
+ControllerResult* bulk_create(Model *schema, char *data, Arena *arena) {
+    if (!schema) return make_result(arena, 0, "Model not found", NULL, 0);
+    LOG_DEBUG("Bulk creating %s...", schema->name);
+
+    if (!data) return make_result(arena, 0, "Invalid JSON data", NULL, 0);
+
+    BulkRows bulk = { schema, arena, NULL, 0, 0 };
+    if (parse_bulk_rows(&bulk, data) != 0) {
+        free_bulk_rows(&bulk);
+        return make_result(arena, 0, "Invalid JSON data", NULL, 0);
+    }
+    int inserted = insert_model_rows(schema, bulk.rows, bulk.count);
+    free_bulk_rows(&bulk);
+    if (inserted < 0) return make_result(arena, 0, "Failed to save resources", NULL, 0);
+
+    char json[32];
+    snprintf(json, sizeof(json), "{\"created\": %d}", inserted);
+    char *copy = arena ? arena_strdup(arena, json) : strdup(json);
+    if (!copy) return make_result(arena, 0, "Failed to serialise result", NULL, 0);
+    return make_result(arena, 1, "Resources created successfully", copy, strlen(copy));
 }
 
 // Controller function to update an existing resource (update action)
-ControllerResult* update(const char *model_name, int id, char *data) {
-    printf("Updating %s with ID %d...\n", model_name, id);
+ControllerResult* update(Model *schema, int id, char *data, Arena *arena) {
+    if (!schema) return make_result(arena, 0, "Model not found", NULL, 0);
+    LOG_DEBUG("Updating %s with ID %d...", schema->name, id);
 
-    if (id <= 0) return create_error_result("Invalid resource ID");
-    if (!data || data[0] != '{') return create_error_result("Invalid JSON data");
+    if (id <= 0) return make_result(arena, 0, "Invalid resource ID", NULL, 0);
+    if (!data) return make_result(arena, 0, "Invalid JSON data", NULL, 0);
 
-    Model *schema = find_model_by_name(model_name);
-    if (!schema) return create_error_result("Model not found");
+    char **values = parse_instance_fields(schema, data, arena);
+    if (!values) return make_result(arena, 0, "Invalid JSON data", NULL, 0);
 
-    ModelInstance *instance = find_model_by_primary_key(schema, id);
-    if (!instance) return create_error_result("Resource not found");
+    ModelInstance *instance = find_model_by_primary_key_in_arena(schema, id, arena);
+    if (!instance) {
+        free_instance_fields(schema, values, arena);
+        return make_result(arena, 0, "Resource not found", NULL, 0);
+    }
 
     // Update every non-PK field present in the JSON body
     for (int i = 1; i < schema->field_count; i++) {
-        char *value = parse_json_field(data, schema->fields[i].name);
-        if (value) {
-            set_instance_field(instance, i, value);
-            free(value);
-        }
+        if (values[i]) set_instance_field(instance, i, values[i]);
     }
+    free_instance_fields(schema, values, arena);
 
     if (save_model_instance(instance) != 0) {
         free_model_instance(instance);
-        return create_error_result("Failed to update resource");
+        return make_result(arena, 0, "Failed to update resource", NULL, 0);
     }
 
-    char *json = build_instance_json(schema, instance);
+    char *json = build_instance_json(schema, instance, arena);
     free_model_instance(instance);
 
-    if (!json) return create_error_result("Failed to serialise resource");
-    return create_success_result("Resource updated successfully", json, strlen(json));
+    if (!json) return make_result(arena, 0, "Failed to serialise resource", NULL, 0);
+    return make_result(arena, 1, "Resource updated successfully", json, strlen(json));
 }
 
 // Controller function to fully replace a resource (PUT action)
-ControllerResult* replace(const char *model_name, int id, char *data) {
-    printf("Replacing %s with ID %d...\n", model_name, id);
+ControllerResult* replace(Model *schema, int id, char *data, Arena *arena) {
+    if (!schema) return make_result(arena, 0, "Model not found", NULL, 0);
+    LOG_DEBUG("Replacing %s with ID %d...", schema->name, id);
 
-    if (id <= 0) return create_error_result("Invalid resource ID");
-    if (!data || data[0] != '{') return create_error_result("Invalid JSON data");
+    if (id <= 0) return make_result(arena, 0, "Invalid resource ID", NULL, 0);
+    if (!data) return make_result(arena, 0, "Invalid JSON data", NULL, 0);
 
-    Model *schema = find_model_by_name(model_name);
-    if (!schema) return create_error_result("Model not found");
+    char **values = parse_instance_fields(schema, data, arena);
+    if (!values) return make_result(arena, 0, "Invalid JSON data", NULL, 0);
 
-    ModelInstance *instance = find_model_by_primary_key(schema, id);
-    if (!instance) return create_error_result("Resource not found");
+    ModelInstance *instance = find_model_by_primary_key_in_arena(schema, id, arena);
+    if (!instance) {
+        free_instance_fields(schema, values, arena);
+        return make_result(arena, 0, "Resource not found", NULL, 0);
+    }
 
     // Overwrite ALL fields (including non-PK) from the payload.
-    // Fields absent from the payload are cleared to empty string.
+    // Fields absent from the payload are cleared to empty string
+    // (PUT semantics: missing field means clear it).
     for (int i = 1; i < schema->field_count; i++) {
-        char *value = parse_json_field(data, schema->fields[i].name);
-        if (value) {
-            set_instance_field(instance, i, value);
-            free(value);
-        } else {
-            // PUT semantics: missing field means clear it
-            set_instance_field(instance, i, "");
-        }
+        set_instance_field(instance, i, values[i] ? values[i] : "");
     }
+    free_instance_fields(schema, values, arena);
 
     if (save_model_instance(instance) != 0) {
         free_model_instance(instance);
-        return create_error_result("Failed to replace resource");
+        return make_result(arena, 0, "Failed to replace resource", NULL, 0);
     }
 
-    char *json = build_instance_json(schema, instance);
+    char *json = build_instance_json(schema, instance, arena);
     free_model_instance(instance);
 
-    if (!json) return create_error_result("Failed to serialise resource");
-    return create_success_result("Resource replaced successfully", json, strlen(json));
+    if (!json) return make_result(arena, 0, "Failed to serialise resource", NULL, 0);
+    return make_result(arena, 1, "Resource replaced successfully", json, strlen(json));
 }
 
 // Controller function to delete a resource (destroy action)
-ControllerResult* destroy(const char *model_name, int id) {
-    printf("Deleting %s with ID %d...\n", model_name, id);
+ControllerResult* destroy(Model *schema, int id, Arena *arena) {
+    if (!schema) return make_result(arena, 0, "Model not found", NULL, 0);
+    LOG_DEBUG("Deleting %s with ID %d...", schema->name, id);
 
-    if (id <= 0) return create_error_result("Invalid resource ID");
+    if (id <= 0) return make_result(arena, 0, "Invalid resource ID", NULL, 0);
 
-    Model *schema = find_model_by_name(model_name);
-    if (!schema) return create_error_result("Model not found");
-
-    ModelInstance *instance = find_model_by_primary_key(schema, id);
-    if (!instance) return create_error_result("Resource not found");
+    ModelInstance *instance = find_model_by_primary_key_in_arena(schema, id, arena);
+    if (!instance) return make_result(arena, 0, "Resource not found", NULL, 0);
 
     int result = delete_model_instance(instance);
     free_model_instance(instance);
 
-    if (result != 0) return create_error_result("Failed to delete resource");
-    return create_success_result("Resource deleted successfully", NULL, 0);
+    if (result != 0) return make_result(arena, 0, "Failed to delete resource", NULL, 0);
+    return make_result(arena, 1, "Resource deleted successfully", NULL, 0);
 }
 
 // Convert string to lowercase
@@ -334,9 +561,12 @@ void generate_controller_code(const char *model_name) {
 
     snprintf(resource_dir, sizeof(resource_dir), "%s/%s", scaffolded_path, lowercase_name);
 
-    char mkdir_cmd[512];
-    snprintf(mkdir_cmd, sizeof(mkdir_cmd), "mkdir -p %s", resource_dir);
-    system(mkdir_cmd);
+    // Create the directory (mkdir -p equivalent)
+    if (make_directories(resource_dir, 0755) != 0) {
+        perror("Failed to create resource directory");
+        free(lowercase_name);
+        return;
+    }
 
     FILE *controller_file;
     char controller_filename[512];
@@ -358,6 +588,7 @@ void generate_controller_code(const char *model_name) {
     fprintf(controller_file, "#include <string.h>\n");
     fprintf(controller_file, "#include <ctype.h>\n");
     fprintf(controller_file, "#include \"../../../controllers/scaffold_controller.h\"\n");
+    fprintf(controller_file, "#include \"../../../models/model_setup.h\"\n");
     fprintf(controller_file, "#include \"%s.h\"\n\n", lowercase_name);
 
     // ------------------------------------------------------------------
@@ -370,37 +601,43 @@ void generate_controller_code(const char *model_name) {
     // indx
     fprintf(controller_file, "// List all %s resources\n", model_name);
     fprintf(controller_file, "ControllerResult* indx_%s() {\n", lowercase_name);
-    fprintf(controller_file, "    return indx(\"%s\");\n", model_name);
+    fprintf(controller_file, "    return indx(find_model_by_name(\"%s\"), NULL);\n", model_name);
     fprintf(controller_file, "}\n\n");
 
     // view
     fprintf(controller_file, "// View a single %s by ID\n", model_name);
     fprintf(controller_file, "ControllerResult* view_ctrl_%s(int id) {\n", lowercase_name);
-    fprintf(controller_file, "    return view(\"%s\", id);\n", model_name);
+    fprintf(controller_file, "    return view(find_model_by_name(\"%s\"), id, NULL);\n", model_name);
     fprintf(controller_file, "}\n\n");
 
     // create
     fprintf(controller_file, "// Create a new %s\n", model_name);
     fprintf(controller_file, "ControllerResult* create_ctrl_%s(char *data) {\n", lowercase_name);
-    fprintf(controller_file, "    return create(\"%s\", data);\n", model_name);
+    fprintf(controller_file, "    return create(find_model_by_name(\"%s\"), data, NULL);\n", model_name);
+    fprintf(controller_file, "}\n\n");
+
+    // bulk create
+    fprintf(controller_file, "// Create many %s resources from a JSON array or NDJSON\n", model_name);
+    fprintf(controller_file, "ControllerResult* bulk_create_ctrl_%s(char *data) {\n", lowercase_name);
+    fprintf(controller_file, "    return bulk_create(find_model_by_name(\"%s\"), data, NULL);\n", model_name);
     fprintf(controller_file, "}\n\n");
 
     // update
     fprintf(controller_file, "// Update an existing %s\n", model_name);
     fprintf(controller_file, "ControllerResult* update_ctrl_%s(int id, char *data) {\n", lowercase_name);
-    fprintf(controller_file, "    return update(\"%s\", id, data);\n", model_name);
+    fprintf(controller_file, "    return update(find_model_by_name(\"%s\"), id, data, NULL);\n", model_name);
     fprintf(controller_file, "}\n\n");
 
     // replace (PUT)
     fprintf(controller_file, "// Fully replace a %s\n", model_name);
     fprintf(controller_file, "ControllerResult* replace_ctrl_%s(int id, char *data) {\n", lowercase_name);
-    fprintf(controller_file, "    return replace(\"%s\", id, data);\n", model_name);
+    fprintf(controller_file, "    return replace(find_model_by_name(\"%s\"), id, data, NULL);\n", model_name);
     fprintf(controller_file, "}\n");
 
     // destroy
     fprintf(controller_file, "// Delete a %s\n", model_name);
     fprintf(controller_file, "ControllerResult* destroy_ctrl_%s(int id) {\n", lowercase_name);
-    fprintf(controller_file, "    return destroy(\"%s\", id);\n", model_name);
+    fprintf(controller_file, "    return destroy(find_model_by_name(\"%s\"), id, NULL);\n", model_name);
     fprintf(controller_file, "}\n");
 
     fclose(controller_file);
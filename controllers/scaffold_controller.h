@@ -4,6 +4,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "../utils/arena.h"
+#include "../server/compression.h"
+#include "../database/application/orm.h"
 
 // Controller result structure for better handling of results
 typedef struct {
@@ -11,26 +14,52 @@ typedef struct {
     char *message;      // Success or error message
     void *data;         // Pointer to result data (if applicable)
     int data_size;      // Size of the data (if applicable)
+    Arena *arena;       // Arena the result and its data live in, NULL if malloc'd
+    int encoded;        // data is compressed in the encoding asked for (see view_encoded)
 } ControllerResult;
 
-// Function to create a success result
+// Function to create a success result (takes ownership of data, which must be malloc'd)
 ControllerResult* create_success_result(const char *message, void *data, int data_size);
 
 // Function to create an error result
 ControllerResult* create_error_result(const char *message);
 
-// Function to free a controller result
+// Function to free a controller result and its data (no-op for arena results)
 void free_controller_result(ControllerResult *result);
 
 // Core controller functions
-// The model_name parameter allows these functions to be used generically
-// for any model
-ControllerResult* indx(const char *model_name);
-ControllerResult* view(const char *model_name, int id);
-ControllerResult* create(const char *model_name, char *data);
-ControllerResult* update(const char *model_name, int id, char *data);
-ControllerResult* replace(const char *model_name, int id, char *data);
-ControllerResult* destroy(const char *model_name, int id);
+// The schema parameter (resolved once, e.g. when routes are registered, with
+// find_model_by_name) allows these functions to be used generically for any
+// model; NULL gives a "Model not found" error. The result, its JSON and the instances used on the way are
+// allocated in arena when one is given (HTTP handlers pass request->arena),
+// otherwise with malloc.
+ControllerResult* indx(Model *schema, Arena *arena);
+ControllerResult* view(Model *schema, int id, Arena *arena);
+// Like view, but for a client that accepts encoding: the JSON of a row big
+// enough to compress comes compressed (result->encoded set), and the gzip'd
+// form is kept in the row cache next to the JSON, so repeated reads don't
+// compress it again
+ControllerResult* view_encoded(Model *schema, int id, ContentEncoding encoding, Arena *arena);
+ControllerResult* create(Model *schema, char *data, Arena *arena);
+// Create every object of a JSON array, or of NDJSON (one per line), in one
+// batch insert: all of them or none. The result data is {"created": N}.
+ControllerResult* bulk_create(Model *schema, char *data, Arena *arena);
+ControllerResult* update(Model *schema, int id, char *data, Arena *arena);
+ControllerResult* replace(Model *schema, int id, char *data, Arena *arena);
+ControllerResult* destroy(Model *schema, int id, Arena *arena);
+
+// Paginated listing, produced as a JSON array a chunk at a time (see indx)
+typedef struct IndexCursor IndexCursor;
+// Open a cursor over up to limit rows (limit < 0: no limit) whose primary key
+// is greater than after, in key order; NULL if the model has no table
+IndexCursor* index_cursor_open(Model *schema, int after, int limit);
+// Only list rows whose field equals value (through the field's index, if it
+// has one); -1 if the model has no such field
+int index_cursor_filter(IndexCursor *cursor, const char *field_name, const char *value);
+// Next chunk of the array (valid until the following call), NULL once complete
+const char* index_cursor_next(IndexCursor *cursor, size_t *length);
+// Free a cursor
+void index_cursor_close(IndexCursor *cursor);
 
 // JSON parsing utilities
 char* parse_json_field(const char *json, const char *field_name);
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <errno.h>
 #include "orm.h"
+#include "../../utils/log.h"
 
 // --- Global Database Variable Definition ---
 // Needs to be initialized by calling initialize_database() before use.
@@ -30,6 +31,46 @@ Database *initialize_database(const char *name) {
 
 // --- Model Schema Definition & Cleanup ---
 
+/**
+ * @brief Frees the JSON member names of a model (a no-op if none were built).
+ * @param model The model.
+ * @param field_count Number of entries in model->json_keys.
+ */
+static void free_json_keys(Model *model, int field_count) {
+    if (model->json_keys) {
+        for (int i = 0; i < field_count; i++) free(model->json_keys[i]);
+    }
+    free(model->json_keys);
+    free(model->json_key_lengths);
+    model->json_keys = NULL;
+    model->json_key_lengths = NULL;
+}
+
+/**
+ * @brief Encodes each field's name as a JSON object member, preceded by the
+ * "{" or ", " in front of it and followed by ": ".
+ * @param model The model being defined.
+ * @param fields Its fields.
+ * @param field_count Number of fields.
+ * @return 0 on success, -1 if out of memory.
+ */
+static int build_json_keys(Model *model, Field *fields, int field_count) {
+    model->json_keys = calloc(field_count, sizeof(char *));
+    model->json_key_lengths = calloc(field_count, sizeof(size_t));
+    if (!model->json_keys || !model->json_key_lengths) return -1;
+    for (int i = 0; i < field_count; i++) {
+        JsonWriter writer;
+        json_writer_init(&writer, NULL, strlen(fields[i].name) + 8);
+        json_write_raw(&writer, i == 0 ? "{" : ", ", i == 0 ? 1 : 2);
+        json_write_string(&writer, fields[i].name, strlen(fields[i].name));
+        json_write_raw(&writer, ": ", 2);
+        model->json_keys[i] = json_writer_finish(&writer);
+        if (!model->json_keys[i]) return -1;
+        model->json_key_lengths[i] = writer.length;
+    }
+    return 0;
+}
+
 /**
  * @brief Defines a Model schema and creates the corresponding logical table.
  * Links the ORM Model structure to the underlying Table structure.
@@ -75,6 +116,9 @@ Model *define_model(const char *name, Field *fields, int field_count, Associatio
     model->table_ref = NULL;
     model->fields = NULL; // Will point to user-provided array
     model->associations = NULL; // Will point to user-provided array
+    model->json_keys = NULL;
+    model->json_key_lengths = NULL;
+    model->codec = NULL;
 
 
     // --- Duplicate Name & Extract Column Names ---
@@ -85,10 +129,13 @@ Model *define_model(const char *name, Field *fields, int field_count, Associatio
         return NULL;
     }
 
-    // Create a temporary array of column name pointers for create_table
+    // Create temporary arrays of column name and type pointers for create_table
     char **column_names = (char **)malloc(field_count * sizeof(char *));
-    if (!column_names) {
+    char **column_types = (char **)malloc(field_count * sizeof(char *));
+    if (!column_names || !column_types) {
         perror("Failed to allocate memory for column names array");
+        free(column_names);
+        free(column_types);
         free(model->name);
         free(model);
         return NULL;
@@ -97,19 +144,54 @@ Model *define_model(const char *name, Field *fields, int field_count, Associatio
         if (!fields[i].name) { // Validate field names
              fprintf(stderr, "Error: Field at index %d in model '%s' has NULL name.\n", i, name);
              free(column_names);
+             free(column_types);
              free(model->name);
              free(model);
              return NULL;
         }
         column_names[i] = fields[i].name; // Point to names within the user-provided Field structs
+        column_types[i] = fields[i].type; // Type hints decide how each column is stored
+    }
+
+    // --- Index Field Names ---
+    // Requests resolve field names with one hash lookup instead of a scan.
+    // With duplicate names the first field wins, as with a linear search.
+    name_map_init(&model->field_map);
+    for (int i = field_count - 1; i >= 0; i--) {
+        if (name_map_put(&model->field_map, fields[i].name, i) != 0) {
+            perror("Failed to allocate field name map");
+            name_map_destroy(&model->field_map);
+            free(column_names);
+            free(column_types);
+            free(model->name);
+            free(model);
+            return NULL;
+        }
+    }
+
+    // --- Render JSON Member Names ---
+    // Rows are written as JSON for every read; their member names are the
+    // same each time, so they are encoded once here
+    if (build_json_keys(model, fields, field_count) != 0) {
+        perror("Failed to allocate JSON member names");
+        free_json_keys(model, field_count);
+        name_map_destroy(&model->field_map);
+        free(column_names);
+        free(column_types);
+        free(model->name);
+        free(model);
+        return NULL;
     }
 
     // --- Create Underlying Logical Table ---
-    model->table_ref = create_table(global_db, name, column_names, field_count);
-    free(column_names); // Free the temporary array of pointers (not the names themselves)
+    model->table_ref = create_table(global_db, name, column_names, column_types, field_count);
+    free(column_names); // Free the temporary arrays of pointers (not the strings themselves)
+    free(column_types);
 
     if (!model->table_ref) {
         fprintf(stderr, "Error: Failed to create logical table for model '%s'. ORM definition failed.\n", name);
+        free_json_keys(model, field_count);
+        name_map_destroy(&model->field_map);
         free(model->name);
         free(model);
         return NULL;
@@ -139,8 +221,10 @@ Model *define_model(const char *name, Field *fields, int field_count, Associatio
  */
 void destroy_model_schema(Model* model) {
     if (!model) return;
-    // We only allocated the Model struct and duplicated its name.
+    // We only allocated the Model struct, its field map and JSON names and duplicated its name.
     free(model->name);
+    name_map_destroy(&model->field_map);
+    free_json_keys(model, model->field_count);
     // The table_ref is managed by the logical layer (destroy_database)
     // The fields and associations arrays are assumed to be managed externally.
     free(model);
@@ -156,12 +240,26 @@ void destroy_model_schema(Model* model) {
  * @return Pointer to the newly allocated ModelInstance, or NULL on failure.
  */
 ModelInstance* create_new_instance(Model* model_schema) {
+    return create_instance_in_arena(model_schema, NULL);
+}
+
+/**
+ * @brief Allocates an empty ModelInstance in an arena. Its data array and the
+ * values set on it come from the same arena, so the whole instance is freed
+ * when the arena is reset.
+ * @param model_schema Pointer to the Model schema this instance belongs to.
+ * @param arena Arena to allocate from, or NULL to use malloc.
+ * @return Pointer to the new ModelInstance, or NULL on failure.
+ */
+ModelInstance* create_instance_in_arena(Model* model_schema, Arena *arena) {
     if (!model_schema) {
         fprintf(stderr, "Error: Cannot create instance with NULL model schema.\n");
         return NULL;
     }
 
-    ModelInstance* instance = (ModelInstance*)malloc(sizeof(ModelInstance));
+    size_t data_size = model_schema->field_count * sizeof(char*);
+    ModelInstance* instance = arena ? arena_alloc(arena, sizeof(ModelInstance))
+                                    : (ModelInstance*)malloc(sizeof(ModelInstance));
     if (!instance) {
         perror("Failed to allocate ModelInstance structure");
         return NULL;
@@ -169,15 +267,17 @@ ModelInstance* create_new_instance(Model* model_schema) {
 
     instance->model_schema = model_schema;
     instance->record_offset = -1; // Mark as new/unsaved initially
+    instance->arena = arena;
 
-    // Allocate the data array (array of char pointers)
-    // Use calloc to initialize all pointers to NULL
-    instance->data = (char**)calloc(model_schema->field_count, sizeof(char*));
+    // Allocate the data array (array of char pointers), all NULL
+    instance->data = arena ? arena_alloc(arena, data_size ? data_size : 1)
+                           : (char**)calloc(model_schema->field_count, sizeof(char*));
     if (!instance->data) {
         perror("Failed to allocate data array for ModelInstance");
-        free(instance);
+        if (!arena) free(instance);
         return NULL;
     }
+    if (arena) memset(instance->data, 0, data_size);
 
     return instance;
 }
@@ -198,13 +298,14 @@ int set_instance_field(ModelInstance *instance, int field_index, const char *val
         return -1;
     }
 
-    // Free existing data at this index to prevent memory leaks
-    free(instance->data[field_index]);
+    // Free existing data at this index to prevent memory leaks (arena
+    // values are freed with the arena)
+    if (!instance->arena) free(instance->data[field_index]);
     instance->data[field_index] = NULL; // Set to NULL before potential strdup
 
     // If a non-NULL value is provided, duplicate it
     if (value != NULL) {
-        instance->data[field_index] = strdup(value);
+        instance->data[field_index] = instance->arena ? arena_strdup(instance->arena, value) : strdup(value);
         if (!instance->data[field_index]) {
             perror("Failed to duplicate string in set_instance_field");
             return -1; // Memory allocation failed
@@ -220,7 +321,7 @@ int set_instance_field(ModelInstance *instance, int field_index, const char *val
 */
 
 void free_model_instance(ModelInstance* instance) {
-    if (!instance) return;
+    if (!instance || instance->arena) return;
 
     // Free the individual data strings if they were allocated (strdup'd)
     if (instance->data) {
@@ -258,6 +359,24 @@ int find_primary_key_index(Model* model) {
     return -1; // No primary key field found in the schema
 }
 
+/**
+ * @brief Converts a primary key value to the integer the logical layer uses.
+ * @param model Pointer to the Model schema (for the error message).
+ * @param value The primary key value.
+ * @param out Output: the key.
+ * @return 0 on success, -1 if value is not an integer.
+ */
+static int parse_primary_key(Model *model, const char *value, int *out) {
+    int primary_key = atoi(value);
+    // Basic check: if atoi returned 0, ensure the string was actually "0"
+    if (primary_key == 0 && strcmp(value, "0") != 0) {
+        fprintf(stderr, "Error: Invalid integer format for primary key value '%s' in model '%s'.\n", value, model->name);
+        return -1;
+    }
+    *out = primary_key;
+    return 0;
+}
+
 /**
  * @brief Saves (inserts or updates) a ModelInstance to the database.
  * @param instance Pointer to the ModelInstance to save.
@@ -291,13 +410,8 @@ int save_model_instance(ModelInstance *instance) {
          return -1;
     }
     // Convert primary key string to integer for logical layer functions
-    // Add error checking for atoi if PK might not be a valid integer string
-    int primary_key = atoi(instance->data[pk_index]);
-     // Basic check: if atoi returned 0, ensure the string was actually "0"
-     if (primary_key == 0 && strcmp(instance->data[pk_index], "0") != 0) {
-         fprintf(stderr, "Error: Invalid integer format for primary key value '%s' in model '%s'.\n", instance->data[pk_index], schema->name);
-         return -1;
-     }
+    int primary_key;
+    if (parse_primary_key(schema, instance->data[pk_index], &primary_key) != 0) return -1;
 
 
     // --- Callbacks (Example - Implement if needed) ---
@@ -319,7 +433,7 @@ int save_model_instance(ModelInstance *instance) {
         if (result_offset != -1) {
             instance->record_offset = result_offset; // Update instance with the new offset
             // if (schema->after_save) schema->after_save(instance); // After insert callback
-            printf("Instance of '%s' (PK=%d) inserted at offset %ld.\n", schema->name, primary_key, result_offset);
+            LOG_DEBUG("Instance of '%s' (PK=%d) inserted at offset %ld.", schema->name, primary_key, result_offset);
         } else {
             // insert_row already printed an error
             return -1; // Insert failed
@@ -330,7 +444,7 @@ int save_model_instance(ModelInstance *instance) {
          if (result_offset != -1) {
               instance->record_offset = result_offset; // Update instance offset (might change)
               // if (schema->after_save) schema->after_save(instance); // After update callback
-              printf("Instance of '%s' (PK=%d) updated, new offset %ld.\n", schema->name, primary_key, result_offset);
+              LOG_DEBUG("Instance of '%s' (PK=%d) updated, new offset %ld.", schema->name, primary_key, result_offset);
          } else {
               // update_row already printed an error
               return -1; // Update failed
@@ -340,6 +454,49 @@ int save_model_instance(ModelInstance *instance) {
     return 0; // Success
 }
 
+/**
+ * @brief Inserts many new rows of a model with one batch insert.
+ * @param model_schema Pointer to the Model schema.
+ * @param rows For each row, one value per field (NULL for a null value).
+ * @param count Number of rows.
+ * @return count on success, -1 on failure (nothing is inserted when a key is
+ * missing, invalid or already taken, or a value does not fit its field).
+ */
+int insert_model_rows(Model *model_schema, char ***rows, int count) {
+    if (!model_schema || !model_schema->table_ref || count < 0 || (count > 0 && !rows)) {
+        fprintf(stderr, "Error: Invalid arguments for insert_model_rows.\n");
+        return -1;
+    }
+    int pk_index = find_primary_key_index(model_schema);
+    if (pk_index == -1) {
+        fprintf(stderr, "Error: Cannot save model '%s', no primary key defined in schema.\n", model_schema->name);
+        return -1;
+    }
+    if (count == 0) return 0;
+
+    int *primary_keys = malloc(count * sizeof(int));
+    if (!primary_keys) {
+        perror("Failed to allocate primary keys for batch insert");
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (!rows[i] || !rows[i][pk_index]) {
+            fprintf(stderr, "Error: Cannot save model '%s', primary key value is NULL.\n", model_schema->name);
+            free(primary_keys);
+            return -1;
+        }
+        if (parse_primary_key(model_schema, rows[i][pk_index], &primary_keys[i]) != 0) {
+            free(primary_keys);
+            return -1;
+        }
+    }
+
+    int inserted = insert_rows_batch(model_schema->table_ref, count, primary_keys, rows, NULL);
+    free(primary_keys);
+    if (inserted >= 0) LOG_DEBUG("%d instances of '%s' inserted.", inserted, model_schema->name);
+    return inserted;
+}
+
 /**
  * @brief Deletes a ModelInstance from the database.
  * @param instance Pointer to the ModelInstance to delete. Must have been previously saved.
@@ -381,7 +538,7 @@ int delete_model_instance(ModelInstance *instance) {
         long old_offset = instance->record_offset; // Store offset for logging
         instance->record_offset = -1; // Mark instance as no longer persisted
         // if (schema->after_delete) schema->after_delete(instance); // After delete callback
-        printf("Instance of '%s' (PK=%d, old offset=%ld) deleted.\n", schema->name, primary_key, old_offset);
+        LOG_DEBUG("Instance of '%s' (PK=%d, old offset=%ld) deleted.", schema->name, primary_key, old_offset);
         return 0;
     } else {
         // delete_row already printed an error
@@ -426,9 +583,9 @@ ModelInstance* find_model_by_primary_key(Model *model_schema, int primary_key) {
     }
 
     // Get the record offset (search index again - slightly inefficient, could modify read_row)
-    instance->record_offset = search_key(table->primary_index, primary_key);
+    instance->record_offset = find_row_offset(table, primary_key);
     if (instance->record_offset == -1) {
-         // This indicates an inconsistency: read_row found data, but search_key didn't!
+         // This indicates an inconsistency: read_row found data, but find_row_offset didn't!
          fprintf(stderr, "CRITICAL INCONSISTENCY: Row data found for PK %d but key not in index!\n", primary_key);
          free_model_instance(instance); // Free the partially created instance
          for (int i = 0; i < model_schema->field_count; i++) free(row_values[i]);
@@ -464,6 +621,169 @@ ModelInstance* find_model_by_primary_key(Model *model_schema, int primary_key) {
     return instance;
 }
 
+// State of a find_model_by_primary_key_in_arena lookup
+typedef struct {
+    ModelInstance *instance;
+    int failed;
+} FoundRow;
+
+// scan_rows callback: copy the row's values into the instance
+static int copy_found_row(void *context, int primary_key, char **values) {
+    (void)primary_key;
+    FoundRow *found = context;
+    for (int i = 0; i < found->instance->model_schema->field_count; i++) {
+        if (set_instance_field(found->instance, i, values[i]) != 0) {
+            found->failed = 1;
+            break;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Finds a ModelInstance by its primary key, allocating it in an arena.
+ * The row is decoded by a one-key scan and each value copied straight into
+ * the instance, instead of read_row's copies being copied again.
+ * @param model_schema Pointer to the Model schema.
+ * @param primary_key The integer primary key value.
+ * @param arena Arena to allocate from, or NULL to use malloc.
+ * @return The instance, or NULL if not found/error.
+ */
+ModelInstance* find_model_by_primary_key_in_arena(Model *model_schema, int primary_key, Arena *arena) {
+    if (!model_schema || !model_schema->table_ref) {
+        fprintf(stderr, "Error: Invalid model schema provided to find_model_by_primary_key_in_arena.\n");
+        return NULL;
+    }
+    if (!arena) return find_model_by_primary_key(model_schema, primary_key);
+
+    Table* table = model_schema->table_ref;
+    ModelInstance* instance = create_instance_in_arena(model_schema, arena);
+    if (!instance) return NULL;
+
+    FoundRow found = { instance, 0 };
+    if (scan_rows(table, primary_key, primary_key, copy_found_row, &found) <= 0 || found.failed) return NULL;
+
+    // Only whether the instance is saved matters to save/delete, but keep the
+    // offset right for callers that print it
+    instance->record_offset = find_row_offset(table, primary_key);
+    if (instance->record_offset == -1) return NULL; // Deleted since the scan
+    return instance;
+}
+
+// State of a find_models_in_range scan
+typedef struct {
+    Model *model_schema;
+    ModelInstanceCallback callback;
+    void *context;
+} RangeScan;
+
+// scan_rows callback: present the row as a borrowed ModelInstance
+static int range_scan_row(void *context, int primary_key, char **values) {
+    (void)primary_key;
+    RangeScan *scan = context;
+    ModelInstance instance = { scan->model_schema, values, -1, NULL };
+    return scan->callback(scan->context, &instance);
+}
+
+/**
+ * @brief Visits the instances with primary keys in [lo, hi] in key order.
+ * Costs one index descent plus the rows visited (O(log n + k)); no row is
+ * copied. The scan holds the table's read lock, so the callback must not save
+ * or delete instances of this model.
+ * @param model_schema Pointer to the schema of the model to scan.
+ * @param lo Smallest primary key to visit.
+ * @param hi Largest primary key to visit.
+ * @param callback Called with a read-only instance valid only during the call
+ * (its data is not owned and record_offset is -1); nonzero stops the scan.
+ * @param context Passed to callback.
+ * @return Number of instances visited, or -1 on error.
+ */
+int find_models_in_range(Model *model_schema, int lo, int hi, ModelInstanceCallback callback, void *context) {
+    if (!model_schema || !model_schema->table_ref || !callback) {
+        fprintf(stderr, "Error: Invalid arguments for find_models_in_range.\n");
+        return -1;
+    }
+    if (lo > hi) return 0;
+
+    RangeScan scan = { model_schema, callback, context };
+    return scan_rows(model_schema->table_ref, lo, hi, range_scan_row, &scan);
+}
+
+/**
+ * @brief Finds a field of a model by name.
+ * @param model_schema Pointer to the Model schema.
+ * @param field_name Name of the field.
+ * @return The field's index (its column in the table), or -1 if not found.
+ */
+int model_field_index(Model *model_schema, const char *field_name) {
+    if (!model_schema || !field_name) return -1;
+    return name_map_get(&model_schema->field_map, field_name, strlen(field_name));
+}
+
+/**
+ * @brief Finds a field of a model by a name that is not NUL-terminated.
+ * @param model_schema Pointer to the Model schema.
+ * @param field_name First byte of the name.
+ * @param length Length of the name.
+ * @return The field's index, or -1 if not found.
+ */
+int model_field_index_len(Model *model_schema, const char *field_name, size_t length) {
+    if (!model_schema || !field_name) return -1;
+    return name_map_get(&model_schema->field_map, field_name, length);
+}
+
+/**
+ * @brief Builds a secondary index on a field of the model's table. Inserts,
+ * updates and deletes keep it current. Indexes are held in memory only, so
+ * each one is rebuilt (one pass over the table) when it is created at startup.
+ * @param model_schema Pointer to the Model schema.
+ * @param field_name Name of the field to index.
+ * @return 0 on success, -1 on failure.
+ */
+int create_model_index(Model *model_schema, const char *field_name) {
+    if (!model_schema || !model_schema->table_ref || !field_name) {
+        fprintf(stderr, "Error: Invalid arguments for create_model_index.\n");
+        return -1;
+    }
+    int column = model_field_index(model_schema, field_name);
+    if (column < 0) {
+        fprintf(stderr, "Error: Model '%s' has no field '%s' to index.\n", model_schema->name, field_name);
+        return -1;
+    }
+    return create_column_index(model_schema->table_ref, column);
+}
+
+/**
+ * @brief Visits the instances with primary keys in [lo, hi] whose field equals
+ * value, in key order. With an index on the field this costs one lookup plus
+ * the matching rows; without one, every row in the range is read. Same
+ * borrowing rules as find_models_in_range.
+ * @param model_schema Pointer to the schema of the model to scan.
+ * @param field_name Name of the field to match.
+ * @param value Value to match, compared the way the field's type decodes.
+ * @param lo Smallest primary key to visit.
+ * @param hi Largest primary key to visit.
+ * @param callback Called with each matching read-only instance; nonzero stops the scan.
+ * @param context Passed to callback.
+ * @return Number of instances visited, or -1 on error.
+ */
+int find_models_where(Model *model_schema, const char *field_name, const char *value, int lo, int hi,
+                      ModelInstanceCallback callback, void *context) {
+    if (!model_schema || !model_schema->table_ref || !field_name || !value || !callback) {
+        fprintf(stderr, "Error: Invalid arguments for find_models_where.\n");
+        return -1;
+    }
+    int column = model_field_index(model_schema, field_name);
+    if (column < 0) {
+        fprintf(stderr, "Error: Model '%s' has no field '%s'.\n", model_schema->name, field_name);
+        return -1;
+    }
+    if (lo > hi) return 0;
+
+    RangeScan scan = { model_schema, callback, context };
+    return scan_rows_where(model_schema->table_ref, column, value, lo, hi, range_scan_row, &scan);
+}
+
 
 // --- Utility / Schema Inspection / Configuration ---
 
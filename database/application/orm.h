@@ -2,6 +2,9 @@
 #define ORM_H
 
 #include "../logical/database.h" // Include logical layer definitions
+#include "../../utils/arena.h"       // Per-request allocation of instances
+#include "../../utils/name_map.h"    // Field name -> index lookup
+#include "../../utils/json.h"        // Codec hooks read and write JSON
 
 // --- Structures for ORM Schema Definition ---
 
@@ -30,6 +33,18 @@ typedef struct Association {
                                 // (in this model for belongs_to, in the other for has_many)
 } Association;
 
+/**
+ * @brief JSON fast paths specialised for one model, emitted by the scaffolder
+ * (see generate_model_code) and registered with register_model_codec. Rows
+ * are the same char** values as ModelInstance data; the controllers use a
+ * hook in place of the generic path whenever the model has it.
+ */
+typedef struct ModelCodec {
+    JsonSlotLookup field_slot;  // Field index of a JSON member name (context: the Model), -1 if none
+    void (*write_json)(JsonWriter *writer, char **values); // Appends a row as a JSON object
+    size_t json_overhead;       // Bytes write_json adds to the values, for sizing the writer
+} ModelCodec;
+
 /**
  * @brief Defines the schema (structure) of a data model, mapping to a database table.
  */
@@ -38,6 +53,11 @@ typedef struct Model {
     Table *table_ref;           // Pointer to the underlying logical Table structure
     Field *fields;              // Array defining the fields (columns) of this model
     int field_count;            // Number of fields in the model
+    NameMap field_map;          // Field name -> index in fields, built by define_model
+    char **json_keys;           // Each field's member name as a JSON object writes it, separator
+                                // included ("{\"id\": ", ", \"title\": "), built by define_model
+    size_t *json_key_lengths;
+    const ModelCodec *codec;    // Specialised paths, NULL until one is registered
     Association *associations;  // Array defining relationships with other models (conceptual)
     int association_count;      // Number of associations
     // --- Callback Function Pointers (Example Hooks) ---
@@ -62,6 +82,7 @@ typedef struct ModelInstance {
                             // Data is stored as strings, matching the logical layer.
     long record_offset;     // The file offset of this record in the data file.
                             // Set to -1 for new instances not yet saved or after deletion.
+    Arena *arena;           // Arena holding the instance and its data, NULL if malloc'd
 } ModelInstance;
 
 
@@ -83,7 +104,10 @@ void destroy_model_schema(Model* model); // Frees the Model struct (not the unde
 
 // Model Instance Management
 ModelInstance* create_new_instance(Model* model_schema); // Allocates an empty instance linked to a schema
-void free_model_instance(ModelInstance* instance); // Frees an instance and its data array/strings
+// Like create_new_instance, but the instance and every value later set on it
+// live in arena (NULL: malloc) and go away with it; no free_model_instance needed
+ModelInstance* create_instance_in_arena(Model* model_schema, Arena *arena);
+void free_model_instance(ModelInstance* instance); // Frees an instance and its data array/strings (no-op for arena instances)
 // Sets a field in a ModelInstance by index, handling string duplication. (Moved from main.c)
 int set_instance_field(ModelInstance *instance, int field_index, const char *value);
 
@@ -100,6 +124,18 @@ int set_instance_field(ModelInstance *instance, int field_index, const char *val
  */
 int save_model_instance(ModelInstance *instance);
 
+/**
+ * Inserts many new rows in one batch (insert_rows_batch): one lock, a few
+ * large writes, and a bottom-up index build when the table is empty.
+ * @param model_schema Pointer to the schema of the model.
+ * @param rows For each row, an array of field_count values laid out like
+ * ModelInstance data (NULL for a null value; the primary key is required).
+ * @param count Number of rows.
+ * @return count on success, -1 on failure; either every row is inserted or,
+ * unless a write fails midway, none is.
+ */
+int insert_model_rows(Model *model_schema, char ***rows, int count);
+
 /**
  * Deletes a model instance from the database.
  * Marks the row as deleted in the file and removes it from the index.
@@ -119,6 +155,66 @@ int delete_model_instance(ModelInstance *instance);
  */
 ModelInstance* find_model_by_primary_key(Model *model_schema, int primary_key);
 
+/**
+ * Like find_model_by_primary_key, but the instance is allocated in arena
+ * (NULL: malloc), with each value copied once from the row as it is read.
+ * @param model_schema Pointer to the schema of the model to find.
+ * @param primary_key The integer primary key value to search for.
+ * @param arena Arena to allocate the instance in.
+ * @return The instance, or NULL if the record is not found or an error occurs.
+ */
+ModelInstance* find_model_by_primary_key_in_arena(Model *model_schema, int primary_key, Arena *arena);
+
+/**
+ * Called by find_models_in_range for each instance. The instance is borrowed:
+ * its data is only valid during the call and must not be freed or saved.
+ * Return nonzero to stop the scan.
+ */
+typedef int (*ModelInstanceCallback)(void *context, ModelInstance *instance);
+
+/**
+ * Visits the instances whose primary key is in [lo, hi], in key order, in
+ * O(log n + k) for k instances. The callback must not modify the model's table.
+ * @param model_schema Pointer to the schema of the model to scan.
+ * @param lo Smallest primary key to visit.
+ * @param hi Largest primary key to visit.
+ * @param callback Function called for each instance.
+ * @param context Passed to callback.
+ * @return Number of instances visited, or -1 on error.
+ */
+int find_models_in_range(Model *model_schema, int lo, int hi, ModelInstanceCallback callback, void *context);
+
+/**
+ * Indexes a field so find_models_where can look values up instead of scanning.
+ * The index lives in memory and is rebuilt from the data file when called at startup.
+ * @param model_schema Pointer to the schema of the model.
+ * @param field_name Name of the field to index (indexing the primary key is a no-op).
+ * @return 0 on success, -1 on failure (unknown field, allocation failure).
+ */
+int create_model_index(Model *model_schema, const char *field_name);
+
+/**
+ * Like find_models_in_range, but only visits instances whose field equals value.
+ * Typed fields compare by value ("007" matches an int field holding 7). Uses the
+ * field's index if it has one, otherwise filters the range.
+ * @param model_schema Pointer to the schema of the model to scan.
+ * @param field_name Name of the field to match.
+ * @param value Value to match; "" matches nulls.
+ * @param lo Smallest primary key to visit.
+ * @param hi Largest primary key to visit.
+ * @param callback Function called for each matching instance.
+ * @param context Passed to callback.
+ * @return Number of instances visited, or -1 on error (e.g., unknown field).
+ */
+int find_models_where(Model *model_schema, const char *field_name, const char *value, int lo, int hi,
+                      ModelInstanceCallback callback, void *context);
+
+// Index of the field called field_name in the model, or -1 if there is none
+// (a hash lookup in the model's field map)
+int model_field_index(Model *model_schema, const char *field_name);
+// Same for a name given as length bytes, not necessarily NUL-terminated
+int model_field_index_len(Model *model_schema, const char *field_name, size_t length);
+
 // Utility / Schema Inspection / Configuration
 // Adds foreign key metadata to a field in the model schema (for informational purposes).
 void add_foreign_key(Model *model, const char *field_name, const char *referenced_table, const char *referenced_column);
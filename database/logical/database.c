@@ -3,15 +3,132 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-#include <unistd.h> // For ftruncate, remove, rename, fsync (optional)
+#include <unistd.h> // For ftruncate, remove, rename, fdatasync
+#include <fcntl.h>  // For opening data files during log recovery
+#include <sys/mman.h> // For mmap mode
+#include <sys/stat.h> // For mkdir
 #include <pthread.h>
 #include <errno.h>  // For perror()
 #include <limits.h> // For PATH_MAX
+#include <time.h>   // For pacing compaction
 #include "../utils/path_utils.h"
+#include "../utils/metrics.h"
+#include "../utils/log.h"
+#include "../utils/thread_pool.h"
 #include "database.h"
 
+// --- Locking & Metrics ---
+
+/**
+ * @brief Takes a table's lock shared, recording the wait. An uncontended lock
+ * is taken without reading the clock.
+ * @param table Pointer to the table.
+ */
+static void lock_table_read(Table *table) {
+    if (pthread_rwlock_tryrdlock(&table->lock) == 0) {
+        metrics_observe(table->metrics.read_lock_wait, 0);
+        return;
+    }
+    uint64_t start = metrics_start();
+    pthread_rwlock_rdlock(&table->lock);
+    metrics_observe_since(table->metrics.read_lock_wait, start);
+}
+
+/**
+ * @brief Takes a table's lock exclusively, recording the wait.
+ * @param table Pointer to the table.
+ */
+static void lock_table_write(Table *table) {
+    if (pthread_rwlock_trywrlock(&table->lock) == 0) {
+        metrics_observe(table->metrics.write_lock_wait, 0);
+        return;
+    }
+    uint64_t start = metrics_start();
+    pthread_rwlock_wrlock(&table->lock);
+    metrics_observe_since(table->metrics.write_lock_wait, start);
+}
+
+/**
+ * @brief Registers the metric series of a table.
+ * @param table Pointer to the table (name set).
+ */
+static void register_table_metrics(Table *table) {
+    static const char *op_names[TABLE_OP_COUNT] = {
+        "insert", "insert_batch", "read", "scan", "update", "delete", "compact"
+    };
+    char labels[256];
+    for (int op = 0; op < TABLE_OP_COUNT; op++) {
+        snprintf(labels, sizeof(labels), "table=\"%s\",op=\"%s\"", table->name, op_names[op]);
+        table->metrics.operations[op] = metrics_histogram("cerver_table_operation_duration_seconds",
+                                                          "Time spent in table operations, lock wait included.", labels);
+    }
+    snprintf(labels, sizeof(labels), "table=\"%s\",mode=\"read\"", table->name);
+    table->metrics.read_lock_wait = metrics_histogram("cerver_table_lock_wait_seconds",
+                                                      "Time spent waiting for a table lock.", labels);
+    snprintf(labels, sizeof(labels), "table=\"%s\",mode=\"write\"", table->name);
+    table->metrics.write_lock_wait = metrics_histogram("cerver_table_lock_wait_seconds",
+                                                       "Time spent waiting for a table lock.", labels);
+    snprintf(labels, sizeof(labels), "table=\"%s\"", table->name);
+    table->metrics.bytes_read = metrics_counter("cerver_table_read_bytes_total",
+                                                "Bytes of records read from a table's data file.", labels);
+    table->metrics.bytes_written = metrics_counter("cerver_table_written_bytes_total",
+                                                   "Bytes of records written to a table's data file.", labels);
+}
+
+/**
+ * @brief Renders the state of a database's tables (sizes, row cache) for /metrics.
+ * @param context The database.
+ * @param out Text to append to.
+ */
+static void collect_database_metrics(void *context, MetricsText *out) {
+    Database *db = (Database *)context;
+    metrics_text_printf(out, "# HELP cerver_table_data_bytes Size of a table's data file.\n"
+                             "# TYPE cerver_table_data_bytes gauge\n");
+    // Partitioned tables have no files; their shards are listed instead
+    for (int i = 0; i < db->table_count; i++) {
+        if (db->tables[i]->shards) continue;
+        metrics_text_printf(out, "cerver_table_data_bytes{table=\"%s\"} %ld\n", db->tables[i]->name,
+                            __atomic_load_n(&db->tables[i]->data_size, __ATOMIC_RELAXED));
+    }
+    metrics_text_printf(out, "# HELP cerver_table_rows Live rows in a table.\n"
+                             "# TYPE cerver_table_rows gauge\n");
+    for (int i = 0; i < db->table_count; i++) {
+        if (db->tables[i]->shards) continue;
+        metrics_text_printf(out, "cerver_table_rows{table=\"%s\"} %ld\n", db->tables[i]->name,
+                            __atomic_load_n(&db->tables[i]->row_count, __ATOMIC_RELAXED));
+    }
+    metrics_text_printf(out, "# HELP cerver_table_dead_bytes Bytes of deleted and superseded records in a table's data file.\n"
+                             "# TYPE cerver_table_dead_bytes gauge\n");
+    for (int i = 0; i < db->table_count; i++) {
+        if (db->tables[i]->shards) continue;
+        metrics_text_printf(out, "cerver_table_dead_bytes{table=\"%s\"} %ld\n", db->tables[i]->name,
+                            __atomic_load_n(&db->tables[i]->dead_bytes, __ATOMIC_RELAXED));
+    }
+
+    static const char *cache_help[3][2] = {
+        { "cerver_row_cache_hits_total", "Reads answered from a table's row cache." },
+        { "cerver_row_cache_misses_total", "Reads the row cache of a table could not answer." },
+        { "cerver_row_cache_entries", "Rows held in a table's row cache." },
+    };
+    for (int m = 0; m < 3; m++) {
+        metrics_text_printf(out, "# HELP %s %s\n# TYPE %s %s\n", cache_help[m][0], cache_help[m][1],
+                            cache_help[m][0], m < 2 ? "counter" : "gauge");
+        for (int i = 0; i < db->table_count; i++) {
+            if (!db->tables[i]->row_cache || db->tables[i]->parent) continue; // Shards share their table's
+            uint64_t hits, misses;
+            int entries;
+            row_cache_stats(db->tables[i]->row_cache, &hits, &misses, &entries);
+            uint64_t value = m == 0 ? hits : m == 1 ? misses : (uint64_t)entries;
+            metrics_text_printf(out, "%s{table=\"%s\"} %llu\n", cache_help[m][0], db->tables[i]->name,
+                                (unsigned long long)value);
+        }
+    }
+}
+
 // --- Database & Table Creation/Deletion ---
 
+static void read_catalog(Database *db);
+
 /**
  * @brief Creates a new Database structure.
  * @param name The name for the new database.
@@ -30,457 +147,3154 @@ Database *create_database(const char *name) {
         return NULL;
     }
     db->table_count = 0;
+    db->mmap_tables = 0;
+    db->row_cache_entries = 0;
+    db->io_backend = DATA_IO_STDIO;
+    db->table_shards = 1;
+    db->wal = NULL;
+    db->durability = WAL_DURABILITY_OFF;
+    pthread_mutex_init(&db->checkpoint_lock, NULL);
+    pthread_mutex_init(&db->compactor_lock, NULL);
+    pthread_condattr_t wake_attr;
+    pthread_condattr_init(&wake_attr);
+    pthread_condattr_setclock(&wake_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&db->compactor_wake, &wake_attr);
+    pthread_condattr_destroy(&wake_attr);
+    db->compactor_running = 0;
+    db->compactor_stopping = 0;
+    db->compact_dead_ratio = 0;
+    db->compact_rate = 0;
+    db->change_listener = NULL;
+    db->change_context = NULL;
+    db->catalog = NULL;
+    db->catalog_count = 0;
+    db->catalog_on_disk = 0;
+    pthread_mutex_init(&db->catalog_lock, NULL);
     // Initialize table pointers to NULL
     for(int i=0; i<MAX_TABLES; ++i) db->tables[i] = NULL;
+    read_catalog(db);
+    metrics_add_collector(collect_database_metrics, db);
     printf("Database '%s' created.\n", name);
     return db;
 }
 
 /**
- * @brief Creates a new Table within a Database.
- * Initializes the table structure, creates the data file, initializes the B+ Tree index,
- * and sets up the mutex.
- * @param db Pointer to the Database.
- * @param table_name Name for the new table.
- * @param columns Array of strings containing the names of the columns.
- * @param column_count Number of columns.
- * @return Pointer to the created Table, or NULL on failure.
+ * @brief Copies a table name lowercased, as it appears in paths.
+ * @param table_name Name of the table.
+ * @param out Buffer of FILENAME_BUF_SIZE bytes receiving the name.
  */
-Table *create_table(Database *db, const char *table_name, char **columns, int column_count) {
-    // --- Input Validation ---
-    if (!db) {
-        fprintf(stderr, "Error: Database pointer is NULL in create_table.\n");
-        return NULL;
+static void lowercase_table_name(const char *table_name, char *out) {
+    strncpy(out, table_name, FILENAME_BUF_SIZE - 1);
+    out[FILENAME_BUF_SIZE - 1] = '\0';
+    for (int i = 0; out[i]; i++) out[i] = tolower((unsigned char)out[i]);
+}
+
+/**
+ * @brief Builds the directory holding a table's files, scaffolded_resources/<table>.
+ * The shards of a partitioned table ("book.0", "book.1"...) share its directory.
+ * @param table_name Name of the table (lowercased for the path).
+ * @param out Buffer receiving the path.
+ * @param out_size Size of out.
+ * @return 0 on success, -1 if the path could not be built.
+ */
+static int table_resource_dir(const char *table_name, char *out, size_t out_size) {
+    char lowercase_name[FILENAME_BUF_SIZE];
+    lowercase_table_name(table_name, lowercase_name);
+    char *shard_suffix = strchr(lowercase_name, '.');
+    if (shard_suffix) *shard_suffix = '\0';
+
+    char scaffolded_path[FILENAME_BUF_SIZE];
+    if (join_project_path(scaffolded_path, sizeof(scaffolded_path), "scaffolded_resources") != 0) {
+        return -1;
     }
-    if (db->table_count >= MAX_TABLES) {
-        fprintf(stderr, "Error: Maximum table limit (%d) reached.\n", MAX_TABLES);
-        return NULL;
+    snprintf(out, out_size, "%s/%s", scaffolded_path, lowercase_name);
+    return 0;
+}
+
+/**
+ * @brief Builds the path of one of a table's files, e.g. scaffolded_resources/book/book.idx
+ * (or book/book.1.idx for shard 1 of a partitioned table).
+ * @param table_name Name of the table (lowercased for the path).
+ * @param extension File extension including the dot (".dat", ".idx", ".tmp").
+ * @param out Buffer receiving the path.
+ * @param out_size Size of out.
+ * @return 0 on success, -1 if the path could not be built.
+ */
+static int table_file_path(const char *table_name, const char *extension, char *out, size_t out_size) {
+    char resource_dir[FILENAME_BUF_SIZE];
+    if (table_resource_dir(table_name, resource_dir, sizeof(resource_dir)) != 0) return -1;
+
+    char base[FILENAME_BUF_SIZE];
+    lowercase_table_name(table_name, base);
+    snprintf(out, out_size, "%s/%s%s", resource_dir, base, extension);
+    return 0;
+}
+
+/**
+ * @brief Reads the record at the current position of a data file stream.
+ * @param file Data file positioned at the start of a record.
+ * @param buffer In/out: buffer receiving the record, grown as needed.
+ * @param capacity In/out: size of *buffer.
+ * @return The record length, 0 at the end of the file, or -1 if the rest of
+ * the file is not a complete record (a torn append or corruption).
+ */
+static long read_next_record(FILE *file, unsigned char **buffer, size_t *capacity) {
+    unsigned char header[RECORD_HEADER_MAX_SIZE];
+    size_t got = 0, header_len = 0, length = 0;
+    int c;
+    while (header_len == 0 && got < sizeof(header) && (c = getc(file)) != EOF) {
+        header[got++] = (unsigned char)c;
+        header_len = record_header(header, got, &length);
     }
-     if (!table_name || strlen(table_name) == 0) {
-        fprintf(stderr, "Error: Invalid table name provided.\n");
-        return NULL;
+    if (got == 0 && !ferror(file)) return 0;
+    if (header_len == 0) return -1;
+
+    if (length > *capacity) {
+        unsigned char *grown = realloc(*buffer, length);
+        if (!grown) {
+            perror("Failed to allocate record buffer");
+            return -1;
+        }
+        *buffer = grown;
+        *capacity = length;
     }
-    if (!columns || column_count <= 0 || column_count > MAX_COLUMNS) {
-         fprintf(stderr, "Error: Invalid column definition (count: %d).\n", column_count);
-         return NULL;
+    memcpy(*buffer, header, header_len);
+    if (fread(*buffer + header_len, 1, length - header_len, file) < length - header_len) return -1;
+    return (long)length;
+}
+
+// Smallest mapping of a data file; mappings double from here so a growing
+// file is only remapped a logarithmic number of times
+#define DATA_MAP_MIN_LENGTH ((size_t)1 << 20)
+
+/**
+ * @brief Unmaps a table's data file, returning it to pread mode.
+ * @param table Pointer to the table.
+ */
+static void unmap_data_file(Table *table) {
+    if (table->data_map) munmap(table->data_map, table->data_map_length);
+    table->data_map = NULL;
+    table->data_map_length = 0;
+}
+
+/**
+ * @brief Maps a table's data file read-only, replacing any previous mapping.
+ * The mapping is shared, so records written through data_file appear in it
+ * without remapping until data_size outgrows data_map_length. Bytes past the
+ * end of the file are never touched. Call with the table write-locked (or
+ * before it is shared).
+ * @param table Pointer to the table (data_fd and data_size must be current).
+ * @return 0 on success, -1 on failure (the table is left in pread mode).
+ */
+static int map_data_file(Table *table) {
+    unmap_data_file(table);
+    size_t length = DATA_MAP_MIN_LENGTH;
+    while (length < (size_t)table->data_size) length *= 2;
+
+    void *map = mmap(NULL, length, PROT_READ, MAP_SHARED, table->data_fd, 0);
+    if (map == MAP_FAILED) {
+        perror("Failed to map data file");
+        return -1;
     }
-     // Check for duplicate table name
-     for(int i=0; i<db->table_count; ++i) {
-         if(db->tables[i] && strcmp(db->tables[i]->name, table_name) == 0) {
-             fprintf(stderr, "Error: Table '%s' already exists in database '%s'.\n", table_name, db->name);
-             return NULL;
-         }
-     }
+    madvise(map, length, MADV_RANDOM); // Reads are point lookups through the index
+    table->data_map = map;
+    table->data_map_length = length;
+    return 0;
+}
 
+// Sequential pass over a table's records, straight from the mapping in mmap
+// mode (with read-ahead hinted) or through data_file otherwise
+typedef struct {
+    Table *table;
+    long offset;                // Offset of the next record
+    unsigned char *buffer;      // pread mode: copy of the current record
+    size_t capacity;
+} RecordScan;
 
-    // --- Allocation and Initialization ---
-    Table *table = (Table *)malloc(sizeof(Table));
-    if (!table) {
-        perror("Failed to allocate memory for table structure");
-        return NULL;
+static void scan_begin(RecordScan *scan, Table *table) {
+    scan->table = table;
+    scan->offset = RECORD_FILE_HEADER_SIZE;
+    scan->buffer = NULL;
+    scan->capacity = 0;
+    if (table->data_map) {
+        madvise(table->data_map, table->data_map_length, MADV_SEQUENTIAL);
+    } else {
+        fseek(table->data_file, RECORD_FILE_HEADER_SIZE, SEEK_SET);
     }
-    // Initialize fields to safe values before potential errors
-    table->name = NULL;
-    table->columns = NULL;
-    table->primary_index = NULL;
-    table->data_file = NULL;
+}
 
-    table->name = strdup(table_name);
-    if (!table->name) {
-        perror("Failed to duplicate table name");
-        free(table);
-        return NULL;
+/**
+ * @brief Advances a scan to the next record.
+ * @param scan The scan.
+ * @param record Output: the record, valid until the next call.
+ * @return The record length, 0 at the end of the file, or -1 if the rest of
+ * the file is not a complete record. scan->offset stays at the start of an
+ * incomplete record.
+ */
+static long scan_next(RecordScan *scan, const unsigned char **record) {
+    Table *table = scan->table;
+    long length;
+    if (table->data_map) {
+        if (scan->offset >= table->data_size) return 0;
+        size_t available = table->data_size - scan->offset, record_len;
+        if (record_header(table->data_map + scan->offset, available, &record_len) == 0 || record_len > available) {
+            return -1;
+        }
+        *record = table->data_map + scan->offset;
+        length = (long)record_len;
+    } else {
+        length = read_next_record(table->data_file, &scan->buffer, &scan->capacity);
+        if (length <= 0) return length;
+        *record = scan->buffer;
     }
+    scan->offset += length;
+    metrics_count(table->metrics.bytes_read, (uint64_t)length);
+    return length;
+}
 
-    // Allocate and copy column names provided by the caller
-    table->columns = (char **)malloc(column_count * sizeof(char *));
-    if (!table->columns) {
-        perror("Failed to allocate memory for column names array");
-        free(table->name);
-        free(table);
-        return NULL;
+static void scan_end(RecordScan *scan) {
+    free(scan->buffer);
+    if (scan->table->data_map) {
+        madvise(scan->table->data_map, scan->table->data_map_length, MADV_RANDOM);
     }
-    // Initialize column pointers before strdup loop
-    for(int i=0; i<column_count; ++i) table->columns[i] = NULL;
+}
 
-    for (int i = 0; i < column_count; i++) {
-        if (!columns[i] || strlen(columns[i]) == 0) {
-             fprintf(stderr, "Error: Invalid column name provided at index %d.\n", i);
-             // Cleanup previously allocated names
-             for (int j = 0; j < i; j++) free(table->columns[j]);
-             free(table->columns);
-             free(table->name);
-             free(table);
-             return NULL;
+// A live record found while rebuilding an index
+typedef struct {
+    int primary_key;
+    long file_offset;
+} IndexEntry;
+
+static int compare_index_entries(const void *a, const void *b) {
+    const IndexEntry *x = (const IndexEntry *)a, *y = (const IndexEntry *)b;
+    if (x->primary_key != y->primary_key) return x->primary_key < y->primary_key ? -1 : 1;
+    return (x->file_offset > y->file_offset) - (x->file_offset < y->file_offset);
+}
+
+/**
+ * @brief Rebuilds a table's primary index by scanning its data file once.
+ * Only needed when the .idx file is missing or out of step with the .dat file;
+ * a normal start just opens the index. The live records are gathered and
+ * sorted, and the index is built bottom-up from them (bulk_load_tree), so each
+ * page is written once. An incomplete record at the end of the file (an append
+ * cut short by a crash) is truncated away. Also counts the table's dead bytes,
+ * since the scan sees every deleted record.
+ * @param table Pointer to the table (data_file must be open, data_size current).
+ * @return Number of live rows indexed, or -1 on failure.
+ */
+static int rebuild_index(Table *table) {
+    clear_tree(table->primary_index);
+
+    RecordScan scan;
+    const unsigned char *record;
+    long record_len;
+    long offset = RECORD_FILE_HEADER_SIZE;
+    long dead_bytes = 0;
+    IndexEntry *entries = NULL;
+    size_t entry_count = 0, entry_capacity = 0;
+    int out_of_memory = 0;
+    scan_begin(&scan, table);
+    while ((record_len = scan_next(&scan, &record)) > 0) {
+        int primary_key;
+        if (record_is_deleted(record)) {
+            dead_bytes += record_len;
+        } else if (record_primary_key(table->column_types, table->column_count, record, record_len, &primary_key) == 0) {
+            if (entry_count == entry_capacity) {
+                size_t capacity = entry_capacity ? entry_capacity * 2 : 1024;
+                IndexEntry *grown = realloc(entries, capacity * sizeof(IndexEntry));
+                if (!grown) {
+                    out_of_memory = 1;
+                    break;
+                }
+                entries = grown;
+                entry_capacity = capacity;
+            }
+            entries[entry_count].primary_key = primary_key;
+            entries[entry_count].file_offset = offset;
+            entry_count++;
         }
-        table->columns[i] = strdup(columns[i]);
-        if (!table->columns[i]) {
-            perror("Failed to duplicate column name");
-            // Cleanup previously allocated names
-            for (int j = 0; j < i; j++) free(table->columns[j]);
-            free(table->columns);
-            free(table->name);
-            free(table);
-            return NULL;
+        offset += record_len;
+    }
+    scan_end(&scan);
+
+    if (out_of_memory) {
+        perror("Failed to allocate index rebuild");
+        free(entries);
+        return -1;
+    }
+    if (ferror(table->data_file)) {
+        perror("Failed to read data file while rebuilding index");
+        clearerr(table->data_file);
+        free(entries);
+        return -1;
+    }
+    if (record_len < 0) {
+        fprintf(stderr, "Warning: Dropping incomplete record at offset %ld of table '%s'.\n", offset, table->name);
+        fflush(table->data_file);
+        if (ftruncate(table->data_fd, offset) != 0) {
+            perror("Failed to truncate incomplete record");
+            free(entries);
+            return -1;
         }
     }
-    table->column_count = column_count;
 
-    // Initialize the B+ Tree index
-    table->primary_index = initialize_tree();
-    if (!table->primary_index) {
-        fprintf(stderr, "Error: Failed to initialize B+ Tree index for table '%s'\n", table_name);
-        // Cleanup allocated resources
-        for (int i = 0; i < column_count; i++) free(table->columns[i]);
-        free(table->columns);
-        free(table->name);
-        free(table);
-        return NULL;
+    // Keep the last copy if a key appears more than once
+    qsort(entries, entry_count, sizeof(IndexEntry), compare_index_entries);
+    int *keys = malloc((entry_count ? entry_count : 1) * sizeof(int));
+    long *file_offsets = malloc((entry_count ? entry_count : 1) * sizeof(long));
+    int rows = 0;
+    if (keys && file_offsets) {
+        for (size_t i = 0; i < entry_count; i++) {
+            if (i + 1 < entry_count && entries[i + 1].primary_key == entries[i].primary_key) continue;
+            keys[rows] = entries[i].primary_key;
+            file_offsets[rows] = entries[i].file_offset;
+            rows++;
+        }
     }
+    free(entries);
+    int loaded = keys && file_offsets && bulk_load_tree(table->primary_index, keys, file_offsets, rows) == 0;
+    if (!keys || !file_offsets) perror("Failed to allocate index rebuild");
+    free(keys);
+    free(file_offsets);
+    if (!loaded) return -1;
 
-    // Convert table name to lowercase for file creation
-    char lowercase_name[FILENAME_BUF_SIZE];
-    strncpy(lowercase_name, table_name, FILENAME_BUF_SIZE - 1);
-    lowercase_name[FILENAME_BUF_SIZE - 1] = '\0';
-    
-    for (int i = 0; lowercase_name[i]; i++) {
-        lowercase_name[i] = tolower(lowercase_name[i]);
+    table->data_size = offset;
+    table->row_count = rows;
+    table->dead_bytes = dead_bytes;
+    table->dead_bytes_known = 1;
+    if (sync_tree(table->primary_index, table->data_size) != 0) return -1;
+    return rows;
+}
+
+/**
+ * @brief Counts a table's live rows by walking its primary index.
+ * @param table Pointer to the table.
+ * @return Number of keys in the index.
+ */
+static long count_index_rows(Table *table) {
+    BPlusTreeIterator it = bpt_iter_seek(table->primary_index, INT_MIN);
+    int primary_key;
+    long file_offset;
+    long rows = 0;
+    while (bpt_iter_next(&it, &primary_key, &file_offset)) rows++;
+    return rows;
+}
+
+/**
+ * @brief Splits one line of a legacy text data file (" a|b|c") into values.
+ * @param line The line without its newline; modified in place.
+ * @param values Output: column_count pointers into line.
+ * @return 0 on success, -1 if the line does not have column_count fields.
+ */
+static int split_text_row(char *line, char **values, int column_count) {
+    int count = 0;
+    char *field = line + 1; // Skip the marker
+    while (count < column_count) {
+        values[count++] = field;
+        char *delimiter = strchr(field, '|');
+        if (!delimiter) break;
+        *delimiter = '\0';
+        field = delimiter + 1;
     }
+    return count == column_count && !strchr(field, '|') ? 0 : -1;
+}
 
-    // Create directory path for the resource if it doesn't exist
-    char resource_dir[FILENAME_BUF_SIZE];
-    char scaffolded_path[FILENAME_BUF_SIZE];
-    
-    // Combine project root with scaffolded_resources path
-    if (join_project_path(scaffolded_path, sizeof(scaffolded_path), "scaffolded_resources") != 0) {
-        fprintf(stderr, "Error creating path to scaffolded_resources\n");
-        return NULL;
+/**
+ * @brief Converts a data file in the old pipe-delimited text format to the
+ * binary record format. Deleted rows are dropped. The original file is kept
+ * next to the new one as <table>.dat.txt.
+ * @param table Pointer to the table (data_file open on the text file).
+ * @param filename Path of the data file.
+ * @return 0 on success, -1 on failure (the text file is left in place).
+ */
+static int convert_text_data_file(Table *table, const char *filename) {
+    char temp_filename[FILENAME_BUF_SIZE];
+    char backup_filename[FILENAME_BUF_SIZE];
+    if (table_file_path(table->name, ".dat.tmp", temp_filename, sizeof(temp_filename)) != 0 ||
+        table_file_path(table->name, ".dat.txt", backup_filename, sizeof(backup_filename)) != 0) {
+        return -1;
     }
-    
-    // Create the full resource directory path
-    snprintf(resource_dir, sizeof(resource_dir), "%s/%s", scaffolded_path, lowercase_name);
-    
-    // Create the directory (mkdir -p equivalent)
-    char mkdir_cmd[FILENAME_BUF_SIZE * 2];
-    snprintf(mkdir_cmd, sizeof(mkdir_cmd), "mkdir -p %s", resource_dir);
-    system(mkdir_cmd);
 
-    // Construct data filename and open/create the file
-    char filename[FILENAME_BUF_SIZE];
-    snprintf(filename, sizeof(filename), "%s/%s.dat", resource_dir, lowercase_name);
+    FILE *converted = fopen(temp_filename, "wb");
+    if (!converted) {
+        perror("Failed to create converted data file");
+        return -1;
+    }
+    unsigned char file_header[RECORD_FILE_HEADER_SIZE];
+    record_file_header(file_header, table->column_types, table->column_count);
+    int failed = fwrite(file_header, 1, sizeof(file_header), converted) != sizeof(file_header);
 
-    // Open in "a+b" (append + binary) first. This creates the file if it doesn't exist.
-    FILE* temp_fp = fopen(filename, "a+b");
-    if (!temp_fp) {
-         perror("Failed to create/open data file initially");
-         destroy_tree(table->primary_index); // Cleanup index
-         for (int i = 0; i < column_count; i++) free(table->columns[i]);
-         free(table->columns);
-         free(table->name);
-         free(table);
-         return NULL;
+    char **values = malloc(table->column_count * sizeof(char *));
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t line_length;
+    int rows = 0, skipped = 0;
+    rewind(table->data_file);
+    while (!failed && values && (line_length = getline(&line, &line_capacity, table->data_file)) > 0) {
+        if (line[line_length - 1] == '\n') line[--line_length] = '\0';
+        if (line[0] != ' ') continue; // Deleted rows (DELETED_MARKER) are not carried over
+
+        int bad_column = 0;
+        long record_len = -1;
+        if (split_text_row(line, values, table->column_count) == 0) {
+            record_len = record_encode(table->column_types, table->column_count, values, 0,
+                                       &table->record_buffer, &table->record_capacity, &bad_column);
+        }
+        if (record_len < 0) {
+            skipped++;
+            continue;
+        }
+        failed = fwrite(table->record_buffer, 1, record_len, converted) != (size_t)record_len;
+        rows++;
     }
-    fclose(temp_fp); // Close it immediately
+    free(line);
+    free(values);
+    if (!values || ferror(table->data_file) || fflush(converted) != 0) failed = 1;
+    fclose(converted);
 
-    // Now open in "r+b" (read/update binary) mode for actual operations.
-    table->data_file = fopen(filename, "r+b");
-    if (!table->data_file) {
-        perror("Failed to open data file for read/update");
-        // Attempt to remove the file we might have just created? Risky.
-        // remove(filename);
-        destroy_tree(table->primary_index);
-        for (int i = 0; i < column_count; i++) free(table->columns[i]);
-        free(table->columns);
-        free(table->name);
-        free(table);
-        return NULL;
+    if (failed) {
+        perror("Failed to convert data file");
+        remove(temp_filename);
+        return -1;
+    }
+    if (rename(filename, backup_filename) != 0 || rename(temp_filename, filename) != 0) {
+        perror("Failed to replace data file with its converted copy");
+        return -1;
     }
 
-    // Initialize the mutex for thread safety
-    if (pthread_mutex_init(&table->lock, NULL) != 0) {
-        perror("Mutex initialization failed");
-        fclose(table->data_file);
-        destroy_tree(table->primary_index);
-        for (int i = 0; i < column_count; i++) free(table->columns[i]);
-        free(table->columns);
-        free(table->name);
-        free(table);
-        return NULL;
+    // Continue on the converted file
+    FILE *reopened = fopen(filename, "r+b");
+    if (!reopened) {
+        perror("Failed to reopen converted data file");
+        return -1;
     }
+    fclose(table->data_file);
+    table->data_file = reopened;
+    table->data_fd = fileno(reopened);
 
-    // Add the newly created table to the database's list
-    db->tables[db->table_count++] = table;
-    printf("Table '%s' created successfully in database '%s'.\n", table_name, db->name);
-    return table;
+    printf("Converted data file of table '%s' to the binary row format (%d rows", table->name, rows);
+    if (skipped > 0) printf(", %d unreadable rows skipped", skipped);
+    printf("); the text file is kept as %s.\n", backup_filename);
+    return 0;
 }
 
 /**
- * @brief Destroys a Table structure and frees its resources.
- * Closes the data file, destroys the index, frees column names, name, and the struct itself.
- * @param table Pointer to the Table to destroy.
+ * @brief Checks the header of a table's data file, writing it to a new file
+ * and converting a legacy text file.
+ * @param table Pointer to the table (data_file open).
+ * @param filename Path of the data file.
+ * @return 1 if the file was converted (so the index must be rebuilt), 0 if it
+ * is ready as is, -1 if it can't be used.
  */
-void destroy_table(Table *table) {
-     if (!table) return;
-     printf("Destroying table '%s'...\n", table->name);
+static int prepare_data_file(Table *table, const char *filename) {
+    unsigned char header[RECORD_FILE_HEADER_SIZE];
+    ssize_t got = pread(table->data_fd, header, sizeof(header), 0);
+    if (got < 0) {
+        perror("Failed to read data file header");
+        return -1;
+    }
+    if (got == 0) {
+        record_file_header(header, table->column_types, table->column_count);
+        if (fwrite(header, 1, sizeof(header), table->data_file) != sizeof(header) || fflush(table->data_file) != 0) {
+            perror("Failed to write data file header");
+            return -1;
+        }
+        return 0;
+    }
 
-     // Best practice: Lock before destroying, although if called correctly,
-     // no other thread should be using it.
-     // pthread_mutex_lock(&table->lock); // Optional lock
+    switch (record_check_file_header(header, got, table->column_types, table->column_count)) {
+    case 0:
+        return 0;
+    case 1:
+        // Version 1 records are version 2 records without previous versions
+        record_file_header(header, table->column_types, table->column_count);
+        if (pwrite(table->data_fd, header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+            perror("Failed to upgrade data file header");
+            return -1;
+        }
+        printf("Note: Upgraded data file of table '%s' to record format version %d.\n", table->name, RECORD_FORMAT_VERSION);
+        return 0;
+    case -2:
+        fprintf(stderr, "Error: Data file of table '%s' was written with different columns or column types.\n", table->name);
+        return -1;
+    default:
+        return convert_text_data_file(table, filename) == 0 ? 1 : -1;
+    }
+}
 
-     // Destroy mutex *after* ensuring no operations are pending
-     pthread_mutex_destroy(&table->lock);
+/**
+ * @brief Writes the index pages changed by the last row operation, recording
+ * the data file size they correspond to. Call with the table locked.
+ * @param table Pointer to the table.
+ */
+static void sync_index(Table *table) {
+    if (sync_tree(table->primary_index, table->data_size) != 0) {
+        fprintf(stderr, "Warning: Failed to write index for table '%s'; it will be rebuilt on the next start.\n", table->name);
+    }
+}
 
-     // Close the data file
-     if (table->data_file) {
-         fclose(table->data_file);
-         table->data_file = NULL;
-         // Optionally remove the .dat file from disk
-         // char filename[FILENAME_BUF_SIZE];
-         // snprintf(filename, sizeof(filename), "%s.dat", table->name);
-         // remove(filename); // Uncomment to delete file on table destroy
-     }
+// --- Write-Ahead Log ---
+// Every row operation logs the bytes it is about to write to the data file,
+// under the table's write lock, and waits for the log's group fsync (in
+// commit durability) only after unlocking, so writers to every table share
+// the same fsync. Data and index files are fsynced only at checkpoints, when
+// the log is emptied.
 
-     // Destroy the B+ Tree index
-     if (table->primary_index) {
-         destroy_tree(table->primary_index);
-         table->primary_index = NULL;
-     }
+/**
+ * @brief Builds the path of one of the database's own files, e.g. its
+ * write-ahead log scaffolded_resources/<db>.wal, creating the directory.
+ * @param db Pointer to the database.
+ * @param extension File extension including the dot (".wal", ".catalog").
+ * @param out Buffer receiving the path.
+ * @param out_size Size of out.
+ * @return 0 on success, -1 if the path could not be built.
+ */
+static int database_file_path(Database *db, const char *extension, char *out, size_t out_size) {
+    char scaffolded_path[FILENAME_BUF_SIZE];
+    if (join_project_path(scaffolded_path, sizeof(scaffolded_path), "scaffolded_resources") != 0) return -1;
+    if (make_directories(scaffolded_path, 0755) != 0) {
+        perror("Failed to create scaffolded_resources directory");
+        return -1;
+    }
+    snprintf(out, out_size, "%s/%s%s", scaffolded_path, db->name, extension);
+    return 0;
+}
 
-     // Free column names
-     if (table->columns) {
-         for (int i = 0; i < table->column_count; i++) {
-             free(table->columns[i]);
-         }
-         free(table->columns);
-         table->columns = NULL;
-     }
+/**
+ * @brief Fsyncs a directory so renames and new files in it survive a crash.
+ * @param path Path of the directory.
+ * @return 0 on success, -1 on failure.
+ */
+static int sync_directory(const char *path) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY);
+    if (fd < 0 || fsync(fd) != 0) {
+        perror("Failed to sync directory");
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
 
-     // Free table name
-     free(table->name);
-     table->name = NULL;
+/**
+ * @brief Makes a table's data file, index file and directory entries durable.
+ * Call with the table write-locked.
+ * @param table Pointer to the table.
+ * @return 0 on success, -1 on an I/O error.
+ */
+static int make_table_durable(Table *table) {
+    if (fflush(table->data_file) != 0 || fdatasync(table->data_fd) != 0) {
+        perror("Failed to sync data file");
+        return -1;
+    }
+    if (table->primary_index->fd >= 0 && fdatasync(table->primary_index->fd) != 0) {
+        perror("Failed to sync index file");
+        return -1;
+    }
+    char resource_dir[FILENAME_BUF_SIZE];
+    if (table_resource_dir(table->name, resource_dir, sizeof(resource_dir)) != 0) return -1;
+    return sync_directory(resource_dir);
+}
 
-     // Free the table structure itself
-     free(table);
- }
+// --- Catalog Snapshot ---
+// At every checkpoint and on shutdown, with the tables locked and their files
+// synced, the catalog (each table's columns, data size, index root and row
+// and dead byte counts) is written to scaffolded_resources/<db>.catalog.
+// A table opened with its index exactly as recorded takes its counts from
+// there instead of counting them. A delete leaves the data size and index
+// shape as they were, so a snapshot can't be checked against the files: it is
+// removed once read at startup, and removed durably by the first write after
+// each checkpoint, before that write reaches any file. A snapshot on disk
+// therefore always describes the files as they are.
+
+#define CATALOG_VERSION 1
 
 /**
- * @brief Destroys a Database structure and all its tables.
- * @param db Pointer to the Database to destroy.
+ * @brief Reads the catalog snapshot left by the last checkpoint or shutdown
+ * into db->catalog, then removes it. A missing or unreadable snapshot only
+ * means counts are taken from the tables when they open.
+ * @param db Pointer to the database.
  */
-void destroy_database(Database *db) {
-    if (!db) return;
-    printf("Destroying database '%s'...\n", db->name);
-    // Iterate through the table pointers and destroy each table
-    for (int i = 0; i < db->table_count; i++) {
-        if (db->tables[i]) {
-            destroy_table(db->tables[i]);
-            db->tables[i] = NULL; // Clear the pointer in the array
+static void read_catalog(Database *db) {
+    char path[FILENAME_BUF_SIZE];
+    if (database_file_path(db, ".catalog", path, sizeof(path)) != 0) return;
+    FILE *file = fopen(path, "r");
+    if (!file) return;
+
+    int version = 0;
+    db->catalog = calloc(MAX_TABLES, sizeof(CatalogEntry));
+    if (!db->catalog) {
+        perror("Failed to allocate catalog");
+    } else if (fscanf(file, "cerver-catalog %d\n", &version) != 1 || version != CATALOG_VERSION) {
+        fprintf(stderr, "Warning: Ignoring catalog snapshot '%s' in an unknown format.\n", path);
+    } else {
+        char line[FILENAME_BUF_SIZE * 2];
+        char name[FILENAME_BUF_SIZE];
+        while (db->catalog_count < MAX_TABLES && fgets(line, sizeof(line), file)) {
+            CatalogEntry *entry = &db->catalog[db->catalog_count];
+            unsigned int root, pages;
+            // %255s: FILENAME_BUF_SIZE - 1
+            if (sscanf(line, "table %255s %d %ld %ld %ld %u %u", name, &entry->column_count, &entry->data_size,
+                       &entry->row_count, &entry->dead_bytes, &root, &pages) != 7) {
+                continue;
+            }
+            entry->name = strdup(name);
+            if (!entry->name) break;
+            entry->index_root = root;
+            entry->index_pages = pages;
+            db->catalog_count++;
         }
     }
-    // Free the database name
-    free(db->name);
-    db->name = NULL;
-    // Free the database structure itself
-    free(db);
+    fclose(file);
+
+    // Writes from now on are not in it; the next checkpoint or shutdown writes it again
+    // (no write has been made yet, so there is nothing for invalidate_catalog to race)
+    char directory[FILENAME_BUF_SIZE];
+    if (remove(path) != 0) perror("Failed to remove catalog snapshot");
+    else if (join_project_path(directory, sizeof(directory), "scaffolded_resources") == 0) sync_directory(directory);
 }
 
+/**
+ * @brief Removes the catalog snapshot written by the last checkpoint, if this
+ * is the first write since, and waits until the removal is durable. Call with
+ * the table write-locked, before the write touches its data or index file.
+ * @param db Pointer to the database (NULL for a table outside one).
+ */
+static void invalidate_catalog(Database *db) {
+    if (!db || !__atomic_load_n(&db->catalog_on_disk, __ATOMIC_ACQUIRE)) return;
+    pthread_mutex_lock(&db->catalog_lock);
+    if (db->catalog_on_disk) {
+        char path[FILENAME_BUF_SIZE], directory[FILENAME_BUF_SIZE];
+        if (database_file_path(db, ".catalog", path, sizeof(path)) != 0 ||
+            join_project_path(directory, sizeof(directory), "scaffolded_resources") != 0 ||
+            (remove(path) != 0 && errno != ENOENT) || sync_directory(directory) != 0) {
+            // Left set, so the next write tries again
+            perror("Failed to remove catalog snapshot");
+        } else {
+            // Cleared only once removed: a write on another table that sees it clear may go ahead
+            __atomic_store_n(&db->catalog_on_disk, 0, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&db->catalog_lock);
+}
 
-// --- Row Operations ---
+/**
+ * @brief Looks up a table in the catalog snapshot read at startup.
+ * @param db Pointer to the database.
+ * @param table_name Name of the table (a shard's own name for a shard).
+ * @return The entry, or NULL if the snapshot has none for the table.
+ */
+static CatalogEntry *find_catalog_entry(Database *db, const char *table_name) {
+    for (int i = 0; i < db->catalog_count; i++) {
+        if (strcmp(db->catalog[i].name, table_name) == 0) return &db->catalog[i];
+    }
+    return NULL;
+}
 
 /**
- * @brief Inserts a new row into the table. Appends to file, adds to index.
+ * @brief Writes the catalog snapshot, replacing the previous one atomically.
+ * Call with every table write-locked and its files durable (make_table_durable).
+ * @param db Pointer to the database.
+ * @return 0 on success, -1 on an I/O error (the tables then count their rows on the next start).
+ */
+static int write_catalog(Database *db) {
+    char path[FILENAME_BUF_SIZE], temp_path[FILENAME_BUF_SIZE + 8], directory[FILENAME_BUF_SIZE];
+    if (database_file_path(db, ".catalog", path, sizeof(path)) != 0 ||
+        join_project_path(directory, sizeof(directory), "scaffolded_resources") != 0) {
+        return -1;
+    }
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE *file = fopen(temp_path, "w");
+    if (!file) {
+        perror("Failed to create catalog snapshot");
+        return -1;
+    }
+
+    fprintf(file, "cerver-catalog %d\n", CATALOG_VERSION);
+    for (int i = 0; i < db->table_count; i++) {
+        Table *table = db->tables[i];
+        if (table->shards) continue; // Partitioned tables have no files; their shards are listed
+        BPlusTree *index = table->primary_index;
+        fprintf(file, "table %s %d %ld %ld %ld %u %u\n", table->name, table->column_count, table->data_size,
+                table->row_count, table->dead_bytes_known ? table->dead_bytes : -1L,
+                index->root ? (unsigned int)index->root->page_id : 0U, (unsigned int)index->page_count);
+    }
+    // Tables this run has not opened can't have changed, so they keep their entries
+    for (int i = 0; i < db->catalog_count; i++) {
+        CatalogEntry *entry = &db->catalog[i];
+        int open = 0;
+        for (int t = 0; t < db->table_count && !open; t++) open = strcmp(db->tables[t]->name, entry->name) == 0;
+        if (open) continue;
+        fprintf(file, "table %s %d %ld %ld %ld %u %u\n", entry->name, entry->column_count, entry->data_size,
+                entry->row_count, entry->dead_bytes, (unsigned int)entry->index_root, (unsigned int)entry->index_pages);
+    }
+
+    int written = !ferror(file) && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    if (fclose(file) != 0 || !written || rename(temp_path, path) != 0) {
+        perror("Failed to write catalog snapshot");
+        remove(temp_path);
+        return -1;
+    }
+    return sync_directory(directory);
+}
+
+/**
+ * @brief Takes a newly opened table's row and dead byte counts from the
+ * catalog snapshot, if its entry matches the table's data file and index.
+ * @param table Pointer to the table (index open, data_size current).
+ * @return 0 if the counts were restored, -1 if they have to be counted.
+ */
+static int restore_table_counts(Table *table) {
+    CatalogEntry *entry = find_catalog_entry(table->database, table->name);
+    BPlusTree *index = table->primary_index;
+    if (!entry || entry->column_count != table->column_count || entry->data_size != table->data_size ||
+        !index->root || entry->index_root != index->root->page_id || entry->index_pages != index->page_count ||
+        entry->row_count < 0) {
+        return -1;
+    }
+    table->row_count = entry->row_count;
+    if (entry->dead_bytes >= 0) {
+        table->dead_bytes = entry->dead_bytes;
+        table->dead_bytes_known = 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Checkpoints the database: with every table write-locked (so no write
+ * is half made), fsyncs all data and index files, after which no logged record
+ * is needed and the log (if any) is emptied, and writes the catalog snapshot.
+ * @param db Pointer to the database.
+ * @param wait 1 to wait for a checkpoint already running, 0 to leave it to that one.
+ */
+static void checkpoint_database(Database *db, int wait) {
+    if (wait) pthread_mutex_lock(&db->checkpoint_lock);
+    else if (pthread_mutex_trylock(&db->checkpoint_lock) != 0) return;
+
+    // Elsewhere tables are locked one at a time, or a partitioned table's shards
+    // in order (as they are in db->tables), so taking them all in order can't
+    // deadlock. Partitioned tables have nothing to sync; their shards do.
+    for (int i = 0; i < db->table_count; i++) {
+        if (!db->tables[i]->shards) lock_table_write(db->tables[i]);
+    }
+    int status = 0;
+    for (int i = 0; i < db->table_count && status == 0; i++) {
+        if (!db->tables[i]->shards) status = make_table_durable(db->tables[i]);
+    }
+    if (status == 0) {
+        // Set even if writing failed, since a renamed file may still be there. No writer
+        // is between invalidate_catalog and its write while every table is locked.
+        write_catalog(db);
+        __atomic_store_n(&db->catalog_on_disk, 1, __ATOMIC_RELEASE);
+        if (db->wal) wal_reset(db->wal);
+    } else {
+        fprintf(stderr, "Warning: Checkpoint of database '%s' failed; its write-ahead log is kept.\n", db->name);
+    }
+    for (int i = db->table_count - 1; i >= 0; i--) {
+        if (!db->tables[i]->shards) pthread_rwlock_unlock(&db->tables[i]->lock);
+    }
+    pthread_mutex_unlock(&db->checkpoint_lock);
+}
+
+/**
+ * @brief Logs the writes a row operation is about to make to the data file.
+ * Call with the table write-locked, before making them.
  * @param table Pointer to the table.
- * @param primary_key The integer primary key for the new row.
- * @param values Array of strings representing the values for each column.
- * @return The file offset of the newly inserted row, or -1 on failure.
+ * @param writes The writes, as offsets and bytes of the data file.
+ * @param count Number of writes.
+ * @return Log position to pass to finish_write, 0 when there is no log, -1 on failure.
  */
-long insert_row(Table *table, int primary_key, char **values) {
-    if (!table || !table->data_file || !table->primary_index || !values) {
-        fprintf(stderr, "Error: Invalid arguments for insert_row.\n");
+static int64_t log_writes(Table *table, const WalWrite *writes, int count) {
+    Wal *wal = table->database ? table->database->wal : NULL;
+    if (!wal) return 0;
+    uint64_t lsn = wal_append(wal, WAL_RECORD_WRITE, table->name, writes, count);
+    if (lsn == 0) {
+        fprintf(stderr, "Error: Could not log write to table '%s'.\n", table->name);
         return -1;
     }
-    long current_offset = -1;
-    long result_offset = -1;
+    return (int64_t)lsn;
+}
 
-    pthread_mutex_lock(&table->lock); // Lock the table for thread safety
+/**
+ * @brief Waits, in commit durability, for the fsync covering a logged row
+ * operation, and checkpoints the log once it is large. Call after unlocking
+ * the table.
+ * @param table Pointer to the table.
+ * @param lsn Value returned by log_writes.
+ * @return 0 on success, -1 if the write could not be made durable.
+ */
+static int finish_write(Table *table, int64_t lsn) {
+    Database *db = table->database;
+    if (!db || !db->wal || lsn <= 0) return 0;
+    int status = 0;
+    if (db->durability == WAL_DURABILITY_COMMIT && wal_commit(db->wal, (uint64_t)lsn) != 0) {
+        fprintf(stderr, "Error: Write to table '%s' could not be made durable.\n", table->name);
+        status = -1;
+    }
+    if (wal_size(db->wal) > WAL_CHECKPOINT_SIZE) checkpoint_database(db, 0);
+    return status;
+}
 
-    // 1. Check if primary key already exists using the index
-    if (search_key(table->primary_index, primary_key) != -1) {
-        fprintf(stderr, "Error: Primary key %d already exists in table '%s'. Insertion aborted.\n", primary_key, table->name);
-        pthread_mutex_unlock(&table->lock);
+/**
+ * @brief Before a table's data file is rewritten in a way that moves rows
+ * (compaction, truncation), makes the file durable and logs that the records
+ * logged for it so far must not be replayed. Call with the table write-locked,
+ * and make the rewritten file durable (make_table_durable) before unlocking.
+ * @param table Pointer to the table.
+ * @return 0 on success (or when there is no log), -1 on failure.
+ */
+static int log_table_rewrite(Table *table) {
+    Wal *wal = table->database ? table->database->wal : NULL;
+    if (!wal) return 0;
+    if (make_table_durable(table) != 0) return -1;
+    uint64_t lsn = wal_append(wal, WAL_RECORD_TABLE_SYNCED, table->name, NULL, 0);
+    if (lsn == 0 || wal_commit(wal, lsn) != 0) {
+        fprintf(stderr, "Error: Could not log rewrite of table '%s'.\n", table->name);
         return -1;
     }
+    return 0;
+}
+
+// A table's log records being replayed by open_database_log
+typedef struct {
+    char name[WAL_MAX_TABLE_NAME + 1];
+    int last_synced;            // Position of its last WAL_RECORD_TABLE_SYNCED, -1 if none
+    int fd;                     // Its data file, opened on the first replayed write (-1: not yet, -2: missing)
+    int writes;                 // Writes replayed
+} RecoveredTable;
+
+typedef struct {
+    RecoveredTable tables[MAX_TABLES];
+    int count;
+    int failed;
+} LogRecovery;
+
+/**
+ * @brief Finds (or adds) a table of a recovery by name.
+ * @return The table, or NULL if MAX_TABLES tables are already tracked.
+ */
+static RecoveredTable *recovered_table(LogRecovery *recovery, const char *name) {
+    for (int i = 0; i < recovery->count; i++) {
+        if (strcmp(recovery->tables[i].name, name) == 0) return &recovery->tables[i];
+    }
+    if (recovery->count == MAX_TABLES) return NULL;
+    RecoveredTable *table = &recovery->tables[recovery->count++];
+    snprintf(table->name, sizeof(table->name), "%s", name);
+    table->last_synced = -1;
+    table->fd = -1;
+    table->writes = 0;
+    return table;
+}
+
+// wal_replay callback, first pass: find where each table's replay starts
+static int note_table_synced(void *context, int position, const WalEntry *entry) {
+    LogRecovery *recovery = context;
+    RecoveredTable *table = recovered_table(recovery, entry->table);
+    if (!table) {
+        recovery->failed = 1;
+        return 1;
+    }
+    if (entry->type == WAL_RECORD_TABLE_SYNCED) table->last_synced = position;
+    return 0;
+}
+
+// wal_replay callback, second pass: write a record into its data file
+static int replay_entry(void *context, int position, const WalEntry *entry) {
+    LogRecovery *recovery = context;
+    RecoveredTable *table = recovered_table(recovery, entry->table);
+    if (!table || entry->type != WAL_RECORD_WRITE || position < table->last_synced) return 0;
+
+    if (table->fd == -1) {
+        char filename[FILENAME_BUF_SIZE];
+        table->fd = -2;
+        if (table_file_path(table->name, ".dat", filename, sizeof(filename)) == 0) {
+            int fd = open(filename, O_RDWR);
+            if (fd >= 0) table->fd = fd;
+            else if (errno != ENOENT) perror("Failed to open data file for log recovery");
+        }
+        if (table->fd == -2) {
+            fprintf(stderr, "Warning: Skipping logged writes to table '%s', which has no data file.\n", table->name);
+        }
+    }
+    if (table->fd < 0) return 0;
+
+    for (int i = 0; i < entry->write_count; i++) {
+        const WalWrite *write = &entry->writes[i];
+        if (pwrite(table->fd, write->data, write->length, write->offset) != (ssize_t)write->length) {
+            perror("Failed to replay logged write");
+            recovery->failed = 1;
+            return 1;
+        }
+        table->writes++;
+    }
+    return 0;
+}
 
-    // 2. Seek to the end of the data file to append the new row
-    if (fseek(table->data_file, 0, SEEK_END) != 0) {
-        perror("Failed to seek to end of file for insert");
-        pthread_mutex_unlock(&table->lock);
+/**
+ * @brief Replays the log left by the last run into the data files and starts
+ * a new one.
+ * @param db Pointer to the database (no tables created yet).
+ * @param durability Durability of writes from now on.
+ * @param flush_interval_us Longest a batched write waits for its fsync.
+ * @return 0 on success, -1 on failure.
+ */
+int open_database_log(Database *db, WalDurability durability, int flush_interval_us) {
+    if (!db || db->wal || db->table_count > 0) {
+        fprintf(stderr, "Error: open_database_log must be called once, before tables are created.\n");
+        return -1;
+    }
+    char path[FILENAME_BUF_SIZE];
+    if (database_file_path(db, ".wal", path, sizeof(path)) != 0) {
+        fprintf(stderr, "Error: Could not build the write-ahead log path.\n");
         return -1;
     }
 
-    // 3. Get the current file offset *before* writing the new row
-    // This offset will be stored in the index.
-    current_offset = ftell(table->data_file);
-    if (current_offset == -1) {
-        perror("Failed to get current file offset before insert");
-        pthread_mutex_unlock(&table->lock);
+    // Replay in two passes: a table's records before its last sync marker are obsolete
+    LogRecovery *recovery = calloc(1, sizeof(LogRecovery));
+    if (!recovery) {
+        perror("Failed to allocate log recovery");
         return -1;
     }
+    int records = wal_replay(path, note_table_synced, recovery);
+    if (records > 0 && !recovery->failed) wal_replay(path, replay_entry, recovery);
 
-    // 4. Write the row data to the file
-    // Prepend with a space ' ' (not DELETED_MARKER) to indicate a valid row.
-    // Use '|' as delimiter and '\n' at the end.
-    if (fprintf(table->data_file, " ") < 1) { // Write the valid marker
-         perror("Failed to write row marker");
-         pthread_mutex_unlock(&table->lock);
-         return -1;
+    int status = (records < 0 || recovery->failed) ? -1 : 0;
+    for (int i = 0; i < recovery->count; i++) {
+        RecoveredTable *table = &recovery->tables[i];
+        if (table->fd < 0) continue;
+        if (fdatasync(table->fd) != 0) {
+            perror("Failed to sync recovered data file");
+            status = -1;
+        }
+        close(table->fd);
+        if (status == 0 && table->writes > 0) {
+            // The index may not match the recovered rows; it is rebuilt when the table opens
+            char index_filename[FILENAME_BUF_SIZE];
+            if (table_file_path(table->name, ".idx", index_filename, sizeof(index_filename)) == 0) remove(index_filename);
+            printf("Recovered %d logged writes to table '%s'.\n", table->writes, table->name);
+        }
     }
-    for (int i = 0; i < table->column_count; i++) {
-        // Basic sanitization: replace delimiters within values to prevent parsing errors
-        char sanitized_value[MAX_ROW_LEN]; // Use a buffer for sanitization
-        strncpy(sanitized_value, values[i] ? values[i] : "", MAX_ROW_LEN - 1);
-        sanitized_value[MAX_ROW_LEN - 1] = '\0'; // Ensure null termination
-        char *ptr = sanitized_value;
-        while (*ptr) {
-            if (*ptr == '|' || *ptr == '\n' || *ptr == DELETED_MARKER) {
-                *ptr = '_'; // Replace forbidden characters
-            }
-            ptr++;
+    free(recovery);
+    if (status != 0) {
+        fprintf(stderr, "Error: Recovery from write-ahead log '%s' failed; the log is kept.\n", path);
+        return -1;
+    }
+
+    // Everything in the old log is now in the data files
+    if (remove(path) != 0 && errno != ENOENT) {
+        perror("Failed to remove recovered write-ahead log");
+        return -1;
+    }
+    db->durability = durability;
+    if (durability == WAL_DURABILITY_OFF) return 0;
+    db->wal = wal_open(path, durability, flush_interval_us);
+    if (!db->wal) {
+        db->durability = WAL_DURABILITY_OFF;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Opens the files of a table: initializes the table structure, creates
+ * the data file, opens (or rebuilds) the B+ Tree index, takes the row counts
+ * and sets up the locks. The table is not added to db->tables, so several
+ * tables (the shards of a partitioned table) can be loaded at once.
+ * @param db Pointer to the Database.
+ * @param table_name Name for the new table.
+ * @param columns Array of strings containing the names of the columns.
+ * @param column_types Type hint of each column, or NULL to store every column as a string.
+ * @param column_count Number of columns (already checked against MAX_COLUMNS).
+ * @param parent The partitioned table when opening one of its shards, else NULL.
+ * @return Pointer to the loaded Table, or NULL on failure.
+ */
+static Table *load_table(Database *db, const char *table_name, char **columns, char **column_types,
+                         int column_count, Table *parent) {
+    // --- Allocation and Initialization ---
+    Table *table = (Table *)malloc(sizeof(Table));
+    if (!table) {
+        perror("Failed to allocate memory for table structure");
+        return NULL;
+    }
+    // Initialize fields to safe values before potential errors
+    table->name = NULL;
+    table->columns = NULL;
+    table->column_types = NULL;
+    table->record_buffer = NULL;
+    table->record_capacity = 0;
+    table->primary_index = NULL;
+    table->data_file = NULL;
+    table->data_fd = -1;
+    table->data_size = 0;
+    table->row_count = 0;
+    table->data_map = NULL;
+    table->data_map_length = 0;
+    table->column_indexes = NULL;
+    table->secondary_index_count = 0;
+    table->index_text = NULL;
+    table->index_text_capacity = 0;
+    table->database = db;
+    table->dead_bytes = 0;
+    table->dead_bytes_known = 0;
+    table->compacting = 0;
+    table->file_generation = 0;
+    table->row_cache = NULL;
+    table->io_backend = db->io_backend;
+    table->shards = NULL;
+    table->shard_count = 0;
+    table->parent = parent;
+    table->snapshots = 0;
+    table->draining = 0;
+    table->delete_seq = 0;
+    table->retired = NULL;
+    table->retired_count = 0;
+    table->retired_capacity = 0;
+
+    table->name = strdup(table_name);
+    if (!table->name) {
+        perror("Failed to duplicate table name");
+        free(table);
+        return NULL;
+    }
+    if (parent) table->metrics = parent->metrics; // Shards are reported as their table
+    else register_table_metrics(table);
+
+    // Allocate and copy column names provided by the caller
+    table->columns = (char **)malloc(column_count * sizeof(char *));
+    if (!table->columns) {
+        perror("Failed to allocate memory for column names array");
+        free(table->name);
+        free(table);
+        return NULL;
+    }
+    // Initialize column pointers before strdup loop
+    for(int i=0; i<column_count; ++i) table->columns[i] = NULL;
+
+    for (int i = 0; i < column_count; i++) {
+        if (!columns[i] || strlen(columns[i]) == 0) {
+             fprintf(stderr, "Error: Invalid column name provided at index %d.\n", i);
+             // Cleanup previously allocated names
+             for (int j = 0; j < i; j++) free(table->columns[j]);
+             free(table->columns);
+             free(table->name);
+             free(table);
+             return NULL;
+        }
+        table->columns[i] = strdup(columns[i]);
+        if (!table->columns[i]) {
+            perror("Failed to duplicate column name");
+            // Cleanup previously allocated names
+            for (int j = 0; j < i; j++) free(table->columns[j]);
+            free(table->columns);
+            free(table->name);
+            free(table);
+            return NULL;
         }
+    }
+    table->column_count = column_count;
+
+    table->column_types = (ColumnType *)malloc(column_count * sizeof(ColumnType));
+    if (!table->column_types) {
+        perror("Failed to allocate memory for column types");
+        for (int i = 0; i < column_count; i++) free(table->columns[i]);
+        free(table->columns);
+        free(table->name);
+        free(table);
+        return NULL;
+    }
+    for (int i = 0; i < column_count; i++) {
+        table->column_types[i] = column_type_from_name(column_types ? column_types[i] : NULL);
+    }
+
+    // Create directory path for the resource if it doesn't exist
+    char resource_dir[FILENAME_BUF_SIZE];
+    if (table_resource_dir(table_name, resource_dir, sizeof(resource_dir)) != 0) {
+        fprintf(stderr, "Error creating path to scaffolded_resources\n");
+        for (int i = 0; i < column_count; i++) free(table->columns[i]);
+        free(table->columns);
+        free(table->column_types);
+        free(table->name);
+        free(table);
+        return NULL;
+    }
+
+    // Create the directory (mkdir -p equivalent)
+    if (make_directories(resource_dir, 0755) != 0) {
+        perror("Failed to create table directory");
+        for (int i = 0; i < column_count; i++) free(table->columns[i]);
+        free(table->columns);
+        free(table->column_types);
+        free(table->name);
+        free(table);
+        return NULL;
+    }
+
+    // Construct data filename and open/create the file
+    char filename[FILENAME_BUF_SIZE];
+    table_file_path(table_name, ".dat", filename, sizeof(filename));
+
+    // Open in "a+b" (append + binary) first. This creates the file if it doesn't exist.
+    FILE* temp_fp = fopen(filename, "a+b");
+    if (!temp_fp) {
+         perror("Failed to create/open data file initially");
+         for (int i = 0; i < column_count; i++) free(table->columns[i]);
+         free(table->columns);
+         free(table->column_types);
+         free(table->name);
+         free(table);
+         return NULL;
+    }
+    fclose(temp_fp); // Close it immediately
+
+    // Now open in "r+b" (read/update binary) mode for actual operations.
+    table->data_file = fopen(filename, "r+b");
+    if (!table->data_file) {
+        perror("Failed to open data file for read/update");
+        for (int i = 0; i < column_count; i++) free(table->columns[i]);
+        free(table->columns);
+        free(table->column_types);
+        free(table->name);
+        free(table);
+        return NULL;
+    }
+    table->data_fd = fileno(table->data_file); // Reads use pread and leave the stream alone
+
+    // New files get a header; text files from before the binary format are converted
+    int converted = prepare_data_file(table, filename);
+    if (converted < 0) {
+        fclose(table->data_file);
+        for (int i = 0; i < column_count; i++) free(table->columns[i]);
+        free(table->columns);
+        free(table->column_types);
+        free(table->record_buffer);
+        free(table->name);
+        free(table);
+        return NULL;
+    }
+
+    // Open the B+ Tree index; only its header and root are read here
+    char index_filename[FILENAME_BUF_SIZE];
+    table_file_path(table_name, ".idx", index_filename, sizeof(index_filename));
+    table->primary_index = open_tree(index_filename);
+    if (!table->primary_index) {
+        fprintf(stderr, "Error: Failed to open B+ Tree index for table '%s'\n", table_name);
+        // Cleanup allocated resources
+        fclose(table->data_file);
+        for (int i = 0; i < column_count; i++) free(table->columns[i]);
+        free(table->columns);
+        free(table->column_types);
+        free(table->record_buffer);
+        free(table->name);
+        free(table);
+        return NULL;
+    }
+
+    // The index records the data file size it was last synced with. If that no
+    // longer matches (new index, crash between the two writes, file replaced,
+    // file converted), rebuild it from the data file once.
+    fseek(table->data_file, 0, SEEK_END);
+    table->data_size = ftell(table->data_file);
+    if (db->mmap_tables) map_data_file(table); // Falls back to pread if the file can't be mapped
+    if (converted || table->primary_index->synced_data_size != table->data_size) {
+        int rows = rebuild_index(table);
+        if (rows < 0) {
+            fprintf(stderr, "Warning: Failed to rebuild index for table '%s'; it will be rebuilt on the next start.\n", table_name);
+            table->row_count = count_index_rows(table);
+        } else if (table->data_size > RECORD_FILE_HEADER_SIZE) {
+            printf("Rebuilt index for table '%s' (%d rows).\n", table_name, rows);
+        }
+    } else if (restore_table_counts(table) != 0) {
+        // Not in the catalog snapshot: the rows are counted from the index, and
+        // the compactor counts dead rows in the background
+        table->row_count = count_index_rows(table);
+    }
+    // An empty table has no dead rows
+    if (table->data_size == RECORD_FILE_HEADER_SIZE) table->dead_bytes_known = 1;
+    if (converted && db->wal && make_table_durable(table) != 0) {
+        // Logged offsets refer to the converted file, so it must not be lost in a crash
+        fprintf(stderr, "Warning: Converted data file of table '%s' may not survive a crash.\n", table_name);
+    }
+
+    // Initialize the reader-writer lock. Writers are preferred so a steady
+    // stream of reads can't hold off inserts indefinitely.
+    pthread_rwlockattr_t lock_attr;
+    pthread_rwlockattr_init(&lock_attr);
+    pthread_rwlockattr_setkind_np(&lock_attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    int lock_status = pthread_rwlock_init(&table->lock, &lock_attr);
+    pthread_rwlockattr_destroy(&lock_attr);
+    if (lock_status != 0) {
+        fprintf(stderr, "Lock initialization failed: %s\n", strerror(lock_status));
+        unmap_data_file(table);
+        fclose(table->data_file);
+        destroy_tree(table->primary_index);
+        for (int i = 0; i < column_count; i++) free(table->columns[i]);
+        free(table->columns);
+        free(table->column_types);
+        free(table->record_buffer);
+        free(table->name);
+        free(table);
+        return NULL;
+    }
+
+    pthread_mutex_init(&table->snapshot_lock, NULL);
+    pthread_cond_init(&table->snapshot_done, NULL);
+
+    // Reads still work without the cache, so failing to allocate it is not an error
+    if (parent) table->row_cache = parent->row_cache;
+    else if (db->row_cache_entries > 0) table->row_cache = row_cache_create(db->row_cache_entries);
+
+    return table;
+}
+
+/**
+ * @brief Creates a new Table within a Database, backed by its own files
+ * (see load_table), and adds it to the database.
+ * @param db Pointer to the Database.
+ * @param table_name Name for the new table.
+ * @param columns Array of strings containing the names of the columns.
+ * @param column_types Type hint of each column, or NULL to store every column as a string.
+ * @param column_count Number of columns.
+ * @param parent The partitioned table when opening one of its shards, else NULL.
+ * @return Pointer to the created Table, or NULL on failure.
+ */
+static Table *open_table(Database *db, const char *table_name, char **columns, char **column_types,
+                         int column_count, Table *parent) {
+    // --- Input Validation ---
+    if (!db) {
+        fprintf(stderr, "Error: Database pointer is NULL in create_table.\n");
+        return NULL;
+    }
+    if (db->table_count >= MAX_TABLES) {
+        fprintf(stderr, "Error: Maximum table limit (%d) reached.\n", MAX_TABLES);
+        return NULL;
+    }
+     if (!table_name || strlen(table_name) == 0) {
+        fprintf(stderr, "Error: Invalid table name provided.\n");
+        return NULL;
+    }
+    if (!columns || column_count <= 0 || column_count > MAX_COLUMNS) {
+         fprintf(stderr, "Error: Invalid column definition (count: %d).\n", column_count);
+         return NULL;
+    }
+     // Check for duplicate table name
+     for(int i=0; i<db->table_count; ++i) {
+         if(db->tables[i] && strcmp(db->tables[i]->name, table_name) == 0) {
+             fprintf(stderr, "Error: Table '%s' already exists in database '%s'.\n", table_name, db->name);
+             return NULL;
+         }
+     }
+
+    Table *table = load_table(db, table_name, columns, column_types, column_count, parent);
+    if (!table) return NULL;
+
+    // Add the newly created table to the database's list
+    db->tables[db->table_count++] = table;
+    printf("Table '%s' created successfully in database '%s'.\n", table_name, db->name);
+    return table;
+}
+
+/**
+ * @brief Decides how many shards a table is partitioned into. A table keeps
+ * the layout it was created with: <table>.shards holds the count of a
+ * partitioned table, and a table that already has an unpartitioned data file
+ * stays unpartitioned. A new table takes db->table_shards, recorded in
+ * <table>.shards when it is more than 1.
+ * @param db Pointer to the Database.
+ * @param table_name Name of the table.
+ * @return Number of shards (1 for an unpartitioned table), or -1 on failure.
+ */
+static int table_shard_count(Database *db, const char *table_name) {
+    char shards_filename[FILENAME_BUF_SIZE], filename[FILENAME_BUF_SIZE];
+    if (table_file_path(table_name, ".shards", shards_filename, sizeof(shards_filename)) != 0 ||
+        table_file_path(table_name, ".dat", filename, sizeof(filename)) != 0) {
+        fprintf(stderr, "Error creating path to scaffolded_resources\n");
+        return -1;
+    }
+
+    FILE *file = fopen(shards_filename, "r");
+    if (file) {
+        int count = 0;
+        int valid = fscanf(file, "%d", &count) == 1 && count >= 1 && count <= MAX_TABLE_SHARDS;
+        fclose(file);
+        if (!valid) {
+            fprintf(stderr, "Error: Shard count in '%s' is not valid.\n", shards_filename);
+            return -1;
+        }
+        if (db->table_shards > 1 && db->table_shards != count) {
+            printf("Note: Table '%s' keeps the %d shards it was created with.\n", table_name, count);
+        }
+        return count;
+    }
+    if (db->table_shards <= 1) return 1;
+    if (access(filename, F_OK) == 0) {
+        printf("Note: Table '%s' already has unpartitioned data; it is not split into shards.\n", table_name);
+        return 1;
+    }
+
+    char resource_dir[FILENAME_BUF_SIZE];
+    table_resource_dir(table_name, resource_dir, sizeof(resource_dir));
+    if (make_directories(resource_dir, 0755) != 0) {
+        perror("Failed to create table directory");
+        return -1;
+    }
+
+    // Rows are placed by the shard count, so it must be on disk before any row is
+    file = fopen(shards_filename, "w");
+    if (!file) {
+        perror("Failed to create shard count file");
+        return -1;
+    }
+    int written = fprintf(file, "%d\n", db->table_shards) > 0 && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    if (fclose(file) != 0 || !written) {
+        perror("Failed to write shard count file");
+        remove(shards_filename);
+        return -1;
+    }
+    return db->table_shards;
+}
+
+void destroy_table(Table *table);
+
+/**
+ * @brief Runs count jobs, job(args + i * arg_size), on a thread pool of up to
+ * one thread per CPU and waits for all of them. With one CPU, or when the
+ * pool can't be started, they run on the calling thread.
+ * @param job Function run for each job.
+ * @param args Array of count job arguments of arg_size bytes each.
+ * @param arg_size Size of one argument.
+ * @param count Number of jobs.
+ */
+static void run_parallel(ThreadPoolJob job, void *args, size_t arg_size, int count) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cpus < count ? (int)cpus : count;
+    ThreadPool *pool = threads > 1 ? thread_pool_create(threads, count) : NULL;
+    for (int i = 0; i < count; i++) {
+        void *arg = (char *)args + i * arg_size;
+        if (!pool || thread_pool_submit(pool, job, arg) != 0) job(arg);
+    }
+    thread_pool_destroy(pool); // Runs the jobs still queued, then joins the workers
+}
+
+// One shard opened by a pool thread (see create_partitioned_table)
+typedef struct {
+    Database *db;
+    Table *parent;
+    char name[FILENAME_BUF_SIZE];
+    char **columns;
+    char **column_types;
+    int column_count;
+    Table *table;               // The loaded shard, NULL on failure
+} ShardLoad;
+
+static void load_shard(void *arg) {
+    ShardLoad *load = (ShardLoad *)arg;
+    load->table = load_table(load->db, load->name, load->columns, load->column_types,
+                             load->column_count, load->parent);
+}
+
+/**
+ * @brief Creates a table hash-partitioned into shards named <table>.<n>, each
+ * a table with its own files and lock, registered in db->tables before the
+ * partitioned table itself (which owns no files).
+ * @param db Pointer to the Database.
+ * @param table_name Name for the new table.
+ * @param columns Array of strings containing the names of the columns.
+ * @param column_types Type hint of each column, or NULL to store every column as a string.
+ * @param column_count Number of columns.
+ * @param shard_count Number of shards (2 to MAX_TABLE_SHARDS).
+ * @return Pointer to the created Table, or NULL on failure.
+ */
+static Table *create_partitioned_table(Database *db, const char *table_name, char **columns,
+                                       char **column_types, int column_count, int shard_count) {
+    if (db->table_count + shard_count + 1 > MAX_TABLES) {
+        fprintf(stderr, "Error: Maximum table limit (%d) reached.\n", MAX_TABLES);
+        return NULL;
+    }
+    for (int i = 0; i < db->table_count; i++) {
+        if (strcmp(db->tables[i]->name, table_name) == 0) {
+            fprintf(stderr, "Error: Table '%s' already exists in database '%s'.\n", table_name, db->name);
+            return NULL;
+        }
+    }
+
+    Table *table = calloc(1, sizeof(Table));
+    if (!table) {
+        perror("Failed to allocate memory for table structure");
+        return NULL;
+    }
+    table->name = strdup(table_name);
+    table->shards = calloc(shard_count, sizeof(Table *));
+    if (!table->name || !table->shards) {
+        perror("Failed to allocate partitioned table");
+        free(table->name);
+        free(table->shards);
+        free(table);
+        return NULL;
+    }
+    table->data_fd = -1;
+    table->database = db;
+    table->io_backend = db->io_backend;
+    pthread_rwlock_init(&table->lock, NULL); // Never taken: each shard has its own
+    pthread_mutex_init(&table->snapshot_lock, NULL);
+    pthread_cond_init(&table->snapshot_done, NULL);
+    register_table_metrics(table);
+    if (db->row_cache_entries > 0) table->row_cache = row_cache_create(db->row_cache_entries);
+
+    // The shards have their own files, so they are opened (and their indexes
+    // rebuilt, if need be) in parallel, then added in order
+    int first_shard = db->table_count;
+    ShardLoad *loads = calloc(shard_count, sizeof(ShardLoad));
+    if (!loads) {
+        perror("Failed to allocate shard loads");
+        goto fail;
+    }
+    for (int i = 0; i < shard_count; i++) {
+        loads[i].db = db;
+        loads[i].parent = table;
+        snprintf(loads[i].name, sizeof(loads[i].name), "%s.%d", table_name, i);
+        loads[i].columns = columns;
+        loads[i].column_types = column_types;
+        loads[i].column_count = column_count;
+    }
+    run_parallel(load_shard, loads, sizeof(ShardLoad), shard_count);
+    int loaded = 0;
+    while (loaded < shard_count && loads[loaded].table) loaded++;
+    if (loaded < shard_count) {
+        for (int i = 0; i < shard_count; i++) destroy_table(loads[i].table);
+        free(loads);
+        goto fail;
+    }
+    for (int i = 0; i < shard_count; i++) {
+        table->shards[i] = loads[i].table;
+        db->tables[db->table_count++] = table->shards[i];
+        table->shard_count++;
+    }
+    free(loads);
+
+    // The shards checked the columns; callers read them from the table
+    table->column_count = column_count;
+    table->columns = calloc(column_count, sizeof(char *));
+    table->column_types = malloc(column_count * sizeof(ColumnType));
+    if (!table->columns || !table->column_types) {
+        perror("Failed to allocate memory for column names array");
+        goto fail;
+    }
+    for (int i = 0; i < column_count; i++) {
+        table->columns[i] = strdup(table->shards[0]->columns[i]);
+        if (!table->columns[i]) {
+            perror("Failed to duplicate column name");
+            goto fail;
+        }
+        table->column_types[i] = table->shards[0]->column_types[i];
+    }
+
+    db->tables[db->table_count++] = table;
+    printf("Table '%s' created successfully in database '%s' (%d shards).\n", table_name, db->name, shard_count);
+    return table;
+
+fail:
+    // The shards opened so far were added last; take them back out
+    for (int i = 0; i < table->shard_count; i++) {
+        db->tables[first_shard + i] = NULL;
+        destroy_table(table->shards[i]);
+    }
+    db->table_count = first_shard;
+    table->shard_count = 0;
+    destroy_table(table);
+    return NULL;
+}
+
+/**
+ * @brief Creates a new Table within a Database, partitioned into shards if the
+ * table already is or db->table_shards asks for it (see table_shard_count).
+ * @param db Pointer to the Database.
+ * @param table_name Name for the new table.
+ * @param columns Array of strings containing the names of the columns.
+ * @param column_types Type hint of each column, or NULL to store every column as a string.
+ * @param column_count Number of columns.
+ * @return Pointer to the created Table, or NULL on failure.
+ */
+Table *create_table(Database *db, const char *table_name, char **columns, char **column_types, int column_count) {
+    // open_table reports invalid arguments
+    if (!db || !table_name || table_name[0] == '\0' || !columns || column_count <= 0 || column_count > MAX_COLUMNS) {
+        return open_table(db, table_name, columns, column_types, column_count, NULL);
+    }
+    if (strchr(table_name, '.')) {
+        fprintf(stderr, "Error: Table name '%s' must not contain '.'.\n", table_name);
+        return NULL;
+    }
+    int shard_count = table_shard_count(db, table_name);
+    if (shard_count < 0) return NULL;
+    if (shard_count == 1) return open_table(db, table_name, columns, column_types, column_count, NULL);
+    return create_partitioned_table(db, table_name, columns, column_types, column_count, shard_count);
+}
+
+/**
+ * @brief Destroys a Table structure and frees its resources.
+ * Closes the data file, destroys the index, frees column names, name, and the struct itself.
+ * @param table Pointer to the Table to destroy.
+ */
+void destroy_table(Table *table) {
+     if (!table) return;
+     printf("Destroying table '%s'...\n", table->name);
+
+     // Best practice: Lock before destroying, although if called correctly,
+     // no other thread should be using it.
+     // pthread_rwlock_wrlock(&table->lock); // Optional lock
+
+     // Destroy the lock *after* ensuring no operations are pending
+     pthread_rwlock_destroy(&table->lock);
+     pthread_mutex_destroy(&table->snapshot_lock);
+     pthread_cond_destroy(&table->snapshot_done);
+     free(table->retired);
+     table->retired = NULL;
+
+     // Unmap and close the data file
+     unmap_data_file(table);
+     if (table->data_file) {
+         fclose(table->data_file);
+         table->data_file = NULL;
+         table->data_fd = -1;
+         // Optionally remove the .dat file from disk
+         // char filename[FILENAME_BUF_SIZE];
+         // snprintf(filename, sizeof(filename), "%s.dat", table->name);
+         // remove(filename); // Uncomment to delete file on table destroy
+     }
+
+     // Destroy the B+ Tree index
+     if (table->primary_index) {
+         destroy_tree(table->primary_index);
+         table->primary_index = NULL;
+     }
+
+     // Free column names
+     if (table->columns) {
+         for (int i = 0; i < table->column_count; i++) {
+             free(table->columns[i]);
+         }
+         free(table->columns);
+         table->columns = NULL;
+     }
+     free(table->column_types);
+     table->column_types = NULL;
+     free(table->record_buffer);
+     table->record_buffer = NULL;
+
+     // Free the secondary indexes
+     if (table->column_indexes) {
+         for (int i = 0; i < table->column_count; i++) hash_index_destroy(table->column_indexes[i]);
+         free(table->column_indexes);
+         table->column_indexes = NULL;
+     }
+     free(table->index_text);
+     table->index_text = NULL;
+
+     // Free the row cache, reporting how well it did (a shard's belongs to its table)
+     if (table->row_cache && !table->parent) {
+         uint64_t hits, misses;
+         int cached;
+         row_cache_stats(table->row_cache, &hits, &misses, &cached);
+         printf("Row cache of table '%s': %llu hits, %llu misses, %d rows cached.\n", table->name,
+                (unsigned long long)hits, (unsigned long long)misses, cached);
+         row_cache_destroy(table->row_cache);
+         table->row_cache = NULL;
+     }
+
+     // A partitioned table's shards are destroyed on their own
+     free(table->shards);
+     table->shards = NULL;
+
+     // Free table name
+     free(table->name);
+     table->name = NULL;
+
+     // Free the table structure itself
+     free(table);
+ }
+
+static void stop_compactor(Database *db);
+
+/**
+ * @brief Destroys a Database structure and all its tables.
+ * @param db Pointer to the Database to destroy.
+ */
+void destroy_database(Database *db) {
+    if (!db) return;
+    printf("Destroying database '%s'...\n", db->name);
+    metrics_remove_collector(collect_database_metrics, db);
+    stop_compactor(db);
+    // A clean shutdown leaves an empty log and a catalog snapshot for the next start
+    checkpoint_database(db, 1);
+    wal_close(db->wal);
+    db->wal = NULL;
+    pthread_mutex_destroy(&db->checkpoint_lock);
+    pthread_mutex_destroy(&db->compactor_lock);
+    pthread_mutex_destroy(&db->catalog_lock);
+    pthread_cond_destroy(&db->compactor_wake);
+    // Iterate through the table pointers and destroy each table
+    for (int i = 0; i < db->table_count; i++) {
+        if (db->tables[i]) {
+            destroy_table(db->tables[i]);
+            db->tables[i] = NULL; // Clear the pointer in the array
+        }
+    }
+    for (int i = 0; i < db->catalog_count; i++) free(db->catalog[i].name);
+    free(db->catalog);
+    // Free the database name
+    free(db->name);
+    db->name = NULL;
+    // Free the database structure itself
+    free(db);
+}
+
+
+// --- Row Operations ---
+
+/**
+ * @brief Position of the shard of a partitioned table holding a primary key.
+ * Keys are spread by a multiplicative hash so consecutive keys land on
+ * different shards; the mapping decides where stored rows are, so it must
+ * never change.
+ * @param table Pointer to the partitioned table.
+ * @param primary_key The primary key.
+ * @return Index into table->shards.
+ */
+static int shard_index(const Table *table, int primary_key) {
+    return table_shard_of_key(table->shard_count, primary_key);
+}
+
+/**
+ * @brief The hash behind shard_index, for a table of shard_count shards.
+ */
+int table_shard_of_key(int shard_count, int primary_key) {
+    uint32_t hash = (uint32_t)primary_key * 2654435761u;
+    return (int)(((uint64_t)hash * (uint32_t)shard_count) >> 32);
+}
+
+/**
+ * @brief The shard of a partitioned table holding a primary key, or the table
+ * itself when it is not partitioned.
+ * @param table Pointer to the table.
+ * @param primary_key The primary key.
+ * @return The table to operate on.
+ */
+static Table *shard_for_key(Table *table, int primary_key) {
+    if (!table->shards) return table;
+    return table->shards[shard_index(table, primary_key)];
+}
+
+/**
+ * @brief Tells the database's change listener about a row change. Call with
+ * the table write-locked, once the change is made.
+ * @param table Pointer to the table (or shard) changed.
+ * @param type Kind of change.
+ * @param primary_key Key of the row (unused for ROW_CHANGE_TRUNCATE).
+ * @param record New version of the row for ROW_CHANGE_PUT, else NULL.
+ * @param length Length of record.
+ */
+static void notify_change(Table *table, RowChangeType type, int primary_key, const unsigned char *record,
+                          size_t length) {
+    Database *db = table->database;
+    if (db && db->change_listener) {
+        db->change_listener(db->change_context, table, type, primary_key, record, length);
+    }
+}
+
+/**
+ * @brief Encodes a row into the table's record buffer. Call with the table write-locked.
+ * @param table Pointer to the table.
+ * @param values One string per column.
+ * @param previous Distance back to the version the row replaces, 0 for a new row.
+ * @return The record length, or -1 if a value doesn't fit its column's type.
+ */
+static long encode_row(Table *table, char **values, uint64_t previous) {
+    int bad_column = -1;
+    long record_len = record_encode(table->column_types, table->column_count, values, previous,
+                                    &table->record_buffer, &table->record_capacity, &bad_column);
+    if (record_len < 0 && bad_column >= 0) {
+        fprintf(stderr, "Error: Invalid value '%s' for column '%s' of table '%s'.\n",
+                values[bad_column] ? values[bad_column] : "", table->columns[bad_column], table->name);
+    }
+    return record_len;
+}
+
+/**
+ * @brief Appends bytes (one or more encoded records) to the data file.
+ * Call with the table write-locked.
+ * @param table Pointer to the table.
+ * @param bytes The bytes to append.
+ * @param length Number of bytes.
+ * @return Offset the bytes were written at, or -1 on an I/O error.
+ */
+static long append_bytes(Table *table, const unsigned char *bytes, long length) {
+    // data_size is the end of the file; appending there keeps the offset that was logged
+    long offset = table->data_size;
+    if (table->io_backend == DATA_IO_URING) {
+        // One positioned write, past the stream (which is repositioned before it is next read)
+        if (data_io_write(table->io_backend, table->data_fd, bytes, length, offset) != 0) {
+            perror("Failed to write row data");
+            return -1;
+        }
+    } else {
+        if (fseek(table->data_file, table->data_size, SEEK_SET) != 0) {
+            perror("Failed to seek to end of file for append");
+            return -1;
+        }
+        offset = ftell(table->data_file);
+        if (offset == -1) {
+            perror("Failed to get current file offset before append");
+            return -1;
+        }
+        if (fwrite(bytes, 1, length, table->data_file) != (size_t)length) {
+            perror("Failed to write row data");
+            return -1;
+        }
+        // Pass the data to the OS so readers see it; durability comes from the write-ahead log
+        if (fflush(table->data_file) != 0) {
+            perror("Failed to flush data file after append");
+            return -1;
+        }
+    }
+    table->data_size = offset + length;
+    metrics_count(table->metrics.bytes_written, (uint64_t)length);
+    if (table->data_map && (size_t)table->data_size > table->data_map_length) {
+        map_data_file(table); // Outgrew the mapping; on failure reads fall back to pread
+    }
+    return offset;
+}
+
+/**
+ * @brief Marks the record at offset as deleted by rewriting its flags byte.
+ * Call with the table write-locked.
+ * @param table Pointer to the table.
+ * @param offset Offset of the record.
+ * @return 0 on success, -1 on an I/O error.
+ */
+static int mark_record_deleted(Table *table, long offset) {
+    if (table->io_backend == DATA_IO_URING) {
+        const unsigned char flag = RECORD_FLAG_DELETED;
+        if (data_io_write(table->io_backend, table->data_fd, &flag, 1, offset + RECORD_FLAGS_OFFSET) != 0) {
+            perror("Failed to write delete flag");
+            return -1;
+        }
+        metrics_count(table->metrics.bytes_written, 1);
+        return 0;
+    }
+    if (fseek(table->data_file, offset + RECORD_FLAGS_OFFSET, SEEK_SET) != 0) {
+        char errorMsg[100];
+        snprintf(errorMsg, 100, "Failed to seek to row offset %ld for delete", offset);
+        perror(errorMsg);
+        return -1;
+    }
+    if (fputc(RECORD_FLAG_DELETED, table->data_file) == EOF) {
+        perror("Failed to write delete flag");
+        return -1;
+    }
+    if (fflush(table->data_file) != 0) {
+        perror("Failed to flush data file after marking delete");
+        return -1;
+    }
+    metrics_count(table->metrics.bytes_written, 1);
+    return 0;
+}
+
+/**
+ * @brief Appends the record in the table's record buffer to the data file.
+ * Call with the table write-locked.
+ * @param table Pointer to the table.
+ * @param record_len Length of the encoded record.
+ * @return Offset of the record, or -1 on an I/O error.
+ */
+static long append_record(Table *table, long record_len) {
+    return append_bytes(table, table->record_buffer, record_len);
+}
+
+/**
+ * @brief Adds the record at offset, which is being deleted or superseded, to
+ * the table's dead bytes. Call with the table write-locked.
+ * @param table Pointer to the table.
+ * @param offset Offset of the record.
+ */
+static void count_dead_record(Table *table, long offset) {
+    unsigned char header[RECORD_HEADER_MAX_SIZE];
+    const unsigned char *bytes = header;
+    size_t available;
+    if (table->data_map && offset < table->data_size) {
+        bytes = table->data_map + offset;
+        available = table->data_size - offset;
+    } else {
+        ssize_t got = pread(table->data_fd, header, sizeof(header), offset);
+        if (got <= 0) return;
+        available = got;
+    }
+    size_t length;
+    if (record_header(bytes, available, &length) != 0) table->dead_bytes += length;
+}
+
+/**
+ * @brief Adds a record's values to the table's secondary indexes (add = 1) or
+ * removes them (add = 0). Call with the table write-locked.
+ * @param table Pointer to the table.
+ * @param primary_key The row's primary key.
+ * @param record The row's encoded record.
+ * @param length Length of the record.
+ * @param add 1 to add, 0 to remove.
+ */
+static void update_secondary_indexes(Table *table, int primary_key, const unsigned char *record,
+                                     size_t length, int add) {
+    if (table->secondary_index_count == 0) return;
+
+    char *values[MAX_COLUMNS];
+    if (record_decode_into(table->column_types, table->column_count, record, length, values,
+                           &table->index_text, &table->index_text_capacity) != 0) {
+        fprintf(stderr, "Warning: Could not decode row %d of table '%s' for its secondary indexes.\n", primary_key, table->name);
+        return;
+    }
+    for (int i = 1; i < table->column_count; i++) {
+        if (!table->column_indexes[i]) continue;
+        if (!add) {
+            hash_index_remove(table->column_indexes[i], values[i], primary_key);
+        } else if (hash_index_add(table->column_indexes[i], values[i], primary_key) != 0) {
+            fprintf(stderr, "Warning: Row %d is missing from the index on column '%s' of table '%s'.\n", primary_key, table->columns[i], table->name);
+        }
+    }
+}
+
+/**
+ * @brief Inserts a new row into the table. Appends to file, adds to index.
+ * @param table Pointer to the table.
+ * @param primary_key The integer primary key for the new row.
+ * @param values Array of strings representing the values for each column.
+ * @return The file offset of the newly inserted row, or -1 on failure.
+ */
+static long insert_row_untimed(Table *table, int primary_key, char **values) {
+    if (!table || !values) {
+        fprintf(stderr, "Error: Invalid arguments for insert_row.\n");
+        return -1;
+    }
+    long current_offset = -1;
+    long result_offset = -1;
+
+    lock_table_write(table); // Lock the table for thread safety
+    invalidate_catalog(table->database);
+
+    // 1. Check if primary key already exists using the index
+    if (search_key(table->primary_index, primary_key) != -1) {
+        fprintf(stderr, "Error: Primary key %d already exists in table '%s'. Insertion aborted.\n", primary_key, table->name);
+        pthread_rwlock_unlock(&table->lock);
+        return -1;
+    }
+
+    // 2. Encode the row, log it and append it to the data file
+    long record_len = encode_row(table, values, 0);
+    if (record_len < 0) {
+        pthread_rwlock_unlock(&table->lock);
+        return -1;
+    }
+    WalWrite write = { table->data_size, table->record_buffer, (uint32_t)record_len };
+    int64_t lsn = log_writes(table, &write, 1);
+    if (lsn < 0) {
+        pthread_rwlock_unlock(&table->lock);
+        return -1;
+    }
+    current_offset = append_record(table, record_len);
+    if (current_offset == -1) {
+        pthread_rwlock_unlock(&table->lock);
+        return -1;
+    }
+
+    // 3. If writing seems successful, insert the primary key and its offset into the B+ Tree index
+    insert_key(table->primary_index, primary_key, current_offset);
+    table->row_count++;
+    sync_index(table);
+    update_secondary_indexes(table, primary_key, table->record_buffer, record_len, 1);
+    notify_change(table, ROW_CHANGE_PUT, primary_key, table->record_buffer, (size_t)record_len);
+    result_offset = current_offset; // Set the successful offset to return
+
+    pthread_rwlock_unlock(&table->lock); // Unlock the table
+    if (finish_write(table, lsn) != 0) return -1;
+    return result_offset;
+}
+
+/**
+ * @brief insert_row_untimed on the key's shard, timed into the table's insert duration metric.
+ */
+long insert_row(Table *table, int primary_key, char **values) {
+    if (!table) return insert_row_untimed(table, primary_key, values);
+    table = shard_for_key(table, primary_key);
+    uint64_t start = metrics_start();
+    long result = insert_row_untimed(table, primary_key, values);
+    metrics_observe_since(table->metrics.operations[TABLE_OP_INSERT], start);
+    return result;
+}
+
+// One row of a batch insert
+typedef struct {
+    int primary_key;
+    int row;            // Position in the caller's arrays
+    long offset;        // Offset of the row's record in the encoded batch
+    long length;        // Length of the record
+} BatchRow;
+
+/**
+ * @brief qsort comparator ordering batch rows by primary key.
+ */
+static int compare_batch_rows(const void *a, const void *b) {
+    int left = ((const BatchRow *)a)->primary_key;
+    int right = ((const BatchRow *)b)->primary_key;
+    return (left > right) - (left < right);
+}
+
+/**
+ * @brief Inserts many rows under one write lock. The rows are sorted by key
+ * and encoded into one buffer, which is logged and appended in
+ * BULK_WRITE_SIZE pieces, so a batch costs a handful of writes instead of
+ * several per row. An empty index is built bottom-up from the sorted keys
+ * (bulk_load_tree); otherwise the keys are inserted in order.
+ * @param table Pointer to the table.
+ * @param count Number of rows.
+ * @param primary_keys Primary key of each row.
+ * @param values One array of column strings per row.
+ * @param offsets Output (may be NULL): file offset of each row.
+ * @return count on success, or -1 on failure.
+ */
+static int insert_rows_batch_untimed(Table *table, int count, const int *primary_keys, char ***values, long *offsets) {
+    if (!table || count < 0 || (count > 0 && (!primary_keys || !values))) {
+        fprintf(stderr, "Error: Invalid arguments for insert_rows_batch.\n");
+        return -1;
+    }
+    if (count == 0) return 0;
+
+    BatchRow *rows = malloc(count * sizeof(BatchRow));
+    if (!rows) {
+        perror("Failed to allocate batch insert");
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        rows[i].primary_key = primary_keys[i];
+        rows[i].row = i;
+        if (offsets) offsets[i] = -1;
+    }
+    qsort(rows, count, sizeof(BatchRow), compare_batch_rows);
+    for (int i = 1; i < count; i++) {
+        if (rows[i].primary_key == rows[i - 1].primary_key) {
+            fprintf(stderr, "Error: Primary key %d appears twice in a batch for table '%s'. Insertion aborted.\n", rows[i].primary_key, table->name);
+            free(rows);
+            return -1;
+        }
+    }
+
+    unsigned char *batch = NULL;
+    size_t batch_length = 0, batch_capacity = 0;
+    int64_t lsn = 0;
+    int status = -1;
+
+    lock_table_write(table);
+    invalidate_catalog(table->database);
+
+    // 1. Check every key and encode every row before writing anything, in key
+    // order so the rows also land in the data file sorted
+    BPlusTreeNode *root = table->primary_index->root;
+    int index_empty = root && root->is_leaf && root->num_keys == 0;
+    for (int i = 0; i < count; i++) {
+        BatchRow *row = &rows[i];
+        if (!index_empty && search_key(table->primary_index, row->primary_key) != -1) {
+            fprintf(stderr, "Error: Primary key %d already exists in table '%s'. Insertion aborted.\n", row->primary_key, table->name);
+            goto done;
+        }
+        long record_len = values[row->row] ? encode_row(table, values[row->row], 0) : -1;
+        if (record_len < 0) goto done;
+        if (batch_length + record_len > batch_capacity) {
+            size_t capacity = batch_capacity ? batch_capacity : 65536;
+            while (capacity < batch_length + record_len) capacity *= 2;
+            unsigned char *grown = realloc(batch, capacity);
+            if (!grown) {
+                perror("Failed to grow batch insert buffer");
+                goto done;
+            }
+            batch = grown;
+            batch_capacity = capacity;
+        }
+        memcpy(batch + batch_length, table->record_buffer, record_len);
+        row->offset = batch_length;
+        row->length = record_len;
+        batch_length += record_len;
+    }
+
+    // 2. Log and append the batch a piece at a time
+    long base = table->data_size;
+    long written = 0;
+    while ((size_t)written < batch_length) {
+        long piece = (long)batch_length - written;
+        if (piece > BULK_WRITE_SIZE) piece = BULK_WRITE_SIZE;
+        WalWrite write = { base + written, batch + written, (uint32_t)piece };
+        int64_t piece_lsn = log_writes(table, &write, 1);
+        if (piece_lsn < 0 || append_bytes(table, batch + written, piece) == -1) break;
+        if (piece_lsn > 0) lsn = piece_lsn;
+        written += piece;
+    }
+
+    // 3. Index the rows that reached the file (all of them unless a write failed)
+    int indexed = 0;
+    while (indexed < count && rows[indexed].offset + rows[indexed].length <= written) indexed++;
+    int loaded = 0;
+    if (index_empty && indexed > 0) {
+        int *keys = malloc(indexed * sizeof(int));
+        long *file_offsets = malloc(indexed * sizeof(long));
+        if (keys && file_offsets) {
+            for (int i = 0; i < indexed; i++) {
+                keys[i] = rows[i].primary_key;
+                file_offsets[i] = base + rows[i].offset;
+            }
+            loaded = bulk_load_tree(table->primary_index, keys, file_offsets, indexed) == 0;
+        }
+        free(keys);
+        free(file_offsets);
+    }
+    for (int i = 0; i < indexed; i++) {
+        if (!loaded) insert_key(table->primary_index, rows[i].primary_key, base + rows[i].offset);
+        update_secondary_indexes(table, rows[i].primary_key, batch + rows[i].offset, rows[i].length, 1);
+        notify_change(table, ROW_CHANGE_PUT, rows[i].primary_key, batch + rows[i].offset, (size_t)rows[i].length);
+        if (offsets) offsets[rows[i].row] = base + rows[i].offset;
+    }
+    table->row_count += indexed;
+    if (indexed > 0) sync_index(table);
+    if (indexed == count) status = count;
+
+done:
+    pthread_rwlock_unlock(&table->lock);
+    free(batch);
+    free(rows);
+    if (finish_write(table, lsn) != 0) return -1;
+    return status;
+}
+
+static int delete_row_untimed(Table *table, int primary_key);
+
+/**
+ * @brief Inserts many rows into a partitioned table: the rows of each shard
+ * with one insert_rows_batch_untimed under that shard's lock, so only the
+ * shards the batch touches are locked, one at a time. When a shard fails the
+ * rows already inserted are deleted again, keeping the batch all or nothing
+ * (though concurrent readers may see part of it meanwhile).
+ * @param table Pointer to the partitioned table.
+ * @param count Number of rows.
+ * @param primary_keys Primary key of each row.
+ * @param values One array of column strings per row.
+ * @param offsets Output (may be NULL): file offset of each row in its shard.
+ * @return count on success, or -1 on failure.
+ */
+static int insert_rows_partitioned(Table *table, int count, const int *primary_keys, char ***values, long *offsets) {
+    if (count < 0 || (count > 0 && (!primary_keys || !values))) {
+        fprintf(stderr, "Error: Invalid arguments for insert_rows_batch.\n");
+        return -1;
+    }
+    if (count == 0) return 0;
+
+    int *keys = malloc(count * sizeof(int));
+    int *rows = malloc(count * sizeof(int));        // Caller's position of each grouped row
+    char ***grouped_values = malloc(count * sizeof(char **));
+    long *grouped_offsets = malloc(count * sizeof(long));
+    if (!keys || !rows || !grouped_values || !grouped_offsets) {
+        perror("Failed to allocate batch insert");
+        free(keys);
+        free(rows);
+        free(grouped_values);
+        free(grouped_offsets);
+        return -1;
+    }
+
+    // Group the rows by shard (a counting sort), keeping their order within each
+    int starts[MAX_TABLE_SHARDS + 1] = { 0 };
+    int next[MAX_TABLE_SHARDS];
+    for (int i = 0; i < count; i++) starts[shard_index(table, primary_keys[i]) + 1]++;
+    for (int s = 0; s < table->shard_count; s++) {
+        starts[s + 1] += starts[s];
+        next[s] = starts[s];
+    }
+    for (int i = 0; i < count; i++) {
+        int position = next[shard_index(table, primary_keys[i])]++;
+        keys[position] = primary_keys[i];
+        rows[position] = i;
+        grouped_values[position] = values[i];
+        grouped_offsets[position] = -1;
+    }
+
+    int status = count, failed_shard = -1;
+    for (int s = 0; s < table->shard_count && failed_shard < 0; s++) {
+        int shard_rows = starts[s + 1] - starts[s];
+        if (shard_rows > 0 && insert_rows_batch_untimed(table->shards[s], shard_rows, keys + starts[s],
+                                                        grouped_values + starts[s],
+                                                        grouped_offsets + starts[s]) != shard_rows) {
+            failed_shard = s;
+        }
+    }
+    if (failed_shard >= 0) {
+        // The failed shard too may have kept the rows written before its failure
+        for (int i = 0; i < starts[failed_shard + 1]; i++) {
+            if (grouped_offsets[i] != -1) delete_row_untimed(shard_for_key(table, keys[i]), keys[i]);
+            grouped_offsets[i] = -1;
+        }
+        fprintf(stderr, "Error: Batch insert into table '%s' failed; no rows were inserted.\n", table->name);
+        status = -1;
+    }
+    for (int i = 0; offsets && i < count; i++) offsets[rows[i]] = grouped_offsets[i];
+
+    free(keys);
+    free(rows);
+    free(grouped_values);
+    free(grouped_offsets);
+    return status;
+}
+
+/**
+ * @brief insert_rows_batch_untimed (split by shard on a partitioned table),
+ * timed into the table's insert_batch duration metric.
+ */
+int insert_rows_batch(Table *table, int count, const int *primary_keys, char ***values, long *offsets) {
+    if (!table) return insert_rows_batch_untimed(table, count, primary_keys, values, offsets);
+    uint64_t start = metrics_start();
+    int result = table->shards ? insert_rows_partitioned(table, count, primary_keys, values, offsets)
+                               : insert_rows_batch_untimed(table, count, primary_keys, values, offsets);
+    metrics_observe_since(table->metrics.operations[TABLE_OP_INSERT_BATCH], start);
+    return result;
+}
+
+/**
+ * @brief Reads the record starting at offset in the data file with pread, so
+ * concurrent readers never share a stream position.
+ * @param table Pointer to the table.
+ * @param offset File offset of the record.
+ * @param buffer Caller's buffer, used when the record fits.
+ * @param size Size of buffer (at least RECORD_HEADER_MAX_SIZE).
+ * @param length Output: length of the record.
+ * @return buffer, or a heap buffer the caller must free for longer records.
+ * NULL if no complete record starts at offset, or on error.
+ */
+static unsigned char *pread_record(Table *table, long offset, unsigned char *buffer, size_t size, size_t *length) {
+    ssize_t got = data_io_read(table->io_backend, table->data_fd, buffer, size, offset);
+    if (got < 0) {
+        perror("Failed to read row data from file");
+        return NULL;
+    }
+    size_t record_len;
+    if (record_header(buffer, got, &record_len) == 0) return NULL;
+    *length = record_len;
+    metrics_count(table->metrics.bytes_read, record_len);
+    if (record_len <= (size_t)got) return buffer;
+
+    // Longer than the first read: fetch the whole record into a heap buffer
+    unsigned char *record = malloc(record_len);
+    if (!record) {
+        perror("Failed to allocate memory for long row");
+        return NULL;
+    }
+    memcpy(record, buffer, got);
+    size_t have = got;
+    while (have < record_len) {
+        ssize_t n = data_io_read(table->io_backend, table->data_fd, record + have, record_len - have, offset + have);
+        if (n <= 0) {
+            if (n < 0) perror("Failed to read row data from file");
+            free(record);
+            return NULL;
+        }
+        have += n;
+    }
+    return record;
+}
+
+/**
+ * @brief Finds the record starting at offset in the mapping of the data file.
+ * Call with the table locked, and use the record before unlocking: a writer
+ * may remap the file.
+ * @param table Pointer to the table (in mmap mode).
+ * @param offset File offset of the record.
+ * @param length Output: length of the record.
+ * @return Pointer into the mapping, or NULL if no complete record starts at offset.
+ */
+static const unsigned char *mapped_record(Table *table, long offset, size_t *length) {
+    if (offset < RECORD_FILE_HEADER_SIZE || offset >= table->data_size) return NULL;
+    size_t available = table->data_size - offset;
+    if (record_header(table->data_map + offset, available, length) == 0 || *length > available) return NULL;
+    metrics_count(table->metrics.bytes_read, *length);
+    return table->data_map + offset;
+}
+
+/**
+ * @brief Gets the record at offset: in place in mmap mode, else with pread.
+ * Call with the table locked, and release a record flagged in *owned with free().
+ * @param table Pointer to the table.
+ * @param offset File offset of the record.
+ * @param buffer Caller's buffer for pread mode.
+ * @param size Size of buffer.
+ * @param length Output: length of the record.
+ * @param owned Output: 1 if the record is a heap copy the caller must free.
+ * @return The record, or NULL if no complete record starts at offset.
+ */
+static const unsigned char *fetch_record(Table *table, long offset, unsigned char *buffer, size_t size,
+                                         size_t *length, int *owned) {
+    *owned = 0;
+    if (table->data_map) return mapped_record(table, offset, length);
+    unsigned char *record = pread_record(table, offset, buffer, size, length);
+    *owned = record && record != buffer;
+    return record;
+}
+
+/**
+ * @brief Removes the row stored at offset from the table's secondary indexes.
+ * Call with the table write-locked, before the row's key leaves the index.
+ * @param table Pointer to the table.
+ * @param primary_key The row's primary key.
+ * @param offset File offset of the row's record.
+ */
+static void unindex_record_at(Table *table, int primary_key, long offset) {
+    if (table->secondary_index_count == 0) return;
+
+    unsigned char buffer[MAX_ROW_LEN];
+    size_t record_len;
+    int owned;
+    const unsigned char *record = fetch_record(table, offset, buffer, sizeof(buffer), &record_len, &owned);
+    if (!record) return;
+    update_secondary_indexes(table, primary_key, record, record_len, 0);
+    if (owned) free((unsigned char *)record);
+}
+
+/**
+ * @brief Reads a row from the table using the primary key index.
+ * Takes the table's read lock, so any number of reads run in parallel. In
+ * mmap mode the row is decoded straight from the mapping.
+ * @param table Pointer to the table.
+ * @param primary_key The primary key of the row to read.
+ * @return Newly allocated array of strings (row data). Caller must free. NULL if not found/error.
+ */
+static char **read_row_untimed(Table *table, int primary_key) {
+    if (!table) return NULL;
+
+    unsigned char buffer[MAX_ROW_LEN]; // Buffer to read the row from the file
+    size_t record_len = 0;
+
+    lock_table_read(table); // Shared: concurrent reads only exclude writers
+
+    // 1. Search the index for the primary key to get the file offset
+    long file_offset = search_key(table->primary_index, primary_key);
+
+    // 2. If key not found in index, the row doesn't exist (or was deleted)
+    if (file_offset == -1) {
+        // This is a normal "not found" case, not necessarily an error.
+        pthread_rwlock_unlock(&table->lock);
+        return NULL;
+    }
+
+    // 3. Find the record at the row's offset, in place or read with pread
+    const unsigned char *record;
+    int mapped = table->data_map != NULL;
+    if (mapped) {
+        record = mapped_record(table, file_offset, &record_len);
+    } else {
+        record = pread_record(table, file_offset, buffer, sizeof(buffer), &record_len);
+    }
+    if (!record) {
+        pthread_rwlock_unlock(&table->lock);
+        // This indicates a potential inconsistency: index points past EOF.
+        fprintf(stderr, "Error: Found offset %ld for key %d, but could not read a row there in table '%s'. Possible data corruption.\n", file_offset, primary_key, table->name);
+        return NULL;
+    }
+
+    // 4. A record flagged deleted exists physically but is treated as not found
+    char **row_data = NULL;
+    if (!record_is_deleted(record)) {
+        // 5. Decode the fields in place into one string per column
+        row_data = record_decode(table->column_types, table->column_count, record, record_len);
+        if (!row_data) {
+            fprintf(stderr, "Error: Row at offset %ld for key %d in table '%s' could not be decoded. Data might be corrupt or schema mismatch.\n", file_offset, primary_key, table->name);
+        }
+    }
+    pthread_rwlock_unlock(&table->lock);
+
+    if (!mapped && record != buffer) free((unsigned char *)record);
+    return row_data; // Return the array of column strings
+}
+
+/**
+ * @brief read_row_untimed on the key's shard, timed into the table's read duration metric.
+ */
+char **read_row(Table *table, int primary_key) {
+    if (!table) return read_row_untimed(table, primary_key);
+    table = shard_for_key(table, primary_key);
+    uint64_t start = metrics_start();
+    char **result = read_row_untimed(table, primary_key);
+    metrics_observe_since(table->metrics.operations[TABLE_OP_READ], start);
+    return result;
+}
+
+/**
+ * @brief Looks up the data file offset of a row.
+ * @param table Pointer to the table.
+ * @param primary_key The primary key to look up.
+ * @return The row's offset, or -1 if not found.
+ */
+long find_row_offset(Table *table, int primary_key) {
+    if (!table) return -1;
+    table = shard_for_key(table, primary_key);
+
+    lock_table_read(table);
+    long file_offset = search_key(table->primary_index, primary_key);
+    pthread_rwlock_unlock(&table->lock);
+    return file_offset;
+}
+
+/**
+ * @brief qsort comparator for ascending ints.
+ */
+static int compare_ints(const void *a, const void *b) {
+    int left = *(const int *)a, right = *(const int *)b;
+    return (left > right) - (left < right);
+}
+
+/**
+ * @brief Collects the keys of every shard of a partitioned table, sorted
+ * together. Each shard is read-locked in turn, so the keys are not one snapshot.
+ * @param table Pointer to the partitioned table.
+ * @param count Output: number of keys returned.
+ * @return Newly allocated array of keys (caller must free), or NULL if empty.
+ */
+static int *collect_partitioned_keys(Table *table, int *count) {
+    int *keys = NULL, total = 0;
+    for (int s = 0; s < table->shard_count; s++) {
+        int shard_keys;
+        int *part = collect_primary_keys(table->shards[s], &shard_keys);
+        if (!part) continue;
+        int *grown = realloc(keys, (size_t)(total + shard_keys) * sizeof(int));
+        if (!grown) {
+            perror("Failed to allocate primary keys");
+            free(part);
+            free(keys);
+            return NULL;
+        }
+        keys = grown;
+        memcpy(keys + total, part, (size_t)shard_keys * sizeof(int));
+        total += shard_keys;
+        free(part);
+    }
+    if (total > 0) qsort(keys, total, sizeof(int), compare_ints);
+    *count = total;
+    return keys;
+}
+
+/**
+ * @brief Collects every primary key in the table in ascending order.
+ * @param table Pointer to the table.
+ * @param count Output: number of keys returned.
+ * @return Newly allocated array of keys (caller must free), or NULL if empty.
+ */
+int *collect_primary_keys(Table *table, int *count) {
+    *count = 0;
+    if (!table) return NULL;
+    if (table->shards) return collect_partitioned_keys(table, count);
+
+    lock_table_read(table);
+    int *keys = collect_all_keys(table->primary_index, count);
+    pthread_rwlock_unlock(&table->lock);
+    return keys;
+}
+
+// --- Snapshots ---
+// A range scan pins a snapshot of each table it reads: the data file size and
+// the delete count, taken under the read lock. Rows never move while one is
+// pinned, so the scan can let go of the lock between steps: a record at or
+// past the snapshot's end was written since, and the version the scan sees
+// is found by following the records' previous fields back below the end
+// (update_row chains each new version to the one it replaces). A row deleted
+// since is no longer in the index, so delete_row keeps it in table->retired
+// while snapshots are pinned. Moving rows (compaction, truncation) waits for
+// the snapshots to end first, which is what lets compaction drop old versions.
+
+#define SNAPSHOT_STEP_KEYS (4 * DATA_IO_BATCH) // Most keys a snapshot scan examines under one lock
+
+typedef struct {
+    long end;                   // Data file size: later records are newer than the snapshot
+    uint64_t deleted_at;        // Table's delete_seq: later retired rows were deleted since
+} Snapshot;
+
+/**
+ * @brief Pins a snapshot of the table. Call with the table read-locked.
+ * @param table Pointer to the table.
+ * @param snapshot Output: the snapshot.
+ * @return 0, or -1 if a writer is waiting to move the table's rows (the scan
+ * must hold the lock instead).
+ */
+static int pin_snapshot(Table *table, Snapshot *snapshot) {
+    if (__atomic_load_n(&table->draining, __ATOMIC_SEQ_CST) > 0) return -1;
+    __atomic_add_fetch(&table->snapshots, 1, __ATOMIC_SEQ_CST);
+    snapshot->end = table->data_size;
+    snapshot->deleted_at = table->delete_seq;
+    return 0;
+}
+
+/**
+ * @brief Ends a snapshot taken with pin_snapshot, waking a writer waiting
+ * for the last one. Needs no lock.
+ */
+static void unpin_snapshot(Table *table) {
+    if (__atomic_sub_fetch(&table->snapshots, 1, __ATOMIC_SEQ_CST) == 0 &&
+        __atomic_load_n(&table->draining, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&table->snapshot_lock);
+        pthread_cond_broadcast(&table->snapshot_done);
+        pthread_mutex_unlock(&table->snapshot_lock);
+    }
+}
+
+/**
+ * @brief Waits until no snapshot of the table is pinned, so its rows can move,
+ * and forgets the retired rows. Call with the table write-locked; the lock is
+ * released while waiting (other writers may run meanwhile) and held again on
+ * return. Until end_drain, new scans hold the lock instead of pinning.
+ * @param table Pointer to the table.
+ */
+static void wait_for_snapshots(Table *table) {
+    __atomic_add_fetch(&table->draining, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&table->snapshots, __ATOMIC_SEQ_CST) > 0) {
+        pthread_rwlock_unlock(&table->lock);
+        pthread_mutex_lock(&table->snapshot_lock);
+        while (__atomic_load_n(&table->snapshots, __ATOMIC_SEQ_CST) > 0) {
+            pthread_cond_wait(&table->snapshot_done, &table->snapshot_lock);
+        }
+        pthread_mutex_unlock(&table->snapshot_lock);
+        lock_table_write(table);
+    }
+    table->retired_count = 0;
+}
+
+static void end_drain(Table *table) {
+    __atomic_sub_fetch(&table->draining, 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Position of the first retired row with key >= key.
+ */
+static int first_retired_at_least(const Table *table, int key) {
+    int low = 0, high = table->retired_count;
+    while (low < high) {
+        int mid = (low + high) >> 1;
+        if (table->retired[mid].primary_key < key) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+/**
+ * @brief Makes room for one more retired row, so recording it once the
+ * delete is written can't fail. Call with the table write-locked.
+ * @return 0, or -1 on allocation failure.
+ */
+static int reserve_retired_row(Table *table) {
+    if (table->retired_count < table->retired_capacity) return 0;
+    int capacity = table->retired_capacity ? table->retired_capacity * 2 : 64;
+    RetiredRow *grown = realloc(table->retired, (size_t)capacity * sizeof(RetiredRow));
+    if (!grown) {
+        perror("Failed to allocate retired rows");
+        return -1;
+    }
+    table->retired = grown;
+    table->retired_capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Keeps a row just deleted for the pinned snapshots, after any earlier
+ * deletes of the same key. Call with the table write-locked, after
+ * reserve_retired_row.
+ * @param table Pointer to the table.
+ * @param primary_key The deleted row's key.
+ * @param file_offset Its record, which was current until the delete.
+ */
+static void retire_row(Table *table, int primary_key, long file_offset) {
+    int position = first_retired_at_least(table, primary_key);
+    while (position < table->retired_count && table->retired[position].primary_key == primary_key) position++;
+    memmove(&table->retired[position + 1], &table->retired[position],
+            (size_t)(table->retired_count - position) * sizeof(RetiredRow));
+    table->retired[position] = (RetiredRow){ primary_key, file_offset, ++table->delete_seq };
+    table->retired_count++;
+}
+
+// State shared by the rows of one scan
+typedef struct {
+    Table *table;               // Table scanned (partitioned or not), whose columns decode the rows
+    int column;                 // Column to match, or -1 to visit every row
+    const char *match;          // Canonical value to match
+    RowCallback callback;
+    void *context;
+    int rows;                   // Rows passed to callback
+    char *values[MAX_COLUMNS];  // Decoded row, pointing into text
+    char *text;
+    size_t text_capacity;
+    unsigned char buffer[MAX_ROW_LEN];
+    unsigned char *batch;       // DATA_IO_BATCH row buffers when rows are read in batches, else NULL
+    int batch_size;             // Rows read in the next batch
+    int pending;                // Rows queued for it
+    Table *tables[DATA_IO_BATCH]; // Table (or shard) each queued row is read from
+    int keys[DATA_IO_BATCH];
+    long offsets[DATA_IO_BATCH];
+    DataIoRead reads[DATA_IO_BATCH];
+    int versions;               // Rows come from a snapshot, where a deleted flag only means a newer version exists
+    const unsigned char *records[DATA_IO_BATCH]; // Snapshot scan: copies of a step's rows
+    size_t lengths[DATA_IO_BATCH];
+} RowScan;
+
+/**
+ * @brief Decodes a record and passes it to the scan's callback if it matches.
+ * @return Nonzero if the callback asked to stop.
+ */
+static int visit_record(RowScan *scan, int primary_key, const unsigned char *record, size_t record_len) {
+    Table *table = scan->table;
+    if ((record_is_deleted(record) && !scan->versions) ||
+        record_decode_into(table->column_types, table->column_count, record, record_len,
+                           scan->values, &scan->text, &scan->text_capacity) != 0) {
+        return 0;
+    }
+    if (scan->column >= 0 && strcmp(scan->values[scan->column], scan->match) != 0) return 0;
+
+    scan->rows++;
+    return scan->callback(scan->context, primary_key, scan->values);
+}
+
+/**
+ * @brief Decodes the row at offset and passes it to the scan's callback if it
+ * matches. Call with the table locked.
+ * @param table The table (or shard) holding the row.
+ * @return Nonzero if the callback asked to stop.
+ */
+static int visit_row(RowScan *scan, Table *table, int primary_key, long file_offset) {
+    size_t record_len = 0;
+    int owned;
+    const unsigned char *record = fetch_record(table, file_offset, scan->buffer, sizeof(scan->buffer),
+                                               &record_len, &owned);
+    if (!record) {
+        fprintf(stderr, "Error: Could not read row for key %d at offset %ld in table '%s'. Possible data corruption.\n", primary_key, file_offset, table->name);
+        return 0;
+    }
+
+    int stop = visit_record(scan, primary_key, record, record_len);
+    if (owned) free((unsigned char *)record);
+    return stop;
+}
+
+/**
+ * @brief Reads the scan's queued rows with one batched read, then visits them
+ * in key order. Each batch is twice the last, up to DATA_IO_BATCH, so a scan
+ * the callback stops early reads few rows past the end. Call with the table locked.
+ * @return Nonzero if the callback asked to stop.
+ */
+static int flush_pending_rows(RowScan *scan) {
+    int count = scan->pending;
+    scan->pending = 0;
+    for (int i = 0; i < count; i++) {
+        scan->reads[i].fd = scan->tables[i]->data_fd;
+        scan->reads[i].offset = scan->offsets[i];
+        scan->reads[i].buffer = scan->batch + (size_t)i * MAX_ROW_LEN;
+        scan->reads[i].size = MAX_ROW_LEN;
+    }
+    data_io_read_batch(scan->table->io_backend, scan->reads, count);
+    if (scan->batch_size < DATA_IO_BATCH) scan->batch_size *= 2;
+
+    for (int i = 0; i < count; i++) {
+        DataIoRead *read = &scan->reads[i];
+        size_t record_len;
+        int stop;
+        if (read->result > 0 && record_header(read->buffer, read->result, &record_len) != 0 &&
+            record_len <= (size_t)read->result) {
+            metrics_count(scan->tables[i]->metrics.bytes_read, record_len);
+            stop = visit_record(scan, scan->keys[i], read->buffer, record_len);
+        } else {
+            // Longer than MAX_ROW_LEN, or the read failed: read the row on its own
+            stop = visit_row(scan, scan->tables[i], scan->keys[i], scan->offsets[i]);
+        }
+        if (stop) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Visits the row at offset, or queues it to be read in a batch with
+ * the next rows when the scan reads in batches. Call with the table locked.
+ * @param table The table (or shard) holding the row.
+ * @return Nonzero if the callback asked to stop.
+ */
+static int scan_row_at(RowScan *scan, Table *table, int primary_key, long file_offset) {
+    if (!scan->batch || table->data_map) {
+        // Mapped rows are read in place, after the rows queued before them
+        if (scan->pending > 0 && flush_pending_rows(scan)) return 1;
+        return visit_row(scan, table, primary_key, file_offset);
+    }
+    scan->tables[scan->pending] = table;
+    scan->keys[scan->pending] = primary_key;
+    scan->offsets[scan->pending++] = file_offset;
+    return scan->pending == scan->batch_size ? flush_pending_rows(scan) : 0;
+}
+
+static pthread_once_t scan_batch_once = PTHREAD_ONCE_INIT;
+static pthread_key_t scan_batch_key;    // Frees a thread's batch buffers when it exits
+static __thread int scan_batch_busy;    // A scan of this thread is using them (callbacks may scan too)
+
+static void create_scan_batch_key() {
+    pthread_key_create(&scan_batch_key, free);
+}
+
+/**
+ * @brief The calling thread's DATA_IO_BATCH row buffers for batched scans,
+ * allocated once and reused, since scans are frequent and short. Hand them
+ * back with release_scan_batch.
+ * @return The buffers, or NULL if they are in use or can't be allocated.
+ */
+static unsigned char *thread_scan_batch() {
+    if (scan_batch_busy) return NULL;
+    pthread_once(&scan_batch_once, create_scan_batch_key);
+    unsigned char *batch = pthread_getspecific(scan_batch_key);
+    if (!batch) {
+        batch = malloc((size_t)DATA_IO_BATCH * MAX_ROW_LEN);
+        if (batch) pthread_setspecific(scan_batch_key, batch);
+    }
+    scan_batch_busy = batch != NULL;
+    return batch;
+}
+
+static void release_scan_batch(unsigned char *batch) {
+    if (batch) scan_batch_busy = 0;
+}
+
+/**
+ * @brief Position of the first key >= key in an ascending array.
+ */
+static int first_key_at_least(const int *keys, int count, int key) {
+    int low = 0, high = count;
+    while (low < high) {
+        int mid = (low + high) >> 1;
+        if (keys[mid] < key) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+// The rows of one table (or shard) a scan visits, in key order: a walk of its
+// primary index from lo, or the keys its secondary index holds for the value
+typedef struct {
+    Table *table;
+    BPlusTreeIterator it;
+    const int *index_keys;      // Keys from the secondary index
+    int index_count;
+    int index_position;
+    int use_index;
+    int primary_key;            // Current row, while valid
+    long file_offset;
+    int valid;                  // 0 once past hi
+} ScanCursor;
+
+/**
+ * @brief Advances a cursor to its next row with key <= hi. Call with the table locked.
+ */
+static void cursor_next(ScanCursor *cursor, int hi) {
+    if (!cursor->use_index) {
+        cursor->valid = bpt_iter_next(&cursor->it, &cursor->primary_key, &cursor->file_offset) &&
+                        cursor->primary_key <= hi;
+        return;
+    }
+    cursor->valid = 0;
+    while (cursor->index_position < cursor->index_count && cursor->index_keys[cursor->index_position] <= hi) {
+        int key = cursor->index_keys[cursor->index_position++];
+        long file_offset = search_key(cursor->table->primary_index, key);
+        if (file_offset != -1) {
+            cursor->primary_key = key;
+            cursor->file_offset = file_offset;
+            cursor->valid = 1;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Positions a cursor at a table's first row in [lo, hi], using the
+ * column's secondary index when it has one. Call with the table locked.
+ * @param column Column to match, or -1 for every row.
+ * @param match Canonical value to match.
+ */
+static void cursor_begin(ScanCursor *cursor, Table *table, int column, const char *match, int lo, int hi) {
+    cursor->table = table;
+    HashIndex *index = (column >= 0 && table->column_indexes) ? table->column_indexes[column] : NULL;
+    cursor->use_index = index != NULL;
+    if (index) {
+        // Only the rows holding the value, in key order
+        cursor->index_keys = hash_index_find(index, match, &cursor->index_count);
+        cursor->index_position = first_key_at_least(cursor->index_keys, cursor->index_count, lo);
+    } else {
+        cursor->it = bpt_iter_seek(table->primary_index, lo);
+    }
+    cursor_next(cursor, hi);
+}
+
+// One table (or shard) of a snapshot scan: its index and retired rows from
+// the step's first key
+typedef struct {
+    Table *table;
+    Snapshot snapshot;
+    BPlusTreeIterator it;
+    int has_row;                // The index has a row with key <= hi at it
+    int row_key;
+    long row_offset;
+    int retired_position;       // Next retired row to consider
+} SnapshotCursor;
+
+/**
+ * @brief Finds the version of a row a snapshot sees, following the previous
+ * fields back from the record at offset. Call with the table locked.
+ * @param scan The scan (for its read buffer).
+ * @param cursor The row's part of the scan.
+ * @param file_offset A record of the row.
+ * @return Offset of the version the snapshot sees, or -1 if the row did not
+ * exist yet when it was taken.
+ */
+static long snapshot_version(RowScan *scan, SnapshotCursor *cursor, long file_offset) {
+    Table *table = cursor->table;
+    while (file_offset >= cursor->snapshot.end) {
+        size_t record_len;
+        int owned;
+        const unsigned char *record = fetch_record(table, file_offset, scan->buffer, sizeof(scan->buffer),
+                                                   &record_len, &owned);
+        if (!record) return -1;
+        uint64_t previous = record_previous(table->column_types, table->column_count, record, record_len);
+        if (owned) free((unsigned char *)record);
+        if (previous == 0 || previous > (uint64_t)file_offset) return -1;
+        file_offset -= (long)previous;
+    }
+    return file_offset;
+}
+
+/**
+ * @brief Positions a snapshot cursor at its part's first candidates with key
+ * in [key, hi]. Call with the table locked.
+ */
+static void snapshot_cursor_seek(SnapshotCursor *cursor, int key, int hi) {
+    cursor->it = bpt_iter_seek(cursor->table->primary_index, key);
+    cursor->has_row = bpt_iter_next(&cursor->it, &cursor->row_key, &cursor->row_offset) && cursor->row_key <= hi;
+    cursor->retired_position = first_retired_at_least(cursor->table, key);
+}
+
+/**
+ * @brief Smallest key a snapshot cursor has a candidate for within hi.
+ * @return 1 and sets *key, or 0 when the cursor is done.
+ */
+static int snapshot_cursor_key(const SnapshotCursor *cursor, int hi, int *key) {
+    const Table *table = cursor->table;
+    int has_retired = cursor->retired_position < table->retired_count &&
+                      table->retired[cursor->retired_position].primary_key <= hi;
+    if (!cursor->has_row && !has_retired) return 0;
+    *key = cursor->has_row ? cursor->row_key : INT_MAX;
+    if (has_retired && table->retired[cursor->retired_position].primary_key < *key) {
+        *key = table->retired[cursor->retired_position].primary_key;
+    }
+    return 1;
+}
+
+/**
+ * @brief Takes a cursor's candidates for key: its index entry and the rows
+ * retired under that key. At most one of them is visible to the snapshot.
+ * Call with the table locked.
+ * @return Offset of the version the snapshot sees, or -1 if none.
+ */
+static long snapshot_cursor_take(RowScan *scan, SnapshotCursor *cursor, int key, int hi) {
+    Table *table = cursor->table;
+    long visible = -1;
+    if (cursor->has_row && cursor->row_key == key) {
+        visible = snapshot_version(scan, cursor, cursor->row_offset);
+        cursor->has_row = bpt_iter_next(&cursor->it, &cursor->row_key, &cursor->row_offset) && cursor->row_key <= hi;
+    }
+    while (cursor->retired_position < table->retired_count &&
+           table->retired[cursor->retired_position].primary_key == key) {
+        RetiredRow *retired = &table->retired[cursor->retired_position++];
+        if (visible == -1 && retired->deleted_at > cursor->snapshot.deleted_at) {
+            visible = snapshot_version(scan, cursor, retired->file_offset);
+        }
+    }
+    return visible;
+}
+
+/**
+ * @brief Copies the step's rows out of the data files with one batched read
+ * (in place from the mapping in mmap mode) into the scan's row buffers.
+ * Call with the tables locked; release the copies with free_step_rows.
+ * @return Number of rows copied; unreadable rows are reported and dropped.
+ */
+static int copy_step_rows(RowScan *scan, unsigned char *buffers, int count) {
+    int queued = 0;
+    for (int i = 0; i < count; i++) {
+        if (scan->tables[i]->data_map) continue;
+        DataIoRead *read = &scan->reads[queued++];
+        read->fd = scan->tables[i]->data_fd;
+        read->offset = scan->offsets[i];
+        read->buffer = buffers + (size_t)i * MAX_ROW_LEN;
+        read->size = MAX_ROW_LEN;
+    }
+    data_io_read_batch(scan->table->io_backend, scan->reads, queued);
+
+    int kept = 0;
+    queued = 0;
+    for (int i = 0; i < count; i++) {
+        Table *table = scan->tables[i];
+        unsigned char *buffer = buffers + (size_t)kept * MAX_ROW_LEN;
+        const unsigned char *record = NULL;
+        size_t record_len = 0;
+        if (table->data_map) {
+            const unsigned char *mapped = mapped_record(table, scan->offsets[i], &record_len);
+            if (mapped && record_len <= MAX_ROW_LEN) {
+                memcpy(buffer, mapped, record_len);
+                record = buffer;
+            } else if (mapped && (record = malloc(record_len))) {
+                memcpy((unsigned char *)record, mapped, record_len);
+            }
+        } else {
+            DataIoRead *read = &scan->reads[queued++];
+            if (read->result > 0 && record_header(read->buffer, read->result, &record_len) != 0 &&
+                record_len <= (size_t)read->result) {
+                metrics_count(table->metrics.bytes_read, record_len);
+                if (read->buffer != buffer) memmove(buffer, read->buffer, record_len);
+                record = buffer;
+            } else {
+                // Longer than MAX_ROW_LEN, or the read failed: read the row on its own
+                record = pread_record(table, scan->offsets[i], buffer, MAX_ROW_LEN, &record_len);
+            }
+        }
+        if (!record) {
+            fprintf(stderr, "Error: Could not read row for key %d at offset %ld in table '%s'. Possible data corruption.\n", scan->keys[i], scan->offsets[i], table->name);
+            continue;
+        }
+        scan->keys[kept] = scan->keys[i];
+        scan->records[kept] = record;
+        scan->lengths[kept++] = record_len;
+    }
+    return kept;
+}
+
+static void free_step_rows(RowScan *scan, unsigned char *buffers, int count) {
+    for (int i = 0; i < count; i++) {
+        const unsigned char *slot = buffers + (size_t)i * MAX_ROW_LEN;
+        if (scan->records[i] != slot) free((unsigned char *)scan->records[i]);
+    }
+}
+
+/**
+ * @brief Snapshot body of scan_matching_rows (see Snapshots): repeatedly
+ * read-locks the parts (in order) for just long enough to copy out the next
+ * rows the snapshots see, then passes them to the callback unlocked. Steps
+ * grow like batched reads, from SCAN_FIRST_BATCH rows to DATA_IO_BATCH.
+ * @param cursors One cursor per part, with its table and pinned snapshot set.
+ * @param buffers DATA_IO_BATCH row buffers of MAX_ROW_LEN bytes.
+ */
+static void scan_snapshot(RowScan *scan, SnapshotCursor *cursors, int part_count, int lo, int hi,
+                          unsigned char *buffers) {
+    scan->versions = 1;
+    int next_key = lo, step = SCAN_FIRST_BATCH, finished = 0;
+    while (!finished) {
+        for (int p = 0; p < part_count; p++) lock_table_read(cursors[p].table);
+        for (int p = 0; p < part_count; p++) snapshot_cursor_seek(&cursors[p], next_key, hi);
+
+        // Gather whole keys, stopping before a new one once the step is full
+        int count = 0, examined = 0;
+        while (1) {
+            int key = 0, has_key = 0;
+            for (int p = 0; p < part_count; p++) {
+                int part_key;
+                if (snapshot_cursor_key(&cursors[p], hi, &part_key) && (!has_key || part_key < key)) {
+                    key = part_key;
+                    has_key = 1;
+                }
+            }
+            if (!has_key) {
+                finished = 1;
+                break;
+            }
+            if (count == step || examined == SNAPSHOT_STEP_KEYS) {
+                next_key = key;
+                break;
+            }
+            examined++;
+            for (int p = 0; p < part_count; p++) {
+                long file_offset = snapshot_cursor_take(scan, &cursors[p], key, hi);
+                if (file_offset == -1) continue;
+                scan->tables[count] = cursors[p].table;
+                scan->keys[count] = key;
+                scan->offsets[count++] = file_offset;
+                break; // Keys are in one shard only
+            }
+        }
+        count = copy_step_rows(scan, buffers, count);
+        for (int p = part_count - 1; p >= 0; p--) pthread_rwlock_unlock(&cursors[p].table->lock);
+
+        int stopped = 0;
+        for (int i = 0; i < count && !stopped; i++) {
+            stopped = visit_record(scan, scan->keys[i], scan->records[i], scan->lengths[i]);
+        }
+        free_step_rows(scan, buffers, count);
+        if (stopped) finished = 1;
+        if (step < DATA_IO_BATCH) step *= 2;
+    }
+}
+
+/**
+ * @brief Shared body of scan_rows and scan_rows_where. A range scan reads at
+ * a snapshot with scan_snapshot; other scans (and scans of a table waiting to
+ * be compacted) hold the read lock throughout. A partitioned table is scanned
+ * with every shard read-locked (in order) and a cursor per shard, always
+ * visiting the smallest key next, so rows still come in key order.
+ * @param column Column to match, or -1 for every row.
+ * @param match Canonical value to match.
+ * @return Number of rows passed to callback, or -1 on error.
+ */
+static int scan_matching_rows(Table *table, int column, const char *match, int lo, int hi,
+                              RowCallback callback, void *context) {
+    if (!table || !callback) return -1;
+    uint64_t start = metrics_start();
+
+    // An equality match on an integer key is just a one-key range
+    if (column == 0 && table->column_types[0] == COLUMN_INT) {
+        if (match[0] == '\0') return 0;
+        int key = atoi(match);
+        if (key < lo || key > hi) return 0;
+        lo = hi = key;
+        column = -1;
+    }
+
+    RowScan *scan = malloc(sizeof(RowScan));
+    if (!scan) {
+        perror("Failed to allocate row scan");
+        return -1;
+    }
+    scan->table = table;
+    scan->column = column;
+    scan->match = match;
+    scan->callback = callback;
+    scan->context = context;
+    scan->rows = 0;
+    scan->text = NULL;
+    scan->text_capacity = 0;
+    scan->batch_size = SCAN_FIRST_BATCH;
+    scan->pending = 0;
+    scan->versions = 0;
+    // Range scans copy rows out of snapshots in the batch buffers. Holding the
+    // lock, batches only pay off with io_uring; without a buffer rows are read one by one.
+    unsigned char *batch = lo != hi ? thread_scan_batch() : NULL;
+    scan->batch = table->io_backend == DATA_IO_URING ? batch : NULL;
+
+    // A one-key range is in a single shard
+    Table **parts = &table;
+    int part_count = 1;
+    if (table->shards && lo == hi) {
+        parts = &table->shards[shard_index(table, lo)];
+    } else if (table->shards) {
+        parts = table->shards;
+        part_count = table->shard_count;
+    }
+    for (int p = 0; p < part_count; p++) lock_table_read(parts[p]);
 
-        // Write the sanitized value and the appropriate delimiter
-        if (fprintf(table->data_file, "%s%c", sanitized_value, (i == table->column_count - 1) ? '\n' : '|') < 0) {
-            perror("Failed to write column data");
-            // Attempt to truncate back to original position? Very difficult to guarantee consistency.
-             pthread_mutex_unlock(&table->lock);
-             return -1;
-        }
+    // Pin a snapshot of every part at once, or of none. Secondary index scans
+    // keep the lock, since the index's key lists may change once it is let go.
+    SnapshotCursor snapshots[MAX_TABLE_SHARDS];
+    int pinned = 0;
+    while (batch && pinned < part_count &&
+           !(column >= 0 && parts[pinned]->column_indexes && parts[pinned]->column_indexes[column]) &&
+           pin_snapshot(parts[pinned], &snapshots[pinned].snapshot) == 0) {
+        snapshots[pinned].table = parts[pinned];
+        pinned++;
+    }
+    if (pinned < part_count) {
+        while (pinned > 0) unpin_snapshot(parts[--pinned]);
     }
 
-    // 5. Flush the file stream to ensure data is passed to the OS buffer
-    if (fflush(table->data_file) != 0) {
-        perror("Failed to flush data file after insert");
-        // Data might be partially written. Consider the insert failed.
-        // We didn't add to index yet, so state is somewhat recoverable.
-        pthread_mutex_unlock(&table->lock);
-        return -1; // Indicate failure
+    if (pinned > 0) {
+        for (int p = part_count - 1; p >= 0; p--) pthread_rwlock_unlock(&parts[p]->lock);
+        scan_snapshot(scan, snapshots, part_count, lo, hi, batch);
+        for (int p = 0; p < part_count; p++) unpin_snapshot(parts[p]);
+    } else {
+        ScanCursor cursors[MAX_TABLE_SHARDS];
+        for (int p = 0; p < part_count; p++) cursor_begin(&cursors[p], parts[p], column, match, lo, hi);
+        int stopped = 0;
+        while (!stopped) {
+            ScanCursor *next = NULL;
+            for (int p = 0; p < part_count; p++) {
+                if (cursors[p].valid && (!next || cursors[p].primary_key < next->primary_key)) next = &cursors[p];
+            }
+            if (!next) break;
+            stopped = scan_row_at(scan, next->table, next->primary_key, next->file_offset);
+            cursor_next(next, hi);
+        }
+        if (!stopped && scan->pending > 0) flush_pending_rows(scan);
+        for (int p = part_count - 1; p >= 0; p--) pthread_rwlock_unlock(&parts[p]->lock);
     }
-    // For stronger durability guarantee (at performance cost), use fsync:
-    // fsync(fileno(table->data_file));
 
-    // 6. If writing seems successful, insert the primary key and its offset into the B+ Tree index
-    insert_key(table->primary_index, primary_key, current_offset);
-    result_offset = current_offset; // Set the successful offset to return
+    int rows = scan->rows;
+    release_scan_batch(batch);
+    free(scan->text);
+    free(scan);
+    // A one-key range is how point reads by primary key reach the table
+    metrics_observe_since(table->metrics.operations[lo == hi ? TABLE_OP_READ : TABLE_OP_SCAN], start);
+    return rows;
+}
 
-    pthread_mutex_unlock(&table->lock); // Unlock the table
-    return result_offset;
+/**
+ * @brief Visits the rows with keys in [lo, hi] in key order.
+ * @param table Pointer to the table.
+ * @param lo Smallest key to visit.
+ * @param hi Largest key to visit.
+ * @param callback Called for each row; a nonzero return stops the scan.
+ * @param context Passed to callback.
+ * @return Number of rows passed to callback, or -1 on error.
+ */
+int scan_rows(Table *table, int lo, int hi, RowCallback callback, void *context) {
+    return scan_matching_rows(table, -1, NULL, lo, hi, callback, context);
 }
 
 /**
- * @brief Reads a row from the table using the primary key index.
+ * @brief Visits the rows with keys in [lo, hi] whose column equals value.
  * @param table Pointer to the table.
- * @param primary_key The primary key of the row to read.
- * @return Newly allocated array of strings (row data). Caller must free. NULL if not found/error.
+ * @param column Index of the column to match.
+ * @param value Value to match, canonicalised for the column's type first.
+ * @param lo Smallest key to visit.
+ * @param hi Largest key to visit.
+ * @param callback Called for each row; a nonzero return stops the scan.
+ * @param context Passed to callback.
+ * @return Number of rows passed to callback, or -1 on error.
  */
-char **read_row(Table *table, int primary_key) {
-    if (!table || !table->data_file || !table->primary_index) return NULL;
+int scan_rows_where(Table *table, int column, const char *value, int lo, int hi,
+                    RowCallback callback, void *context) {
+    if (!table || column < 0 || column >= table->column_count) return -1;
 
-    char **row_data = NULL;
-    char buffer[MAX_ROW_LEN]; // Buffer to read the row from the file
+    char canonical[32];
+    const char *match = record_canonical_value(table->column_types[column], value, canonical, sizeof(canonical));
+    if (!match) return 0; // Not a value of the column's type: nothing can match
+    return scan_matching_rows(table, column, match, lo, hi, callback, context);
+}
 
-    pthread_mutex_lock(&table->lock); // Lock for thread safety
+// One shard's secondary index built by a pool thread (see create_column_index)
+typedef struct {
+    Table *table;
+    int column;
+    int status;                 // Result of create_column_index
+} ShardIndexBuild;
 
-    // 1. Search the index for the primary key to get the file offset
-    long file_offset = search_key(table->primary_index, primary_key);
+static void build_shard_index(void *arg) {
+    ShardIndexBuild *build = (ShardIndexBuild *)arg;
+    build->status = create_column_index(build->table, build->column);
+}
 
-    // 2. If key not found in index, the row doesn't exist (or was deleted)
-    if (file_offset == -1) {
-        // This is a normal "not found" case, not necessarily an error.
-        // fprintf(stderr, "Debug: Row with primary key %d not found in index for table '%s'.\n", primary_key, table->name);
-        pthread_mutex_unlock(&table->lock);
-        return NULL;
+/**
+ * @brief Builds a secondary index on a column from the table's current rows.
+ * @param table Pointer to the table.
+ * @param column Index of the column.
+ * @return 0 on success (or if the column is already indexed), -1 on failure.
+ */
+int create_column_index(Table *table, int column) {
+    if (!table || column < 0 || column >= table->column_count) {
+        fprintf(stderr, "Error: Invalid arguments for create_column_index.\n");
+        return -1;
     }
-
-    // 3. Seek to the record's position in the data file using the offset
-    if (fseek(table->data_file, file_offset, SEEK_SET) != 0) {
-        char errorMsg[100];
-        snprintf(errorMsg, 100, "Failed to seek to row offset %ld for key %d", file_offset, primary_key);
-        perror(errorMsg);
-        pthread_mutex_unlock(&table->lock);
-        return NULL;
+    if (column == 0) return 0; // Lookups on the primary key already use the primary index
+    if (table->shards) {
+        // Each shard scans its own rows, so they are indexed in parallel
+        ShardIndexBuild *builds = calloc(table->shard_count, sizeof(ShardIndexBuild));
+        if (!builds) {
+            perror("Failed to allocate shard index builds");
+            return -1;
+        }
+        for (int s = 0; s < table->shard_count; s++) {
+            builds[s].table = table->shards[s];
+            builds[s].column = column;
+        }
+        run_parallel(build_shard_index, builds, sizeof(ShardIndexBuild), table->shard_count);
+        int status = 0;
+        for (int s = 0; s < table->shard_count; s++) {
+            if (builds[s].status != 0) status = -1;
+        }
+        free(builds);
+        return status;
     }
 
-    // 4. Read the line/row from the file into the buffer
-    if (fgets(buffer, sizeof(buffer), table->data_file) == NULL) {
-        if (feof(table->data_file)) {
-             // This indicates a potential inconsistency: index points past EOF.
-             fprintf(stderr, "Error: Found offset %ld for key %d, but reached EOF unexpectedly in table '%s'. Possible data corruption.\n", file_offset, primary_key, table->name);
-        } else {
-             // Other read error
-             perror("Failed to read row data from file");
+    lock_table_write(table);
+    if (!table->column_indexes) {
+        table->column_indexes = calloc(table->column_count, sizeof(HashIndex *));
+        if (!table->column_indexes) {
+            perror("Failed to allocate secondary index table");
+            pthread_rwlock_unlock(&table->lock);
+            return -1;
         }
-        pthread_mutex_unlock(&table->lock);
-        return NULL;
     }
-
-    // 5. Check if the row is marked as deleted (first character)
-    if (buffer[0] == DELETED_MARKER) {
-        // Row exists physically but is logically deleted. Treat as not found.
-        // fprintf(stderr, "Debug: Row with primary key %d found at offset %ld but is marked as deleted.\n", primary_key, file_offset);
-        pthread_mutex_unlock(&table->lock);
-        return NULL;
+    if (table->column_indexes[column]) {
+        pthread_rwlock_unlock(&table->lock);
+        return 0;
     }
-     if (buffer[0] != ' ') {
-         // First character should be space for valid row or '#' for deleted. Anything else is corruption.
-         fprintf(stderr, "Error: Row at offset %ld for key %d has invalid marker character '%c'. Possible data corruption.\n", file_offset, primary_key, buffer[0]);
-          pthread_mutex_unlock(&table->lock);
-         return NULL;
-     }
 
-
-    // 6. Allocate memory for the result array (char **) to hold column strings
-    row_data = (char **)malloc(table->column_count * sizeof(char *));
-    if (!row_data) {
-        perror("Failed to allocate memory for row data array");
-        pthread_mutex_unlock(&table->lock);
-        return NULL;
+    HashIndex *index = hash_index_create();
+    if (!index) {
+        pthread_rwlock_unlock(&table->lock);
+        return -1;
     }
-    // Initialize pointers to NULL for easier cleanup on error
-    for(int i=0; i < table->column_count; ++i) row_data[i] = NULL;
-
-    // 7. Parse the line using strtok_r (re-entrant version of strtok)
-    // Start parsing *after* the initial marker character (space).
-    char *line_start = buffer + 1;
-    char *token;
-    char *saveptr; // Pointer for strtok_r state
-    int col_idx = 0;
-
-    token = strtok_r(line_start, "|\n", &saveptr); // Get first token
-    while (token != NULL && col_idx < table->column_count) {
-        row_data[col_idx] = strdup(token); // Duplicate the token string
-        if (!row_data[col_idx]) {
-            perror("Failed to duplicate token string");
-            // Cleanup already duplicated tokens and the array itself
-            for (int j = 0; j < col_idx; j++) free(row_data[j]);
-            free(row_data);
-            pthread_mutex_unlock(&table->lock);
-            return NULL;
+
+    // One pass over the live rows
+    unsigned char buffer[MAX_ROW_LEN];
+    char *values[MAX_COLUMNS];
+    int rows = 0, failed = 0;
+    BPlusTreeIterator it = bpt_iter_seek(table->primary_index, INT_MIN);
+    int primary_key;
+    long file_offset;
+    while (!failed && bpt_iter_next(&it, &primary_key, &file_offset)) {
+        size_t record_len;
+        int owned;
+        const unsigned char *record = fetch_record(table, file_offset, buffer, sizeof(buffer), &record_len, &owned);
+        if (!record) continue;
+        if (!record_is_deleted(record) &&
+            record_decode_into(table->column_types, table->column_count, record, record_len,
+                               values, &table->index_text, &table->index_text_capacity) == 0) {
+            failed = hash_index_add(index, values[column], primary_key) != 0;
+            rows++;
         }
-        col_idx++;
-        token = strtok_r(NULL, "|\n", &saveptr); // Get next token
+        if (owned) free((unsigned char *)record);
+    }
+    if (failed) {
+        fprintf(stderr, "Error: Failed to build index on column '%s' of table '%s'.\n", table->columns[column], table->name);
+        hash_index_destroy(index);
+        pthread_rwlock_unlock(&table->lock);
+        return -1;
     }
 
-    // 8. Check if the number of parsed columns matches the expected count
-    if (col_idx != table->column_count) {
-        fprintf(stderr, "Warning: Row for key %d at offset %ld in table '%s' has %d columns, expected %d. Data might be corrupt or schema mismatch.\n", primary_key, file_offset, table->name, col_idx, table->column_count);
-        // Cleanup and return NULL as the data is inconsistent
-        for (int j = 0; j < col_idx; j++) free(row_data[j]);
-        free(row_data);
-        row_data = NULL;
+    table->column_indexes[column] = index;
+    table->secondary_index_count++;
+    pthread_rwlock_unlock(&table->lock);
+    printf("Created index on column '%s' of table '%s' (%d rows).\n", table->columns[column], table->name, rows);
+    return 0;
+}
+
+/**
+ * @brief Switches a table between mmap mode and pread mode.
+ * @param table Pointer to the table.
+ * @param enabled 1 for mmap mode, 0 for pread.
+ * @return 0 on success, -1 if the file could not be mapped.
+ */
+int set_table_mmap(Table *table, int enabled) {
+    if (!table) return -1;
+    if (table->shards) {
+        int status = 0;
+        for (int s = 0; s < table->shard_count; s++) {
+            if (set_table_mmap(table->shards[s], enabled) != 0) status = -1;
+        }
+        return status;
     }
 
-    pthread_mutex_unlock(&table->lock); // Unlock the table
-    return row_data; // Return the array of column strings
+    lock_table_write(table);
+    int status = 0;
+    if (!enabled) {
+        unmap_data_file(table);
+    } else if (!table->data_map) {
+        status = map_data_file(table);
+    }
+    pthread_rwlock_unlock(&table->lock);
+    return status;
 }
 
 /**
@@ -489,11 +3303,12 @@ char **read_row(Table *table, int primary_key) {
  * @param primary_key The primary key of the row to delete.
  * @return 0 on success, -1 on failure.
  */
-int delete_row(Table *table, int primary_key) {
-    if (!table || !table->data_file || !table->primary_index) return -1;
+static int delete_row_untimed(Table *table, int primary_key) {
+    if (!table) return -1;
     int result = -1;
 
-    pthread_mutex_lock(&table->lock); // Lock for thread safety
+    lock_table_write(table); // Lock for thread safety
+    invalidate_catalog(table->database);
 
     // 1. Find the offset of the row using the index
     long file_offset = search_key(table->primary_index, primary_key);
@@ -501,141 +3316,105 @@ int delete_row(Table *table, int primary_key) {
     // 2. If key not found, cannot delete
     if (file_offset == -1) {
         // fprintf(stderr, "Debug: Row with primary key %d not found for deletion in table '%s'.\n", primary_key, table->name);
-        pthread_mutex_unlock(&table->lock);
+        pthread_rwlock_unlock(&table->lock);
         return -1;
     }
-
-    // 3. Seek to the beginning of the record in the data file
-    if (fseek(table->data_file, file_offset, SEEK_SET) != 0) {
-        char errorMsg[100];
-        snprintf(errorMsg, 100, "Failed to seek to row offset %ld for delete (key %d)", file_offset, primary_key);
-        perror(errorMsg);
-        pthread_mutex_unlock(&table->lock);
+    // Scans at a snapshot still see the row, so keep it for them
+    int retire = __atomic_load_n(&table->snapshots, __ATOMIC_SEQ_CST) > 0;
+    if (!retire) {
+        table->retired_count = 0; // No snapshot older than the deletes is left
+    } else if (reserve_retired_row(table) != 0) {
+        pthread_rwlock_unlock(&table->lock);
         return -1;
     }
+    if (table->row_cache) row_cache_invalidate(table->row_cache, primary_key);
 
-    // 4. Overwrite the first character with the DELETED_MARKER
-    if (fputc(DELETED_MARKER, table->data_file) == EOF) {
-         perror("Failed to write delete marker");
-         pthread_mutex_unlock(&table->lock);
-         return -1;
-    }
-
-    // 5. Flush the change to ensure the marker is written to OS buffers
-     if (fflush(table->data_file) != 0) {
-        perror("Failed to flush data file after marking delete");
-        // Attempt to undo? fseek back, fputc ' '? Risky. Consider delete failed.
-        pthread_mutex_unlock(&table->lock);
+    // 3. Log the delete, then set the deleted flag in the record's header
+    static const unsigned char deleted_flag = RECORD_FLAG_DELETED;
+    WalWrite write = { file_offset + RECORD_FLAGS_OFFSET, &deleted_flag, 1 };
+    int64_t lsn = log_writes(table, &write, 1);
+    if (lsn < 0 || mark_record_deleted(table, file_offset) != 0) {
+        pthread_rwlock_unlock(&table->lock);
         return -1;
     }
-    // Optional: fsync for stronger guarantee
-    // fsync(fileno(table->data_file));
 
-    // 6. If marking the row seems successful, remove the key from the B+ Tree index
+    // 4. If marking the row seems successful, remove the key from the B+ Tree index
+    count_dead_record(table, file_offset);
+    unindex_record_at(table, primary_key, file_offset);
     delete_key(table->primary_index, primary_key);
+    table->row_count--;
+    sync_index(table);
+    if (retire) retire_row(table, primary_key, file_offset);
+    notify_change(table, ROW_CHANGE_DELETE, primary_key, NULL, 0);
     result = 0; // Indicate success
 
-    pthread_mutex_unlock(&table->lock); // Unlock the table
+    pthread_rwlock_unlock(&table->lock); // Unlock the table
+    if (finish_write(table, lsn) != 0) return -1;
+    return result;
+}
+
+/**
+ * @brief delete_row_untimed on the key's shard, timed into the table's delete duration metric.
+ */
+int delete_row(Table *table, int primary_key) {
+    if (!table) return delete_row_untimed(table, primary_key);
+    table = shard_for_key(table, primary_key);
+    uint64_t start = metrics_start();
+    int result = delete_row_untimed(table, primary_key);
+    metrics_observe_since(table->metrics.operations[TABLE_OP_DELETE], start);
     return result;
 }
 
 /**
- * @brief Updates a row by marking the old one deleted and inserting the new data.
+ * @brief Updates a row by marking the old one deleted and inserting the new
+ * data, which points back at the old version for scans at earlier snapshots.
  * @param table Pointer to the table.
  * @param primary_key The primary key of the row to update (assumed not to change).
  * @param new_values Array of strings with the new column values.
  * @return The new file offset of the updated row, or -1 on failure.
  */
-long update_row(Table *table, int primary_key, char **new_values) {
-     if (!table || !table->data_file || !table->primary_index || !new_values) return -1;
+static long update_row_untimed(Table *table, int primary_key, char **new_values) {
+     if (!table || !new_values) return -1;
      long new_offset = -1;
 
-     pthread_mutex_lock(&table->lock); // Lock for the entire update operation
+     lock_table_write(table); // Lock for the entire update operation
+     invalidate_catalog(table->database);
 
-     // --- Step 1: Mark the old row as deleted ---
-
-     // 1a. Find the offset of the existing row
+     // --- Step 1: Find the existing row and encode the new one ---
+     // Encoding first means a value that does not fit its column leaves the old row untouched.
      long old_offset = search_key(table->primary_index, primary_key);
      if (old_offset == -1) {
-         fprintf(stderr, "Error: Row with primary key %d not found for update in table '%s'.\n", primary_key, table->name);
-         pthread_mutex_unlock(&table->lock);
-         return -1;
-     }
-
-     // 1b. Seek to the old row's position
-     if (fseek(table->data_file, old_offset, SEEK_SET) != 0) {
-         char errorMsg[100];
-         snprintf(errorMsg, 100, "Failed to seek to old offset %ld for update (key %d)", old_offset, primary_key);
-         perror(errorMsg);
-         pthread_mutex_unlock(&table->lock);
-         return -1;
-     }
-
-     // 1c. Write the delete marker
-     if (fputc(DELETED_MARKER, table->data_file) == EOF) {
-         perror("Failed to write delete marker during update");
-         pthread_mutex_unlock(&table->lock);
+         LOG_DEBUG("Row with primary key %d not found for update in table '%s'.", primary_key, table->name);
+         pthread_rwlock_unlock(&table->lock);
          return -1;
      }
-
-     // 1d. Flush the marker write
-      if (fflush(table->data_file) != 0) {
-         perror("Failed to flush delete marker during update");
-         pthread_mutex_unlock(&table->lock);
+     // The new version is appended at data_size and points back at the old one
+     long record_len = encode_row(table, new_values, (uint64_t)(table->data_size - old_offset));
+     if (record_len < 0) {
+         pthread_rwlock_unlock(&table->lock);
          return -1;
      }
-     // Optional: fsync(fileno(table->data_file));
-
-
-     // --- Step 2: Append the new row data ---
+     if (table->row_cache) row_cache_invalidate(table->row_cache, primary_key);
 
-     // 2a. Seek to the end of the file
-     if (fseek(table->data_file, 0, SEEK_END) != 0) {
-         perror("Failed to seek to end of file for update append");
-         // State is inconsistent: old row marked deleted, new not written.
-         // Rollback is difficult here without proper transaction log.
-         pthread_mutex_unlock(&table->lock);
+     // --- Step 2: Mark the old row as deleted and append the new row data ---
+     // Both writes go in one log record, so after a crash either both are
+     // replayed or neither is: the row can't be left deleted without its new version.
+     static const unsigned char deleted_flag = RECORD_FLAG_DELETED;
+     WalWrite writes[2] = {
+         { old_offset + RECORD_FLAGS_OFFSET, &deleted_flag, 1 },
+         { table->data_size, table->record_buffer, (uint32_t)record_len }
+     };
+     int64_t lsn = log_writes(table, writes, 2);
+     if (lsn < 0 || mark_record_deleted(table, old_offset) != 0) {
+         pthread_rwlock_unlock(&table->lock);
          return -1;
      }
-
-     // 2b. Get the offset where the new data will start
-     new_offset = ftell(table->data_file);
+     new_offset = append_record(table, record_len);
      if (new_offset == -1) {
-         perror("Failed to get new offset for update append");
-         pthread_mutex_unlock(&table->lock);
-         return -1;
-     }
-
-     // 2c. Write the new row data (similar to insert_row)
-     if (fprintf(table->data_file, " ") < 1) { // Valid marker
-         perror("Failed to write row marker for updated row");
-          pthread_mutex_unlock(&table->lock);
+         // State is inconsistent until the next start, when the logged update is replayed
+         pthread_rwlock_unlock(&table->lock);
          return -1;
      }
-     for (int i = 0; i < table->column_count; i++) {
-         char sanitized_value[MAX_ROW_LEN];
-         strncpy(sanitized_value, new_values[i] ? new_values[i] : "", MAX_ROW_LEN - 1);
-         sanitized_value[MAX_ROW_LEN - 1] = '\0';
-         char *ptr = sanitized_value;
-         while (*ptr) {
-             if (*ptr == '|' || *ptr == '\n' || *ptr == DELETED_MARKER) *ptr = '_';
-             ptr++;
-         }
-         if (fprintf(table->data_file, "%s%c", sanitized_value, (i == table->column_count - 1) ? '\n' : '|') < 0) {
-              perror("Failed to write updated column data");
-              pthread_mutex_unlock(&table->lock);
-              return -1;
-         }
-     }
-
-     // 2d. Flush the newly appended data
-     if (fflush(table->data_file) != 0) {
-         perror("Failed to flush new data during update");
-         pthread_mutex_unlock(&table->lock);
-         return -1; // New data might be partially written. Inconsistent state.
-     }
-     // Optional: fsync(fileno(table->data_file));
-
 
      // --- Step 3: Update the index ---
      // Remove the old entry (which pointed to old_offset) and insert the new entry
@@ -643,32 +3422,55 @@ long update_row(Table *table, int primary_key, char **new_values) {
      // If PK could change, the logic would need adjustment (delete old PK, insert new PK).
      delete_key(table->primary_index, primary_key);
      insert_key(table->primary_index, primary_key, new_offset);
+     sync_index(table);
+     count_dead_record(table, old_offset);
+     unindex_record_at(table, primary_key, old_offset);
+     update_secondary_indexes(table, primary_key, table->record_buffer, record_len, 1);
+     notify_change(table, ROW_CHANGE_PUT, primary_key, table->record_buffer, (size_t)record_len);
 
-     pthread_mutex_unlock(&table->lock); // Unlock the table
+     pthread_rwlock_unlock(&table->lock); // Unlock the table
+     if (finish_write(table, lsn) != 0) return -1;
      return new_offset; // Return the offset of the newly written data
 }
 
+/**
+ * @brief update_row_untimed on the key's shard, timed into the table's update duration metric.
+ */
+long update_row(Table *table, int primary_key, char **new_values) {
+    if (!table) return update_row_untimed(table, primary_key, new_values);
+    table = shard_for_key(table, primary_key);
+    uint64_t start = metrics_start();
+    long result = update_row_untimed(table, primary_key, new_values);
+    metrics_observe_since(table->metrics.operations[TABLE_OP_UPDATE], start);
+    return result;
+}
+
 
 // --- Basic Transaction Control (Non-ACID) ---
 
 /**
- * @brief Flushes file buffers to the operating system.
- * Does NOT guarantee data is written to persistent storage (disk).
- * This is NOT an ACID commit.
- * @param table Pointer to the table whose file buffer should be flushed.
+ * @brief Makes every write to the table so far durable: waits for the
+ * write-ahead log to be fsynced, or without a log fsyncs the data file.
+ * This is NOT an ACID commit (there is no isolation or atomic multi-row unit).
+ * @param table Pointer to the table to commit.
  */
 void commit_transaction(Table *table) {
-    if (!table || !table->data_file) return;
-    pthread_mutex_lock(&table->lock);
-    if (fflush(table->data_file) != 0) {
-        perror("fflush failed during commit_transaction");
+    if (!table) return;
+    if (table->database && table->database->wal) {
+        if (wal_sync(table->database->wal) != 0) {
+            fprintf(stderr, "Error: Write-ahead log sync failed during commit_transaction.\n");
+        }
+        return;
+    }
+    if (table->shards) {
+        for (int s = 0; s < table->shard_count; s++) commit_transaction(table->shards[s]);
+        return;
+    }
+    lock_table_write(table);
+    if (fflush(table->data_file) != 0 || fdatasync(table->data_fd) != 0) {
+        perror("Sync failed during commit_transaction");
     }
-    // For stronger durability (at significant performance cost), use fsync:
-    // if (fsync(fileno(table->data_file)) != 0) {
-    //     perror("fsync failed during commit_transaction");
-    // }
-    pthread_mutex_unlock(&table->lock);
-    // printf("Transaction flushed for table '%s'.\n", table->name); // Optional log
+    pthread_rwlock_unlock(&table->lock);
 }
 
 /**
@@ -677,34 +3479,86 @@ void commit_transaction(Table *table) {
  * @param table Pointer to the table to rollback/clear.
  */
 void rollback_transaction(Table *table) {
-    if (!table || !table->data_file || !table->primary_index) return;
-    pthread_mutex_lock(&table->lock);
+    if (!table) return;
+    if (table->shards) {
+        for (int s = 0; s < table->shard_count; s++) rollback_transaction(table->shards[s]);
+        return;
+    }
+    lock_table_write(table);
+    invalidate_catalog(table->database);
+    wait_for_snapshots(table); // Offsets are about to be reused
+    if (log_table_rewrite(table) != 0) {
+        fprintf(stderr, "Error: Rollback of table '%s' aborted.\n", table->name);
+        end_drain(table);
+        pthread_rwlock_unlock(&table->lock);
+        return;
+    }
 
     // 1. Truncate the physical data file to zero length
     if (ftruncate(fileno(table->data_file), 0) != 0) {
          perror("ftruncate failed during rollback_transaction");
          // Continue to clear index anyway, but file state is uncertain.
     }
-    // Reset file pointer to the beginning after truncation
+    // Reset file pointer to the beginning after truncation and rewrite the file header
     rewind(table->data_file);
+    unsigned char file_header[RECORD_FILE_HEADER_SIZE];
+    record_file_header(file_header, table->column_types, table->column_count);
+    if (fwrite(file_header, 1, sizeof(file_header), table->data_file) != sizeof(file_header) ||
+        fflush(table->data_file) != 0) {
+        perror("Failed to rewrite data file header during rollback_transaction");
+    }
 
-    // 2. Destroy the existing B+ Tree index
-    destroy_tree(table->primary_index);
-
-    // 3. Initialize a new, empty B+ Tree index
-    table->primary_index = initialize_tree();
-    if (!table->primary_index) {
-        // This is a critical error, the table is now unusable.
-        fprintf(stderr, "CRITICAL ERROR: Failed to re-initialize index during rollback for table '%s'. Table is inconsistent.\n", table->name);
-        // Consider exiting or marking the table as unusable.
+    // 2. Empty the B+ Tree index and record the empty data file
+    clear_tree(table->primary_index);
+    table->data_size = RECORD_FILE_HEADER_SIZE;
+    table->row_count = 0;
+    table->dead_bytes = 0;
+    table->dead_bytes_known = 1;
+    table->file_generation++; // A compaction copying the old rows must not swap them in
+    sync_index(table);
+    for (int i = 0; table->column_indexes && i < table->column_count; i++) {
+        if (table->column_indexes[i]) hash_index_clear(table->column_indexes[i]);
+    }
+    if (table->row_cache) row_cache_clear(table->row_cache);
+    notify_change(table, ROW_CHANGE_TRUNCATE, 0, NULL, 0);
+    if (table->database && table->database->wal && make_table_durable(table) != 0) {
+        fprintf(stderr, "Warning: Cleared table '%s' may not survive a crash.\n", table->name);
     }
 
-    pthread_mutex_unlock(&table->lock);
+    end_drain(table);
+    pthread_rwlock_unlock(&table->lock);
     printf("Transaction rolled back (table '%s' cleared).\n", table->name);
 }
 
 // --- Utility Functions ---
 
+/**
+ * @brief Installs the listener told about every row change (see ChangeListener).
+ * @param db Pointer to the Database.
+ * @param listener The listener, or NULL to remove it.
+ * @param context Passed to listener.
+ */
+void set_change_listener(Database *db, ChangeListener listener, void *context) {
+    if (!db) return;
+    db->change_context = context;
+    db->change_listener = listener;
+}
+
+/**
+ * @brief Looks up a table by name, skipping the shards of partitioned tables.
+ * @param db Pointer to the Database.
+ * @param table_name Name of the table.
+ * @return The table, or NULL if there is none of that name.
+ */
+Table *find_table(Database *db, const char *table_name) {
+    if (!db || !table_name) return NULL;
+    for (int i = 0; i < db->table_count; i++) {
+        Table *table = db->tables[i];
+        if (table && !table->parent && strcmp(table->name, table_name) == 0) return table;
+    }
+    return NULL;
+}
+
 /**
  * @brief Prints the schema information (tables and columns) for the database.
  * @param db Pointer to the Database.
@@ -736,156 +3590,601 @@ void print_database(Database *db) {
      printf("--- End Schema ---\n\n");
 }
 
+// --- Compaction ---
+// Updates and deletes leave dead records in the data file until the table is
+// compacted. Compaction copies the live records to a new file with pread while
+// the table stays readable and writable: records before the end of the copied
+// range never move meanwhile, they can only be flagged deleted. It then
+// write-locks the table just long enough to walk the old and new indexes
+// together, dropping rows deleted since the copy and copying rows written
+// since, and to swap in the new file and index. Only the current version of
+// each row is copied, so this is also the garbage collection of old versions:
+// before the swap it waits for the scans reading at snapshots to end (see
+// Snapshots). A background thread per database compacts tables once enough
+// of their data file is dead.
+
+#define COMPACT_CHUNK_SIZE ((size_t)1 << 20) // Bytes read or buffered for writing at once
+#define COMPACT_PACE_STEP (256L << 10)       // Bytes moved between rate limit checks
+
+// Sequential pread of the records in [RECORD_FILE_HEADER_SIZE, end) of a data file
+typedef struct {
+    int fd;
+    long end;
+    long offset;                // File offset of buffer[0]
+    unsigned char *buffer;
+    size_t length;              // Bytes read into buffer
+    size_t position;            // Start of the next record in buffer
+    size_t capacity;
+} ChunkReader;
+
+static int chunk_reader_init(ChunkReader *reader, int fd, long end) {
+    reader->fd = fd;
+    reader->end = end;
+    reader->offset = RECORD_FILE_HEADER_SIZE;
+    reader->length = 0;
+    reader->position = 0;
+    reader->capacity = COMPACT_CHUNK_SIZE;
+    reader->buffer = malloc(reader->capacity);
+    if (!reader->buffer) {
+        perror("Failed to allocate compaction read buffer");
+        return -1;
+    }
+    return 0;
+}
+
 /**
- * @brief Compacts the table's data file by removing deleted rows.
- * Reads the old file, writes valid rows to a temporary file, rebuilds the index,
- * and replaces the old file with the temporary file. This is an I/O intensive operation.
- * @param table Pointer to the Table to compact.
+ * @brief Reads the next record, refilling the buffer a chunk at a time.
+ * @param reader The reader.
+ * @param record Output: the record, valid until the next call.
+ * @param offset Output: the record's file offset.
+ * @return The record length, 0 at the end of the range, or -1 on a read error
+ * or if the range does not end on a whole record (the file was truncated).
  */
-void compact_table(Table *table) {
-    if (!table || !table->data_file || !table->primary_index) {
-         fprintf(stderr, "Error: Cannot compact invalid table.\n");
-         return;
+static long chunk_next(ChunkReader *reader, const unsigned char **record, long *offset) {
+    while (1) {
+        size_t available = reader->length - reader->position;
+        size_t record_len = 0;
+        size_t header_len = record_header(reader->buffer + reader->position, available, &record_len);
+        if (header_len != 0 && record_len <= available) {
+            *record = reader->buffer + reader->position;
+            *offset = reader->offset + (long)reader->position;
+            reader->position += record_len;
+            return (long)record_len;
+        }
+        long next = reader->offset + (long)reader->position;
+        if (next + (long)available >= reader->end) return available == 0 ? 0 : -1;
+
+        // Keep the partial record at the front and read more after it
+        memmove(reader->buffer, reader->buffer + reader->position, available);
+        reader->offset = next;
+        reader->position = 0;
+        reader->length = available;
+        if (header_len != 0 && record_len > reader->capacity) {
+            unsigned char *grown = realloc(reader->buffer, record_len);
+            if (!grown) {
+                perror("Failed to grow compaction read buffer");
+                return -1;
+            }
+            reader->buffer = grown;
+            reader->capacity = record_len;
+        }
+        size_t want = reader->capacity - reader->length;
+        long left = reader->end - (reader->offset + (long)reader->length);
+        if ((long)want > left) want = (size_t)left;
+        ssize_t got = pread(reader->fd, reader->buffer + reader->length, want, reader->offset + reader->length);
+        if (got < 0) {
+            perror("Failed to read data file during compaction");
+            return -1;
+        }
+        if (got == 0) return -1; // Shorter than when the compaction started
+        reader->length += got;
+    }
+}
+
+/**
+ * @brief Writes all of a buffer at an offset of a file.
+ * @return 0 on success, -1 on an I/O error.
+ */
+static int pwrite_all(int fd, const unsigned char *bytes, size_t length, long offset) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pwrite(fd, bytes + done, length - done, offset + done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("Failed to write compacted data file");
+            return -1;
+        }
+        done += n;
     }
+    return 0;
+}
 
-    pthread_mutex_lock(&table->lock); // Lock the table during compaction
-    printf("Compacting table '%s'...\n", table->name);
+// Buffered appends to the compacted data file
+typedef struct {
+    int fd;
+    long size;                  // Bytes written to the file
+    unsigned char *buffer;      // COMPACT_CHUNK_SIZE bytes following size
+    size_t length;
+} CompactWriter;
 
-    // --- Setup: Temp file and new index ---
+static int writer_flush(CompactWriter *writer) {
+    if (pwrite_all(writer->fd, writer->buffer, writer->length, writer->size) != 0) return -1;
+    writer->size += writer->length;
+    writer->length = 0;
+    return 0;
+}
 
-    // Build the correct directory path the same way create_table does
-    char lowercase_name[FILENAME_BUF_SIZE];
-    strncpy(lowercase_name, table->name, FILENAME_BUF_SIZE - 1);
-    lowercase_name[FILENAME_BUF_SIZE - 1] = '\0';
-    for (int i = 0; lowercase_name[i]; i++) {
-        lowercase_name[i] = tolower((unsigned char)lowercase_name[i]);
+/**
+ * @brief Appends bytes to the compacted file.
+ * @return Their offset in the file, or -1 on an I/O error.
+ */
+static long writer_append(CompactWriter *writer, const unsigned char *bytes, size_t length) {
+    if (writer->length + length > COMPACT_CHUNK_SIZE && writer_flush(writer) != 0) return -1;
+    long offset = writer->size + (long)writer->length;
+    if (length > COMPACT_CHUNK_SIZE) { // Buffer is empty after the flush above
+        if (pwrite_all(writer->fd, bytes, length, offset) != 0) return -1;
+        writer->size += length;
+        return offset;
     }
+    memcpy(writer->buffer + writer->length, bytes, length);
+    writer->length += length;
+    return offset;
+}
 
-    char scaffolded_path[FILENAME_BUF_SIZE];
-    if (join_project_path(scaffolded_path, sizeof(scaffolded_path), "scaffolded_resources") != 0) {
-        fprintf(stderr, "Error: Could not build scaffolded_resources path during compaction.\n");
-        pthread_mutex_unlock(&table->lock);
-        return;
+/**
+ * @brief Flags a record already appended to the compacted file as deleted.
+ * @param writer The writer.
+ * @param offset Offset returned by writer_append for the record.
+ * @return The record length, or -1 on an I/O error.
+ */
+static long writer_mark_deleted(CompactWriter *writer, long offset) {
+    unsigned char header[RECORD_HEADER_MAX_SIZE];
+    unsigned char *bytes = header;
+    size_t available;
+    if (offset >= writer->size) {
+        bytes = writer->buffer + (offset - writer->size);
+        available = writer->length - (offset - writer->size);
+    } else {
+        ssize_t got = pread(writer->fd, header, sizeof(header), offset);
+        if (got <= 0) {
+            perror("Failed to read compacted data file");
+            return -1;
+        }
+        available = got;
     }
+    size_t length;
+    if (record_header(bytes, available, &length) == 0) return -1;
+    if (offset >= writer->size) {
+        bytes[RECORD_FLAGS_OFFSET] = RECORD_FLAG_DELETED;
+        return (long)length;
+    }
+    static const unsigned char deleted_flag = RECORD_FLAG_DELETED;
+    return pwrite_all(writer->fd, &deleted_flag, 1, offset + RECORD_FLAGS_OFFSET) == 0 ? (long)length : -1;
+}
 
-    char resource_dir[FILENAME_BUF_SIZE];
-    snprintf(resource_dir, sizeof(resource_dir), "%s/%s", scaffolded_path, lowercase_name);
+/**
+ * @brief The time ns nanoseconds after start.
+ */
+static struct timespec time_after(const struct timespec *start, long long ns) {
+    struct timespec t = { start->tv_sec + (time_t)(ns / 1000000000LL), start->tv_nsec + (long)(ns % 1000000000LL) };
+    if (t.tv_nsec >= 1000000000L) {
+        t.tv_sec++;
+        t.tv_nsec -= 1000000000L;
+    }
+    return t;
+}
+
+/**
+ * @brief Keeps compaction I/O within the database's rate limit by sleeping
+ * until moving bytes since start fits it.
+ * @param db The table's database (NULL: no limit).
+ * @param start When the compaction started (CLOCK_MONOTONIC).
+ * @param bytes Bytes read and written since start.
+ * @return 0, or -1 if the compactor is stopping and the compaction should give up.
+ */
+static int pace_compaction(Database *db, const struct timespec *start, long bytes) {
+    if (!db) return 0;
+    pthread_mutex_lock(&db->compactor_lock);
+    if (db->compact_rate > 0) {
+        struct timespec until = time_after(start, (long long)((double)bytes / db->compact_rate * 1e9));
+        while (!db->compactor_stopping &&
+               pthread_cond_timedwait(&db->compactor_wake, &db->compactor_lock, &until) != ETIMEDOUT) {
+        }
+    }
+    int stopping = db->compactor_stopping;
+    pthread_mutex_unlock(&db->compactor_lock);
+    return stopping ? -1 : 0;
+}
+
+// A row whose copy is out of date when the copy phase ends
+typedef struct {
+    int key;
+    long live_offset;           // Offset in the current data file, -1 if the row was deleted
+    long copy_offset;           // Offset in the compacted file, -1 if it wasn't copied
+} CompactFixup;
+
+/**
+ * @brief Compacts the table's data file: copies its live records to a new file
+ * while the table stays available, then catches up and swaps the files and
+ * index under a short write lock (see the section comment). I/O is paced by
+ * the database's compaction rate.
+ * @param table Pointer to the Table to compact.
+ * @return 0 on success (or if the table is already being compacted), -1 on failure.
+ */
+static int compact_table_untimed(Table *table) {
+    if (!table) {
+         fprintf(stderr, "Error: Cannot compact invalid table.\n");
+         return -1;
+    }
+    Database *db = table->database;
 
     char temp_filename[FILENAME_BUF_SIZE];
-    snprintf(temp_filename, sizeof(temp_filename), "%s/%s.tmp", resource_dir, lowercase_name);
+    char temp_index_filename[FILENAME_BUF_SIZE];
+    char data_filename[FILENAME_BUF_SIZE];
+    char index_filename[FILENAME_BUF_SIZE];
+    if (table_file_path(table->name, ".tmp", temp_filename, sizeof(temp_filename)) != 0 ||
+        table_file_path(table->name, ".idx.tmp", temp_index_filename, sizeof(temp_index_filename)) != 0 ||
+        table_file_path(table->name, ".dat", data_filename, sizeof(data_filename)) != 0 ||
+        table_file_path(table->name, ".idx", index_filename, sizeof(index_filename)) != 0) {
+        fprintf(stderr, "Error: Could not build scaffolded_resources path during compaction.\n");
+        return -1;
+    }
 
-    // Open temporary file for writing binary data
-    FILE *temp_file = fopen(temp_filename, "wb");
-    if (!temp_file) {
-        perror("Failed to open temporary file for compaction");
-        pthread_mutex_unlock(&table->lock);
-        return;
+    // Claim the table and fix the range to copy
+    lock_table_write(table);
+    if (table->compacting) {
+        pthread_rwlock_unlock(&table->lock);
+        return 0;
     }
+    table->compacting = 1;
+    long copy_end = table->data_size;
+    int data_fd = table->data_fd;
+    unsigned long generation = table->file_generation;
+    pthread_rwlock_unlock(&table->lock);
+    LOG_INFO("Compacting table '%s'...", table->name);
 
-    // Create a new B+ Tree index to be populated during compaction
-    BPlusTree *new_index = initialize_tree();
-    if (!new_index) {
-         fprintf(stderr, "Error: Failed to create new index for compaction\n");
-         fclose(temp_file);
-         remove(temp_filename); // Clean up temp file
-         pthread_mutex_unlock(&table->lock);
-         return;
-    }
-
-    // --- Process old file: Read, Filter, Write, Re-index ---
-    rewind(table->data_file); // Start reading from the beginning of the old file
-    char buffer[MAX_ROW_LEN];
-    long current_write_offset = 0; // Tracks offset in the *new* temp file
-
-    while (fgets(buffer, sizeof(buffer), table->data_file) != NULL) {
-        // Check if the row is valid (not marked as deleted)
-        if (buffer[0] != DELETED_MARKER && buffer[0] == ' ') {
-            // This is a valid row, write it to the temp file
-            // Get primary key from the row data (assuming first column is PK)
-             char temp_buffer_for_parse[MAX_ROW_LEN]; // Use copy for strtok
-             strncpy(temp_buffer_for_parse, buffer + 1, MAX_ROW_LEN -1); // Copy data part
-             temp_buffer_for_parse[MAX_ROW_LEN -1] = '\0';
-
-             char *first_col = strtok(temp_buffer_for_parse, "|"); // Modifies temp_buffer_for_parse
-             if (first_col) {
-                 int primary_key = atoi(first_col); // Convert PK string to int
-
-                 // Write the original valid row (including the space marker) to the temp file
-                 if (fputs(buffer, temp_file) == EOF) {
-                      perror("Failed to write row to temp file during compaction");
-                      fclose(temp_file); remove(temp_filename); destroy_tree(new_index);
-                      pthread_mutex_unlock(&table->lock); return;
-                 }
+    int status = -1;
+    int locked = 0, drained = 0;
+    ChunkReader reader = { 0 };
+    CompactWriter writer = { -1, 0, NULL, 0 };
+    CompactFixup *fixups = NULL;
+    int fixup_count = 0, fixup_capacity = 0;
+    long dead_bytes = 0;        // Dead records left in the compacted file
 
-                 // Add the key and its *new* offset in the temp file to the new index
-                 insert_key(new_index, primary_key, current_write_offset);
+    writer.fd = open(temp_filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    writer.buffer = malloc(COMPACT_CHUNK_SIZE);
+    remove(temp_index_filename); // Never reuse a leftover from an interrupted compaction
+    BPlusTree *new_index = open_tree(temp_index_filename);
+    if (writer.fd < 0 || !writer.buffer || !new_index || chunk_reader_init(&reader, data_fd, copy_end) != 0) {
+        perror("Failed to set up compaction");
+        goto done;
+    }
+    unsigned char file_header[RECORD_FILE_HEADER_SIZE];
+    record_file_header(file_header, table->column_types, table->column_count);
+    if (writer_append(&writer, file_header, sizeof(file_header)) < 0) goto done;
 
-                 // Update the write offset for the next valid row
-                 // ftell after fputs gives the position *after* the write
-                 current_write_offset = ftell(temp_file);
-                 if(current_write_offset == -1) {
-                     perror("ftell failed on temp file during compaction");
-                     fclose(temp_file); remove(temp_filename); destroy_tree(new_index);
-                     pthread_mutex_unlock(&table->lock); return;
-                 }
-             } else {
-                 // Should not happen with valid data, indicates potential corruption
-                 fprintf(stderr, "Warning: Could not parse primary key during compaction for row: %s", buffer);
-             }
+    // --- Copy the live records of [header, copy_end) without the lock ---
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long paced = 0;
+    const unsigned char *record;
+    long record_len, record_offset;
+    while ((record_len = chunk_next(&reader, &record, &record_offset)) > 0) {
+        long moved = reader.offset + (long)reader.length + writer.size;
+        if (moved - paced >= COMPACT_PACE_STEP) {
+            if (pace_compaction(db, &start, moved) != 0) goto done;
+            paced = moved;
+        }
+        if (record_is_deleted(record)) continue;
+
+        int primary_key;
+        if (record_primary_key(table->column_types, table->column_count, record, record_len, &primary_key) != 0) {
+            fprintf(stderr, "Warning: Could not read primary key during compaction for record of %ld bytes.\n", record_len);
+            continue;
+        }
+        long new_offset = writer_append(&writer, record, record_len);
+        if (new_offset < 0) goto done;
+        // Keep the last copy of a key stored twice (left by a crash), as rebuild_index does
+        long previous = search_key(new_index, primary_key);
+        if (previous != -1) {
+            long dead = writer_mark_deleted(&writer, previous);
+            if (dead < 0) goto done;
+            dead_bytes += dead;
+            delete_key(new_index, primary_key);
+        }
+        insert_key(new_index, primary_key, new_offset);
+    }
+    // Writing the new index now leaves only the pages the catch-up changes for the lock
+    if (record_len < 0 || writer_flush(&writer) != 0 || sync_tree(new_index, writer.size) != 0) goto done;
+
+    // --- Catch up and swap under the write lock ---
+    // Once no snapshot is left, no scan needs the versions the copy dropped
+    lock_table_write(table);
+    invalidate_catalog(table->database);
+    locked = 1;
+    wait_for_snapshots(table);
+    drained = 1;
+    if (table->file_generation != generation) {
+        fprintf(stderr, "Warning: Table '%s' was cleared during compaction.\n", table->name);
+        goto done;
+    }
+
+    // Walk both indexes in key order. A key only in the copy was deleted since;
+    // one at or past copy_end in the table was written since.
+    BPlusTreeIterator live = bpt_iter_seek(table->primary_index, INT_MIN);
+    BPlusTreeIterator copied = bpt_iter_seek(new_index, INT_MIN);
+    int live_key = 0, copied_key = 0;
+    long live_offset = -1, copied_offset = -1;
+    int has_live = bpt_iter_next(&live, &live_key, &live_offset);
+    int has_copied = bpt_iter_next(&copied, &copied_key, &copied_offset);
+    while (has_live || has_copied) {
+        CompactFixup fixup;
+        if (has_copied && (!has_live || copied_key < live_key)) {
+            fixup = (CompactFixup){ copied_key, -1, copied_offset };
+            has_copied = bpt_iter_next(&copied, &copied_key, &copied_offset);
+        } else if (!has_copied || live_key < copied_key) {
+            fixup = (CompactFixup){ live_key, live_offset, -1 };
+            has_live = bpt_iter_next(&live, &live_key, &live_offset);
+        } else {
+            int written_since = live_offset >= copy_end;
+            fixup = (CompactFixup){ live_key, live_offset, copied_offset };
+            has_live = bpt_iter_next(&live, &live_key, &live_offset);
+            has_copied = bpt_iter_next(&copied, &copied_key, &copied_offset);
+            if (!written_since) continue; // The copy is current
         }
-        // If row starts with DELETED_MARKER, skip it (don't write to temp file)
+        if (fixup_count == fixup_capacity) {
+            int capacity = fixup_capacity ? fixup_capacity * 2 : 64;
+            CompactFixup *grown = realloc(fixups, capacity * sizeof(CompactFixup));
+            if (!grown) {
+                perror("Failed to allocate compaction catch-up list");
+                goto done;
+            }
+            fixups = grown;
+            fixup_capacity = capacity;
+        }
+        fixups[fixup_count++] = fixup;
     }
 
-    // --- Finalization: Replace files and index ---
-    // Ensure all data is written to the temp file buffer
-    if (fflush(temp_file) != 0) {
-         perror("Failed to flush temp file before closing");
-         fclose(temp_file); remove(temp_filename); destroy_tree(new_index);
-         pthread_mutex_unlock(&table->lock); return;
+    unsigned char buffer[MAX_ROW_LEN];
+    for (int i = 0; i < fixup_count; i++) {
+        if (fixups[i].copy_offset != -1) {
+            long dead = writer_mark_deleted(&writer, fixups[i].copy_offset);
+            if (dead < 0) goto done;
+            dead_bytes += dead;
+            delete_key(new_index, fixups[i].key);
+        }
+        if (fixups[i].live_offset == -1) continue;
+
+        size_t length;
+        unsigned char *row = pread_record(table, fixups[i].live_offset, buffer, sizeof(buffer), &length);
+        if (!row) {
+            fprintf(stderr, "Error: Could not read row %d during compaction.\n", fixups[i].key);
+            goto done;
+        }
+        long new_offset = writer_append(&writer, row, length);
+        if (row != buffer) free(row);
+        if (new_offset < 0) goto done;
+        insert_key(new_index, fixups[i].key, new_offset);
+    }
+    if (writer_flush(&writer) != 0) goto done;
+    if (db && db->wal && fdatasync(writer.fd) != 0) {
+        perror("Failed to sync compacted data file");
+        goto done;
     }
-    // Optional: fsync(fileno(temp_file));
-    fclose(temp_file); // Close the temporary file
 
-    // Close the old data file (it's no longer needed)
+    // Rows move, so logged offsets won't apply to the new file
+    if (log_table_rewrite(table) != 0) goto done;
+
+    // Open the new file before renaming it over the old one, so a failure
+    // leaves the table on its old file
+    FILE *compacted = fopen(temp_filename, "r+b");
+    if (!compacted) {
+        perror("Failed to open compacted data file");
+        goto done;
+    }
+    if (rename(temp_filename, data_filename) != 0) {
+        perror("Failed to rename compacted data file");
+        fclose(compacted);
+        goto done;
+    }
+    long old_size = table->data_size;
+    int was_mapped = table->data_map != NULL;
+    unmap_data_file(table);
     fclose(table->data_file);
-    table->data_file = NULL; // Mark as closed
-
-    // Replace the old data file with the compacted temporary file
-    char old_filename[FILENAME_BUF_SIZE];
-    snprintf(old_filename, sizeof(old_filename), "%s/%s.dat", resource_dir, lowercase_name);
-    if (remove(old_filename) != 0) {
-        // If remove fails, the original file might still exist.
-        perror("Failed to remove old data file during compaction");
-        remove(temp_filename); // Try to clean up temp file
-        destroy_tree(new_index); // Free the index we built
-        // Attempt to reopen old file? Table state is inconsistent.
-        fprintf(stderr, "Error: Compaction failed for table '%s'. Original file may still exist, but index is lost.\n", table->name);
-        pthread_mutex_unlock(&table->lock);
-        return;
+    table->data_file = compacted;
+    table->data_fd = fileno(compacted);
+    table->data_size = writer.size;
+    if (was_mapped) map_data_file(table);
+
+    // Write the new index and move it over the old one. If this fails the old
+    // .idx no longer matches the data file and is rebuilt on the next start.
+    if (sync_tree(new_index, table->data_size) != 0 || rename(temp_index_filename, index_filename) != 0) {
+        perror("Failed to replace index file during compaction");
     }
-    if (rename(temp_filename, old_filename) != 0) {
-         // If rename fails, the old file is gone, but the temp file couldn't be renamed.
-         perror("Failed to rename temporary data file during compaction");
-         destroy_tree(new_index);
-         fprintf(stderr, "Error: Compaction failed for table '%s'. Data file lost or inaccessible.\n", table->name);
-         pthread_mutex_unlock(&table->lock);
-         return;
+    destroy_tree(table->primary_index);
+    table->primary_index = new_index;
+    new_index = NULL;
+    table->dead_bytes = dead_bytes;
+    table->dead_bytes_known = 1;
+    table->file_generation++;
+
+    // Later logged writes use offsets in the new file, so the rename must be durable first
+    if (db && db->wal && make_table_durable(table) != 0) {
+        fprintf(stderr, "Warning: Compacted table '%s' may not survive a crash.\n", table->name);
     }
+    LOG_INFO("Table '%s' compacted from %ld to %ld bytes (%d rows caught up).",
+             table->name, old_size, table->data_size, fixup_count);
+    metrics_count(table->metrics.bytes_read, (uint64_t)copy_end);
+    metrics_count(table->metrics.bytes_written, (uint64_t)table->data_size);
+    status = 0;
 
-    // Reopen the newly compacted data file for the table
-    table->data_file = fopen(old_filename, "r+b");
-    if (!table->data_file) {
-        perror("Failed to reopen compacted data file");
-        destroy_tree(new_index); // Free the new index as we can't use it
-        fprintf(stderr, "Error: Compaction failed for table '%s'. Could not reopen data file.\n", table->name);
-        pthread_mutex_unlock(&table->lock);
+done:
+    if (status != 0) fprintf(stderr, "Error: Compaction of table '%s' did not complete.\n", table->name);
+    if (!locked) lock_table_write(table);
+    if (drained) end_drain(table);
+    table->compacting = 0;
+    pthread_rwlock_unlock(&table->lock);
+
+    free(reader.buffer);
+    free(writer.buffer);
+    free(fixups);
+    if (writer.fd >= 0) close(writer.fd);
+    if (new_index) {
+        destroy_tree(new_index);
+        remove(temp_index_filename);
+    }
+    if (status != 0) remove(temp_filename);
+    return status;
+}
+
+/**
+ * @brief compact_table_untimed (on each shard of a partitioned table), timed
+ * into the table's compact duration metric.
+ */
+int compact_table(Table *table) {
+    if (!table) return compact_table_untimed(table);
+    uint64_t start = metrics_start();
+    int result = 0;
+    if (table->shards) {
+        // One shard at a time, so the others stay fully available
+        for (int s = 0; s < table->shard_count; s++) {
+            if (compact_table_untimed(table->shards[s]) != 0) result = -1;
+        }
+    } else {
+        result = compact_table_untimed(table);
+    }
+    metrics_observe_since(table->metrics.operations[TABLE_OP_COMPACT], start);
+    return result;
+}
+
+/**
+ * @brief Counts the dead records a table's data file held when it opened
+ * (the index was not rebuilt, so nothing counted them), reading the file with
+ * pread outside the lock. A delete made during the count may be counted
+ * twice; dead_bytes only decides when to compact, which resets it exactly.
+ * @param table Pointer to the table.
+ */
+static void count_dead_bytes(Table *table) {
+    lock_table_write(table);
+    if (table->dead_bytes_known || table->compacting) {
+        pthread_rwlock_unlock(&table->lock);
         return;
     }
+    table->compacting = 1; // Keeps compaction from replacing the file mid-count
+    table->dead_bytes = 0; // Deletes from now on are counted as they happen
+    long end = table->data_size;
+    int data_fd = table->data_fd;
+    unsigned long generation = table->file_generation;
+    pthread_rwlock_unlock(&table->lock);
+
+    ChunkReader reader;
+    long dead_bytes = 0, record_len = -1, record_offset;
+    if (chunk_reader_init(&reader, data_fd, end) == 0) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        long paced = 0;
+        const unsigned char *record;
+        while ((record_len = chunk_next(&reader, &record, &record_offset)) > 0) {
+            if (record_is_deleted(record)) dead_bytes += record_len;
+            long moved = reader.offset + (long)reader.length;
+            if (moved - paced >= COMPACT_PACE_STEP) {
+                if (pace_compaction(table->database, &start, moved) != 0) {
+                    record_len = -1;
+                    break;
+                }
+                paced = moved;
+            }
+        }
+        free(reader.buffer);
+    }
+
+    lock_table_write(table);
+    if (table->file_generation == generation) {
+        table->dead_bytes += dead_bytes;
+        table->dead_bytes_known = record_len == 0; // Counted again on the next pass otherwise
+    }
+    table->compacting = 0;
+    pthread_rwlock_unlock(&table->lock);
+}
+
+/**
+ * @brief Whether a table's dead records have reached the compaction threshold.
+ */
+static int compaction_due(Table *table, double dead_ratio) {
+    lock_table_read(table);
+    long records = table->data_size - RECORD_FILE_HEADER_SIZE;
+    int due = table->dead_bytes_known && !table->compacting &&
+              table->dead_bytes >= COMPACT_MIN_DEAD_BYTES && table->dead_bytes >= dead_ratio * records;
+    pthread_rwlock_unlock(&table->lock);
+    return due;
+}
+
+/**
+ * @brief Compactor thread: checks every table each COMPACTOR_INTERVAL_MS and
+ * compacts the ones over the threshold, one at a time.
+ */
+static void *compactor_main(void *arg) {
+    Database *db = arg;
+    pthread_mutex_lock(&db->compactor_lock);
+    while (!db->compactor_stopping) {
+        struct timespec now, until;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        until = time_after(&now, COMPACTOR_INTERVAL_MS * 1000000LL);
+        pthread_cond_timedwait(&db->compactor_wake, &db->compactor_lock, &until);
+        if (db->compactor_stopping) break;
+        double dead_ratio = db->compact_dead_ratio;
+        pthread_mutex_unlock(&db->compactor_lock);
+
+        for (int i = 0; i < db->table_count; i++) {
+            Table *table = db->tables[i];
+            if (table->shards) continue; // Its shards are compacted on their own
+            if (!table->dead_bytes_known) count_dead_bytes(table);
+            if (compaction_due(table, dead_ratio)) compact_table(table);
+        }
+        pthread_mutex_lock(&db->compactor_lock);
+    }
+    pthread_mutex_unlock(&db->compactor_lock);
+    return NULL;
+}
 
-    // Replace the old index with the newly built one
-    destroy_tree(table->primary_index); // Free the old index
-    table->primary_index = new_index;   // Assign the new index
+/**
+ * @brief Starts the database's background compactor (or changes its settings
+ * if it is running).
+ * @param db Pointer to the database, with its tables created.
+ * @param dead_ratio Share of a data file that must be dead records.
+ * @param bytes_per_second Compaction I/O limit, 0 for none.
+ * @return 0 on success, -1 if the thread could not be started.
+ */
+int start_compactor(Database *db, double dead_ratio, long bytes_per_second) {
+    if (!db || dead_ratio <= 0) return -1;
+    pthread_mutex_lock(&db->compactor_lock);
+    db->compact_dead_ratio = dead_ratio;
+    db->compact_rate = bytes_per_second > 0 ? bytes_per_second : 0;
+    int status = 0;
+    if (!db->compactor_running) {
+        int error = pthread_create(&db->compactor, NULL, compactor_main, db);
+        if (error != 0) {
+            fprintf(stderr, "Failed to start compactor thread: %s\n", strerror(error));
+            status = -1;
+        } else {
+            db->compactor_running = 1;
+        }
+    }
+    pthread_mutex_unlock(&db->compactor_lock);
+    return status;
+}
 
-    printf("Table '%s' compacted successfully.\n", table->name);
-    pthread_mutex_unlock(&table->lock); // Release the lock
+/**
+ * @brief Stops the compactor, abandoning a compaction in progress (its
+ * temporary files are removed and the table is left as it was).
+ * @param db Pointer to the database.
+ */
+static void stop_compactor(Database *db) {
+    pthread_mutex_lock(&db->compactor_lock);
+    db->compactor_stopping = 1;
+    pthread_cond_broadcast(&db->compactor_wake);
+    int running = db->compactor_running;
+    db->compactor_running = 0;
+    pthread_mutex_unlock(&db->compactor_lock);
+    if (running) pthread_join(db->compactor, NULL);
 }
@@ -2,55 +2,241 @@
 #define DATABASE_H
 
 #include "../physical/b_plus_tree.h" // Include B+ Tree definitions
+#include "../physical/hash_index.h"  // Secondary indexes
+#include "../physical/record.h"      // Binary row format of the data file
+#include "../physical/wal.h"         // Write-ahead log
+#include "../physical/row_cache.h"   // Cache of rendered rows
+#include "../physical/data_io.h"     // pread/stdio or io_uring data file I/O
 #include <pthread.h>                 // For thread safety (mutex)
 #include <stdio.h>                   // For FILE type
 
 // --- Configuration Constants ---
 #define MAX_TABLES 100      // Maximum number of tables allowed in a database
 #define MAX_COLUMNS 100     // Maximum number of columns allowed in a table
-#define MAX_ROW_LEN 4096    // Maximum expected length of a single row string (for buffer safety)
+#define MAX_ROW_LEN 4096    // Bytes read at once for a row; longer rows take a second read
 #define FILENAME_BUF_SIZE 256 // Buffer size for constructing filenames
-#define DELETED_MARKER '#'  // Character used to mark rows as deleted in the data file
+#define DELETED_MARKER '#'  // Marks deleted rows in legacy pipe-delimited text data files
+#ifndef WAL_CHECKPOINT_SIZE
+#define WAL_CHECKPOINT_SIZE (64UL << 20) // Log size at which the data files are synced and the log emptied
+#endif
+#define WAL_DEFAULT_FLUSH_INTERVAL_US 1000 // Longest a batched write waits for its fsync
+#ifndef COMPACT_MIN_DEAD_BYTES
+#define COMPACT_MIN_DEAD_BYTES (1L << 20) // Dead bytes below which a table is never compacted automatically
+#endif
+#define COMPACTOR_INTERVAL_MS 1000          // How often the compactor checks the tables
+#define COMPACT_DEFAULT_DEAD_RATIO 0.5      // Share of a data file that is dead rows when it is compacted
+#define COMPACT_DEFAULT_RATE (16L << 20)    // Compaction I/O in bytes per second
+#define ROW_CACHE_DEFAULT_ENTRIES 8192      // Rows cached per table unless configured otherwise
+#ifndef BULK_WRITE_SIZE
+#define BULK_WRITE_SIZE (4L << 20)          // Bytes of a batch insert logged and appended at once
+#endif
+#define SCAN_FIRST_BATCH 4                  // Rows in a scan's first batched read; later ones double up to DATA_IO_BATCH
+#define MAX_TABLE_SHARDS 16                 // Most shards a table can be partitioned into
 
 // --- Structures ---
 
+// Table operations timed separately (see TableMetrics)
+typedef enum {
+    TABLE_OP_INSERT,
+    TABLE_OP_INSERT_BATCH,
+    TABLE_OP_READ,
+    TABLE_OP_SCAN,
+    TABLE_OP_UPDATE,
+    TABLE_OP_DELETE,
+    TABLE_OP_COMPACT,
+    TABLE_OP_COUNT
+} TableOp;
+
+// Metric series of a table (ids from utils/metrics.h, -1 when not registered)
+typedef struct {
+    int operations[TABLE_OP_COUNT]; // Duration of each operation, lock wait included
+    int read_lock_wait;         // Time spent waiting for the shared lock
+    int write_lock_wait;        // Time spent waiting for the exclusive lock
+    int bytes_read;             // Bytes of records read from the data file
+    int bytes_written;          // Bytes of records written to the data file
+} TableMetrics;
+
+// A row deleted while scans were reading the table at a snapshot: its key no
+// longer reaches the record, so the scans find the version they see here
+typedef struct {
+    int primary_key;
+    long file_offset;           // Record that was current when the row was deleted
+    uint64_t deleted_at;        // Table's delete_seq after the delete
+} RetiredRow;
+
+// A table as recorded in the database's catalog snapshot (<db>.catalog),
+// written at every checkpoint and on shutdown with the table's files synced,
+// and removed by the first write after it.
+// A table whose index still has the recorded root, page count and data size
+// takes its counts from here when it opens instead of recounting them.
+typedef struct {
+    char *name;
+    int column_count;
+    long data_size;             // Data file size, which the index was synced with
+    long row_count;
+    long dead_bytes;            // -1 if they had not been counted yet
+    uint32_t index_root;        // Page of the index root
+    uint32_t index_pages;       // Pages in the index file
+} CatalogEntry;
+
 // Represents a table within the database
 typedef struct Table {
     char *name;                 // Name of the table
     char **columns;             // Array of column name strings
+    ColumnType *column_types;   // Storage type of each column
     int column_count;           // Number of columns in the table
-    BPlusTree *primary_index;   // B+ Tree index on the primary key
+    BPlusTree *primary_index;   // B+ Tree index on the primary key, stored in the table's .idx file
     FILE *data_file;            // File pointer to the data file (.dat) storing rows
-    pthread_mutex_t lock;       // Mutex to ensure thread-safe access to the table
+    int data_fd;                // Descriptor of data_file, read with pread by concurrent readers
+    long data_size;             // Bytes of the data file covered by the index
+    long row_count;             // Live rows, i.e. keys in primary_index (0 for a partitioned table)
+    pthread_rwlock_t lock;      // Shared by reads, exclusive for writes, commit, rollback and compaction
+    unsigned char *record_buffer; // Encoding buffer reused by writers (under the write lock)
+    size_t record_capacity;
+    unsigned char *data_map;    // Read-only mapping of the data file in mmap mode, NULL when reading with pread
+    size_t data_map_length;     // Bytes mapped: at least data_size, with room for appends before a remap
+    HashIndex **column_indexes; // Secondary index of each column (NULL where there is none), kept in memory
+    int secondary_index_count;  // Number of non-NULL column_indexes
+    char *index_text;           // Decode buffer for maintaining secondary indexes (under the write lock)
+    size_t index_text_capacity;
+    struct Database *database;  // Database the table belongs to (for its write-ahead log)
+    long dead_bytes;            // Bytes of deleted and superseded records in the data file
+    int dead_bytes_known;       // 0 until dead_bytes covers records written before the table opened
+    int compacting;             // A compaction (or dead byte count) is copying the data file
+    unsigned long file_generation; // Bumped whenever rows move (compaction, truncation)
+    RowCache *row_cache;        // Rendered rows by primary key, NULL when disabled; invalidated by every write
+    DataIoBackend io_backend;   // How the data file is read and appended to
+    TableMetrics metrics;
+    struct Table **shards;      // Partitioned table: shard_count tables holding its rows, and no files of its own
+    int shard_count;            // 0 when the table is not partitioned
+    struct Table *parent;       // Shard: the partitioned table, whose metrics and row cache it shares
+    int snapshots;              // Scans reading the table at a snapshot, outside the lock (atomic)
+    int draining;               // Rows are about to move: new scans hold the lock instead (atomic)
+    pthread_mutex_t snapshot_lock; // With snapshot_done, wakes a writer waiting for snapshots to end
+    pthread_cond_t snapshot_done;
+    uint64_t delete_seq;        // Deletes so far, ordering them against snapshots
+    RetiredRow *retired;        // Rows deleted under snapshots, by key; dropped once none remain
+    int retired_count;
+    int retired_capacity;
 } Table;
 
+// Kind of row change passed to a ChangeListener
+typedef enum {
+    ROW_CHANGE_PUT,             // A row was inserted or updated; record is its new version
+    ROW_CHANGE_DELETE,          // A row was deleted
+    ROW_CHANGE_TRUNCATE         // Every row of the table (or of the shard) was removed
+} RowChangeType;
+
+// Called after each committed row change with the table (a shard, for a
+// partitioned table) still write-locked, so the calls for one key come in the
+// order the changes were made. record is the encoded row of a ROW_CHANGE_PUT
+// (record.h format, length bytes), NULL otherwise; it is only valid during the call.
+typedef void (*ChangeListener)(void *context, Table *table, RowChangeType type, int primary_key,
+                               const unsigned char *record, size_t length);
+
 // Represents the database itself
 typedef struct Database {
     char *name;                 // Name of the database
     Table *tables[MAX_TABLES];  // Array of pointers to tables within the database
     int table_count;            // Current number of tables in the database
+    int mmap_tables;            // Tables created from now on start in mmap mode
+    int row_cache_entries;      // Row cache size of tables created from now on, 0 for none
+    DataIoBackend io_backend;   // Data file I/O of tables created from now on
+    int table_shards;           // Shards of tables created from now on, 1 for unpartitioned tables
+    Wal *wal;                   // Write-ahead log of row writes, NULL when durability is off
+    WalDurability durability;
+    pthread_mutex_t checkpoint_lock; // Held while the log is being checkpointed
+    pthread_mutex_t compactor_lock; // Guards the compactor fields below
+    pthread_cond_t compactor_wake;  // Signalled to stop the compactor (CLOCK_MONOTONIC timeouts)
+    pthread_t compactor;            // Background compaction thread
+    int compactor_running;
+    int compactor_stopping;         // Set on shutdown; running compactions give up
+    double compact_dead_ratio;      // Dead share of a data file that triggers compaction
+    long compact_rate;              // Compaction I/O limit in bytes per second, 0 for none
+    ChangeListener change_listener; // Told about every row change (replication), NULL for none
+    void *change_context;
+    CatalogEntry *catalog;          // Catalog snapshot read at startup (it is removed once read)
+    int catalog_count;
+    int catalog_on_disk;            // A checkpoint wrote the snapshot and no write has removed it yet
+    pthread_mutex_t catalog_lock;   // Held while the first write after a checkpoint removes it
 } Database;
 
 // --- Function Prototypes ---
 
 // Database Management
 Database *create_database(const char *name); // Creates a new database structure
-// Creates a new table within the database.
-// Columns is an array of strings representing column names.
-Table *create_table(Database *db, const char *table_name, char **columns, int column_count);
+// Creates a new table within the database, or opens it if its files already exist.
+// Columns is an array of strings representing column names, and column_types
+// their type hints ("int", "float", "boolean", "date", "string"...), which
+// decide how each column is stored; NULL stores every column as a string.
+// The primary index is opened from <table>.idx; it is only rebuilt from the
+// data file when the index is missing or does not match it. A data file in
+// the old pipe-delimited text format is converted on open.
+// With db->table_shards > 1 a new table is hash-partitioned by primary key
+// into that many shards (<table>.<n>.dat and .idx, each with its own lock),
+// recorded in <table>.shards; existing tables keep the layout they have.
+// The shards are opened in parallel, one thread per CPU. Row and dead byte
+// counts come from the catalog snapshot when the table is unchanged since it
+// was written, from rebuilding the index otherwise, or else from the index.
+Table *create_table(Database *db, const char *table_name, char **columns, char **column_types, int column_count);
 void destroy_database(Database *db); // Frees all resources associated with the database and its tables
 
+// Recovers the database's write-ahead log (scaffolded_resources/<db>.wal) left
+// by a crash, writing the logged changes into the data files (whose indexes
+// are then rebuilt when the tables open), and starts a new log with the given
+// durability. Call before creating tables. Returns 0, or -1 if recovery failed
+// (the log is kept for the next attempt).
+int open_database_log(Database *db, WalDurability durability, int flush_interval_us);
+
+// Starts a background thread that compacts each table once its deleted and
+// superseded rows make up dead_ratio of its data file (and at least
+// COMPACT_MIN_DEAD_BYTES), moving at most bytes_per_second of compaction I/O
+// (0: no limit; the limit also applies to compact_table). Call after the
+// tables are created. Returns 0, or -1 if the thread could not be started.
+int start_compactor(Database *db, double dead_ratio, long bytes_per_second);
+
+// Installs the listener told about every row change from now on (NULL removes
+// it). Call before writes start, e.g. right after the tables are created.
+void set_change_listener(Database *db, ChangeListener listener, void *context);
+
+// Looks up a table by name; shards of partitioned tables are not found
+Table *find_table(Database *db, const char *table_name);
+
+// Shard of a table partitioned into shard_count shards that holds primary_key
+int table_shard_of_key(int shard_count, int primary_key);
+
 // Row Operations (Primary Key is assumed to be the first column and an integer)
+// On a partitioned table, operations on one key take only the lock of the
+// key's shard; scans lock every shard and merge them in key order.
 
 /**
  * Inserts a new row into the table.
  * @param table Pointer to the table.
  * @param primary_key The integer primary key for the new row.
  * @param values Array of strings representing the values for each column.
+ * Fails if a value does not parse as its column's type.
  * @return The file offset of the newly inserted row, or -1 on failure (e.g., PK exists, IO error).
  */
 long insert_row(Table *table, int primary_key, char **values);
 
+/**
+ * Inserts many new rows under a single write lock: every key is checked and
+ * every row encoded first (so a duplicate key or bad value inserts nothing),
+ * then the rows are written sorted by key through one large buffer, logged
+ * and appended BULK_WRITE_SIZE bytes at a time. The index of an empty table
+ * is built bottom-up from the sorted keys instead of key by key.
+ * @param table Pointer to the table.
+ * @param count Number of rows.
+ * @param primary_keys The integer primary key of each row (no duplicates).
+ * @param values For each row, an array of strings with one value per column.
+ * @param offsets Output (may be NULL): the file offset of each inserted row.
+ * @return count on success, or -1 on failure. After a failed write the rows
+ * written before it are kept and indexed. A partitioned table inserts each
+ * shard's rows under that shard's lock, and if one shard fails, deletes the
+ * rows the others inserted.
+ */
+int insert_rows_batch(Table *table, int count, const int *primary_keys, char ***values, long *offsets);
+
 /**
  * Reads a row from the table based on its primary key.
  * @param table Pointer to the table.
@@ -62,6 +248,75 @@ long insert_row(Table *table, int primary_key, char **values);
  */
 char **read_row(Table *table, int primary_key);
 
+/**
+ * Looks up the data file offset of a row under the table's read lock.
+ * @param table Pointer to the table.
+ * @param primary_key The primary key to look up.
+ * @return The row's offset, or -1 if the key is not in the index.
+ */
+long find_row_offset(Table *table, int primary_key);
+
+/**
+ * Collects every primary key in the table, in ascending order, under the
+ * table's read lock.
+ * @param table Pointer to the table.
+ * @param count Output: number of keys returned.
+ * @return Newly allocated array of keys (caller must free), or NULL if the table is empty.
+ */
+int *collect_primary_keys(Table *table, int *count);
+
+/**
+ * Called by scan_rows for each row. values holds one string per column and is
+ * only valid during the call. Return nonzero to stop the scan.
+ */
+typedef int (*RowCallback)(void *context, int primary_key, char **values);
+
+/**
+ * Visits the rows with lo <= primary key <= hi in ascending key order: one
+ * index descent, then a walk along the leaf chain, decoding each row into a
+ * buffer reused for the whole scan. A range scan sees the table as it was
+ * when it started (a snapshot): it takes the read lock only for short steps
+ * that copy out the versions of the next rows that were current then, and
+ * runs the callback between them, so writers are not held up by it. The
+ * callback must still not modify the table, since some scans (one key, a
+ * secondary index, a table about to be compacted) hold the lock throughout.
+ * @param table Pointer to the table.
+ * @param lo Smallest key to visit.
+ * @param hi Largest key to visit.
+ * @param callback Function called for each row.
+ * @param context Passed to callback.
+ * @return Number of rows passed to callback, or -1 on error.
+ */
+int scan_rows(Table *table, int lo, int hi, RowCallback callback, void *context);
+
+/**
+ * Like scan_rows, but only visits rows whose column equals value, compared the
+ * way the column's type decodes (so "1.50" finds 1.5 in a float column). Uses
+ * the column's secondary index when it has one, and otherwise filters a scan
+ * of [lo, hi].
+ * @param table Pointer to the table.
+ * @param column Index of the column to match.
+ * @param value Value to match ("" matches nulls).
+ * @param lo Smallest key to visit.
+ * @param hi Largest key to visit.
+ * @param callback Function called for each row.
+ * @param context Passed to callback.
+ * @return Number of rows passed to callback, or -1 on error.
+ */
+int scan_rows_where(Table *table, int column, const char *value, int lo, int hi,
+                    RowCallback callback, void *context);
+
+/**
+ * Builds an in-memory secondary index on a column from the rows already in the
+ * table and keeps it up to date on insert, update and delete, so equality
+ * lookups on the column (scan_rows_where) read only the matching rows. The
+ * index is not stored on disk; create it again after each start.
+ * @param table Pointer to the table.
+ * @param column Index of the column (not 0, which the primary index covers).
+ * @return 0 on success (or if the index already exists), -1 on failure.
+ */
+int create_column_index(Table *table, int column);
+
 /**
  * Updates an existing row in the table.
  * This currently marks the old row as deleted and appends the new row data.
@@ -82,13 +337,27 @@ long update_row(Table *table, int primary_key, char **new_values);
  */
 int delete_row(Table *table, int primary_key);
 
+/**
+ * Switches a table between reading rows through a read-only memory map of its
+ * data file (mmap mode) and reading them with pread. In mmap mode a point
+ * read is a lookup in the mapping with no system call, and full scans read
+ * the mapping sequentially. Writes go through the file either way.
+ * @param table Pointer to the table.
+ * @param enabled 1 for mmap mode, 0 for pread.
+ * @return 0 on success, -1 if the file could not be mapped (the table keeps using pread).
+ */
+int set_table_mmap(Table *table, int enabled);
+
 // Basic Transaction Control (Limitations Apply)
 // NOTE: These are NOT ACID-compliant transactions.
-void commit_transaction(Table *table); // Flushes file buffers to the OS (does not guarantee disk write)
+void commit_transaction(Table *table); // Makes every write so far durable (waits for the log, or fsyncs the data file)
 void rollback_transaction(Table *table); // Clears all data from the table file and index (effectively TRUNCATE)
 
 // Utility Functions
 void print_database(Database *db); // Prints the names of tables and columns in the database
-void compact_table(Table *table);  // Rewrites the data file to remove deleted rows and rebuilds the index. Expensive operation.
+// Rewrites the data file without its deleted rows while the table stays
+// readable and writable; only the final catch-up and file swap lock it.
+// Returns 0 on success (or if the table is already being compacted), -1 on failure.
+int compact_table(Table *table);
 
 #endif // DATABASE_H
@@ -0,0 +1,1178 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>     // For INT_MIN and INT_MAX, the range of a full scan
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>   // For socket timeouts
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "../utils/metrics.h"
+#include "../utils/log.h"
+#include "replication.h"
+
+#define MESSAGE_HEADER_SIZE 5           // uint32 length and uint8 type
+#define SEND_CHUNK (64 * 1024)          // Bytes of the stream sent at once, and the fill level that flushes a message buffer
+
+// Growing byte buffer, for messages being built or received
+typedef struct {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+} Buffer;
+
+// A connected replica, served by its own thread (primary)
+typedef struct {
+    int fd;
+    char address[INET6_ADDRSTRLEN + 8]; // "host:port", the metrics label
+    pthread_t thread;
+    int active;                 // Slot in use until the thread is joined (under stream_lock)
+    int finished;               // The thread has returned (atomic)
+    uint64_t acked;             // Stream offset the replica has applied (under stream_lock)
+    uint64_t last_ack_ms;       // Monotonic time of its last message
+    Buffer in;                  // Bytes received and not parsed yet
+    Buffer out;                 // Messages not sent yet
+} ReplicaLink;
+
+typedef enum {
+    ROLE_NONE,
+    ROLE_PRIMARY,
+    ROLE_REPLICA
+} Role;
+
+static Role role = ROLE_NONE;
+static Database *database;
+static int stopping;                        // Set by replication_stop (atomic)
+
+// Primary: the change stream
+static pthread_mutex_t stream_lock = PTHREAD_MUTEX_INITIALIZER; // Guards the backlog, links and head
+static pthread_cond_t stream_grew;          // Changes were appended, or replication is stopping
+static unsigned char *backlog;              // Ring holding the last REPLICATION_BACKLOG_SIZE bytes of the stream
+static uint64_t stream_head;                // Stream offset after the last change
+static uint64_t run_id;                     // Identifies this run of the primary to reconnecting replicas
+static int listen_fd = -1;
+static pthread_t listener;
+static ReplicaLink links[REPLICATION_MAX_REPLICAS];
+
+// Replica: the link to the primary
+static char primary_host[256];
+static char primary_port[16];
+static pthread_t follower;
+static pthread_mutex_t follower_lock = PTHREAD_MUTEX_INITIALIZER; // Guards follower_fd and the waits below
+static pthread_cond_t follower_wake;        // Signalled to stop a reconnect pause
+static int follower_fd = -1;                // Socket to the primary, -1 while disconnected
+static uint64_t primary_run_id;             // Run id of the primary the tables follow, 0 for none yet
+static uint64_t applied_offset;             // Stream offset applied up to (atomic)
+static uint64_t primary_offset;             // Stream offset the primary last reported (atomic)
+static uint64_t applied_commit_us;          // Commit time of the last change applied (atomic)
+static int connected;                       // Linked to the primary and synced (atomic)
+static Table *synced_tables[MAX_TABLES];    // Tables of the last full sync whose columns match the primary's
+static int synced_count;
+
+static int full_sync_metric = -1;
+static int applied_metric = -1;
+
+// --- Helpers ---
+
+/**
+ * @brief Microseconds since 1970, the commit time carried by changes.
+ */
+static uint64_t wall_clock_us() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+/**
+ * @brief Monotonic time in milliseconds, for heartbeats and timeouts.
+ */
+static uint64_t monotonic_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Initializes a condition variable whose timed waits use CLOCK_MONOTONIC.
+ */
+static void init_monotonic_cond(pthread_cond_t *cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/**
+ * @brief The CLOCK_MONOTONIC time ms milliseconds from now, for pthread_cond_timedwait.
+ */
+static struct timespec deadline_in(uint64_t ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += (time_t)(ms / 1000);
+    deadline.tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return deadline;
+}
+
+/**
+ * @brief Makes room for extra more bytes in a buffer.
+ * @return 0, or -1 if out of memory.
+ */
+static int buffer_reserve(Buffer *buffer, size_t extra) {
+    if (buffer->length + extra <= buffer->capacity) return 0;
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < buffer->length + extra) capacity *= 2;
+    unsigned char *grown = realloc(buffer->data, capacity);
+    if (!grown) {
+        perror("Failed to grow replication buffer");
+        return -1;
+    }
+    buffer->data = grown;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+static void buffer_free(Buffer *buffer) {
+    free(buffer->data);
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+/**
+ * @brief Appends a message to a buffer: its header, then up to two pieces of payload.
+ * @return 0, or -1 if out of memory.
+ */
+static int append_message(Buffer *buffer, uint8_t type, const void *payload, size_t length,
+                          const void *more, size_t more_length) {
+    if (buffer_reserve(buffer, MESSAGE_HEADER_SIZE + length + more_length) != 0) return -1;
+    uint32_t size = (uint32_t)(1 + length + more_length);
+    unsigned char *out = buffer->data + buffer->length;
+    memcpy(out, &size, 4);
+    out[4] = type;
+    if (length) memcpy(out + MESSAGE_HEADER_SIZE, payload, length);
+    if (more_length) memcpy(out + MESSAGE_HEADER_SIZE + length, more, more_length);
+    buffer->length += MESSAGE_HEADER_SIZE + length + more_length;
+    return 0;
+}
+
+/**
+ * @brief Appends a message whose payload is two uint64 values.
+ */
+static int append_pair(Buffer *buffer, uint8_t type, uint64_t first, uint64_t second) {
+    uint64_t payload[2] = { first, second };
+    return append_message(buffer, type, payload, sizeof(payload), NULL, 0);
+}
+
+/**
+ * @brief Writes every byte to a socket, waiting as the socket's send timeout allows.
+ * @return 0, or -1 if the link failed or timed out.
+ */
+static int send_all(int fd, const unsigned char *data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += sent;
+        length -= (size_t)sent;
+    }
+    return 0;
+}
+
+/**
+ * @brief Sends and empties a buffer of messages.
+ * @return 0, or -1 if the link failed.
+ */
+static int send_buffer(int fd, Buffer *buffer) {
+    int status = send_all(fd, buffer->data, buffer->length);
+    buffer->length = 0;
+    return status;
+}
+
+/**
+ * @brief Reads what a socket has into a buffer, waiting for data unless dontwait is set.
+ * @return Bytes read; 0 if the peer closed the link; -1 on error or timeout
+ * (errno EAGAIN when nothing was waiting, or the timeout passed).
+ */
+static ssize_t receive_some(int fd, Buffer *buffer, int dontwait) {
+    if (buffer_reserve(buffer, SEND_CHUNK) != 0) return -1;
+    ssize_t got;
+    do {
+        got = recv(fd, buffer->data + buffer->length, buffer->capacity - buffer->length,
+                   dontwait ? MSG_DONTWAIT : 0);
+    } while (got < 0 && errno == EINTR);
+    if (got > 0) buffer->length += (size_t)got;
+    return got;
+}
+
+/**
+ * @brief Finds the message starting at *position of a received buffer.
+ * @param buffer Received bytes.
+ * @param position Offset of the message; advanced past it when one is complete.
+ * @param type Output: message type.
+ * @param payload Output: the payload, inside the buffer.
+ * @param length Output: payload length.
+ * @return 1 if a complete message was found, 0 if more bytes are needed, -1 if it is malformed.
+ */
+static int next_message(const Buffer *buffer, size_t *position, uint8_t *type, const unsigned char **payload,
+                        size_t *length) {
+    size_t available = buffer->length - *position;
+    if (available < MESSAGE_HEADER_SIZE) return 0;
+    const unsigned char *start = buffer->data + *position;
+    uint32_t size;
+    memcpy(&size, start, 4);
+    if (size < 1 || size > REPLICATION_MAX_MESSAGE) return -1;
+    if (available < 4 + (size_t)size) return 0;
+    *type = start[4];
+    *payload = start + MESSAGE_HEADER_SIZE;
+    *length = size - 1;
+    *position += 4 + (size_t)size;
+    return 1;
+}
+
+/**
+ * @brief Drops the parsed bytes at the front of a received buffer.
+ */
+static void consume(Buffer *buffer, size_t position) {
+    memmove(buffer->data, buffer->data + position, buffer->length - position);
+    buffer->length -= position;
+}
+
+/**
+ * @brief Sets a socket's send and receive timeouts and turns off Nagle's
+ * algorithm, so small changes leave at once.
+ */
+static void configure_socket(int fd) {
+    struct timeval timeout = { REPLICATION_TIMEOUT, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+}
+
+/**
+ * @brief Reads a table name field (uint8 length, then the bytes).
+ * @param payload Field start; advanced past it.
+ * @param end End of the payload.
+ * @param name Output buffer of WAL_MAX_TABLE_NAME + 1 bytes.
+ * @return 0, or -1 if the field is truncated.
+ */
+static int read_name(const unsigned char **payload, const unsigned char *end, char *name) {
+    if (*payload >= end) return -1;
+    size_t length = **payload;
+    if ((size_t)(end - *payload) < 1 + length) return -1;
+    memcpy(name, *payload + 1, length);
+    name[length] = '\0';
+    *payload += 1 + length;
+    return 0;
+}
+
+// --- Primary: Recording Changes ---
+
+/**
+ * @brief Copies bytes into the backlog at the head of the stream and advances
+ * it. Call with stream_lock held.
+ */
+static void backlog_append(const unsigned char *data, size_t length) {
+    while (length > 0) {
+        size_t position = (size_t)(stream_head % REPLICATION_BACKLOG_SIZE);
+        size_t piece = REPLICATION_BACKLOG_SIZE - position;
+        if (piece > length) piece = length;
+        memcpy(backlog + position, data, piece);
+        stream_head += piece;
+        data += piece;
+        length -= piece;
+    }
+}
+
+/**
+ * @brief Copies length bytes of the stream from offset out of the backlog.
+ * Call with stream_lock held, for bytes still in it (see backlog_holds).
+ */
+static void backlog_read(uint64_t offset, unsigned char *out, size_t length) {
+    while (length > 0) {
+        size_t position = (size_t)(offset % REPLICATION_BACKLOG_SIZE);
+        size_t piece = REPLICATION_BACKLOG_SIZE - position;
+        if (piece > length) piece = length;
+        memcpy(out, backlog + position, piece);
+        offset += piece;
+        out += piece;
+        length -= piece;
+    }
+}
+
+/**
+ * @brief Whether the stream from offset to the head is still in the backlog.
+ * Call with stream_lock held.
+ */
+static int backlog_holds(uint64_t offset) {
+    return offset <= stream_head && stream_head - offset <= REPLICATION_BACKLOG_SIZE;
+}
+
+/**
+ * @brief ChangeListener of the primary: appends the change to the stream.
+ * Called with the table write-locked, so the changes of a key reach the
+ * stream in the order they were made.
+ */
+static void record_change(void *context, Table *table, RowChangeType type, int primary_key,
+                          const unsigned char *record, size_t length) {
+    (void)context;
+    Table *logical = table->parent ? table->parent : table;
+    size_t name_length = strlen(logical->name);
+    if (name_length > WAL_MAX_TABLE_NAME) return;
+
+    // Everything but the record goes into one header
+    unsigned char header[MESSAGE_HEADER_SIZE + 8 + 1 + WAL_MAX_TABLE_NAME + 4 + 2];
+    size_t used = MESSAGE_HEADER_SIZE;
+    uint64_t commit_us = wall_clock_us();
+    memcpy(header + used, &commit_us, 8);
+    used += 8;
+    header[used++] = (unsigned char)name_length;
+    memcpy(header + used, logical->name, name_length);
+    used += name_length;
+    int32_t key = primary_key;
+    memcpy(header + used, &key, 4);
+    used += 4;
+
+    uint8_t message_type = REPLICATION_MSG_PUT;
+    if (type == ROW_CHANGE_DELETE) {
+        message_type = REPLICATION_MSG_DELETE;
+        record = NULL;
+    } else if (type == ROW_CHANGE_TRUNCATE) {
+        message_type = REPLICATION_MSG_TRUNCATE;
+        record = NULL;
+        int shard = 0;
+        while (table->parent && shard < logical->shard_count && logical->shards[shard] != table) shard++;
+        header[used++] = (unsigned char)(table->parent ? shard : 0);
+        header[used++] = (unsigned char)(table->parent ? logical->shard_count : 0);
+    }
+    if (!record) length = 0;
+    uint32_t size = (uint32_t)(used - 4 + length);
+    memcpy(header, &size, 4);
+    header[4] = message_type;
+
+    pthread_mutex_lock(&stream_lock);
+    if (!backlog) { // Replication has stopped
+        pthread_mutex_unlock(&stream_lock);
+        return;
+    }
+    backlog_append(header, used);
+    if (length) backlog_append(record, length);
+    pthread_cond_broadcast(&stream_grew);
+    pthread_mutex_unlock(&stream_lock);
+}
+
+// --- Primary: Serving Replicas ---
+
+// A snapshot of one table being sent to a replica
+typedef struct {
+    ReplicaLink *link;
+    Table *table;
+    unsigned char *record;      // Encoding buffer reused for every row
+    size_t capacity;
+    int failed;
+} SnapshotSend;
+
+/**
+ * @brief scan_rows callback sending one snapshot row (as a REPLICATION_MSG_ROW).
+ */
+static int send_snapshot_row(void *context, int primary_key, char **values) {
+    SnapshotSend *send = context;
+    Table *table = send->table;
+    int bad_column = -1;
+    long length = record_encode(table->column_types, table->column_count, values, 0,
+                                &send->record, &send->capacity, &bad_column);
+    unsigned char prefix[1 + WAL_MAX_TABLE_NAME + 4];
+    size_t name_length = strlen(table->name);
+    prefix[0] = (unsigned char)name_length;
+    memcpy(prefix + 1, table->name, name_length);
+    int32_t key = primary_key;
+    memcpy(prefix + 1 + name_length, &key, 4);
+    if (length < 0 ||
+        append_message(&send->link->out, REPLICATION_MSG_ROW, prefix, 1 + name_length + 4, send->record,
+                       (size_t)length) != 0 ||
+        (send->link->out.length >= SEND_CHUNK && send_buffer(send->link->fd, &send->link->out) != 0)) {
+        send->failed = 1;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Sends every table's schema and rows to a replica, then REPLICATION_MSG_SYNC_DONE.
+ * Rows are read with snapshot scans, so writers carry on meanwhile.
+ * @return 0, or -1 if the link failed.
+ */
+static int send_snapshot(ReplicaLink *link) {
+    SnapshotSend send = { link, NULL, NULL, 0, 0 };
+    for (int i = 0; i < database->table_count && !send.failed; i++) {
+        Table *table = database->tables[i];
+        size_t name_length = strlen(table->name);
+        if (table->parent || name_length > WAL_MAX_TABLE_NAME) continue;
+
+        unsigned char payload[1 + WAL_MAX_TABLE_NAME + RECORD_FILE_HEADER_SIZE];
+        payload[0] = (unsigned char)name_length;
+        memcpy(payload + 1, table->name, name_length);
+        record_file_header(payload + 1 + name_length, table->column_types, table->column_count);
+        if (append_message(&link->out, REPLICATION_MSG_TABLE, payload,
+                           1 + name_length + RECORD_FILE_HEADER_SIZE, NULL, 0) != 0) {
+            send.failed = 1;
+            break;
+        }
+        send.table = table;
+        if (scan_rows(table, INT_MIN, INT_MAX, send_snapshot_row, &send) < 0) send.failed = 1;
+    }
+    free(send.record);
+    if (send.failed || append_message(&link->out, REPLICATION_MSG_SYNC_DONE, NULL, 0, NULL, 0) != 0) return -1;
+    return send_buffer(link->fd, &link->out);
+}
+
+/**
+ * @brief Reads the acks a replica has sent, without waiting.
+ * @return 0, or -1 if the replica closed the link or sent garbage.
+ */
+static int read_acks(ReplicaLink *link) {
+    while (1) {
+        ssize_t got = receive_some(link->fd, &link->in, 1);
+        if (got == 0) return -1;
+        if (got < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+            break;
+        }
+    }
+    size_t position = 0;
+    uint8_t type;
+    const unsigned char *payload;
+    size_t length;
+    int found;
+    while ((found = next_message(&link->in, &position, &type, &payload, &length)) == 1) {
+        if (type != REPLICATION_MSG_ACK || length < 8) continue;
+        uint64_t offset;
+        memcpy(&offset, payload, 8);
+        pthread_mutex_lock(&stream_lock);
+        link->acked = offset < stream_head ? offset : stream_head;
+        pthread_mutex_unlock(&stream_lock);
+        link->last_ack_ms = monotonic_ms();
+    }
+    consume(&link->in, position);
+    return found < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Streams changes to a replica from cursor on, with a heartbeat
+ * whenever it has been quiet for REPLICATION_HEARTBEAT_MS, until the link
+ * fails, the replica falls out of the backlog or replication stops.
+ * @return 0 when stopped, -1 when the link was dropped.
+ */
+static int stream_changes(ReplicaLink *link, uint64_t cursor) {
+    unsigned char *chunk = malloc(SEND_CHUNK);
+    if (!chunk) {
+        perror("Failed to allocate replication send buffer");
+        return -1;
+    }
+    int status = -1;
+    uint64_t last_heartbeat_ms = monotonic_ms();
+    link->last_ack_ms = last_heartbeat_ms;
+    while (1) {
+        pthread_mutex_lock(&stream_lock);
+        if (cursor == stream_head && !__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+            struct timespec deadline = deadline_in(REPLICATION_ACK_POLL_MS);
+            pthread_cond_timedwait(&stream_grew, &stream_lock, &deadline);
+        }
+        uint64_t end = stream_head;         // Always the end of a whole change
+        pthread_mutex_unlock(&stream_lock);
+        if (__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+            status = 0;
+            break;
+        }
+
+        int lost = 0;
+        while (cursor < end && !lost) {
+            size_t piece = end - cursor < SEND_CHUNK ? (size_t)(end - cursor) : SEND_CHUNK;
+            pthread_mutex_lock(&stream_lock);
+            lost = !backlog_holds(cursor);
+            if (!lost) backlog_read(cursor, chunk, piece);
+            pthread_mutex_unlock(&stream_lock);
+            if (lost) break;
+            if (send_all(link->fd, chunk, piece) != 0) goto done;
+            cursor += piece;
+        }
+        if (lost) {
+            LOG_WARN("Replica %s fell more than %lu bytes of changes behind; it will resync.",
+                     link->address, (unsigned long)REPLICATION_BACKLOG_SIZE);
+            break;
+        }
+
+        // Between changes: a heartbeat when due (busy or not, so the replica
+        // knows how far behind it is), and the replica's acks
+        uint64_t now = monotonic_ms();
+        if (now - last_heartbeat_ms >= REPLICATION_HEARTBEAT_MS) {
+            if (append_pair(&link->out, REPLICATION_MSG_HEARTBEAT, end, wall_clock_us()) != 0 ||
+                send_buffer(link->fd, &link->out) != 0) {
+                break;
+            }
+            last_heartbeat_ms = now;
+        }
+        if (read_acks(link) != 0) break;
+        if (monotonic_ms() - link->last_ack_ms > REPLICATION_TIMEOUT * 1000UL) {
+            LOG_WARN("Replica %s stopped answering.", link->address);
+            break;
+        }
+    }
+done:
+    free(chunk);
+    return status;
+}
+
+/**
+ * @brief Thread serving one replica: the handshake, a full sync when the
+ * replica can't resume, then the stream.
+ */
+static void *serve_replica(void *arg) {
+    ReplicaLink *link = arg;
+    configure_socket(link->fd);
+
+    // The replica opens with a hello naming what it has
+    uint8_t type = 0;
+    const unsigned char *payload = NULL;
+    size_t length = 0, position = 0;
+    int found = 0;
+    while ((found = next_message(&link->in, &position, &type, &payload, &length)) == 0) {
+        if (receive_some(link->fd, &link->in, 0) <= 0) break;
+    }
+    if (found != 1 || type != REPLICATION_MSG_HELLO || length < 16) {
+        LOG_WARN("Replica %s did not say hello; closing the link.", link->address);
+        goto finish;
+    }
+    uint64_t their_run, their_offset;
+    memcpy(&their_run, payload, 8);
+    memcpy(&their_offset, payload + 8, 8);
+    consume(&link->in, position);
+
+    pthread_mutex_lock(&stream_lock);
+    int resume = their_run == run_id && backlog_holds(their_offset);
+    uint64_t cursor = resume ? their_offset : stream_head;
+    link->acked = cursor;
+    pthread_mutex_unlock(&stream_lock);
+
+    if (resume) {
+        LOG_INFO("Replica %s resumed at offset %llu.", link->address, (unsigned long long)cursor);
+        if (append_pair(&link->out, REPLICATION_MSG_CONTINUE, run_id, cursor) != 0 ||
+            send_buffer(link->fd, &link->out) != 0) {
+            goto finish;
+        }
+    } else {
+        LOG_INFO("Replica %s connected; sending a full sync from offset %llu.", link->address,
+                 (unsigned long long)cursor);
+        metrics_count(full_sync_metric, 1);
+        if (append_pair(&link->out, REPLICATION_MSG_FULL_SYNC, run_id, cursor) != 0 ||
+            send_snapshot(link) != 0) {
+            LOG_WARN("Full sync of replica %s failed.", link->address);
+            goto finish;
+        }
+    }
+    if (stream_changes(link, cursor) != 0) LOG_WARN("Replica %s disconnected.", link->address);
+
+finish:
+    buffer_free(&link->in);
+    buffer_free(&link->out);
+    __atomic_store_n(&link->finished, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/**
+ * @brief Joins the threads of replicas that have gone and frees their slots.
+ * @param all Also stop and join the ones still connected.
+ */
+static void reap_links(int all) {
+    for (int i = 0; i < REPLICATION_MAX_REPLICAS; i++) {
+        ReplicaLink *link = &links[i];
+        pthread_mutex_lock(&stream_lock);
+        int active = link->active;
+        pthread_mutex_unlock(&stream_lock);
+        if (!active || (!all && !__atomic_load_n(&link->finished, __ATOMIC_ACQUIRE))) continue;
+        if (all) shutdown(link->fd, SHUT_RDWR);
+        pthread_join(link->thread, NULL);
+        close(link->fd);
+        pthread_mutex_lock(&stream_lock);
+        link->active = 0;
+        pthread_mutex_unlock(&stream_lock);
+    }
+}
+
+/**
+ * @brief Listener thread: accepts replicas and starts a thread for each.
+ */
+static void *accept_replicas(void *arg) {
+    (void)arg;
+    while (!__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+        struct sockaddr_storage peer;
+        socklen_t peer_length = sizeof(peer);
+        int fd = accept(listen_fd, (struct sockaddr *)&peer, &peer_length);
+        if (fd < 0) {
+            if (__atomic_load_n(&stopping, __ATOMIC_RELAXED)) break;
+            if (errno != EINTR) {
+                perror("accept of replica failed");
+                usleep(100000);
+            }
+            continue;
+        }
+        reap_links(0);
+
+        char host[INET6_ADDRSTRLEN] = "?";
+        int port = 0;
+        if (peer.ss_family == AF_INET) {
+            struct sockaddr_in *in = (struct sockaddr_in *)&peer;
+            inet_ntop(AF_INET, &in->sin_addr, host, sizeof(host));
+            port = ntohs(in->sin_port);
+        } else if (peer.ss_family == AF_INET6) {
+            struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&peer;
+            inet_ntop(AF_INET6, &in6->sin6_addr, host, sizeof(host));
+            port = ntohs(in6->sin6_port);
+        }
+
+        ReplicaLink *link = NULL;
+        for (int i = 0; i < REPLICATION_MAX_REPLICAS && !link; i++) {
+            if (!links[i].active) link = &links[i];
+        }
+        if (!link) {
+            LOG_WARN("Turning replica %s away: %d replicas are connected already.", host, REPLICATION_MAX_REPLICAS);
+            close(fd);
+            continue;
+        }
+        memset(link, 0, sizeof(*link));
+        link->fd = fd;
+        snprintf(link->address, sizeof(link->address), "%s:%d", host, port);
+        pthread_mutex_lock(&stream_lock);
+        link->acked = stream_head;
+        link->active = 1;
+        pthread_mutex_unlock(&stream_lock);
+        if (pthread_create(&link->thread, NULL, serve_replica, link) != 0) {
+            perror("Failed to start replica thread");
+            close(fd);
+            pthread_mutex_lock(&stream_lock);
+            link->active = 0;
+            pthread_mutex_unlock(&stream_lock);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Metrics collector of the primary: the stream offset and each
+ * replica's lag, in bytes and as the age of its oldest change not applied.
+ */
+static void collect_primary_metrics(void *context, MetricsText *out) {
+    (void)context;
+    uint64_t now_us = wall_clock_us();
+    pthread_mutex_lock(&stream_lock);
+    int replicas = 0;
+    for (int i = 0; i < REPLICATION_MAX_REPLICAS; i++) {
+        if (links[i].active && !__atomic_load_n(&links[i].finished, __ATOMIC_ACQUIRE)) replicas++;
+    }
+    metrics_text_printf(out, "# HELP cerver_replication_offset Bytes of row changes in the replication stream.\n"
+                             "# TYPE cerver_replication_offset gauge\n"
+                             "cerver_replication_offset %llu\n", (unsigned long long)stream_head);
+    metrics_text_printf(out, "# HELP cerver_replication_replicas Replicas connected.\n"
+                             "# TYPE cerver_replication_replicas gauge\n"
+                             "cerver_replication_replicas %d\n", replicas);
+    metrics_text_printf(out, "# HELP cerver_replication_replica_lag_bytes Bytes of changes a replica has not applied yet.\n"
+                             "# TYPE cerver_replication_replica_lag_bytes gauge\n");
+    for (int i = 0; i < REPLICATION_MAX_REPLICAS; i++) {
+        if (!links[i].active || __atomic_load_n(&links[i].finished, __ATOMIC_ACQUIRE)) continue;
+        metrics_text_printf(out, "cerver_replication_replica_lag_bytes{replica=\"%s\"} %llu\n", links[i].address,
+                            (unsigned long long)(stream_head - links[i].acked));
+    }
+    metrics_text_printf(out, "# HELP cerver_replication_replica_lag_seconds Age of the oldest change a replica has not applied.\n"
+                             "# TYPE cerver_replication_replica_lag_seconds gauge\n");
+    for (int i = 0; i < REPLICATION_MAX_REPLICAS; i++) {
+        ReplicaLink *link = &links[i];
+        if (!link->active || __atomic_load_n(&link->finished, __ATOMIC_ACQUIRE)) continue;
+        // Acks fall between changes, so the next change starts at the acked offset
+        double lag = 0;
+        if (link->acked < stream_head && backlog_holds(link->acked) &&
+            stream_head - link->acked >= MESSAGE_HEADER_SIZE + 8) {
+            uint64_t commit_us;
+            backlog_read(link->acked + MESSAGE_HEADER_SIZE, (unsigned char *)&commit_us, 8);
+            if (now_us > commit_us) lag = (double)(now_us - commit_us) / 1e6;
+        }
+        metrics_text_printf(out, "cerver_replication_replica_lag_seconds{replica=\"%s\"} %.6f\n", link->address, lag);
+    }
+    pthread_mutex_unlock(&stream_lock);
+}
+
+int replication_start_primary(Database *db, int port) {
+    if (!db || role != ROLE_NONE) return -1;
+    backlog = malloc(REPLICATION_BACKLOG_SIZE);
+    if (!backlog) {
+        perror("Failed to allocate replication backlog");
+        return -1;
+    }
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        perror("Failed to create replication socket");
+        free(backlog);
+        backlog = NULL;
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons((uint16_t)port);
+    if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listen_fd, 16) != 0) {
+        perror("Failed to listen for replicas");
+        close(listen_fd);
+        listen_fd = -1;
+        free(backlog);
+        backlog = NULL;
+        return -1;
+    }
+
+    database = db;
+    stopping = 0;
+    stream_head = 0;
+    run_id = (wall_clock_us() << 16) ^ (uint64_t)getpid() ^ (uint64_t)(uintptr_t)&address;
+    if (run_id == 0) run_id = 1;
+    init_monotonic_cond(&stream_grew);
+    full_sync_metric = metrics_counter("cerver_replication_full_syncs_total",
+                                       "Full syncs (schema and snapshot) sent to replicas.", NULL);
+    role = ROLE_PRIMARY;
+    set_change_listener(db, record_change, NULL);
+    if (pthread_create(&listener, NULL, accept_replicas, NULL) != 0) {
+        perror("Failed to start replication listener");
+        set_change_listener(db, NULL, NULL);
+        close(listen_fd);
+        listen_fd = -1;
+        role = ROLE_NONE;
+        return -1;
+    }
+    metrics_add_collector(collect_primary_metrics, NULL);
+    printf("Replication: serving replicas on port %d.\n", port);
+    return 0;
+}
+
+// --- Replica: Applying Changes ---
+
+/**
+ * @brief The table a change or snapshot row names, if the last full sync accepted it.
+ */
+static Table *synced_table(const char *name) {
+    for (int i = 0; i < synced_count; i++) {
+        if (strcmp(synced_tables[i]->name, name) == 0) return synced_tables[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Writes a row as the primary has it: updates it if the replica has
+ * the key, inserts it otherwise.
+ * @return 0, or -1 on failure.
+ */
+static int upsert_row(Table *table, int primary_key, char **values) {
+    if (find_row_offset(table, primary_key) >= 0) return update_row(table, primary_key, values) >= 0 ? 0 : -1;
+    return insert_row(table, primary_key, values) >= 0 ? 0 : -1;
+}
+
+// Snapshot rows waiting to be inserted together
+typedef struct {
+    Table *table;               // Table being synced, NULL while its rows are skipped
+    int keys[REPLICATION_SYNC_BATCH];
+    char **values[REPLICATION_SYNC_BATCH];
+    int count;
+} SyncBatch;
+
+/**
+ * @brief Inserts the batched snapshot rows with one batch insert (row by row
+ * if that fails, e.g. because the table still had a key) and frees them.
+ */
+static void flush_sync_batch(SyncBatch *batch) {
+    if (batch->count > 0 &&
+        insert_rows_batch(batch->table, batch->count, batch->keys, batch->values, NULL) != batch->count) {
+        for (int i = 0; i < batch->count; i++) {
+            if (upsert_row(batch->table, batch->keys[i], batch->values[i]) != 0) {
+                fprintf(stderr, "Warning: Replica could not copy row %d of table '%s'.\n", batch->keys[i],
+                        batch->table->name);
+            }
+        }
+    }
+    for (int i = 0; i < batch->count; i++) {
+        for (int c = 0; c < batch->table->column_count; c++) free(batch->values[i][c]);
+        free(batch->values[i]);
+    }
+    batch->count = 0;
+}
+
+/**
+ * @brief Starts syncing a table from its REPLICATION_MSG_TABLE: checks that
+ * the replica has it with the primary's columns and empties it.
+ */
+static void begin_table_sync(SyncBatch *batch, const unsigned char *payload, size_t length) {
+    flush_sync_batch(batch);
+    batch->table = NULL;
+    const unsigned char *end = payload + length;
+    char name[WAL_MAX_TABLE_NAME + 1];
+    if (read_name(&payload, end, name) != 0 || end - payload < RECORD_FILE_HEADER_SIZE) return;
+
+    Table *table = find_table(database, name);
+    if (!table) {
+        LOG_WARN("Replica has no table '%s'; its changes are skipped.", name);
+        return;
+    }
+    if (record_check_file_header(payload, RECORD_FILE_HEADER_SIZE, table->column_types, table->column_count) != 0) {
+        LOG_WARN("Table '%s' has other columns than on the primary; its changes are skipped.", name);
+        return;
+    }
+    rollback_transaction(table);
+    if (synced_count < MAX_TABLES) synced_tables[synced_count++] = table;
+    batch->table = table;
+}
+
+/**
+ * @brief Adds a snapshot row (REPLICATION_MSG_ROW) to the batch of its table.
+ * @return 0, or -1 if the row is malformed.
+ */
+static int add_sync_row(SyncBatch *batch, const unsigned char *payload, size_t length) {
+    const unsigned char *end = payload + length;
+    char name[WAL_MAX_TABLE_NAME + 1];
+    if (read_name(&payload, end, name) != 0 || end - payload < 4) return -1;
+    if (!batch->table || strcmp(batch->table->name, name) != 0) return 0;
+    int32_t key;
+    memcpy(&key, payload, 4);
+    payload += 4;
+    char **values = record_decode(batch->table->column_types, batch->table->column_count, payload,
+                                  (size_t)(end - payload));
+    if (!values) return -1;
+    batch->keys[batch->count] = key;
+    batch->values[batch->count] = values;
+    if (++batch->count == REPLICATION_SYNC_BATCH) flush_sync_batch(batch);
+    return 0;
+}
+
+/**
+ * @brief Applies a change of the stream to its table.
+ * @return 0, or -1 if the change is malformed.
+ */
+static int apply_change(uint8_t type, const unsigned char *payload, size_t length) {
+    static __thread char *decode_buffer;
+    static __thread size_t decode_capacity;
+    const unsigned char *end = payload + length;
+    char name[WAL_MAX_TABLE_NAME + 1];
+    if (length < 8) return -1;
+    uint64_t commit_us;
+    memcpy(&commit_us, payload, 8);
+    payload += 8;
+    if (read_name(&payload, end, name) != 0 || end - payload < 4) return -1;
+    int32_t key;
+    memcpy(&key, payload, 4);
+    payload += 4;
+    __atomic_store_n(&applied_commit_us, commit_us, __ATOMIC_RELAXED);
+
+    Table *table = synced_table(name);
+    if (!table) return 0;
+    if (type == REPLICATION_MSG_PUT) {
+        char *values[MAX_COLUMNS];
+        if (record_decode_into(table->column_types, table->column_count, payload, (size_t)(end - payload),
+                               values, &decode_buffer, &decode_capacity) != 0) {
+            return -1;
+        }
+        if (upsert_row(table, key, values) != 0) {
+            fprintf(stderr, "Warning: Replica could not apply a write of row %d to table '%s'.\n", key, name);
+        }
+    } else if (type == REPLICATION_MSG_DELETE) {
+        if (find_row_offset(table, key) >= 0) delete_row(table, key);
+    } else {
+        if (end - payload < 2) return -1;
+        int shard = payload[0], shard_count = payload[1];
+        if (shard_count == 0) {
+            rollback_transaction(table);
+        } else {
+            // Only the rows the primary kept in that shard go
+            int count = 0;
+            int *keys = collect_primary_keys(table, &count);
+            for (int i = 0; i < count; i++) {
+                if (table_shard_of_key(shard_count, keys[i]) == shard) delete_row(table, keys[i]);
+            }
+            free(keys);
+        }
+    }
+    metrics_count(applied_metric, 1);
+    return 0;
+}
+
+/**
+ * @brief Follows the primary over one connection: says hello, takes a full
+ * sync or resumes, and applies the stream until the link drops or replication stops.
+ */
+static void follow_primary(int fd) {
+    Buffer in = { NULL, 0, 0 }, out = { NULL, 0, 0 };
+    SyncBatch *batch = calloc(1, sizeof(SyncBatch));
+    if (!batch || append_pair(&out, REPLICATION_MSG_HELLO, primary_run_id,
+                              __atomic_load_n(&applied_offset, __ATOMIC_RELAXED)) != 0 ||
+        send_buffer(fd, &out) != 0) {
+        free(batch);
+        buffer_free(&out);
+        return;
+    }
+
+    int syncing = 0, failed = 0;
+    while (!failed && !__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+        ssize_t got = receive_some(fd, &in, 0);
+        if (got <= 0) {
+            if (!__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+                LOG_WARN("Replication link to %s:%s lost.", primary_host, primary_port);
+            }
+            break;
+        }
+
+        size_t position = 0, start;
+        uint8_t type;
+        const unsigned char *payload;
+        size_t length;
+        int found;
+        while (!failed && (start = position, found = next_message(&in, &position, &type, &payload, &length)) == 1) {
+            uint64_t first = 0, second = 0;
+            if (length >= 16) {
+                memcpy(&first, payload, 8);
+                memcpy(&second, payload + 8, 8);
+            }
+            switch (type) {
+                case REPLICATION_MSG_FULL_SYNC:
+                    primary_run_id = first;
+                    __atomic_store_n(&applied_offset, second, __ATOMIC_RELAXED);
+                    __atomic_store_n(&primary_offset, second, __ATOMIC_RELAXED);
+                    synced_count = 0;
+                    syncing = 1;
+                    metrics_count(full_sync_metric, 1);
+                    LOG_INFO("Full sync from %s:%s started.", primary_host, primary_port);
+                    break;
+                case REPLICATION_MSG_CONTINUE:
+                    __atomic_store_n(&applied_offset, second, __ATOMIC_RELAXED);
+                    __atomic_store_n(&connected, 1, __ATOMIC_RELAXED);
+                    LOG_INFO("Replication from %s:%s resumed at offset %llu.", primary_host, primary_port,
+                             (unsigned long long)second);
+                    break;
+                case REPLICATION_MSG_TABLE:
+                    if (syncing) begin_table_sync(batch, payload, length);
+                    break;
+                case REPLICATION_MSG_ROW:
+                    if (syncing && add_sync_row(batch, payload, length) != 0) failed = 1;
+                    break;
+                case REPLICATION_MSG_SYNC_DONE:
+                    if (batch->table) flush_sync_batch(batch);
+                    batch->table = NULL;
+                    syncing = 0;
+                    __atomic_store_n(&connected, 1, __ATOMIC_RELAXED);
+                    LOG_INFO("Full sync from %s:%s done (%d tables).", primary_host, primary_port, synced_count);
+                    break;
+                case REPLICATION_MSG_HEARTBEAT:
+                    if (first > __atomic_load_n(&primary_offset, __ATOMIC_RELAXED)) {
+                        __atomic_store_n(&primary_offset, first, __ATOMIC_RELAXED);
+                    }
+                    break;
+                case REPLICATION_MSG_PUT:
+                case REPLICATION_MSG_DELETE:
+                case REPLICATION_MSG_TRUNCATE: {
+                    if (apply_change(type, payload, length) != 0) {
+                        failed = 1;
+                        break;
+                    }
+                    uint64_t applied = __atomic_add_fetch(&applied_offset, position - start, __ATOMIC_RELAXED);
+                    if (applied > __atomic_load_n(&primary_offset, __ATOMIC_RELAXED)) {
+                        __atomic_store_n(&primary_offset, applied, __ATOMIC_RELAXED);
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+        if (found < 0 || failed) {
+            LOG_ERROR("Malformed replication message from %s:%s; reconnecting.", primary_host, primary_port);
+            break;
+        }
+        consume(&in, position);
+
+        // Tell the primary how far this replica is, which also keeps the link alive
+        uint64_t applied = __atomic_load_n(&applied_offset, __ATOMIC_RELAXED);
+        if (append_message(&out, REPLICATION_MSG_ACK, &applied, sizeof(applied), NULL, 0) != 0 ||
+            send_buffer(fd, &out) != 0) {
+            break;
+        }
+    }
+    // A sync cut short leaves tables part copied; the next connection syncs again
+    if (syncing) {
+        primary_run_id = 0;
+        if (batch->table) flush_sync_batch(batch);
+    }
+    __atomic_store_n(&connected, 0, __ATOMIC_RELAXED);
+    free(batch);
+    buffer_free(&in);
+    buffer_free(&out);
+}
+
+/**
+ * @brief Connects to the primary.
+ * @return The socket, or -1 if the primary can't be reached.
+ */
+static int connect_to_primary() {
+    struct addrinfo hints, *addresses = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(primary_host, primary_port, &hints, &addresses) != 0) return -1;
+    int fd = -1;
+    for (struct addrinfo *address = addresses; address && fd < 0; address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd >= 0 && connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd >= 0) configure_socket(fd);
+    return fd;
+}
+
+/**
+ * @brief Replica thread: follows the primary, reconnecting every
+ * REPLICATION_RETRY_MS while it is unreachable.
+ */
+static void *replicate(void *arg) {
+    (void)arg;
+    int warned = 0;
+    while (!__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+        int fd = connect_to_primary();
+        if (fd >= 0) {
+            pthread_mutex_lock(&follower_lock);
+            follower_fd = fd;
+            pthread_mutex_unlock(&follower_lock);
+            if (!__atomic_load_n(&stopping, __ATOMIC_RELAXED)) follow_primary(fd);
+            pthread_mutex_lock(&follower_lock);
+            follower_fd = -1;
+            pthread_mutex_unlock(&follower_lock);
+            close(fd);
+            warned = 0;
+        } else if (!warned) {
+            LOG_WARN("Primary %s:%s is unreachable; retrying.", primary_host, primary_port);
+            warned = 1;
+        }
+
+        pthread_mutex_lock(&follower_lock);
+        if (!__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+            struct timespec deadline = deadline_in(REPLICATION_RETRY_MS);
+            pthread_cond_timedwait(&follower_wake, &follower_lock, &deadline);
+        }
+        pthread_mutex_unlock(&follower_lock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Metrics collector of a replica: the link state and its lag behind the primary.
+ */
+static void collect_replica_metrics(void *context, MetricsText *out) {
+    (void)context;
+    uint64_t applied = __atomic_load_n(&applied_offset, __ATOMIC_RELAXED);
+    uint64_t primary = __atomic_load_n(&primary_offset, __ATOMIC_RELAXED);
+    int linked = __atomic_load_n(&connected, __ATOMIC_RELAXED);
+    uint64_t lag_bytes = primary > applied ? primary - applied : 0;
+    double lag_seconds = 0;
+    uint64_t commit_us = __atomic_load_n(&applied_commit_us, __ATOMIC_RELAXED);
+    uint64_t now_us = wall_clock_us();
+    if (lag_bytes > 0 && commit_us > 0 && now_us > commit_us) lag_seconds = (double)(now_us - commit_us) / 1e6;
+    metrics_text_printf(out, "# HELP cerver_replication_connected Whether the replica is linked to its primary and synced.\n"
+                             "# TYPE cerver_replication_connected gauge\n"
+                             "cerver_replication_connected %d\n", linked);
+    metrics_text_printf(out, "# HELP cerver_replication_offset Bytes of the primary's change stream applied.\n"
+                             "# TYPE cerver_replication_offset gauge\n"
+                             "cerver_replication_offset %llu\n", (unsigned long long)applied);
+    metrics_text_printf(out, "# HELP cerver_replication_lag_bytes Bytes of changes the primary has reported and the replica not applied.\n"
+                             "# TYPE cerver_replication_lag_bytes gauge\n"
+                             "cerver_replication_lag_bytes %llu\n", (unsigned long long)lag_bytes);
+    metrics_text_printf(out, "# HELP cerver_replication_lag_seconds While behind, the age of the last change applied.\n"
+                             "# TYPE cerver_replication_lag_seconds gauge\n"
+                             "cerver_replication_lag_seconds %.6f\n", lag_seconds);
+}
+
+int replication_start_replica(Database *db, const char *host, int port) {
+    if (!db || !host || role != ROLE_NONE) return -1;
+    snprintf(primary_host, sizeof(primary_host), "%s", host);
+    snprintf(primary_port, sizeof(primary_port), "%d", port);
+    struct addrinfo hints, *addresses = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    int error = getaddrinfo(primary_host, primary_port, &hints, &addresses);
+    if (error != 0) {
+        fprintf(stderr, "Error: Cannot resolve primary '%s': %s\n", host, gai_strerror(error));
+        return -1;
+    }
+    freeaddrinfo(addresses);
+
+    database = db;
+    stopping = 0;
+    primary_run_id = 0;
+    applied_offset = primary_offset = applied_commit_us = 0;
+    init_monotonic_cond(&follower_wake);
+    full_sync_metric = metrics_counter("cerver_replication_full_syncs_total",
+                                       "Full syncs (schema and snapshot) taken from the primary.", NULL);
+    applied_metric = metrics_counter("cerver_replication_changes_applied_total",
+                                     "Row changes of the primary applied.", NULL);
+    role = ROLE_REPLICA;
+    if (pthread_create(&follower, NULL, replicate, NULL) != 0) {
+        perror("Failed to start replication thread");
+        role = ROLE_NONE;
+        return -1;
+    }
+    metrics_add_collector(collect_replica_metrics, NULL);
+    printf("Replication: following the primary at %s:%d (read-only).\n", host, port);
+    return 0;
+}
+
+// --- Shutdown ---
+
+void replication_stop() {
+    if (role == ROLE_NONE) return;
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELAXED);
+    if (role == ROLE_PRIMARY) {
+        metrics_remove_collector(collect_primary_metrics, NULL);
+        set_change_listener(database, NULL, NULL);
+        shutdown(listen_fd, SHUT_RDWR); // Wakes the accept
+        pthread_join(listener, NULL);
+        close(listen_fd);
+        listen_fd = -1;
+        pthread_mutex_lock(&stream_lock);
+        pthread_cond_broadcast(&stream_grew);
+        pthread_mutex_unlock(&stream_lock);
+        reap_links(1);
+        pthread_mutex_lock(&stream_lock);
+        free(backlog);
+        backlog = NULL;
+        pthread_mutex_unlock(&stream_lock);
+    } else {
+        metrics_remove_collector(collect_replica_metrics, NULL);
+        pthread_mutex_lock(&follower_lock);
+        if (follower_fd >= 0) shutdown(follower_fd, SHUT_RDWR);
+        pthread_cond_broadcast(&follower_wake);
+        pthread_mutex_unlock(&follower_lock);
+        pthread_join(follower, NULL);
+    }
+    role = ROLE_NONE;
+}
+
+int replication_is_replica() {
+    return role == ROLE_REPLICA;
+}
@@ -0,0 +1,84 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include <stdint.h>     // For stream offsets
+#include "database.h"
+
+// --- Replication ---
+// Asynchronous primary/replica replication of row changes over TCP.
+//
+// The primary installs a change listener (see ChangeListener) that appends
+// every committed insert, update and delete to an in-memory backlog holding
+// the last REPLICATION_BACKLOG_SIZE bytes of the change stream. Writers only
+// copy their change into the backlog; a sender thread per replica ships it.
+// A position in the stream is a byte offset, counted from the primary's start.
+//
+// A replica connects with the stream offset it applied up to and the run id
+// of the primary it came from. If that primary is still running and the
+// offset is still in the backlog, streaming resumes from there; otherwise the
+// replica gets a full sync: each table's schema, a snapshot of its rows (the
+// replica empties its table first), then the stream from the offset the
+// snapshot started at. Changes are applied as upserts and idempotent deletes,
+// so those that raced with the snapshot leave the same rows as on the primary.
+// Replicas ack what they have applied, and both sides export their lag.
+//
+// Every message is framed as
+//
+//   uint32 length        bytes after this field
+//   uint8  type          REPLICATION_MSG_*
+//   payload
+//
+// and a change in the stream (REPLICATION_MSG_PUT, _DELETE, _TRUNCATE) as
+//
+//   uint64 commit time   microseconds since 1970 on the primary's clock
+//   uint8  name length, then the table name
+//   int32  primary key
+//   PUT: the row's record (record.h format); TRUNCATE: uint8 shard, uint8
+//   shard count (both 0 for an unpartitioned table)
+//
+// Integers are in host byte order, like the records they carry, so both ends
+// must share it. The tables a replica serves must be defined with the same
+// columns as on the primary; others are skipped.
+
+#ifndef REPLICATION_BACKLOG_SIZE
+#define REPLICATION_BACKLOG_SIZE (16UL << 20)   // Bytes of recent changes a reconnecting replica can resume from
+#endif
+#define REPLICATION_HEARTBEAT_MS 1000           // Longest the primary stays silent
+#define REPLICATION_ACK_POLL_MS 100             // How often an idle primary reads its replicas' acks
+#define REPLICATION_TIMEOUT 10                  // Seconds without a message before a link is dropped
+#define REPLICATION_RETRY_MS 1000               // Pause before a replica reconnects
+#define REPLICATION_MAX_MESSAGE (64U << 20)     // Largest message accepted
+#define REPLICATION_MAX_REPLICAS 16             // Replicas one primary streams to at once
+#define REPLICATION_SYNC_BATCH 1024             // Snapshot rows a replica inserts in one batch
+
+// Message types
+#define REPLICATION_MSG_HELLO 1         // Replica: uint64 run id, uint64 offset applied (0, 0 for none)
+#define REPLICATION_MSG_ACK 2           // Replica: uint64 offset applied
+#define REPLICATION_MSG_CONTINUE 3      // Primary: uint64 run id, uint64 offset the stream resumes at
+#define REPLICATION_MSG_FULL_SYNC 4     // Primary: uint64 run id, uint64 offset the stream starts at after the snapshot
+#define REPLICATION_MSG_TABLE 5         // Primary: uint8 name length, name, the table's RECORD_FILE_HEADER_SIZE file header
+#define REPLICATION_MSG_ROW 6           // Primary: uint8 name length, name, int32 key, record (a snapshot row)
+#define REPLICATION_MSG_SYNC_DONE 7     // Primary: the snapshot is complete
+#define REPLICATION_MSG_HEARTBEAT 8     // Primary: uint64 stream offset, uint64 time in microseconds
+#define REPLICATION_MSG_PUT 9           // Stream: a row inserted or updated
+#define REPLICATION_MSG_DELETE 10       // Stream: a row deleted
+#define REPLICATION_MSG_TRUNCATE 11     // Stream: a table (or one shard of it) emptied
+
+// Starts recording db's row changes and serving them to replicas on port.
+// Call after the tables are created and before writes start.
+// Returns 0, or -1 if the port can't be listened on.
+int replication_start_primary(Database *db, int port);
+
+// Starts applying the changes of the primary at host:port to db's tables,
+// reconnecting whenever the link drops. Call after the tables are created.
+// Returns 0, or -1 if the host can't be resolved or the thread started.
+int replication_start_replica(Database *db, const char *host, int port);
+
+// Stops either role: closes every link and joins its threads. Call before
+// the database is destroyed.
+void replication_stop();
+
+// Returns 1 if this server is a replica (its tables follow a primary)
+int replication_is_replica();
+
+#endif // REPLICATION_H
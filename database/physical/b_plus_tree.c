@@ -1,97 +1,571 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>     // For open
+#include <unistd.h>    // For pread, pwrite, ftruncate, close
+#include <sys/stat.h>  // For fstat
 #include "b_plus_tree.h"
 
+// --- On-disk layout ---
+
+#define BPT_MAGIC "CRVBPT1"     // 8 bytes including the NUL
+#define BPT_VERSION 2
+#define NODE_ALIGNMENT 64       // Cached nodes start on a cache line
+
+// Page 0 of the index file
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t page_size;
+    uint32_t leaf_max_keys;
+    uint32_t internal_max_keys;
+    uint32_t root;
+    uint32_t page_count;
+    uint32_t free_head;
+    uint32_t syncing;           // Set while pages are being written; a crash leaves it set
+    int64_t data_size;          // Data file size the index describes
+} IndexHeader;
+
+// Start of every page after the header; free pages use nothing else
+typedef struct {
+    uint8_t is_leaf;
+    uint8_t is_free;
+    uint16_t num_keys;
+    PageId next;
+} PageHeader;
+
+_Static_assert(sizeof(IndexHeader) <= BPT_PAGE_SIZE, "index header must fit in a page");
+_Static_assert(sizeof(PageHeader) == BPT_NODE_HEADER_SIZE && offsetof(BPlusTreeNode, leaf) == BPT_NODE_HEADER_SIZE,
+               "node header must be 8 bytes");
+_Static_assert(sizeof(LeafEntries) <= BPT_PAGE_SIZE - BPT_NODE_HEADER_SIZE, "leaf entries must fit in a page");
+_Static_assert(sizeof(InternalEntries) <= BPT_PAGE_SIZE - BPT_NODE_HEADER_SIZE, "internal entries must fit in a page");
+_Static_assert(LEAF_MIN_KEYS >= 1 && INTERNAL_MIN_KEYS >= 1, "BPT_PAGE_SIZE is too small");
+
 // --- Forward declarations for internal helper functions ---
-BPlusTreeNode *find_leaf_node(BPlusTreeNode *node, int key);
-void insert_into_leaf(BPlusTreeNode *leaf, int key, long file_offset);
+BPlusTreeNode *find_leaf_node(BPlusTree *tree, int key);
+void insert_into_leaf(BPlusTree *tree, BPlusTreeNode *leaf, int index, int key, long file_offset);
 void insert_into_parent(BPlusTree* tree, BPlusTreeNode *left, int key, BPlusTreeNode *right);
-void insert_into_node(BPlusTreeNode *node, int index, int key, BPlusTreeNode *right_child);
-void delete_entry(BPlusTree *tree, BPlusTreeNode *node, int key);
+void insert_into_node(BPlusTree *tree, BPlusTreeNode *node, int index, int key, BPlusTreeNode *right_child);
+void delete_entry(BPlusTree *tree, BPlusTreeNode *leaf, int index);
 void handle_underflow(BPlusTree *tree, BPlusTreeNode *node);
-void merge_nodes(BPlusTree *tree, BPlusTreeNode *left_node, BPlusTreeNode *right_node, int k_prime_index, int k_prime);
-static void fix_ancestor_separator(BPlusTreeNode *leaf, int old_key, int new_key);
+void merge_nodes(BPlusTree *tree, BPlusTreeNode *left_node, BPlusTreeNode *right_node, int k_prime_index);
+static void fix_ancestor_separator(BPlusTree *tree, BPlusTreeNode *leaf, int old_key, int new_key);
+
+
+// --- Key Search ---
+
+/**
+ * @brief Binary search for the first key that is >= key.
+ * @param keys Sorted keys.
+ * @param count Number of keys.
+ * @param key The key to look for.
+ * @return Index in [0, count].
+ */
+static inline int lower_bound(const int32_t *keys, int count, int key) {
+    int low = 0, high = count;
+    while (low < high) {
+        int mid = (low + high) >> 1;
+        if (keys[mid] < key) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+/**
+ * @brief Binary search for the first key that is > key, which is the child of
+ * an internal node to follow for key.
+ * @return Index in [0, count].
+ */
+static inline int upper_bound(const int32_t *keys, int count, int key) {
+    int low = 0, high = count;
+    while (low < high) {
+        int mid = (low + high) >> 1;
+        if (keys[mid] <= key) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+/**
+ * @brief Minimum number of keys for a non-root node of this kind.
+ */
+static inline int min_keys(const BPlusTreeNode *node) {
+    return node->is_leaf ? LEAF_MIN_KEYS : INTERNAL_MIN_KEYS;
+}
+
+
+// --- Page Cache ---
+
+/**
+ * @brief Appends a page id to one of the tree's growable page lists.
+ * @return 0 on success, -1 if the list could not grow.
+ */
+static int push_page(PageId **list, int *count, int *capacity, PageId page) {
+    if (*count == *capacity) {
+        int new_capacity = *capacity ? *capacity * 2 : 16;
+        PageId *grown = realloc(*list, new_capacity * sizeof(PageId));
+        if (!grown) {
+            perror("Failed to grow B+ Tree page list");
+            return -1;
+        }
+        *list = grown;
+        *capacity = new_capacity;
+    }
+    (*list)[(*count)++] = page;
+    return 0;
+}
+
+/**
+ * @brief Makes sure the page cache has a slot for the given page id.
+ * @return 0 on success, -1 on allocation failure.
+ */
+static int reserve_page_slot(BPlusTree *tree, PageId page) {
+    if (page < tree->page_capacity) return 0;
+    PageId new_capacity = tree->page_capacity ? tree->page_capacity : 64;
+    while (new_capacity <= page) new_capacity *= 2;
+    BPlusTreeNode **grown = realloc(tree->pages, new_capacity * sizeof(BPlusTreeNode *));
+    if (!grown) {
+        perror("Failed to grow B+ Tree page cache");
+        return -1;
+    }
+    memset(grown + tree->page_capacity, 0, (new_capacity - tree->page_capacity) * sizeof(BPlusTreeNode *));
+    tree->pages = grown;
+    tree->page_capacity = new_capacity;
+    return 0;
+}
+
+/**
+ * @brief Allocates a zeroed, cache-line aligned node.
+ * @return The node, or NULL on failure.
+ */
+static BPlusTreeNode *allocate_node() {
+    void *memory = NULL;
+    if (posix_memalign(&memory, NODE_ALIGNMENT, sizeof(BPlusTreeNode)) != 0) {
+        perror("Failed to allocate memory for BPlusTreeNode");
+        return NULL;
+    }
+    memset(memory, 0, sizeof(BPlusTreeNode));
+    return memory;
+}
+
+/**
+ * @brief Queues a node to be written at the next sync. No-op for memory-only trees.
+ */
+static void mark_dirty(BPlusTree *tree, BPlusTreeNode *node) {
+    if (tree->fd < 0 || node->dirty) return;
+    if (push_page(&tree->dirty_pages, &tree->dirty_count, &tree->dirty_capacity, node->page_id) == 0) {
+        node->dirty = 1;
+    }
+}
+
+/**
+ * @brief Makes node the root of the tree.
+ */
+static void set_root(BPlusTree *tree, BPlusTreeNode *node) {
+    tree->root = node;
+    if (node) node->parent = NULL;
+    tree->header_dirty = 1;
+}
+
+/**
+ * @brief Reads a node page from the index file into the cache.
+ * @return The loaded node, or NULL on an I/O error or a malformed page.
+ */
+static BPlusTreeNode *read_node_page(BPlusTree *tree, PageId page) {
+    BPlusTreeNode *node = allocate_node();
+    if (!node) return NULL;
+
+    if (pread(tree->fd, node->page, BPT_PAGE_SIZE, (off_t)page * BPT_PAGE_SIZE) != BPT_PAGE_SIZE) {
+        perror("Failed to read B+ Tree page");
+        free(node);
+        return NULL;
+    }
+    if (node->is_free || node->is_leaf > 1 ||
+        node->num_keys > (node->is_leaf ? LEAF_MAX_KEYS : INTERNAL_MAX_KEYS)) {
+        fprintf(stderr, "Error: B+ Tree page %u is not a valid node.\n", page);
+        free(node);
+        return NULL;
+    }
+    node->page_id = page;
+    __atomic_store_n(&tree->pages[page], node, __ATOMIC_RELEASE); // Fully read before other readers see it
+    return node;
+}
+
+/**
+ * @brief Returns the node stored in a page, loading it on first use.
+ * Safe to call from concurrent lookups: two readers missing on the same page
+ * are serialized so the page is only loaded once.
+ * @return The node, or NULL for BPT_NO_PAGE or on a read error.
+ */
+static BPlusTreeNode *get_node(BPlusTree *tree, PageId page) {
+    if (page == BPT_NO_PAGE || page >= tree->page_count || page >= tree->page_capacity) return NULL;
+    BPlusTreeNode *node = __atomic_load_n(&tree->pages[page], __ATOMIC_ACQUIRE);
+    if (node || tree->fd < 0) return node;
+
+    pthread_mutex_lock(&tree->load_lock);
+    node = tree->pages[page]; // Another reader may have loaded it meanwhile
+    if (!node) node = read_node_page(tree, page);
+    pthread_mutex_unlock(&tree->load_lock);
+    return node;
+}
+
+/**
+ * @brief Returns child i of an internal node, recording node as its parent.
+ */
+static BPlusTreeNode *get_child(BPlusTree *tree, BPlusTreeNode *node, int i) {
+    BPlusTreeNode *child = get_node(tree, node->internal.children[i]);
+    if (child) child->parent = node;
+    return child;
+}
+
+/**
+ * @brief Points the parent of a child page at node if that child is loaded.
+ * Unloaded children get their parent set when they are next reached from above.
+ */
+static void adopt_child(BPlusTree *tree, BPlusTreeNode *node, PageId child) {
+    if (child != BPT_NO_PAGE && child < tree->page_capacity && tree->pages[child]) {
+        tree->pages[child]->parent = node;
+    }
+}
+
+/**
+ * @brief Takes a page for a new node: one freed since the last sync, then the
+ * on-disk free list, then a new page at the end of the file.
+ * @return The page id, or BPT_NO_PAGE on failure.
+ */
+static PageId allocate_page(BPlusTree *tree) {
+    PageId page;
+    if (tree->freed_count > 0) {
+        page = tree->freed_pages[--tree->freed_count];
+    } else if (tree->free_head != BPT_NO_PAGE) {
+        PageHeader header;
+        page = tree->free_head;
+        if (pread(tree->fd, &header, sizeof(header), (off_t)page * BPT_PAGE_SIZE) != (ssize_t)sizeof(header)) {
+            perror("Failed to read B+ Tree free page");
+            return BPT_NO_PAGE;
+        }
+        tree->free_head = header.next;
+        tree->header_dirty = 1;
+    } else {
+        page = tree->page_count++;
+        tree->header_dirty = 1;
+    }
+    if (reserve_page_slot(tree, page) != 0) return BPT_NO_PAGE;
+    return page;
+}
+
+/**
+ * @brief Drops a node from the tree; its page is reused by later allocations.
+ */
+static void free_node(BPlusTree *tree, BPlusTreeNode *node) {
+    tree->pages[node->page_id] = NULL;
+    if (tree->fd >= 0) {
+        push_page(&tree->freed_pages, &tree->freed_count, &tree->freed_capacity, node->page_id);
+    }
+    free(node);
+}
+
+/**
+ * @brief Frees every cached node and resets the page bookkeeping.
+ */
+static void drop_pages(BPlusTree *tree) {
+    for (PageId i = 0; i < tree->page_capacity; i++) {
+        free(tree->pages[i]);
+        tree->pages[i] = NULL;
+    }
+    tree->root = NULL;
+    tree->page_count = 1; // The header page
+    tree->free_head = BPT_NO_PAGE;
+    tree->freed_count = 0;
+    tree->dirty_count = 0;
+}
 
 
 // --- Initialization ---
 
 /**
- * @brief Initializes a new B+ Tree.
- * Allocates memory for the tree structure and its root node (which starts as a leaf).
- * @return Pointer to the newly created BPlusTree, or NULL on failure.
+ * @brief Allocates an empty tree structure with no root.
+ * @param fd The index file, or -1 for a memory-only tree.
+ * @return Pointer to the new tree, or NULL on failure.
  */
-BPlusTree *initialize_tree() {
-    BPlusTree *tree = (BPlusTree *)malloc(sizeof(BPlusTree));
+static BPlusTree *allocate_tree(int fd) {
+    BPlusTree *tree = (BPlusTree *)calloc(1, sizeof(BPlusTree));
     if (!tree) {
         perror("Failed to allocate memory for BPlusTree");
         return NULL;
     }
-    tree->root = create_new_node(1); // Root starts as a leaf
+    if (pthread_mutex_init(&tree->load_lock, NULL) != 0) {
+        perror("Failed to initialize B+ Tree page cache lock");
+        free(tree);
+        return NULL;
+    }
+    tree->order = INTERNAL_MAX_KEYS + 1;
+    tree->fd = fd;
+    tree->page_count = 1;
+    tree->synced_data_size = -1;
+    return tree;
+}
+
+/**
+ * @brief Initializes a new B+ Tree that lives only in memory.
+ * Allocates memory for the tree structure and its root node (which starts as a leaf).
+ * @return Pointer to the newly created BPlusTree, or NULL on failure.
+ */
+BPlusTree *initialize_tree() {
+    BPlusTree *tree = allocate_tree(-1);
+    if (!tree) return NULL;
+    tree->root = create_new_node(tree, 1); // Root starts as a leaf
     if (!tree->root) {
         perror("Failed to allocate memory for root node");
-        free(tree);
+        destroy_tree(tree);
         return NULL;
     }
-    tree->order = MAX_KEYS + 1;
     tree->root->parent = NULL; // Root has no parent initially
     return tree;
 }
 
 /**
- * @brief Creates a new B+ Tree node.
- * Allocates memory and initializes basic properties (leaf status, key count, pointers).
+ * @brief Creates a new B+ Tree node in a newly allocated page.
+ * @param tree The tree the node belongs to.
  * @param is_leaf 1 if the node should be a leaf, 0 otherwise.
  * @return Pointer to the newly created BPlusTreeNode, or NULL on failure.
  */
-BPlusTreeNode *create_new_node(int is_leaf) {
-    BPlusTreeNode *node = (BPlusTreeNode *)malloc(sizeof(BPlusTreeNode));
+BPlusTreeNode *create_new_node(BPlusTree *tree, int is_leaf) {
+    PageId page = allocate_page(tree);
+    if (page == BPT_NO_PAGE) return NULL;
+
+    BPlusTreeNode *node = allocate_node();
     if (!node) {
-         perror("Failed to allocate memory for BPlusTreeNode");
+        push_page(&tree->freed_pages, &tree->freed_count, &tree->freed_capacity, page);
         return NULL;
     }
-    node->is_leaf = is_leaf;
+    node->is_leaf = is_leaf ? 1 : 0;
     node->num_keys = 0;
-    node->parent = NULL; // Initialize parent to NULL
-    node->next = NULL;   // Initialize next pointer (for leaves) to NULL
-    // Initialize children pointers to NULL
-    for (int i = 0; i < MAX_KEYS + 1; i++) {
-        node->children[i] = NULL;
-    }
-    // No need to initialize keys/offsets explicitly as num_keys is 0
+    node->parent = NULL;       // Initialize parent to NULL
+    node->next = BPT_NO_PAGE;  // Initialize next link (for leaves) to no page
+    node->page_id = page;
+    tree->pages[page] = node;
+    mark_dirty(tree, node);
     return node;
 }
 
+// --- Persistence ---
+
+/**
+ * @brief Writes the header page.
+ * @param syncing 1 while node pages are about to be written, 0 once they all are.
+ * @return 0 on success, -1 on failure.
+ */
+static int write_header(BPlusTree *tree, int syncing) {
+    unsigned char buffer[BPT_PAGE_SIZE] = {0};
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BPT_MAGIC, sizeof(header.magic));
+    header.version = BPT_VERSION;
+    header.page_size = BPT_PAGE_SIZE;
+    header.leaf_max_keys = LEAF_MAX_KEYS;
+    header.internal_max_keys = INTERNAL_MAX_KEYS;
+    header.root = tree->root ? tree->root->page_id : BPT_NO_PAGE;
+    header.page_count = tree->page_count;
+    header.free_head = tree->free_head;
+    header.syncing = syncing;
+    header.data_size = tree->synced_data_size;
+    memcpy(buffer, &header, sizeof(header));
+
+    if (pwrite(tree->fd, buffer, BPT_PAGE_SIZE, 0) != BPT_PAGE_SIZE) {
+        perror("Failed to write B+ Tree header");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes a node to its page.
+ * @return 0 on success, -1 on failure.
+ */
+static int write_node_page(BPlusTree *tree, BPlusTreeNode *node) {
+    if (pwrite(tree->fd, node->page, BPT_PAGE_SIZE, (off_t)node->page_id * BPT_PAGE_SIZE) != BPT_PAGE_SIZE) {
+        perror("Failed to write B+ Tree page");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Chains a released page onto the on-disk free list.
+ * @return 0 on success, -1 on failure.
+ */
+static int write_free_page(BPlusTree *tree, PageId page) {
+    unsigned char buffer[BPT_PAGE_SIZE] = {0};
+    PageHeader header = { .is_free = 1, .next = tree->free_head };
+    memcpy(buffer, &header, sizeof(header));
+
+    if (pwrite(tree->fd, buffer, BPT_PAGE_SIZE, (off_t)page * BPT_PAGE_SIZE) != BPT_PAGE_SIZE) {
+        perror("Failed to write B+ Tree free page");
+        return -1;
+    }
+    tree->free_head = page;
+    return 0;
+}
+
+/**
+ * @brief Resets a tree to a single empty root leaf.
+ */
+static int reset_tree(BPlusTree *tree) {
+    drop_pages(tree);
+    if (tree->fd >= 0 && ftruncate(tree->fd, 0) != 0) {
+        perror("Failed to truncate B+ Tree index file");
+    }
+    tree->root = create_new_node(tree, 1);
+    if (!tree->root) return -1;
+    tree->header_dirty = 1;
+    return 0;
+}
+
+/**
+ * @brief Opens a file-backed B+ Tree.
+ * Reads the header and the root page; every other node is read from its page
+ * the first time an operation reaches it, so opening takes the same time
+ * whatever the number of keys. A file that is missing, was written with a
+ * different page layout, or was left mid-sync gives an empty tree whose
+ * synced_data_size is -1, which the caller treats as "rebuild me".
+ * @param path Path of the index file; created if it does not exist.
+ * @return Pointer to the opened tree, or NULL on failure.
+ */
+BPlusTree *open_tree(const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror("Failed to open B+ Tree index file");
+        return NULL;
+    }
+
+    BPlusTree *tree = allocate_tree(fd);
+    if (!tree) {
+        close(fd);
+        return NULL;
+    }
+
+    IndexHeader header;
+    struct stat st;
+    int valid = fstat(fd, &st) == 0 &&
+                pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+                memcmp(header.magic, BPT_MAGIC, sizeof(header.magic)) == 0 &&
+                header.version == BPT_VERSION &&
+                header.page_size == BPT_PAGE_SIZE &&
+                header.leaf_max_keys == LEAF_MAX_KEYS &&
+                header.internal_max_keys == INTERNAL_MAX_KEYS &&
+                !header.syncing &&
+                header.root != BPT_NO_PAGE && header.root < header.page_count &&
+                header.free_head < header.page_count &&
+                (off_t)header.page_count * BPT_PAGE_SIZE <= st.st_size;
+
+    if (valid) {
+        tree->page_count = header.page_count;
+        tree->free_head = header.free_head;
+        if (reserve_page_slot(tree, header.page_count) == 0) {
+            tree->root = get_node(tree, header.root);
+        }
+        if (tree->root) {
+            tree->synced_data_size = header.data_size;
+            return tree;
+        }
+        fprintf(stderr, "Warning: B+ Tree index '%s' has an unreadable root; starting empty.\n", path);
+    }
+
+    if (reset_tree(tree) != 0) {
+        destroy_tree(tree);
+        return NULL;
+    }
+    tree->synced_data_size = -1;
+    return tree;
+}
+
+/**
+ * @brief Writes all modified pages and then the header.
+ * The header is first rewritten with its syncing flag set, so an index that
+ * was only partly written when the process died is detected on the next open.
+ * @param tree Pointer to the BPlusTree.
+ * @param data_size Size of the data file the index now describes.
+ * @return 0 on success, -1 on an I/O error.
+ */
+int sync_tree(BPlusTree *tree, long data_size) {
+    if (!tree) return -1;
+    int changed = tree->dirty_count > 0 || tree->freed_count > 0 || tree->header_dirty ||
+                  tree->synced_data_size != data_size;
+    tree->synced_data_size = data_size;
+    if (tree->fd < 0 || !changed) return 0;
+
+    int result = write_header(tree, 1);
+    for (int i = 0; i < tree->dirty_count; i++) {
+        PageId page = tree->dirty_pages[i];
+        BPlusTreeNode *node = page < tree->page_capacity ? tree->pages[page] : NULL;
+        if (!node || !node->dirty) continue; // Freed, or queued twice
+        if (write_node_page(tree, node) != 0) result = -1;
+        node->dirty = 0;
+    }
+    tree->dirty_count = 0;
+    for (int i = 0; i < tree->freed_count; i++) {
+        if (write_free_page(tree, tree->freed_pages[i]) != 0) result = -1;
+    }
+    tree->freed_count = 0;
+
+    // Leave the syncing flag set if anything failed, forcing a rebuild on open
+    if (result == 0) result = write_header(tree, 0);
+    if (result == 0) tree->header_dirty = 0;
+    return result;
+}
+
+/**
+ * @brief Removes every key from the tree, leaving an empty root leaf.
+ * @param tree Pointer to the BPlusTree.
+ */
+void clear_tree(BPlusTree *tree) {
+    if (!tree) return;
+    if (reset_tree(tree) != 0) {
+        fprintf(stderr, "Error: Failed to reset B+ Tree.\n");
+    }
+}
+
 // --- Search ---
 
 /**
  * @brief Finds the leaf node where a given key should reside.
- * Traverses the tree from the given node down to the appropriate leaf.
- * @param node The starting node (usually the root).
+ * Traverses the tree from the root down to the appropriate leaf with a binary
+ * search in each internal node, loading nodes from the index file as needed
+ * and recording each node's parent.
+ * @param tree Pointer to the BPlusTree.
  * @param key The key to search for.
  * @return Pointer to the leaf node where the key is or should be inserted, or NULL if tree is empty/invalid.
  */
-BPlusTreeNode *find_leaf_node(BPlusTreeNode *node, int key) {
-    if (!node) return NULL;
-    BPlusTreeNode *current = node;
-    // Traverse down the tree until a leaf node is reached
-    while (!current->is_leaf) {
-        int i = 0;
-        // Find the first key in the internal node that is >= the search key
-        // Or go to the rightmost child if key is larger than all keys
-        while (i < current->num_keys && key >= current->keys[i]) {
-            i++;
-        }
-        // Follow the appropriate child pointer
-        current = current->children[i];
-        if (!current) return NULL; // Should not happen in a valid tree
+BPlusTreeNode *find_leaf_node(BPlusTree *tree, int key) {
+    BPlusTreeNode *current = tree->root;
+    while (current && !current->is_leaf) {
+        // Keys equal to a separator live in the subtree to its right
+        int i = upper_bound(current->internal.keys, current->num_keys, key);
+        current = get_child(tree, current, i);
     }
-    return current; // Return the leaf node found
+    return current; // NULL only if a page could not be read
+}
+
+/**
+ * @brief Read-only version of find_leaf_node for lookups.
+ * Parent pointers are left alone, so concurrent lookups never write to a node.
+ * @param tree Pointer to the BPlusTree.
+ * @param key The key to search for.
+ * @return The leaf where the key is or would be, or NULL on a read error.
+ */
+static BPlusTreeNode *lookup_leaf(BPlusTree *tree, int key) {
+    BPlusTreeNode *current = tree->root;
+    while (current && !current->is_leaf) {
+        int i = upper_bound(current->internal.keys, current->num_keys, key);
+        current = get_node(tree, current->internal.children[i]);
+    }
+    return current;
 }
 
 /**
  * @brief Searches for a key within the B+ Tree.
- * Finds the appropriate leaf node and performs a linear search within that node.
+ * Finds the appropriate leaf node and binary searches it.
  * @param tree Pointer to the BPlusTree.
  * @param key The key to search for.
  * @return The file offset associated with the key if found, otherwise -1.
@@ -99,15 +573,12 @@ BPlusTreeNode *find_leaf_node(BPlusTreeNode *node, int key) {
 long search_key(BPlusTree *tree, int key) {
     if (!tree || !tree->root) return -1; // Handle empty or invalid tree
 
-    // Find the leaf node where the key might exist
-    BPlusTreeNode *leaf = find_leaf_node(tree->root, key);
-    if (!leaf) return -1; // Should not happen if root exists
+    BPlusTreeNode *leaf = lookup_leaf(tree, key);
+    if (!leaf) return -1;
 
-    // Linear search within the leaf node for the key
-    for (int i = 0; i < leaf->num_keys; i++) {
-        if (leaf->keys[i] == key) {
-            return leaf->file_offsets[i]; // Key found, return its associated offset
-        }
+    int i = lower_bound(leaf->leaf.keys, leaf->num_keys, key);
+    if (i < leaf->num_keys && leaf->leaf.keys[i] == key) {
+        return leaf->leaf.file_offsets[i]; // Key found, return its associated offset
     }
     return -1; // Key not found in the leaf node
 }
@@ -117,7 +588,7 @@ long search_key(BPlusTree *tree, int key) {
 /**
  * @brief Inserts a key and its associated file offset into the B+ Tree.
  * Handles finding the correct leaf, inserting, and splitting nodes if necessary,
- * propagating splits up the tree.
+ * propagating splits up the tree. An existing key has its offset replaced.
  * @param tree Pointer to the BPlusTree.
  * @param key The key to insert.
  * @param file_offset The file offset associated with the key.
@@ -125,110 +596,80 @@ long search_key(BPlusTree *tree, int key) {
 void insert_key(BPlusTree *tree, int key, long file_offset) {
     if (!tree || !tree->root) return; // Cannot insert into an invalid tree
 
-    // Special case: Tree is completely empty (root is a leaf with 0 keys)
-    if (tree->root->is_leaf && tree->root->num_keys == 0) {
-         insert_into_leaf(tree->root, key, file_offset);
-         return;
-    }
-
-    // Find the appropriate leaf node for insertion
-    BPlusTreeNode *leaf = find_leaf_node(tree->root, key);
-    if (!leaf) return; // Should not happen
+    BPlusTreeNode *leaf = find_leaf_node(tree, key);
+    if (!leaf) return;
 
-    // Optional: Check for duplicate keys if they are not allowed
-    // for (int i = 0; i < leaf->num_keys; i++) {
-    //     if (leaf->keys[i] == key) {
-    //         fprintf(stderr, "Warning: Duplicate key %d insertion attempted.\n", key);
-    //         // Decide how to handle duplicates: update offset, return error, etc.
-    //         // leaf->file_offsets[i] = file_offset; // Example: Update offset
-    //         return; // Or return an error code
-    //     }
-    // }
+    int index = lower_bound(leaf->leaf.keys, leaf->num_keys, key);
+    if (index < leaf->num_keys && leaf->leaf.keys[index] == key) {
+        leaf->leaf.file_offsets[index] = file_offset;
+        mark_dirty(tree, leaf);
+        return;
+    }
 
     // If the leaf node has space, insert directly
-    if (leaf->num_keys < MAX_KEYS) {
-        insert_into_leaf(leaf, key, file_offset);
-    } else {
-        // Leaf node is full, needs splitting
-        // Create temporary arrays large enough to hold the new key + existing keys
-        int temp_keys[MAX_KEYS + 1];
-        long temp_offsets[MAX_KEYS + 1];
-
-        // Find the position where the new key should be inserted and copy existing keys/offsets
-        int i = 0;
-        while (i < MAX_KEYS && key > leaf->keys[i]) {
-            temp_keys[i] = leaf->keys[i];
-            temp_offsets[i] = leaf->file_offsets[i];
-            i++;
-        }
-        // Insert the new key and offset
-        temp_keys[i] = key;
-        temp_offsets[i] = file_offset;
-        // Copy the remaining keys/offsets
-        while(i < MAX_KEYS) {
-            temp_keys[i+1] = leaf->keys[i];
-            temp_offsets[i+1] = leaf->file_offsets[i];
-            i++;
-        }
-
-        // Create a new leaf node to become the right sibling
-        BPlusTreeNode *new_leaf = create_new_node(1);
-        if (!new_leaf) return; // Allocation failed
-        new_leaf->parent = leaf->parent; // New leaf shares the same parent initially
-
-        // Determine the split point (ceiling of (MAX_KEYS+1)/2)
-        int split_point = (MAX_KEYS + 1) / 2;
+    if (leaf->num_keys < LEAF_MAX_KEYS) {
+        insert_into_leaf(tree, leaf, index, key, file_offset);
+        return;
+    }
 
-        // Redistribute keys/offsets between the original leaf and the new leaf
+    // Leaf node is full, needs splitting. The left half keeps the first
+    // split_point of the LEAF_MAX_KEYS + 1 entries, the new leaf the rest.
+    BPlusTreeNode *new_leaf = create_new_node(tree, 1);
+    if (!new_leaf) return; // Allocation failed
+    new_leaf->parent = leaf->parent; // New leaf shares the same parent initially
+
+    int split_point = (LEAF_MAX_KEYS + 1) / 2;
+    if (index < split_point) {
+        // New key goes left: move the upper entries out, then insert
+        int moved = LEAF_MAX_KEYS - (split_point - 1);
+        memcpy(new_leaf->leaf.keys, leaf->leaf.keys + split_point - 1, moved * sizeof(int32_t));
+        memcpy(new_leaf->leaf.file_offsets, leaf->leaf.file_offsets + split_point - 1, moved * sizeof(int64_t));
+        new_leaf->num_keys = moved;
+        leaf->num_keys = split_point - 1;
+        insert_into_leaf(tree, leaf, index, key, file_offset);
+    } else {
+        // New key goes right
+        int moved = LEAF_MAX_KEYS - split_point;
+        memcpy(new_leaf->leaf.keys, leaf->leaf.keys + split_point, moved * sizeof(int32_t));
+        memcpy(new_leaf->leaf.file_offsets, leaf->leaf.file_offsets + split_point, moved * sizeof(int64_t));
+        new_leaf->num_keys = moved;
         leaf->num_keys = split_point;
-        for(i = 0; i < split_point; i++) {
-            leaf->keys[i] = temp_keys[i];
-            leaf->file_offsets[i] = temp_offsets[i];
-        }
-
-        new_leaf->num_keys = (MAX_KEYS + 1) - split_point;
-        for(i = 0; i < new_leaf->num_keys; i++) {
-            new_leaf->keys[i] = temp_keys[split_point + i];
-            new_leaf->file_offsets[i] = temp_offsets[split_point + i];
-        }
+        insert_into_leaf(tree, new_leaf, index - split_point, key, file_offset);
+    }
 
-        // Link the new leaf into the list of leaf nodes
-        new_leaf->next = leaf->next;
-        leaf->next = new_leaf;
+    // Link the new leaf into the list of leaf nodes
+    new_leaf->next = leaf->next;
+    leaf->next = new_leaf->page_id;
+    mark_dirty(tree, leaf);
 
-        // Insert the first key of the new leaf into the parent node
-        insert_into_parent(tree, leaf, new_leaf->keys[0], new_leaf);
-    }
+    // Insert the first key of the new leaf into the parent node
+    insert_into_parent(tree, leaf, new_leaf->leaf.keys[0], new_leaf);
 }
 
 /**
  * @brief Inserts a key and file offset into a leaf node that is known to have space.
- * Shifts existing keys/offsets to make room and inserts the new entry in sorted order.
+ * @param tree Pointer to the BPlusTree.
  * @param leaf Pointer to the leaf node.
+ * @param index Position of the new entry (from lower_bound).
  * @param key The key to insert.
  * @param file_offset The file offset to insert.
  */
-void insert_into_leaf(BPlusTreeNode *leaf, int key, long file_offset) {
-    int i = leaf->num_keys - 1;
-    // Find the correct position to insert the key while maintaining sorted order
-    // Shift existing keys and offsets to the right
-    while (i >= 0 && key < leaf->keys[i]) {
-        leaf->keys[i + 1] = leaf->keys[i];
-        leaf->file_offsets[i + 1] = leaf->file_offsets[i];
-        i--;
-    }
-    // Insert the new key and offset at the correct position
-    leaf->keys[i + 1] = key;
-    leaf->file_offsets[i + 1] = file_offset;
-    leaf->num_keys++; // Increment the key count
+void insert_into_leaf(BPlusTree *tree, BPlusTreeNode *leaf, int index, int key, long file_offset) {
+    int tail = leaf->num_keys - index;
+    memmove(leaf->leaf.keys + index + 1, leaf->leaf.keys + index, tail * sizeof(int32_t));
+    memmove(leaf->leaf.file_offsets + index + 1, leaf->leaf.file_offsets + index, tail * sizeof(int64_t));
+    leaf->leaf.keys[index] = key;
+    leaf->leaf.file_offsets[index] = file_offset;
+    leaf->num_keys++;
+    mark_dirty(tree, leaf);
 }
 
 /**
- * @brief Inserts a new key and child pointer into a parent node after a split.
+ * @brief Inserts a new key and child into a parent node after a split.
  * Handles splitting the parent node if it's full, potentially creating a new root.
  * @param tree Pointer to the BPlusTree.
  * @param left Pointer to the existing child node (the left node after the split).
- * @param key The key to insert into the parent (usually the first key of the 'right' node).
+ * @param key The key to insert into the parent (the smallest key under 'right').
  * @param right Pointer to the new child node created during the split (the right node).
  */
 void insert_into_parent(BPlusTree* tree, BPlusTreeNode *left, int key, BPlusTreeNode *right) {
@@ -236,115 +677,86 @@ void insert_into_parent(BPlusTree* tree, BPlusTreeNode *left, int key, BPlusTree
 
     // Case 1: The 'left' node was the root. A new root must be created.
     if (parent == NULL) {
-        BPlusTreeNode *new_root = create_new_node(0); // New root is an internal node
+        BPlusTreeNode *new_root = create_new_node(tree, 0); // New root is an internal node
         if (!new_root) return; // Allocation failed
-        new_root->keys[0] = key;         // The key that separated left and right
-        new_root->children[0] = left;    // Old root becomes the left child
-        new_root->children[1] = right;   // New node becomes the right child
+        new_root->internal.keys[0] = key;                  // The key that separated left and right
+        new_root->internal.children[0] = left->page_id;    // Old root becomes the left child
+        new_root->internal.children[1] = right->page_id;   // New node becomes the right child
         new_root->num_keys = 1;
-        // Update parent pointers of the children
+        set_root(tree, new_root);
         left->parent = new_root;
         right->parent = new_root;
-        tree->root = new_root;           // Assign the new root to the tree
         return;
     }
 
-    // Case 2: Parent exists. Find the position for the new key/child pointer.
-    int index = 0; // Index of the pointer *before* which the new key should be inserted
-    while (index < parent->num_keys && parent->children[index] != left) {
+    // Case 2: Parent exists. The new key goes right after the child 'left'.
+    int index = 0;
+    while (index < parent->num_keys && parent->internal.children[index] != left->page_id) {
         index++;
     }
 
     // Case 2a: Parent has space for the new key and child.
-    if (parent->num_keys < MAX_KEYS) {
-        insert_into_node(parent, index, key, right);
-    }
-    // Case 2b: Parent is full. Split the parent node.
-    else {
-        // Create temporary arrays to hold keys and children during split
-        int temp_keys[MAX_KEYS + 1];
-        BPlusTreeNode *temp_children[MAX_KEYS + 2];
-
-        // Copy keys/children from the parent up to the insertion point 'index'
-        for (int i = 0; i < index; i++) {
-             temp_keys[i] = parent->keys[i];
-             temp_children[i] = parent->children[i];
-        }
-         temp_children[index] = parent->children[index]; // This is the 'left' child
-
-        // Insert the new key and the 'right' child pointer
-        temp_keys[index] = key;
-        temp_children[index + 1] = right;
-
-        // Copy the remaining keys/children from the parent
-        for (int i = index; i < parent->num_keys; i++) {
-            temp_keys[i + 1] = parent->keys[i];
-            temp_children[i + 2] = parent->children[i + 1];
-        }
-
-        // Create a new internal node to be the right sibling after the split
-        BPlusTreeNode *new_internal = create_new_node(0);
-        if(!new_internal) return; // Allocation failed
-        new_internal->parent = parent->parent; // Share the same grandparent initially
-
-        // Determine the key to be promoted to the grandparent
-        int split_point_key_index = MAX_KEYS / 2; // Index of the key to promote (middle key)
-        int k_prime = temp_keys[split_point_key_index];
-
-        // Update the original node (parent) - it becomes the left node after split
-        parent->num_keys = split_point_key_index;
-        for(int i=0; i < parent->num_keys; i++) {
-            parent->keys[i] = temp_keys[i];
-            parent->children[i] = temp_children[i];
-            // No need to update parent pointers here, they were already correct
-        }
-        // Update the last child pointer for the modified parent node
-        parent->children[parent->num_keys] = temp_children[parent->num_keys];
-
-
-        // Fill the new internal node (the right node after split)
-        new_internal->num_keys = MAX_KEYS - parent->num_keys; // Keys after the promoted key
-        for(int i=0; i < new_internal->num_keys; i++) {
-            // Keys start from index split_point_key_index + 1 in temp_keys
-            new_internal->keys[i] = temp_keys[split_point_key_index + 1 + i];
-            // Children start from index split_point_key_index + 1 in temp_children
-            new_internal->children[i] = temp_children[split_point_key_index + 1 + i];
-            // Update the parent pointer of these children to the new internal node
-            if (new_internal->children[i]) new_internal->children[i]->parent = new_internal;
-        }
-        // Update the last child pointer for the new internal node
-        new_internal->children[new_internal->num_keys] = temp_children[MAX_KEYS + 1];
-         if (new_internal->children[new_internal->num_keys]) {
-             new_internal->children[new_internal->num_keys]->parent = new_internal;
-         }
-
+    if (parent->num_keys < INTERNAL_MAX_KEYS) {
+        insert_into_node(tree, parent, index, key, right);
+        return;
+    }
 
-        // Recursively insert the promoted key (k_prime) into the grandparent
-        insert_into_parent(tree, parent, k_prime, new_internal);
+    // Case 2b: Parent is full. Split it around its middle key, which moves up.
+    int temp_keys[INTERNAL_MAX_KEYS + 1];
+    PageId temp_children[INTERNAL_MAX_KEYS + 2];
+    int total = parent->num_keys;
+    memcpy(temp_keys, parent->internal.keys, index * sizeof(int32_t));
+    temp_keys[index] = key;
+    memcpy(temp_keys + index + 1, parent->internal.keys + index, (total - index) * sizeof(int32_t));
+    memcpy(temp_children, parent->internal.children, (index + 1) * sizeof(PageId));
+    temp_children[index + 1] = right->page_id;
+    memcpy(temp_children + index + 2, parent->internal.children + index + 1, (total - index) * sizeof(PageId));
+    total++;
+
+    BPlusTreeNode *new_internal = create_new_node(tree, 0);
+    if (!new_internal) return; // Allocation failed
+    new_internal->parent = parent->parent; // Share the same grandparent initially
+    right->parent = parent; // adopt_child below moves it if it lands in new_internal
+
+    int split_point_key_index = total / 2; // Index of the key to promote (middle key)
+    int k_prime = temp_keys[split_point_key_index];
+
+    // The original node keeps the keys before k_prime
+    parent->num_keys = split_point_key_index;
+    memcpy(parent->internal.keys, temp_keys, parent->num_keys * sizeof(int32_t));
+    memcpy(parent->internal.children, temp_children, (parent->num_keys + 1) * sizeof(PageId));
+    mark_dirty(tree, parent);
+
+    // The new node takes the keys after k_prime and their children
+    new_internal->num_keys = total - split_point_key_index - 1;
+    memcpy(new_internal->internal.keys, temp_keys + split_point_key_index + 1, new_internal->num_keys * sizeof(int32_t));
+    memcpy(new_internal->internal.children, temp_children + split_point_key_index + 1,
+           (new_internal->num_keys + 1) * sizeof(PageId));
+    for (int i = 0; i <= new_internal->num_keys; i++) {
+        adopt_child(tree, new_internal, new_internal->internal.children[i]);
     }
+
+    // Recursively insert the promoted key (k_prime) into the grandparent
+    insert_into_parent(tree, parent, k_prime, new_internal);
 }
 
 /**
- * @brief Inserts a key and a right child pointer into an internal node known to have space.
- * Shifts existing keys/pointers to make room.
+ * @brief Inserts a key and a right child into an internal node known to have space.
+ * @param tree Pointer to the BPlusTree.
  * @param node Pointer to the internal node.
- * @param index The index in the parent's keys array where the new key should be inserted.
- * The new child pointer (`right_child`) will be placed at `children[index + 1]`.
+ * @param index Position of the new key; the new child goes to `children[index + 1]`.
  * @param key The key to insert.
  * @param right_child Pointer to the child node that should be to the right of the inserted key.
  */
-void insert_into_node(BPlusTreeNode *node, int index, int key, BPlusTreeNode *right_child) {
-     // Shift keys and children pointers to the right to make space for the new entry
-    for (int i = node->num_keys; i > index; i--) {
-        node->keys[i] = node->keys[i - 1];
-        node->children[i + 1] = node->children[i];
-    }
-    // Insert the new key and the right child pointer at the correct position
-    node->keys[index] = key;
-    node->children[index + 1] = right_child;
-    // Update the parent pointer of the newly inserted child
-    if (right_child) right_child->parent = node;
-    node->num_keys++; // Increment the key count
+void insert_into_node(BPlusTree *tree, BPlusTreeNode *node, int index, int key, BPlusTreeNode *right_child) {
+    int tail = node->num_keys - index;
+    memmove(node->internal.keys + index + 1, node->internal.keys + index, tail * sizeof(int32_t));
+    memmove(node->internal.children + index + 2, node->internal.children + index + 1, tail * sizeof(PageId));
+    node->internal.keys[index] = key;
+    node->internal.children[index + 1] = right_child->page_id;
+    right_child->parent = node;
+    node->num_keys++;
+    mark_dirty(tree, node);
 }
 
 /**
@@ -352,120 +764,154 @@ void insert_into_node(BPlusTreeNode *node, int index, int key, BPlusTreeNode *ri
  * occurrence of old_key as a separator with new_key.
  * Called after deleting the minimum key of a leaf (index 0), because that
  * key may have been pushed up as a separator during a prior split.
- * @param leaf   The leaf node from which the key was just deleted.
+ * @param tree    Pointer to the BPlusTree.
+ * @param leaf    The leaf node from which the key was just deleted.
  * @param old_key The key that was deleted (the old minimum).
  * @param new_key The new minimum key of the leaf after deletion.
  */
-static void fix_ancestor_separator(BPlusTreeNode *leaf, int old_key, int new_key) {
+static void fix_ancestor_separator(BPlusTree *tree, BPlusTreeNode *leaf, int old_key, int new_key) {
     BPlusTreeNode *node = leaf->parent;
     while (node != NULL) {
-        for (int i = 0; i < node->num_keys; i++) {
-            if (node->keys[i] == old_key) {
-                node->keys[i] = new_key;
-                return; // Separators are unique per level; stop after first found
-            }
+        int i = lower_bound(node->internal.keys, node->num_keys, old_key);
+        if (i < node->num_keys && node->internal.keys[i] == old_key) {
+            node->internal.keys[i] = new_key;
+            mark_dirty(tree, node);
+            return; // Separators are unique; stop after the first found
         }
         node = node->parent;
     }
     // Not found is not an error: the key may not have been promoted
 }
 
-// --- Deletion ---
+// --- Bulk Loading ---
 
 /**
- * @brief Initiates the deletion of a key from the B+ Tree.
- * Finds the leaf containing the key and calls delete_entry.
- * @param tree Pointer to the BPlusTree.
- * @param key The key to delete.
+ * @brief Builds an empty tree from sorted keys without any splits.
+ * The leaves are written left to right with the entries spread evenly over
+ * them, so every leaf holds at least LEAF_MIN_KEYS; then each level of
+ * internal nodes is built the same way over the nodes of the level below,
+ * the first key under each child being its separator, until one node is left
+ * to become the root.
+ * @param tree Pointer to an empty BPlusTree.
+ * @param keys Keys in strictly ascending order.
+ * @param file_offsets File offset of each key.
+ * @param count Number of keys.
+ * @return 0 on success, -1 on failure (the tree is left empty).
  */
-void delete_key(BPlusTree *tree, int key) {
-    if (!tree || !tree->root) return; // Cannot delete from an invalid tree
+int bulk_load_tree(BPlusTree *tree, const int *keys, const long *file_offsets, int count) {
+    if (!tree || !tree->root || !tree->root->is_leaf || tree->root->num_keys != 0) {
+        fprintf(stderr, "Error: B+ Tree bulk load needs an empty tree.\n");
+        return -1;
+    }
+    if (count <= 0) return 0;
+
+    int node_count = (count + LEAF_MAX_KEYS - 1) / LEAF_MAX_KEYS;
+    BPlusTreeNode **level = malloc(node_count * sizeof(BPlusTreeNode *));
+    int32_t *first_keys = malloc(node_count * sizeof(int32_t)); // Smallest key under each node of the level
+    if (!level || !first_keys) {
+        perror("Failed to allocate B+ Tree bulk load buffers");
+        free(level);
+        free(first_keys);
+        return -1;
+    }
 
-    // Find the leaf node where the key should exist
-    BPlusTreeNode *leaf = find_leaf_node(tree->root, key);
-    if (!leaf) {
-        // fprintf(stderr, "Key %d not found (leaf not reachable).\n", key);
-        return; // Key not found or tree structure issue
+    // Leaves: the first one is the existing root, then new pages in key order
+    int done = 0;
+    BPlusTreeNode *previous = NULL;
+    for (int i = 0; i < node_count; i++) {
+        BPlusTreeNode *leaf = i == 0 ? tree->root : create_new_node(tree, 1);
+        if (!leaf) goto fail;
+        int take = (count - done) / (node_count - i);
+        memcpy(leaf->leaf.keys, keys + done, take * sizeof(int32_t));
+        for (int j = 0; j < take; j++) leaf->leaf.file_offsets[j] = file_offsets[done + j];
+        leaf->num_keys = take;
+        mark_dirty(tree, leaf);
+        if (previous) previous->next = leaf->page_id;
+        level[i] = leaf;
+        first_keys[i] = keys[done];
+        done += take;
+        previous = leaf;
     }
 
-    // Find the specific index of the key within the leaf node
-    int key_index = -1;
-    for(int i=0; i<leaf->num_keys; i++) {
-        if(leaf->keys[i] == key) {
-            key_index = i;
-            break;
+    // Internal levels, each written over the start of the arrays of the level below
+    while (node_count > 1) {
+        int parent_count = (node_count + INTERNAL_MAX_KEYS) / (INTERNAL_MAX_KEYS + 1);
+        done = 0;
+        for (int i = 0; i < parent_count; i++) {
+            BPlusTreeNode *parent = create_new_node(tree, 0);
+            if (!parent) goto fail;
+            int take = (node_count - done) / (parent_count - i);
+            for (int j = 0; j < take; j++) {
+                parent->internal.children[j] = level[done + j]->page_id;
+                level[done + j]->parent = parent;
+                if (j > 0) parent->internal.keys[j - 1] = first_keys[done + j];
+            }
+            parent->num_keys = take - 1;
+            level[i] = parent;
+            first_keys[i] = first_keys[done];
+            done += take;
         }
+        node_count = parent_count;
     }
 
-    // If the key was not found in the leaf node
-    if (key_index == -1) {
-        // fprintf(stderr, "Key %d not found in leaf node for deletion.\n", key);
-        return;
-    }
+    set_root(tree, level[0]);
+    free(level);
+    free(first_keys);
+    return 0;
 
-    // Call the recursive deletion function starting from the leaf
-    delete_entry(tree, leaf, key);
+fail:
+    free(level);
+    free(first_keys);
+    if (reset_tree(tree) != 0) fprintf(stderr, "Error: Failed to reset B+ Tree after a failed bulk load.\n");
+    return -1;
 }
 
+// --- Deletion ---
+
 /**
- * @brief Deletes an entry (key and associated data/pointer) from a node.
- * Handles shifting elements, and triggers underflow handling if necessary.
- * This function is primarily designed for leaf node deletion initially, but the
- * underflow handling part works recursively for internal nodes as well.
+ * @brief Deletes a key from the B+ Tree.
+ * Finds the leaf containing the key and calls delete_entry.
  * @param tree Pointer to the BPlusTree.
- * @param node Pointer to the node from which the key should be deleted.
  * @param key The key to delete.
  */
-void delete_entry(BPlusTree *tree, BPlusTreeNode *node, int key) {
-    // Find the index of the key to delete within the node
-    int index = 0;
-    while (index < node->num_keys && node->keys[index] < key) {
-        index++;
+void delete_key(BPlusTree *tree, int key) {
+    if (!tree || !tree->root) return; // Cannot delete from an invalid tree
+
+    BPlusTreeNode *leaf = find_leaf_node(tree, key);
+    if (!leaf) return;
+
+    int index = lower_bound(leaf->leaf.keys, leaf->num_keys, key);
+    if (index == leaf->num_keys || leaf->leaf.keys[index] != key) {
+        return; // Key not found
     }
+    delete_entry(tree, leaf, index);
+}
 
-    // Key should be at 'index' if this function is called correctly after checks
-    if (index == node->num_keys || node->keys[index] != key) {
-         // This indicates an issue, key should have been found before calling this
-         fprintf(stderr, "Internal Error: Key %d not found in node %p during delete_entry.\n", key, (void*)node);
-         return;
-     }
+/**
+ * @brief Removes entry index from a leaf, then rebalances the tree if the
+ * leaf drops below its minimum size.
+ * @param tree Pointer to the BPlusTree.
+ * @param leaf Pointer to the leaf holding the entry.
+ * @param index Position of the entry in the leaf.
+ */
+void delete_entry(BPlusTree *tree, BPlusTreeNode *leaf, int index) {
+    int key = leaf->leaf.keys[index];
+    int tail = leaf->num_keys - index - 1;
+    memmove(leaf->leaf.keys + index, leaf->leaf.keys + index + 1, tail * sizeof(int32_t));
+    memmove(leaf->leaf.file_offsets + index, leaf->leaf.file_offsets + index + 1, tail * sizeof(int64_t));
+    leaf->num_keys--;
+    mark_dirty(tree, leaf);
 
-    // Remove the key (and associated offset if it's a leaf node) by shifting elements left
-    for (int i = index; i < node->num_keys - 1; i++) {
-        node->keys[i] = node->keys[i + 1];
-        if (node->is_leaf) {
-            node->file_offsets[i] = node->file_offsets[i + 1];
-        }
-        // Note: For internal nodes, deleting a key also requires shifting children pointers.
-        // This is handled implicitly when merging/borrowing pulls down a parent key.
-        // Direct deletion from internal nodes is more complex in B+ trees and usually involves
-        // replacing the key with its successor from a leaf and deleting from the leaf.
-        // This implementation focuses on leaf deletion triggering potential parent adjustments.
-    }
-    node->num_keys--; // Decrement the key count
-    
     // If the deleted key was the minimum of this leaf (index 0), it may exist
     // as a separator in an ancestor internal node. Update it to the new minimum.
-    if (node->is_leaf && index == 0 && node->num_keys > 0) {
-        fix_ancestor_separator(node, key, node->keys[0]);
+    if (index == 0 && leaf->num_keys > 0) {
+        fix_ancestor_separator(tree, leaf, key, leaf->leaf.keys[0]);
     }
 
-    // --- Underflow Check and Handling ---
-    // Check if the node has fallen below the minimum number of keys required
-    // The root node is allowed to have fewer than MIN_KEYS.
-    if (node != tree->root && node->num_keys < MIN_KEYS) {
-        handle_underflow(tree, node);
-    }
-    // Special case: If the root node becomes empty after deletion/merging
-    else if (tree->root->num_keys == 0 && !tree->root->is_leaf) {
-        // If the root is an internal node and becomes empty, its only child becomes the new root
-        BPlusTreeNode *old_root = tree->root;
-        tree->root = old_root->children[0]; // Promote the first (and only) child
-        if (tree->root) tree->root->parent = NULL; // New root has no parent
-        free(old_root); // Free the old empty root
-    } else if (tree->root->num_keys == 0 && tree->root->is_leaf) {
-        // If the root is a leaf and becomes empty, the tree is now completely empty.
-        // We keep the empty root leaf node.
+    // The root is allowed to have fewer than the minimum number of keys;
+    // an empty root leaf is kept as the empty tree.
+    if (leaf != tree->root && leaf->num_keys < LEAF_MIN_KEYS) {
+        handle_underflow(tree, leaf);
     }
 }
 
@@ -478,108 +924,91 @@ void delete_entry(BPlusTree *tree, BPlusTreeNode *node, int key) {
  */
 void handle_underflow(BPlusTree *tree, BPlusTreeNode *node) {
     // No underflow if node is root or has enough keys
-    if (!node || node == tree->root || node->num_keys >= MIN_KEYS) {
+    if (!node || node == tree->root || node->num_keys >= min_keys(node)) {
         return;
     }
 
     BPlusTreeNode *parent = node->parent;
     if (!parent) {
-         fprintf(stderr, "Internal Error: Underflow node %p has no parent.\n", (void*)node);
+         fprintf(stderr, "Internal Error: Underflow page %u has no parent.\n", node->page_id);
          return; // Should not happen if not root
     }
 
     // Find the index of 'node' within its parent's children array
     int node_index_in_parent = 0;
-    while(node_index_in_parent <= parent->num_keys && parent->children[node_index_in_parent] != node) {
+    while (node_index_in_parent <= parent->num_keys &&
+           parent->internal.children[node_index_in_parent] != node->page_id) {
         node_index_in_parent++;
     }
-     if(node_index_in_parent > parent->num_keys) {
-         fprintf(stderr, "Internal Error: Could not find node %p in parent %p children.\n", (void*)node, (void*)parent);
-         return; // Error case
-     }
+    if (node_index_in_parent > parent->num_keys) {
+        fprintf(stderr, "Internal Error: Could not find page %u in parent page %u children.\n", node->page_id, parent->page_id);
+        return; // Error case
+    }
 
     // --- Attempt to Borrow from Left Sibling ---
-    if (node_index_in_parent > 0) { // Check if a left sibling exists
-        BPlusTreeNode *left_sibling = parent->children[node_index_in_parent - 1];
-        // Check if the left sibling has more than the minimum number of keys
-        if (left_sibling->num_keys > MIN_KEYS) {
-            int k_prime_index = node_index_in_parent - 1; // Index of key in parent separating node and left sibling
-
-            // Shift elements in 'node' to the right to make space for the borrowed element
-            for(int i = node->num_keys; i > 0; i--) {
-                node->keys[i] = node->keys[i-1];
-                if(node->is_leaf) node->file_offsets[i] = node->file_offsets[i-1];
-                // Shift children pointers as well if it's an internal node
-                else node->children[i+1] = node->children[i];
-            }
-             // Shift the first child pointer if internal node
-             if (!node->is_leaf) node->children[1] = node->children[0];
-
+    if (node_index_in_parent > 0) {
+        BPlusTreeNode *left_sibling = get_child(tree, parent, node_index_in_parent - 1);
+        if (left_sibling && left_sibling->num_keys > min_keys(left_sibling)) {
+            int k_prime_index = node_index_in_parent - 1; // Separator between left sibling and node
+            int last = left_sibling->num_keys - 1;
 
             if (node->is_leaf) {
-                // Borrow the last key/offset from the left sibling
-                node->keys[0] = left_sibling->keys[left_sibling->num_keys - 1];
-                node->file_offsets[0] = left_sibling->file_offsets[left_sibling->num_keys - 1];
-                // Update the separating key in the parent to the new first key of 'node'
-                parent->keys[k_prime_index] = node->keys[0];
-            } else { // Internal node borrowing
-                // Borrow the separating key from the parent
-                node->keys[0] = parent->keys[k_prime_index];
-                // Borrow the last child pointer from the left sibling
-                node->children[0] = left_sibling->children[left_sibling->num_keys];
-                // Update the parent pointer of the borrowed child
-                if(node->children[0]) node->children[0]->parent = node;
-                 // Update the separating key in the parent with the last key from the left sibling
-                parent->keys[k_prime_index] = left_sibling->keys[left_sibling->num_keys - 1];
+                // Move the left sibling's last entry to the front of node
+                memmove(node->leaf.keys + 1, node->leaf.keys, node->num_keys * sizeof(int32_t));
+                memmove(node->leaf.file_offsets + 1, node->leaf.file_offsets, node->num_keys * sizeof(int64_t));
+                node->leaf.keys[0] = left_sibling->leaf.keys[last];
+                node->leaf.file_offsets[0] = left_sibling->leaf.file_offsets[last];
+                parent->internal.keys[k_prime_index] = node->leaf.keys[0];
+            } else {
+                // Rotate right through the parent: the separator comes down,
+                // the left sibling's last key goes up with its last child moving over
+                memmove(node->internal.keys + 1, node->internal.keys, node->num_keys * sizeof(int32_t));
+                memmove(node->internal.children + 1, node->internal.children, (node->num_keys + 1) * sizeof(PageId));
+                node->internal.keys[0] = parent->internal.keys[k_prime_index];
+                node->internal.children[0] = left_sibling->internal.children[last + 1];
+                adopt_child(tree, node, node->internal.children[0]);
+                parent->internal.keys[k_prime_index] = left_sibling->internal.keys[last];
             }
 
-            left_sibling->num_keys--; // Decrement key count in sibling
-            node->num_keys++;       // Increment key count in node
+            left_sibling->num_keys--;
+            node->num_keys++;
+            mark_dirty(tree, left_sibling);
+            mark_dirty(tree, node);
+            mark_dirty(tree, parent);
             return; // Borrowing successful, underflow resolved
         }
     }
 
     // --- Attempt to Borrow from Right Sibling ---
-    if (node_index_in_parent < parent->num_keys) { // Check if a right sibling exists
-        BPlusTreeNode *right_sibling = parent->children[node_index_in_parent + 1];
-        // Check if the right sibling has more than the minimum number of keys
-        if (right_sibling->num_keys > MIN_KEYS) {
-            int k_prime_index = node_index_in_parent; // Index of key in parent separating node and right sibling
+    if (node_index_in_parent < parent->num_keys) {
+        BPlusTreeNode *right_sibling = get_child(tree, parent, node_index_in_parent + 1);
+        if (right_sibling && right_sibling->num_keys > min_keys(right_sibling)) {
+            int k_prime_index = node_index_in_parent; // Separator between node and right sibling
+            int remaining = right_sibling->num_keys - 1;
 
             if (node->is_leaf) {
-                 // Borrow the first key/offset from the right sibling
-                node->keys[node->num_keys] = right_sibling->keys[0];
-                node->file_offsets[node->num_keys] = right_sibling->file_offsets[0];
-                // Update the separating key in the parent to the *new* first key of the right sibling
-                parent->keys[k_prime_index] = right_sibling->keys[1];
-
-                // Shift elements left in the right sibling
-                for(int i = 0; i < right_sibling->num_keys - 1; i++) {
-                     right_sibling->keys[i] = right_sibling->keys[i+1];
-                     right_sibling->file_offsets[i] = right_sibling->file_offsets[i+1];
-                }
-            } else { // Internal node borrowing
-                // Borrow the separating key from the parent
-                node->keys[node->num_keys] = parent->keys[k_prime_index];
-                // Borrow the first child pointer from the right sibling
-                node->children[node->num_keys + 1] = right_sibling->children[0];
-                // Update the parent pointer of the borrowed child
-                if(node->children[node->num_keys + 1]) node->children[node->num_keys + 1]->parent = node;
-                // Update the separating key in the parent with the first key from the right sibling
-                parent->keys[k_prime_index] = right_sibling->keys[0];
-
-                 // Shift keys and children left in the right sibling
-                 right_sibling->children[0] = right_sibling->children[1]; // First child pointer shifts
-                 for(int i = 0; i < right_sibling->num_keys - 1; i++) {
-                     right_sibling->keys[i] = right_sibling->keys[i+1];
-                     right_sibling->children[i+1] = right_sibling->children[i+2];
-                 }
-                 // The last child pointer slot is now unused
-                 right_sibling->children[right_sibling->num_keys] = NULL;
+                // Move the right sibling's first entry to the end of node
+                node->leaf.keys[node->num_keys] = right_sibling->leaf.keys[0];
+                node->leaf.file_offsets[node->num_keys] = right_sibling->leaf.file_offsets[0];
+                memmove(right_sibling->leaf.keys, right_sibling->leaf.keys + 1, remaining * sizeof(int32_t));
+                memmove(right_sibling->leaf.file_offsets, right_sibling->leaf.file_offsets + 1, remaining * sizeof(int64_t));
+                parent->internal.keys[k_prime_index] = right_sibling->leaf.keys[0];
+            } else {
+                // Rotate left through the parent
+                node->internal.keys[node->num_keys] = parent->internal.keys[k_prime_index];
+                node->internal.children[node->num_keys + 1] = right_sibling->internal.children[0];
+                adopt_child(tree, node, node->internal.children[node->num_keys + 1]);
+                parent->internal.keys[k_prime_index] = right_sibling->internal.keys[0];
+                memmove(right_sibling->internal.keys, right_sibling->internal.keys + 1, remaining * sizeof(int32_t));
+                memmove(right_sibling->internal.children, right_sibling->internal.children + 1,
+                        (remaining + 1) * sizeof(PageId));
             }
 
-            right_sibling->num_keys--; // Decrement key count in sibling
-            node->num_keys++;        // Increment key count in node
+            right_sibling->num_keys--;
+            node->num_keys++;
+            mark_dirty(tree, right_sibling);
+            mark_dirty(tree, node);
+            mark_dirty(tree, parent);
             return; // Borrowing successful, underflow resolved
         }
     }
@@ -587,113 +1016,83 @@ void handle_underflow(BPlusTree *tree, BPlusTreeNode *node) {
     // --- Merge with a Sibling ---
     // If borrowing failed, we must merge the node with one of its siblings
     if (node_index_in_parent > 0) {
-        // Merge with the left sibling: Merge 'node' INTO 'left_sibling'
-        BPlusTreeNode *left_sibling = parent->children[node_index_in_parent - 1];
-        int k_prime_index = node_index_in_parent - 1;
-        int k_prime = parent->keys[k_prime_index]; // Key separating left_sibling and node
-        merge_nodes(tree, left_sibling, node, k_prime_index, k_prime);
+        // Merge 'node' INTO its left sibling
+        BPlusTreeNode *left_sibling = get_child(tree, parent, node_index_in_parent - 1);
+        if (!left_sibling) return; // Unreadable page
+        merge_nodes(tree, left_sibling, node, node_index_in_parent - 1);
     } else {
-        // Merge with the right sibling: Merge 'right_sibling' INTO 'node'
-        BPlusTreeNode *right_sibling = parent->children[node_index_in_parent + 1];
-        int k_prime_index = node_index_in_parent;
-        int k_prime = parent->keys[k_prime_index]; // Key separating node and right_sibling
-        merge_nodes(tree, node, right_sibling, k_prime_index, k_prime);
+        // Merge the right sibling INTO 'node'
+        BPlusTreeNode *right_sibling = get_child(tree, parent, node_index_in_parent + 1);
+        if (!right_sibling) return; // Unreadable page
+        merge_nodes(tree, node, right_sibling, node_index_in_parent);
     }
 }
 
 /**
  * @brief Merges the 'right_node' into the 'left_node'.
- * This involves pulling down a key from the parent and moving all keys/pointers
- * from the right node into the left node. The right node is then freed.
- * Recursively handles underflow in the parent.
+ * Internal nodes also pull down the separating key from the parent. The right
+ * node's page is then freed and the parent rebalanced if needed.
  * @param tree Pointer to the BPlusTree.
  * @param left_node The node that will receive the merged contents.
  * @param right_node The node whose contents will be merged; this node will be freed.
  * @param k_prime_index The index of the key in the parent node that separates left_node and right_node.
- * @param k_prime The value of the key in the parent that separates the nodes.
  */
-void merge_nodes(BPlusTree *tree, BPlusTreeNode *left_node, BPlusTreeNode *right_node, int k_prime_index, int k_prime) {
+void merge_nodes(BPlusTree *tree, BPlusTreeNode *left_node, BPlusTreeNode *right_node, int k_prime_index) {
     BPlusTreeNode *parent = left_node->parent; // Both nodes must share the same parent
+    int base = left_node->num_keys;
 
-    // If merging internal nodes, pull down the separating key from the parent into the left node
-    if (!left_node->is_leaf) {
-        left_node->keys[left_node->num_keys] = k_prime;
-        left_node->num_keys++;
-    }
-
-    // Copy all keys and data/children pointers from the right_node to the end of the left_node
-    for (int i = 0; i < right_node->num_keys; i++) {
-        left_node->keys[left_node->num_keys] = right_node->keys[i];
-        if (left_node->is_leaf) {
-            left_node->file_offsets[left_node->num_keys] = right_node->file_offsets[i];
-        } else { // Internal node: copy child pointer
-            left_node->children[left_node->num_keys] = right_node->children[i];
-            // Update the parent pointer of the moved child
-            if (left_node->children[left_node->num_keys]) {
-                left_node->children[left_node->num_keys]->parent = left_node;
-            }
-        }
-        left_node->num_keys++;
-    }
-
-    // If internal nodes, copy the last child pointer from the right_node
-    if (!left_node->is_leaf) {
-        left_node->children[left_node->num_keys] = right_node->children[right_node->num_keys];
-         if (left_node->children[left_node->num_keys]) {
-            left_node->children[left_node->num_keys]->parent = left_node;
-        }
-    }
-
-    // If merging leaf nodes, update the 'next' pointer of the left node
     if (left_node->is_leaf) {
+        memcpy(left_node->leaf.keys + base, right_node->leaf.keys, right_node->num_keys * sizeof(int32_t));
+        memcpy(left_node->leaf.file_offsets + base, right_node->leaf.file_offsets, right_node->num_keys * sizeof(int64_t));
+        left_node->num_keys += right_node->num_keys;
         left_node->next = right_node->next;
+    } else {
+        // Pull down the separator, then append the right node's keys and children
+        left_node->internal.keys[base] = parent->internal.keys[k_prime_index];
+        memcpy(left_node->internal.keys + base + 1, right_node->internal.keys, right_node->num_keys * sizeof(int32_t));
+        memcpy(left_node->internal.children + base + 1, right_node->internal.children,
+               (right_node->num_keys + 1) * sizeof(PageId));
+        left_node->num_keys += right_node->num_keys + 1;
+        for (int i = base + 1; i <= left_node->num_keys; i++) {
+            adopt_child(tree, left_node, left_node->internal.children[i]);
+        }
     }
+    mark_dirty(tree, left_node);
 
-    // Remove the separating key (k_prime) and the pointer to right_node from the parent node
-    // Shift keys and child pointers in the parent to the left
-    for (int i = k_prime_index; i < parent->num_keys - 1; i++) {
-        parent->keys[i] = parent->keys[i + 1];
-        parent->children[i + 1] = parent->children[i + 2]; // Shift children pointers starting after the left_node
-    }
-    // Clear the last pointer slot in parent
-    parent->children[parent->num_keys] = NULL;
+    // Remove the separating key and the link to right_node from the parent
+    int tail = parent->num_keys - k_prime_index - 1;
+    memmove(parent->internal.keys + k_prime_index, parent->internal.keys + k_prime_index + 1, tail * sizeof(int32_t));
+    memmove(parent->internal.children + k_prime_index + 1, parent->internal.children + k_prime_index + 2,
+            tail * sizeof(PageId));
     parent->num_keys--;
+    mark_dirty(tree, parent);
 
-    // Free the memory allocated for the right_node, as it's now empty and merged
-    free(right_node);
+    // Release right_node's page, as it's now empty and merged
+    free_node(tree, right_node);
 
-    // --- Check Parent for Underflow ---
-    // After merging, the parent might have underflowed
-    if (parent != tree->root && parent->num_keys < MIN_KEYS) {
+    if (parent == tree->root) {
+        // A root left with no keys hands over to its only child
+        if (parent->num_keys == 0) {
+            set_root(tree, left_node);
+            free_node(tree, parent);
+        }
+    } else if (parent->num_keys < INTERNAL_MIN_KEYS) {
         handle_underflow(tree, parent);
     }
-    // Special case: If the root became empty after the merge (only happens if root had 1 key and 2 children before merge)
-    else if (tree->root->num_keys == 0 && !tree->root->is_leaf) {
-        // The merged node (left_node) becomes the new root
-        BPlusTreeNode *old_root = tree->root;
-        tree->root = left_node;
-        left_node->parent = NULL; // New root has no parent
-        free(old_root);
-    }
 }
 
 
 // --- Cleanup ---
 
 /**
- * @brief Recursively frees the memory allocated for all nodes in a subtree.
- * @param node The root of the subtree to free.
+ * @brief Returns the leftmost leaf of the tree.
  */
-void free_tree_nodes(BPlusTreeNode *node) {
-    if (node == NULL) return;
-    // Recursively free children if it's an internal node
-    if (!node->is_leaf) {
-        for (int i = 0; i <= node->num_keys; i++) {
-            free_tree_nodes(node->children[i]);
-        }
+static BPlusTreeNode *first_leaf(BPlusTree *tree) {
+    BPlusTreeNode *leaf = tree->root;
+    while (leaf && !leaf->is_leaf) {
+        leaf = get_node(tree, leaf->internal.children[0]);
     }
-    // Free the node itself
-    free(node);
+    return leaf;
 }
 
 /**
@@ -707,19 +1106,16 @@ int* collect_all_keys(BPlusTree *tree, int *count) {
     *count = 0;
     if (!tree || !tree->root) return NULL;
 
-    // Find the leftmost leaf by descending left-child pointers
-    BPlusTreeNode *leaf = tree->root;
-    while (!leaf->is_leaf) {
-        leaf = leaf->children[0];
-        if (!leaf) return NULL;
-    }
+    // Find the leftmost leaf by descending left children
+    BPlusTreeNode *leaf = first_leaf(tree);
+    if (!leaf) return NULL;
 
     // First pass: count total keys across all leaves
     int total = 0;
     BPlusTreeNode *cur = leaf;
     while (cur) {
         total += cur->num_keys;
-        cur = cur->next;
+        cur = get_node(tree, cur->next);
     }
 
     if (total == 0) return NULL;
@@ -728,68 +1124,127 @@ int* collect_all_keys(BPlusTree *tree, int *count) {
     int *keys = malloc(total * sizeof(int));
     if (!keys) return NULL;
 
-    // Second pass: collect keys in order
+    // Second pass: copy each leaf's packed keys in order
     int idx = 0;
     cur = leaf;
-    while (cur) {
-        for (int i = 0; i < cur->num_keys; i++) {
-            keys[idx++] = cur->keys[i];
-        }
-        cur = cur->next;
+    while (cur && idx + cur->num_keys <= total) {
+        memcpy(keys + idx, cur->leaf.keys, cur->num_keys * sizeof(int32_t));
+        idx += cur->num_keys;
+        cur = get_node(tree, cur->next);
     }
 
-    *count = total;
+    *count = idx;
     return keys;
 }
 
+// --- Iteration ---
+
+/**
+ * @brief Positions an iterator at the first key >= key.
+ * One descent from the root; the iterator then follows the leaf chain.
+ * @param tree Pointer to the BPlusTree.
+ * @param key Lower bound (inclusive) of the keys to visit.
+ * @return The iterator (at the end straight away if no key is >= key).
+ */
+BPlusTreeIterator bpt_iter_seek(BPlusTree *tree, int key) {
+    BPlusTreeIterator it = { tree, NULL, 0 };
+    if (!tree || !tree->root) return it;
+
+    it.leaf = lookup_leaf(tree, key);
+    if (it.leaf) it.index = lower_bound(it.leaf->leaf.keys, it.leaf->num_keys, key);
+    return it;
+}
+
 /**
- * @brief Destroys the entire B+ Tree, freeing all allocated memory.
+ * @brief Returns the pair at an iterator's position and advances it.
+ * @param it The iterator.
+ * @param key Output: the key.
+ * @param file_offset Output: its data file offset.
+ * @return 1 if a pair was returned, 0 once the keys are exhausted.
+ */
+int bpt_iter_next(BPlusTreeIterator *it, int *key, long *file_offset) {
+    while (it->leaf && it->index >= it->leaf->num_keys) {
+        it->leaf = get_node(it->tree, it->leaf->next);
+        it->index = 0;
+    }
+    if (!it->leaf) return 0;
+
+    *key = it->leaf->leaf.keys[it->index];
+    *file_offset = it->leaf->leaf.file_offsets[it->index];
+    it->index++;
+    return 1;
+}
+
+/**
+ * @brief Destroys the entire B+ Tree, freeing all cached nodes and closing its file.
+ * Pages not yet written by sync_tree are discarded.
  * @param tree Pointer to the BPlusTree to destroy.
  */
 void destroy_tree(BPlusTree *tree) {
     if (tree) {
-        free_tree_nodes(tree->root); // Free all nodes starting from the root
+        drop_pages(tree); // Free all cached nodes
+        free(tree->pages);
+        free(tree->freed_pages);
+        free(tree->dirty_pages);
+        if (tree->fd >= 0) close(tree->fd);
+        pthread_mutex_destroy(&tree->load_lock);
         free(tree); // Free the tree structure itself
     }
 }
 
 // --- Utility (Example for Debugging) ---
 
+/**
+ * @brief Counts the levels of the tree by following the leftmost children.
+ * @param tree Pointer to the BPlusTree.
+ * @return Number of levels (1 for a lone root leaf), or 0 for an invalid tree.
+ */
+int tree_height(BPlusTree *tree) {
+    if (!tree) return 0;
+    int height = 0;
+    BPlusTreeNode *node = tree->root;
+    while (node) {
+        height++;
+        node = node->is_leaf ? NULL : get_node(tree, node->internal.children[0]);
+    }
+    return height;
+}
+
 /**
  * @brief Recursive helper function to print the tree structure.
+ * @param tree The tree, used to load child pages.
  * @param node Current node being printed.
  * @param level Current depth level for indentation.
  */
-void print_tree_recursive(BPlusTreeNode *node, int level) {
+static void print_tree_recursive(BPlusTree *tree, BPlusTreeNode *node, int level) {
      if (node == NULL) return;
 
      // Indentation based on level
      for(int j=0; j<level; ++j) printf("  ");
 
      // Print node type and key count
-     printf("[%p] %s Keys(%d): ", (void*)node, node->is_leaf ? "Leaf" : "Internal", node->num_keys);
+     printf("[page %u] %s Keys(%d): ", node->page_id, node->is_leaf ? "Leaf" : "Internal", node->num_keys);
 
      // Print keys (and offsets for leaves)
      for(int i=0; i < node->num_keys; i++) {
-         printf("%d", node->keys[i]);
-         if(node->is_leaf) printf("(%ld)", node->file_offsets[i]);
-         printf(" ");
+         if (node->is_leaf) printf("%d(%ld) ", node->leaf.keys[i], (long)node->leaf.file_offsets[i]);
+         else printf("%d ", node->internal.keys[i]);
      }
 
-     // Print parent and next pointers (useful for debugging)
-     printf(" Parent: %p Next: %p\n", (void*)node->parent, (void*)node->next);
+     // Print parent and next pages (useful for debugging)
+     printf(" Parent: %u Next: %u\n", node->parent ? node->parent->page_id : BPT_NO_PAGE, node->next);
 
      // Recursively print children if it's an internal node
      if (!node->is_leaf) {
          for (int i = 0; i <= node->num_keys; i++) {
-             print_tree_recursive(node->children[i], level + 1);
+             print_tree_recursive(tree, get_child(tree, node, i), level + 1);
          }
      }
  }
 
 /**
  * @brief Prints the structure of the B+ Tree and the linked list of leaves.
- * Useful for visualizing and debugging the tree.
+ * Useful for visualizing and debugging the tree. Loads every page.
  * @param tree Pointer to the BPlusTree.
  */
 void print_tree(BPlusTree *tree) {
@@ -797,26 +1252,22 @@ void print_tree(BPlusTree *tree) {
          printf("Tree is empty.\n");
          return;
      }
-     printf("\n--- B+ Tree Structure ---\n");
-     print_tree_recursive(tree->root, 0);
+     printf("\n--- B+ Tree Structure (page %d B, leaf fanout %d, internal fanout %d) ---\n",
+            BPT_PAGE_SIZE, LEAF_MAX_KEYS, INTERNAL_MAX_KEYS + 1);
+     print_tree_recursive(tree, tree->root, 0);
      printf("--- End Tree Structure ---\n");
 
-     // Optional: Print the linked list of leaf nodes
+     // Print the linked list of leaf nodes
      printf("Leaf nodes linked list: ");
-     BPlusTreeNode* current = tree->root;
+     BPlusTreeNode* current = first_leaf(tree);
      if (current) {
-         // Find the first leaf node
-         while(current && !current->is_leaf) {
-             current = current->children[0];
-         }
-         // Traverse the linked list of leaves
          while(current) {
              printf("[");
              for(int i = 0; i < current->num_keys; ++i) {
-                 printf("%d ", current->keys[i]);
+                 printf("%d ", current->leaf.keys[i]);
              }
              printf("] -> ");
-             current = current->next; // Move to the next leaf
+             current = get_node(tree, current->next); // Move to the next leaf
          }
          printf("NULL\n");
      } else {
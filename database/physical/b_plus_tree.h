@@ -2,43 +2,130 @@
 #define B_PLUS_TREE_H
 
 #include <stddef.h> // For NULL
+#include <stdint.h> // For fixed-width on-disk fields
+#include <pthread.h> // For the page cache lock
 
 // --- Configuration ---
-// MAX_KEYS defines the maximum number of keys in a node.
-// The order of the tree is MAX_KEYS + 1.
-// MIN_KEYS defines the minimum number of keys (except for the root).
-#define MAX_KEYS 4
-#define MIN_KEYS (MAX_KEYS / 2)
+// Every node is one page of the index file, and the fanout is derived from the
+// page size: a leaf holds as many (key, offset) pairs and an internal node as
+// many (key, child) pairs as fit after the 8-byte node header. Build with e.g.
+// -DBPT_PAGE_SIZE=256 for small, cache-line sized nodes. Index files built with
+// a different page size are rebuilt on open.
+#ifndef BPT_PAGE_SIZE
+#define BPT_PAGE_SIZE 4096
+#endif
+
+#define BPT_NODE_HEADER_SIZE 8
+#define LEAF_MAX_KEYS ((int)((BPT_PAGE_SIZE - BPT_NODE_HEADER_SIZE) / (sizeof(int32_t) + sizeof(int64_t))))
+#define INTERNAL_MAX_KEYS ((int)((BPT_PAGE_SIZE - BPT_NODE_HEADER_SIZE - sizeof(uint32_t)) / (2 * sizeof(uint32_t))))
+// Minimum number of keys in a node other than the root
+#define LEAF_MIN_KEYS (LEAF_MAX_KEYS / 2)
+#define INTERNAL_MIN_KEYS (INTERNAL_MAX_KEYS / 2)
+
+// Page 0 of the index file is its header, so page id 0 doubles as "no page"
+// in child and next links.
+#define BPT_NO_PAGE 0
+
+typedef uint32_t PageId;
 
 // --- Structures ---
 
-// Represents a node in the B+ Tree
+// Leaf entries: keys packed together, then the data file offset of each key
+typedef struct {
+    int32_t keys[LEAF_MAX_KEYS];
+    int64_t file_offsets[LEAF_MAX_KEYS];
+} LeafEntries;
+
+// Internal entries: keys packed together, then num_keys + 1 child pages
+typedef struct {
+    int32_t keys[INTERNAL_MAX_KEYS];
+    PageId children[INTERNAL_MAX_KEYS + 1];
+} InternalEntries;
+
+// Represents a node in the B+ Tree. The first BPT_PAGE_SIZE bytes are the page
+// exactly as stored in the index file, so loading and writing a node is a
+// single read or write with no conversion.
 typedef struct BPlusTreeNode {
-    int keys[MAX_KEYS];                     // Array to store keys
-    long file_offsets[MAX_KEYS];            // Stores file offsets corresponding to keys (only used in leaf nodes)
-    struct BPlusTreeNode *children[MAX_KEYS + 1]; // Array of pointers to child nodes (used in internal nodes)
-    int num_keys;                           // Current number of keys in the node
-    int is_leaf;                            // Flag: 1 if the node is a leaf, 0 otherwise
-    struct BPlusTreeNode *parent;           // Pointer to the parent node (facilitates splitting/merging)
-    struct BPlusTreeNode *next;             // Pointer to the next leaf node (for range scans)
+    union {
+        struct {
+            uint8_t is_leaf;                // Flag: 1 if the node is a leaf, 0 otherwise
+            uint8_t is_free;                // Page is on the free list (never set on a live node)
+            uint16_t num_keys;              // Current number of keys in the node
+            PageId next;                    // Leaf: page of the next leaf (for range scans); free page: next free page
+            union {
+                LeafEntries leaf;
+                InternalEntries internal;
+            };
+        };
+        unsigned char page[BPT_PAGE_SIZE];
+    };
+    struct BPlusTreeNode *parent;           // Parent node; set whenever the node is reached from above, so it is
+                                            // only reliable for nodes on the path of the current operation
+    PageId page_id;                         // Page this node is stored in
+    int dirty;                              // Modified since the last sync_tree
 } BPlusTreeNode;
 
 // Represents the B+ Tree itself
 typedef struct BPlusTree {
     BPlusTreeNode *root;                    // Pointer to the root node of the tree
-    int order;                              // Order of the tree (MAX_KEYS + 1)
+    int order;                              // Order of the tree (children per internal node)
+
+    int fd;                                 // Index file, or -1 for a memory-only tree
+    BPlusTreeNode **pages;                  // Page cache: loaded nodes indexed by page id (NULL = not loaded)
+    PageId page_capacity;                   // Slots in pages
+    pthread_mutex_t load_lock;              // Serializes filling empty page cache slots
+    PageId page_count;                      // Pages allocated in the file, header page included
+    PageId free_head;                       // First page of the on-disk free page list
+    PageId *freed_pages;                    // Pages released since the last sync, reused first
+    int freed_count;
+    int freed_capacity;
+    PageId *dirty_pages;                    // Pages to write out at the next sync
+    int dirty_count;
+    int dirty_capacity;
+    int header_dirty;                       // Root, page count or free list changed
+    long synced_data_size;                  // Data file size recorded by the last sync, -1 if unknown
 } BPlusTree;
 
+// --- Concurrency ---
+// Lookups (search_key, collect_all_keys, iterators, tree_height) never modify a node and
+// may run in parallel; loading a page into the cache is locked internally.
+// Everything else (insert, delete, sync, clear) needs exclusive access to the
+// tree, which database.c provides through the table's reader-writer lock.
+
 // --- Function Prototypes ---
 
 // Initialization
-BPlusTree *initialize_tree();               // Creates and returns a new, empty B+ Tree
-BPlusTreeNode *create_new_node(int is_leaf);// Creates and returns a new, empty B+ Tree node
+BPlusTree *initialize_tree();               // Creates and returns a new, empty memory-only B+ Tree
+// Creates a new, empty node in the next free page of the tree
+BPlusTreeNode *create_new_node(BPlusTree *tree, int is_leaf);
+
+// Persistence
+// Opens (or creates) the index file at path. Only the header and root page are
+// read; other nodes are loaded when first reached. If the file is missing,
+// damaged or was not fully written, the tree starts empty with
+// synced_data_size set to -1 so the caller knows to rebuild it.
+BPlusTree *open_tree(const char *path);
+
+// Writes every page modified since the last sync, then the header recording
+// data_size, the size of the data file the index now describes.
+// Returns 0 on success, -1 on an I/O error.
+int sync_tree(BPlusTree *tree, long data_size);
+
+// Removes every key, leaving an empty root (the index file is truncated).
+void clear_tree(BPlusTree *tree);
 
 // Insertion
 // Inserts a key and its associated file offset into the tree.
+// If the key is already present its offset is replaced.
 void insert_key(BPlusTree *tree, int key, long file_offset);
 
+// Builds the tree bottom-up from count keys in strictly ascending order and
+// their file offsets: leaves are filled left to right and each level of
+// internal nodes is built over the one below, writing every node once.
+// The tree must be empty. Returns 0 on success, -1 on failure (the tree is
+// then left empty).
+int bulk_load_tree(BPlusTree *tree, const int *keys, const long *file_offsets, int count);
+
 // Search
 // Searches for a key in the tree.
 // Returns the associated file offset if found, otherwise returns -1.
@@ -48,18 +135,31 @@ long search_key(BPlusTree *tree, int key);
 // Deletes a key (and its associated entry) from the tree.
 void delete_key(BPlusTree *tree, int key);
 
-// Utility (Optional - for debugging or specific needs)
+// Utility
 void print_tree(BPlusTree *tree);           // Prints a representation of the tree structure (for debugging)
+int tree_height(BPlusTree *tree);           // Number of levels, counting the root and the leaves
 
-// Scan
-// Collects all keys stored in the tree by traversing the leaf linked list.
-// Returns a malloc'd int array sorted in ascending order.
-// Sets *count to the number of keys found. Caller must free the returned array.
-// Returns NULL if the tree is empty or allocation fails.
+// Collects all keys from the B+ Tree in ascending order by traversing the leaf linked list.
+// @param tree  Pointer to the BPlusTree.
+// @param count Output: number of keys returned.
+// @return Newly allocated int array of keys (caller must free), or NULL if tree is empty.
 int* collect_all_keys(BPlusTree *tree, int *count);
 
+// Iteration
+// Cursor over (key, offset) pairs in ascending key order along the leaf chain.
+// It holds no resources; it stays valid only while the tree is not modified.
+typedef struct {
+    BPlusTree *tree;
+    BPlusTreeNode *leaf;                    // Current leaf, NULL at the end
+    int index;                              // Next entry in leaf
+} BPlusTreeIterator;
+
+// Positions an iterator at the first key >= key
+BPlusTreeIterator bpt_iter_seek(BPlusTree *tree, int key);
+// Returns 1 and the pair at the iterator, advancing it, or 0 at the end
+int bpt_iter_next(BPlusTreeIterator *it, int *key, long *file_offset);
+
 // Cleanup
-void free_tree_nodes(BPlusTreeNode *node);  // Recursively frees memory allocated for nodes
-void destroy_tree(BPlusTree *tree);         // Frees all memory associated with the tree
+void destroy_tree(BPlusTree *tree);         // Frees all memory used by the tree and closes its file
 
 #endif // B_PLUS_TREE_H
@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "data_io.h"
+
+// A thread's io_uring: the shared submission and completion rings, mapped
+typedef struct {
+    int fd;
+    unsigned entries;           // Submission queue depth
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;              // The same mapping as sq_ring with IORING_FEAT_SINGLE_MMAP
+    size_t cq_ring_size;
+    size_t sqes_size;
+} Ring;
+
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ring_key;      // Frees a thread's ring when it exits
+static __thread Ring *thread_ring;
+static __thread int thread_ring_failed; // Setup failed: this thread uses pread/pwrite
+
+static pthread_once_t probe_once = PTHREAD_ONCE_INIT;
+static int uring_works;
+
+// --- Ring Setup ---
+
+/**
+ * @brief Unmaps and closes a ring.
+ */
+static void ring_destroy(Ring *ring) {
+    if (!ring) return;
+    if (ring->sqes && ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring && ring->sq_ring != MAP_FAILED) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd >= 0) close(ring->fd);
+    free(ring);
+}
+
+static void release_thread_ring(void *ring) {
+    ring_destroy((Ring *)ring);
+}
+
+static void create_ring_key() {
+    pthread_key_create(&ring_key, release_thread_ring);
+}
+
+/**
+ * @brief Sets up an io_uring with io_uring_setup and maps its rings.
+ * @return The ring, or NULL if io_uring is unavailable.
+ */
+static Ring *ring_create() {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = (int)syscall(__NR_io_uring_setup, DATA_IO_RING_ENTRIES, &params);
+    if (fd < 0) return NULL;
+
+    Ring *ring = calloc(1, sizeof(Ring));
+    if (!ring) {
+        close(fd);
+        return NULL;
+    }
+    ring->fd = fd;
+    ring->entries = params.sq_entries;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring_destroy(ring);
+        return NULL;
+    }
+    ring->cq_ring = single_mmap ? ring->sq_ring
+                                : mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQES);
+    if (ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        ring_destroy(ring);
+        return NULL;
+    }
+
+    char *sq = ring->sq_ring, *cq = ring->cq_ring;
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return ring;
+}
+
+/**
+ * @brief The calling thread's ring, set up on first use.
+ * @return The ring, or NULL if this thread can't have one.
+ */
+static Ring *get_thread_ring() {
+    if (thread_ring) return thread_ring;
+    if (thread_ring_failed) return NULL;
+    pthread_once(&ring_key_once, create_ring_key);
+    thread_ring = ring_create();
+    if (!thread_ring) {
+        thread_ring_failed = 1;
+        return NULL;
+    }
+    pthread_setspecific(ring_key, thread_ring);
+    return thread_ring;
+}
+
+/**
+ * @brief Gives up on the calling thread's ring after a failed io_uring_enter.
+ */
+static void drop_thread_ring() {
+    pthread_setspecific(ring_key, NULL);
+    ring_destroy(thread_ring);
+    thread_ring = NULL;
+    thread_ring_failed = 1;
+}
+
+// --- Submission ---
+
+/**
+ * @brief Runs operations on a ring: queues as many as the ring holds, submits
+ * them and waits for all of their completions in one io_uring_enter, and
+ * repeats for the rest.
+ * @param ring The ring.
+ * @param opcode IORING_OP_READ or IORING_OP_WRITE.
+ * @param ops The operations; each result is set from its completion.
+ * @param count Number of operations.
+ * @return 0, or -1 if io_uring_enter failed (results are then incomplete).
+ */
+static int ring_run(Ring *ring, int opcode, DataIoRead *ops, int count) {
+    for (int done = 0; done < count; ) {
+        unsigned group = (unsigned)(count - done);
+        if (group > ring->entries) group = ring->entries;
+
+        // Only this thread produces, so the tail can be read plainly
+        unsigned tail = *ring->sq_tail;
+        for (unsigned i = 0; i < group; i++) {
+            DataIoRead *op = &ops[done + i];
+            unsigned index = (tail + i) & *ring->sq_mask;
+            struct io_uring_sqe *sqe = &ring->sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = (uint8_t)opcode;
+            sqe->fd = op->fd;
+            sqe->addr = (uint64_t)(uintptr_t)op->buffer;
+            sqe->len = (uint32_t)op->size;
+            sqe->off = (uint64_t)op->offset;
+            sqe->user_data = (uint64_t)(done + i);
+            ring->sq_array[index] = index;
+        }
+        __atomic_store_n(ring->sq_tail, tail + group, __ATOMIC_RELEASE);
+
+        unsigned to_submit = group, completed = 0;
+        while (completed < group) {
+            int n = (int)syscall(__NR_io_uring_enter, ring->fd, to_submit, group - completed,
+                                 IORING_ENTER_GETEVENTS, NULL, 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return -1;
+            }
+            to_submit -= (unsigned)n < to_submit ? (unsigned)n : to_submit;
+
+            unsigned head = *ring->cq_head;
+            unsigned ready = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != ready; head++) {
+                struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+                ops[cqe->user_data].result = cqe->res;
+                completed++;
+            }
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        }
+        done += (int)group;
+    }
+    return 0;
+}
+
+/**
+ * @brief Runs operations with pread or pwrite, one system call each.
+ */
+static void plain_run(int opcode, DataIoRead *ops, int count) {
+    for (int i = 0; i < count; i++) {
+        ssize_t n;
+        do {
+            n = opcode == IORING_OP_READ ? pread(ops[i].fd, ops[i].buffer, ops[i].size, ops[i].offset)
+                                         : pwrite(ops[i].fd, ops[i].buffer, ops[i].size, ops[i].offset);
+        } while (n < 0 && errno == EINTR);
+        ops[i].result = n < 0 ? -errno : n;
+    }
+}
+
+/**
+ * @brief Runs operations with the backend, falling back to pread/pwrite when
+ * the thread has no ring. Positioned reads and writes can be repeated, so a
+ * batch the ring failed part way through is simply run again.
+ */
+static void run_ops(DataIoBackend backend, int opcode, DataIoRead *ops, int count) {
+    Ring *ring = backend == DATA_IO_URING ? get_thread_ring() : NULL;
+    if (ring && ring_run(ring, opcode, ops, count) == 0) return;
+    if (ring) {
+        fprintf(stderr, "Warning: io_uring failed (%s); this thread now uses pread/pwrite.\n", strerror(errno));
+        drop_thread_ring();
+    }
+    plain_run(opcode, ops, count);
+}
+
+// --- Public API ---
+
+static void probe_uring() {
+    Ring *ring = ring_create();
+    if (!ring) return;
+    int fd = open("/dev/zero", O_RDONLY);
+    if (fd >= 0) {
+        unsigned char byte = 1;
+        DataIoRead read = { fd, 0, &byte, 1, -1 };
+        // IORING_OP_READ needs Linux 5.6; older kernels fail it with -EINVAL
+        uring_works = ring_run(ring, IORING_OP_READ, &read, 1) == 0 && read.result == 1 && byte == 0;
+        close(fd);
+    }
+    ring_destroy(ring);
+}
+
+int data_io_probe() {
+    pthread_once(&probe_once, probe_uring);
+    return uring_works;
+}
+
+const char *data_io_backend_name(DataIoBackend backend) {
+    return backend == DATA_IO_URING ? "uring" : "stdio";
+}
+
+ssize_t data_io_read(DataIoBackend backend, int fd, void *buffer, size_t size, long offset) {
+    DataIoRead read = { fd, offset, buffer, size, 0 };
+    run_ops(backend, IORING_OP_READ, &read, 1);
+    if (read.result < 0) {
+        errno = (int)-read.result;
+        return -1;
+    }
+    return read.result;
+}
+
+void data_io_read_batch(DataIoBackend backend, DataIoRead *reads, int count) {
+    if (count > 0) run_ops(backend, IORING_OP_READ, reads, count);
+}
+
+int data_io_write(DataIoBackend backend, int fd, const void *buffer, size_t size, long offset) {
+    const unsigned char *bytes = buffer;
+    while (size > 0) {
+        DataIoRead write = { fd, offset, (unsigned char *)bytes, size, 0 };
+        run_ops(backend, IORING_OP_WRITE, &write, 1);
+        if (write.result < 0) {
+            errno = (int)-write.result;
+            return -1;
+        }
+        if (write.result == 0) {
+            errno = EIO;
+            return -1;
+        }
+        bytes += write.result;
+        offset += write.result;
+        size -= (size_t)write.result;
+    }
+    return 0;
+}
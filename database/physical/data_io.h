@@ -0,0 +1,54 @@
+#ifndef DATA_IO_H
+#define DATA_IO_H
+
+#include <stddef.h>     // For size_t
+#include <sys/types.h>  // For ssize_t
+
+// --- Data File I/O ---
+// Positioned reads and writes of table data files through one of two
+// backends. DATA_IO_STDIO is the original path: pread for rows, the table's
+// FILE stream for appends. DATA_IO_URING goes through an io_uring per thread
+// (set up with the raw system calls, on the thread's first I/O), which lets a
+// scan queue the reads of many rows and wait once for all of them instead of
+// making one pread per row. Appends and delete flags become single positioned
+// writes on the ring.
+//
+// io_uring may be missing (old kernel) or forbidden (seccomp); data_io_probe
+// tells, and a thread whose ring can't be set up uses pread/pwrite instead.
+
+#define DATA_IO_RING_ENTRIES 64             // Submission queue depth of each thread's ring
+#define DATA_IO_BATCH 32                    // Row reads a scan keeps queued at once
+
+typedef enum {
+    DATA_IO_STDIO = 0,          // pread, and fwrite/fflush on the table's FILE
+    DATA_IO_URING               // io_uring reads and writes, batched for scans
+} DataIoBackend;
+
+// One read of a batch
+typedef struct {
+    int fd;                     // File to read
+    long offset;                // Where to read
+    unsigned char *buffer;      // size bytes to fill
+    size_t size;
+    ssize_t result;             // Output: bytes read (short at end of file), or -errno
+} DataIoRead;
+
+// Returns 1 if io_uring works in this process (checked once), else 0
+int data_io_probe();
+
+// Name of a backend, as taken by --io
+const char *data_io_backend_name(DataIoBackend backend);
+
+// Reads up to size bytes at offset, like pread (retried on EINTR).
+// Returns the bytes read, or -1 with errno set.
+ssize_t data_io_read(DataIoBackend backend, int fd, void *buffer, size_t size, long offset);
+
+// Runs every read of a batch, queueing them all before waiting with io_uring
+// (the reads may be of different files). Each read's result is set; a failed
+// read does not stop the others.
+void data_io_read_batch(DataIoBackend backend, DataIoRead *reads, int count);
+
+// Writes all size bytes at offset. Returns 0, or -1 with errno set.
+int data_io_write(DataIoBackend backend, int fd, const void *buffer, size_t size, long offset);
+
+#endif // DATA_IO_H
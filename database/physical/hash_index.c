@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash_index.h"
+
+#define HASH_INDEX_INITIAL_CAPACITY 64  // Slots; doubled when more than 3/4 are used
+
+/**
+ * @brief FNV-1a hash of a value.
+ */
+static uint32_t hash_value(const char *value) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)value; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Finds the slot holding value, or the empty slot where it belongs.
+ */
+static size_t find_slot(const HashIndex *index, const char *value, uint32_t hash) {
+    size_t mask = index->capacity - 1;
+    size_t slot = hash & mask;
+    while (index->slots[slot].value &&
+           (index->slots[slot].hash != hash || strcmp(index->slots[slot].value, value) != 0)) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/**
+ * @brief Allocates the slot array.
+ * @return 0 on success, -1 on allocation failure.
+ */
+static int allocate_slots(HashIndex *index, size_t capacity) {
+    HashIndexEntry *slots = calloc(capacity, sizeof(HashIndexEntry));
+    if (!slots) {
+        perror("Failed to allocate secondary index slots");
+        return -1;
+    }
+    index->slots = slots;
+    index->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Doubles the number of slots, moving every entry.
+ * @return 0 on success, -1 on allocation failure (the index is unchanged).
+ */
+static int grow(HashIndex *index) {
+    HashIndexEntry *old_slots = index->slots;
+    size_t old_capacity = index->capacity;
+    if (allocate_slots(index, old_capacity * 2) != 0) {
+        index->slots = old_slots;
+        index->capacity = old_capacity;
+        return -1;
+    }
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_slots[i].value) {
+            index->slots[find_slot(index, old_slots[i].value, old_slots[i].hash)] = old_slots[i];
+        }
+    }
+    free(old_slots);
+    return 0;
+}
+
+/**
+ * @brief Empties a slot, shifting later entries of the same probe run back so
+ * lookups never stop early at the hole (no tombstones needed).
+ */
+static void remove_slot(HashIndex *index, size_t slot) {
+    size_t mask = index->capacity - 1;
+    free(index->slots[slot].value);
+    free(index->slots[slot].primary_keys);
+
+    size_t hole = slot;
+    size_t next = slot;
+    while (1) {
+        next = (next + 1) & mask;
+        if (!index->slots[next].value) break;
+        size_t home = index->slots[next].hash & mask;
+        // Move the entry into the hole unless its home slot lies after the hole (cyclically)
+        int stays = hole <= next ? (home > hole && home <= next) : (home > hole || home <= next);
+        if (!stays) {
+            index->slots[hole] = index->slots[next];
+            hole = next;
+        }
+    }
+    memset(&index->slots[hole], 0, sizeof(HashIndexEntry));
+    index->used--;
+}
+
+/**
+ * @brief First position in a sorted array whose key is >= key.
+ */
+static int lower_bound(const int *keys, int count, int key) {
+    int low = 0, high = count;
+    while (low < high) {
+        int mid = (low + high) >> 1;
+        if (keys[mid] < key) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+/**
+ * @brief Creates an empty secondary index.
+ * @return The index, or NULL on allocation failure.
+ */
+HashIndex *hash_index_create(void) {
+    HashIndex *index = malloc(sizeof(HashIndex));
+    if (!index) {
+        perror("Failed to allocate secondary index");
+        return NULL;
+    }
+    index->used = 0;
+    if (allocate_slots(index, HASH_INDEX_INITIAL_CAPACITY) != 0) {
+        free(index);
+        return NULL;
+    }
+    return index;
+}
+
+/**
+ * @brief Records that a row holds a value.
+ * @param index The index.
+ * @param value The row's (canonical) column value.
+ * @param primary_key The row's primary key.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int hash_index_add(HashIndex *index, const char *value, int primary_key) {
+    if ((index->used + 1) * 4 > index->capacity * 3 && grow(index) != 0) return -1;
+
+    uint32_t hash = hash_value(value);
+    HashIndexEntry *entry = &index->slots[find_slot(index, value, hash)];
+    if (!entry->value) {
+        entry->value = strdup(value);
+        if (!entry->value) {
+            perror("Failed to copy secondary index value");
+            return -1;
+        }
+        entry->hash = hash;
+        index->used++;
+    }
+
+    // Rows mostly arrive in key order, so appending is the common case
+    int position = (entry->count > 0 && entry->primary_keys[entry->count - 1] < primary_key)
+                   ? entry->count : lower_bound(entry->primary_keys, entry->count, primary_key);
+    if (position < entry->count && entry->primary_keys[position] == primary_key) return 0;
+
+    if (entry->count == entry->capacity) {
+        int capacity = entry->capacity ? entry->capacity * 2 : 4;
+        int *keys = realloc(entry->primary_keys, capacity * sizeof(int));
+        if (!keys) {
+            perror("Failed to grow secondary index entry");
+            return -1;
+        }
+        entry->primary_keys = keys;
+        entry->capacity = capacity;
+    }
+    memmove(entry->primary_keys + position + 1, entry->primary_keys + position,
+            (entry->count - position) * sizeof(int));
+    entry->primary_keys[position] = primary_key;
+    entry->count++;
+    return 0;
+}
+
+/**
+ * @brief Forgets that a row holds a value. The value itself is dropped with
+ * its last row.
+ * @param index The index.
+ * @param value The (canonical) value the row held.
+ * @param primary_key The row's primary key.
+ */
+void hash_index_remove(HashIndex *index, const char *value, int primary_key) {
+    size_t slot = find_slot(index, value, hash_value(value));
+    HashIndexEntry *entry = &index->slots[slot];
+    if (!entry->value) return;
+
+    int position = lower_bound(entry->primary_keys, entry->count, primary_key);
+    if (position == entry->count || entry->primary_keys[position] != primary_key) return;
+    if (entry->count == 1) {
+        remove_slot(index, slot);
+        return;
+    }
+    memmove(entry->primary_keys + position, entry->primary_keys + position + 1,
+            (entry->count - position - 1) * sizeof(int));
+    entry->count--;
+}
+
+/**
+ * @brief Looks up the rows holding a value.
+ * @param index The index.
+ * @param value The (canonical) value.
+ * @param count Output: number of primary keys returned.
+ * @return The primary keys in ascending order (owned by the index), or NULL if none.
+ */
+const int *hash_index_find(const HashIndex *index, const char *value, int *count) {
+    const HashIndexEntry *entry = &index->slots[find_slot(index, value, hash_value(value))];
+    *count = entry->value ? entry->count : 0;
+    return entry->value ? entry->primary_keys : NULL;
+}
+
+/**
+ * @brief Removes every value, keeping the slot array.
+ * @param index The index.
+ */
+void hash_index_clear(HashIndex *index) {
+    for (size_t i = 0; i < index->capacity; i++) {
+        free(index->slots[i].value);
+        free(index->slots[i].primary_keys);
+    }
+    memset(index->slots, 0, index->capacity * sizeof(HashIndexEntry));
+    index->used = 0;
+}
+
+/**
+ * @brief Frees the index and everything in it.
+ * @param index The index (may be NULL).
+ */
+void hash_index_destroy(HashIndex *index) {
+    if (!index) return;
+    hash_index_clear(index);
+    free(index->slots);
+    free(index);
+}
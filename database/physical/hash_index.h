@@ -0,0 +1,47 @@
+#ifndef HASH_INDEX_H
+#define HASH_INDEX_H
+
+#include <stddef.h> // For size_t
+#include <stdint.h> // For the stored hashes
+
+// --- Secondary Index ---
+// In-memory equality index from a column value to the primary keys of the
+// rows holding it. Values are compared as strings, so callers pass them in
+// canonical form (record_canonical_value) for typed columns. Open addressing
+// with linear probing; each entry keeps its primary keys sorted ascending.
+// Not thread-safe: database.c guards it with the table's reader-writer lock.
+
+typedef struct {
+    char *value;                // Column value (owned), NULL for an empty slot
+    uint32_t hash;              // Hash of value
+    int *primary_keys;          // Rows with this value, ascending
+    int count;
+    int capacity;
+} HashIndexEntry;
+
+typedef struct HashIndex {
+    HashIndexEntry *slots;
+    size_t capacity;            // Number of slots, a power of two
+    size_t used;                // Distinct values stored
+} HashIndex;
+
+// Creates an empty index, or returns NULL on allocation failure
+HashIndex *hash_index_create(void);
+
+// Records that the row primary_key holds value. Returns 0, or -1 on allocation failure.
+int hash_index_add(HashIndex *index, const char *value, int primary_key);
+
+// Forgets that the row primary_key holds value (no-op if it wasn't recorded)
+void hash_index_remove(HashIndex *index, const char *value, int primary_key);
+
+// Primary keys of the rows holding value, ascending, with *count set; NULL if
+// none. The array belongs to the index and is valid until it is next modified.
+const int *hash_index_find(const HashIndex *index, const char *value, int *count);
+
+// Removes every value
+void hash_index_clear(HashIndex *index);
+
+// Frees the index
+void hash_index_destroy(HashIndex *index);
+
+#endif // HASH_INDEX_H
@@ -0,0 +1,733 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h> // For strcasecmp
+#include <errno.h>
+#include <math.h>    // For isfinite
+#include <float.h>   // For FLT_DIG, DBL_DIG
+#include "record.h"
+
+/**
+ * @brief Maps a model field's type hint to the way the column is stored.
+ * @param type_name Type hint such as "int", "float", "boolean", "date" or "string" (may be NULL).
+ * @return The storage type; unknown hints are stored as strings.
+ */
+ColumnType column_type_from_name(const char *type_name) {
+    if (!type_name) return COLUMN_STRING;
+    if (strcmp(type_name, "int") == 0 || strcmp(type_name, "integer") == 0) return COLUMN_INT;
+    if (strcmp(type_name, "float") == 0) return COLUMN_FLOAT;
+    if (strcmp(type_name, "double") == 0) return COLUMN_DOUBLE;
+    if (strcmp(type_name, "boolean") == 0 || strcmp(type_name, "bool") == 0) return COLUMN_BOOL;
+    if (strcmp(type_name, "date") == 0) return COLUMN_DATE;
+    return COLUMN_STRING;
+}
+
+/**
+ * @brief FNV-1a hash of the column types, stored in the file header so a data
+ * file is never decoded with a different layout than it was written with.
+ */
+static uint32_t layout_signature(const ColumnType *types, int column_count) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < column_count; i++) {
+        hash ^= (uint32_t)types[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Fills in the header written at the start of a data file.
+ * @param header Output buffer of RECORD_FILE_HEADER_SIZE bytes.
+ * @param types Storage type of each column.
+ * @param column_count Number of columns.
+ */
+void record_file_header(unsigned char header[RECORD_FILE_HEADER_SIZE], const ColumnType *types, int column_count) {
+    uint16_t version = RECORD_FORMAT_VERSION;
+    uint16_t count = (uint16_t)column_count;
+    uint32_t signature = layout_signature(types, column_count);
+
+    memcpy(header, RECORD_FILE_MAGIC, 8);
+    memcpy(header + 8, &version, sizeof(version));
+    memcpy(header + 10, &count, sizeof(count));
+    memcpy(header + 12, &signature, sizeof(signature));
+}
+
+/**
+ * @brief Checks the header at the start of a data file.
+ * @param header Bytes read from the start of the file.
+ * @param length Number of bytes available in header.
+ * @param types Expected storage type of each column.
+ * @param column_count Expected number of columns.
+ * @return 0 if it matches, 1 if it matches but is from format version 1, -1 if
+ * it is not a record file header, -2 if the layout differs.
+ */
+int record_check_file_header(const unsigned char *header, size_t length, const ColumnType *types, int column_count) {
+    if (length < RECORD_FILE_HEADER_SIZE || memcmp(header, RECORD_FILE_MAGIC, 8) != 0) return -1;
+
+    uint16_t version, count;
+    uint32_t signature;
+    memcpy(&version, header + 8, sizeof(version));
+    memcpy(&count, header + 10, sizeof(count));
+    memcpy(&signature, header + 12, sizeof(signature));
+    if ((version != RECORD_FORMAT_VERSION && version != 1) || count != column_count ||
+        signature != layout_signature(types, column_count)) {
+        return -2;
+    }
+    return version == RECORD_FORMAT_VERSION ? 0 : 1;
+}
+
+// --- Typed Field Conversion ---
+
+/**
+ * @brief Days since 1970-01-01 of a proleptic Gregorian date.
+ */
+static int32_t days_from_civil(int year, int month, int day) {
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int year_of_era = year - era * 400;
+    int day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+/**
+ * @brief Inverse of days_from_civil.
+ */
+static void civil_from_days(int32_t days, int *year, int *month, int *day) {
+    days += 719468;
+    int era = (days >= 0 ? days : days - 146096) / 146097;
+    int day_of_era = days - era * 146097;
+    int year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    int day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    int mp = (5 * day_of_year + 2) / 153;
+    *day = day_of_year - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = year_of_era + era * 400 + (*month <= 2);
+}
+
+/**
+ * @brief Parses a "YYYY-MM-DD" date.
+ * @return 0 on success, -1 if the text is not a valid calendar date.
+ */
+static int parse_date(const char *text, int32_t *days) {
+    int year, month, day, consumed = 0;
+    if (sscanf(text, "%4d-%2d-%2d%n", &year, &month, &day, &consumed) != 3 || text[consumed] != '\0') return -1;
+    if (month < 1 || month > 12 || day < 1) return -1;
+
+    static const int month_days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    int leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (day > month_days[month - 1] + (month == 2 && leap)) return -1;
+
+    *days = days_from_civil(year, month, day);
+    return 0;
+}
+
+/**
+ * @brief Parses a typed value into its fixed-width encoding.
+ * @return Number of bytes written to out, or -1 if the text does not parse.
+ */
+static int encode_typed(ColumnType type, const char *text, unsigned char *out) {
+    char *end = NULL;
+    errno = 0;
+    switch (type) {
+    case COLUMN_INT: {
+        long parsed = strtol(text, &end, 10);
+        if (end == text || *end != '\0' || errno == ERANGE || parsed < INT32_MIN || parsed > INT32_MAX) return -1;
+        int32_t value = (int32_t)parsed;
+        memcpy(out, &value, sizeof(value));
+        return sizeof(value);
+    }
+    case COLUMN_FLOAT: {
+        float value = strtof(text, &end);
+        if (end == text || *end != '\0' || !isfinite(value)) return -1;
+        memcpy(out, &value, sizeof(value));
+        return sizeof(value);
+    }
+    case COLUMN_DOUBLE: {
+        double value = strtod(text, &end);
+        if (end == text || *end != '\0' || !isfinite(value)) return -1;
+        memcpy(out, &value, sizeof(value));
+        return sizeof(value);
+    }
+    case COLUMN_BOOL:
+        if (strcasecmp(text, "true") == 0 || strcmp(text, "1") == 0) out[0] = 1;
+        else if (strcasecmp(text, "false") == 0 || strcmp(text, "0") == 0) out[0] = 0;
+        else return -1;
+        return 1;
+    case COLUMN_DATE: {
+        int32_t days;
+        if (parse_date(text, &days) != 0) return -1;
+        memcpy(out, &days, sizeof(days));
+        return sizeof(days);
+    }
+    default:
+        return -1;
+    }
+}
+
+/**
+ * @brief Encoded size of a non-null typed field.
+ */
+static size_t typed_width(ColumnType type) {
+    switch (type) {
+    case COLUMN_INT: return sizeof(int32_t);
+    case COLUMN_FLOAT: return sizeof(float);
+    case COLUMN_DOUBLE: return sizeof(double);
+    case COLUMN_BOOL: return 1;
+    case COLUMN_DATE: return sizeof(int32_t);
+    default: return 0;
+    }
+}
+
+/**
+ * @brief Whether a value is stored as null: NULL for any column, and also
+ * empty or "null" for typed columns.
+ */
+static int is_null_value(ColumnType type, const char *value) {
+    if (!value) return 1;
+    return type != COLUMN_STRING && (value[0] == '\0' || strcmp(value, "null") == 0);
+}
+
+// --- Varints ---
+
+/**
+ * @brief Bytes needed to store value as a varint.
+ */
+static size_t varint_size(uint32_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+/**
+ * @brief Writes value as a varint.
+ * @return Bytes written.
+ */
+static size_t put_varint(unsigned char *out, uint32_t value) {
+    size_t size = 0;
+    while (value >= 0x80) {
+        out[size++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[size++] = (unsigned char)value;
+    return size;
+}
+
+/**
+ * @brief Reads a varint of at most 5 bytes from in[0, available).
+ * @return Bytes consumed, or 0 if it is incomplete or too long.
+ */
+static size_t get_varint(const unsigned char *in, size_t available, uint32_t *value) {
+    uint32_t result = 0;
+    for (size_t i = 0; i < available && i < 5; i++) {
+        result |= (uint32_t)(in[i] & 0x7f) << (7 * i);
+        if (!(in[i] & 0x80)) {
+            *value = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Bytes needed to store a 64-bit value as a varint.
+ */
+static size_t varint64_size(uint64_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+/**
+ * @brief Writes a 64-bit value as a varint.
+ * @return Bytes written.
+ */
+static size_t put_varint64(unsigned char *out, uint64_t value) {
+    size_t size = 0;
+    while (value >= 0x80) {
+        out[size++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[size++] = (unsigned char)value;
+    return size;
+}
+
+/**
+ * @brief Reads a varint of at most 10 bytes from in[0, available).
+ * @return Bytes consumed, or 0 if it is incomplete or too long.
+ */
+static size_t get_varint64(const unsigned char *in, size_t available, uint64_t *value) {
+    uint64_t result = 0;
+    for (size_t i = 0; i < available && i < 10; i++) {
+        result |= (uint64_t)(in[i] & 0x7f) << (7 * i);
+        if (!(in[i] & 0x80)) {
+            *value = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads what follows a record's fields: nothing, or the distance back
+ * to the previous version as one varint running exactly to the end.
+ * @param tail Bytes after the last field.
+ * @param available Number of them.
+ * @param previous Output: the distance, 0 if there is none.
+ * @return 0 on success, -1 if the bytes are not a valid previous field.
+ */
+static int read_previous(const unsigned char *tail, size_t available, uint64_t *previous) {
+    *previous = 0;
+    if (available == 0) return 0;
+    return get_varint64(tail, available, previous) == available && *previous > 0 ? 0 : -1;
+}
+
+// --- Records ---
+
+/**
+ * @brief Encodes a row into the binary record format.
+ * @param types Storage type of each column.
+ * @param column_count Number of columns.
+ * @param values One string per column.
+ * @param previous Distance back to the version this record replaces, 0 for none.
+ * @param buffer In/out: reusable encoding buffer (may be NULL initially).
+ * @param capacity In/out: size of *buffer.
+ * @param bad_column Output: column whose value failed to parse.
+ * @return The record length, or -1 on a parse or allocation failure.
+ */
+long record_encode(const ColumnType *types, int column_count, char **values, uint64_t previous,
+                   unsigned char **buffer, size_t *capacity, int *bad_column) {
+    size_t bitmap_size = (column_count + 7) / 8;
+    size_t payload = bitmap_size;
+    for (int i = 0; i < column_count; i++) {
+        if (is_null_value(types[i], values[i])) continue;
+        if (types[i] == COLUMN_STRING) {
+            size_t string_length = strlen(values[i]);
+            if (string_length > UINT32_MAX) return -1;
+            payload += varint_size((uint32_t)string_length) + string_length;
+        } else {
+            payload += typed_width(types[i]);
+        }
+    }
+    if (previous > 0) payload += varint64_size(previous);
+    if (payload > UINT32_MAX - RECORD_HEADER_MAX_SIZE) return -1;
+
+    size_t needed = 1 + varint_size((uint32_t)payload) + payload;
+    if (needed > *capacity) {
+        size_t new_capacity = *capacity ? *capacity : 256;
+        while (new_capacity < needed) new_capacity *= 2;
+        unsigned char *grown = realloc(*buffer, new_capacity);
+        if (!grown) {
+            perror("Failed to allocate record buffer");
+            return -1;
+        }
+        *buffer = grown;
+        *capacity = new_capacity;
+    }
+
+    unsigned char *record = *buffer;
+    record[RECORD_FLAGS_OFFSET] = 0;
+    size_t pos = 1 + put_varint(record + 1, (uint32_t)payload);
+
+    unsigned char *bitmap = record + pos;
+    memset(bitmap, 0, bitmap_size);
+    pos += bitmap_size;
+
+    for (int i = 0; i < column_count; i++) {
+        if (is_null_value(types[i], values[i])) {
+            bitmap[i / 8] |= 1 << (i % 8);
+            continue;
+        }
+        if (types[i] == COLUMN_STRING) {
+            size_t string_length = strlen(values[i]);
+            pos += put_varint(record + pos, (uint32_t)string_length);
+            memcpy(record + pos, values[i], string_length);
+            pos += string_length;
+        } else {
+            int written = encode_typed(types[i], values[i], record + pos);
+            if (written < 0) {
+                if (bad_column) *bad_column = i;
+                return -1;
+            }
+            pos += written;
+        }
+    }
+    if (previous > 0) pos += put_varint64(record + pos, previous);
+    return (long)pos;
+}
+
+/**
+ * @brief Reads the header of a record.
+ * @param record Start of the record.
+ * @param available Bytes present at record.
+ * @param length Output: size of the whole record.
+ * @return Size of the header, or 0 if it is incomplete or malformed.
+ */
+size_t record_header(const unsigned char *record, size_t available, size_t *length) {
+    if (available < 2 || (record[RECORD_FLAGS_OFFSET] & ~RECORD_FLAG_DELETED)) return 0;
+
+    uint32_t payload;
+    size_t varint = get_varint(record + 1, available - 1, &payload);
+    if (varint == 0) return 0;
+    *length = 1 + varint + (size_t)payload;
+    return 1 + varint;
+}
+
+/**
+ * @brief Whether the record starting at record has been deleted.
+ */
+int record_is_deleted(const unsigned char *record) {
+    return (record[RECORD_FLAGS_OFFSET] & RECORD_FLAG_DELETED) != 0;
+}
+
+/**
+ * @brief Validates a record's header against its length.
+ * @return Offset of the null bitmap, or 0 if the record is malformed.
+ */
+static size_t check_record(int column_count, const unsigned char *record, size_t length) {
+    size_t total;
+    size_t header = record_header(record, length, &total);
+    if (header == 0 || total != length || length - header < (size_t)(column_count + 7) / 8) return 0;
+    return header;
+}
+
+/**
+ * @brief Writes value in decimal; snprintf is the main cost of decoding a row.
+ * @param out Buffer of at least 12 bytes.
+ */
+static void format_int(char *out, int32_t value) {
+    char digits[10];
+    int count = 0;
+    uint32_t magnitude = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+    do {
+        digits[count++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude);
+
+    if (value < 0) *out++ = '-';
+    while (count > 0) *out++ = digits[--count];
+    *out = '\0';
+}
+
+/**
+ * @brief The float next to value in the direction of target.
+ */
+static float next_float(float value, double target) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if (value == 0) bits = 1u | (target < 0 ? 0x80000000u : 0);
+    else if ((target > value) == (value > 0)) bits++;
+    else bits--;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Writes the shortest decimal text that reads back as value.
+ * Typical values (prices, ratings, measurements) have a few decimals, and are
+ * found as the first fixed-point rounding that converts back to the same
+ * float, written with integer arithmetic; anything else goes to snprintf.
+ */
+static void format_float(char *out, size_t out_size, float value) {
+    static const double powers[] = { 1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6 };
+    double magnitude = value < 0 ? -(double)value : value;
+
+    if (magnitude < 1e7 && (magnitude >= 1e-3 || value == 0)) {
+        for (int decimals = 0; decimals <= 6; decimals++) {
+            double scaled_value = (double)value * powers[decimals];
+            long long scaled = (long long)(scaled_value < 0 ? scaled_value - 0.5 : scaled_value + 0.5);
+            double candidate = scaled / powers[decimals];
+            if ((float)candidate != value) continue;
+            // strtof rounds the decimal once, the cast above rounded twice; they
+            // only differ when candidate is exactly halfway to a neighbour
+            double neighbour = next_float(value, candidate);
+            if (candidate != (double)value && candidate == ((double)value + neighbour) / 2) break;
+
+            if (scaled < 0) {
+                *out++ = '-';
+                scaled = -scaled;
+            }
+            char digits[24];
+            int count = 0;
+            do {
+                digits[count++] = '0' + scaled % 10;
+                scaled /= 10;
+            } while (scaled || count <= decimals);
+            while (count > decimals) *out++ = digits[--count];
+            if (decimals > 0) *out++ = '.';
+            while (count > 0) *out++ = digits[--count];
+            *out = '\0';
+            return;
+        }
+    }
+
+    // Values parsed from up to FLT_DIG digits read back from %.6g; 9 digits always do
+    for (int precision = FLT_DIG; precision <= 9; precision++) {
+        snprintf(out, out_size, "%.*g", precision, value);
+        if (strtof(out, NULL) == value) break;
+    }
+}
+
+/**
+ * @brief Decodes one field in place, advancing *pos past it.
+ * @param out Buffer for typed columns rendered as text (at least 32 bytes).
+ * @param text Output: the field's text (points into out or into record).
+ * @param text_length Output: length of text.
+ * @return 0 on success, -1 if the field runs past the end of the record.
+ */
+static int decode_field(ColumnType type, const unsigned char *record, size_t length, size_t *pos,
+                        char *out, size_t out_size, const char **text, size_t *text_length) {
+    if (type == COLUMN_STRING) {
+        uint32_t string_length;
+        size_t varint = get_varint(record + *pos, length - *pos, &string_length);
+        if (varint == 0) return -1;
+        *pos += varint;
+        if (length - *pos < string_length) return -1;
+        *text = (const char *)record + *pos;
+        *text_length = string_length;
+        *pos += string_length;
+        return 0;
+    }
+
+    size_t width = typed_width(type);
+    if (length - *pos < width) return -1;
+    const unsigned char *field = record + *pos;
+    *pos += width;
+
+    switch (type) {
+    case COLUMN_INT: {
+        int32_t value;
+        memcpy(&value, field, sizeof(value));
+        format_int(out, value);
+        break;
+    }
+    case COLUMN_FLOAT: {
+        float value;
+        memcpy(&value, field, sizeof(value));
+        format_float(out, out_size, value);
+        break;
+    }
+    case COLUMN_DOUBLE: {
+        double value;
+        memcpy(&value, field, sizeof(value));
+        for (int precision = DBL_DIG; precision <= 17; precision++) {
+            snprintf(out, out_size, "%.*g", precision, value);
+            if (strtod(out, NULL) == value) break;
+        }
+        break;
+    }
+    case COLUMN_BOOL:
+        strcpy(out, field[0] ? "true" : "false");
+        break;
+    case COLUMN_DATE: {
+        int32_t days;
+        int year, month, day;
+        memcpy(&days, field, sizeof(days));
+        civil_from_days(days, &year, &month, &day);
+        if (year < 0 || year > 9999) {
+            snprintf(out, out_size, "%04d-%02d-%02d", year, month, day);
+            break;
+        }
+        for (int i = 3; i >= 0; i--, year /= 10) out[i] = '0' + year % 10;
+        out[4] = '-';
+        out[5] = '0' + month / 10;
+        out[6] = '0' + month % 10;
+        out[7] = '-';
+        out[8] = '0' + day / 10;
+        out[9] = '0' + day % 10;
+        out[10] = '\0';
+        break;
+    }
+    default:
+        return -1;
+    }
+    *text = out;
+    *text_length = strlen(out);
+    return 0;
+}
+
+/**
+ * @brief Decodes a record into one newly allocated string per column.
+ * @param types Storage type of each column.
+ * @param column_count Number of columns.
+ * @param record Start of the record.
+ * @param length Bytes available at record (the whole record).
+ * @return Array of column_count strings (caller frees each and the array), or NULL.
+ */
+char **record_decode(const ColumnType *types, int column_count, const unsigned char *record, size_t length) {
+    size_t pos = check_record(column_count, record, length);
+    if (pos == 0) return NULL;
+    const unsigned char *bitmap = record + pos;
+    pos += (column_count + 7) / 8;
+
+    char **values = calloc(column_count, sizeof(char *));
+    if (!values) {
+        perror("Failed to allocate memory for row data array");
+        return NULL;
+    }
+
+    for (int i = 0; i < column_count; i++) {
+        char number[32];
+        const char *text = "";
+        size_t text_length = 0;
+        if (!(bitmap[i / 8] & (1 << (i % 8))) &&
+            decode_field(types[i], record, length, &pos, number, sizeof(number), &text, &text_length) != 0) {
+            goto fail;
+        }
+        values[i] = malloc(text_length + 1);
+        if (!values[i]) {
+            perror("Failed to allocate column value");
+            goto fail;
+        }
+        memcpy(values[i], text, text_length);
+        values[i][text_length] = '\0';
+    }
+    uint64_t previous;
+    if (read_previous(record + pos, length - pos, &previous) != 0) goto fail; // Trailing bytes: the record does not match the columns
+
+    return values;
+
+fail:
+    for (int i = 0; i < column_count; i++) free(values[i]);
+    free(values);
+    return NULL;
+}
+
+/**
+ * @brief Decodes a complete record like record_decode, but into a buffer the
+ * caller reuses across records, so a scan allocates nothing per row.
+ * @param types Storage type of each column.
+ * @param column_count Number of columns.
+ * @param record Start of the record.
+ * @param length Bytes available at record (the whole record).
+ * @param values Output: column_count strings pointing into *buffer.
+ * @param buffer In/out: text buffer, grown as needed (caller frees).
+ * @param capacity In/out: size of *buffer.
+ * @return 0 on success, -1 if the record is malformed or on allocation failure.
+ */
+int record_decode_into(const ColumnType *types, int column_count, const unsigned char *record, size_t length,
+                       char **values, char **buffer, size_t *capacity) {
+    size_t pos = check_record(column_count, record, length);
+    if (pos == 0) return -1;
+    const unsigned char *bitmap = record + pos;
+    pos += (column_count + 7) / 8;
+
+    // Strings decode to at most their stored bytes and numbers to well under
+    // 32 characters, so one reservation covers the whole row
+    size_t needed = length + (size_t)column_count * 33;
+    if (needed > *capacity) {
+        char *grown = realloc(*buffer, needed);
+        if (!grown) {
+            perror("Failed to allocate row decode buffer");
+            return -1;
+        }
+        *buffer = grown;
+        *capacity = needed;
+    }
+
+    char *out = *buffer;
+    for (int i = 0; i < column_count; i++) {
+        char number[32];
+        const char *text = "";
+        size_t text_length = 0;
+        if (!(bitmap[i / 8] & (1 << (i % 8))) &&
+            decode_field(types[i], record, length, &pos, number, sizeof(number), &text, &text_length) != 0) {
+            return -1;
+        }
+        values[i] = out;
+        memcpy(out, text, text_length);
+        out[text_length] = '\0';
+        out += text_length + 1;
+    }
+    uint64_t previous;
+    return read_previous(record + pos, length - pos, &previous);
+}
+
+/**
+ * @brief Reads the distance back to the previous version of a record's row,
+ * walking its fields to find where they end.
+ * @param types Storage type of each column.
+ * @param column_count Number of columns.
+ * @param record Start of the record.
+ * @param length Bytes available at record (the whole record).
+ * @return The distance, or 0 if the record has none or is malformed.
+ */
+uint64_t record_previous(const ColumnType *types, int column_count, const unsigned char *record, size_t length) {
+    size_t pos = check_record(column_count, record, length);
+    if (pos == 0) return 0;
+    const unsigned char *bitmap = record + pos;
+    pos += (column_count + 7) / 8;
+    for (int i = 0; i < column_count; i++) {
+        if (bitmap[i / 8] & (1 << (i % 8))) continue;
+        char number[32];
+        const char *text;
+        size_t text_length;
+        if (decode_field(types[i], record, length, &pos, number, sizeof(number), &text, &text_length) != 0) return 0;
+    }
+    uint64_t previous;
+    return read_previous(record + pos, length - pos, &previous) == 0 ? previous : 0;
+}
+
+/**
+ * @brief Renders a value exactly as a column of the given type decodes, so a
+ * value from the outside compares equal to the stored ones: "007" and "7" for
+ * an int column, "1.50" and "1.5" for a float, "" for a null.
+ * @param type Storage type of the column.
+ * @param value The value (NULL is null).
+ * @param out Buffer for typed columns (at least 32 bytes).
+ * @param out_size Size of out.
+ * @return value itself for string columns, out for typed ones, or NULL if the
+ * value does not parse as the type (so no stored value equals it).
+ */
+const char *record_canonical_value(ColumnType type, const char *value, char *out, size_t out_size) {
+    if (type == COLUMN_STRING) return value ? value : "";
+    if (is_null_value(type, value)) return "";
+
+    unsigned char field[sizeof(double)];
+    if (encode_typed(type, value, field) < 0) return NULL;
+    size_t pos = 0, text_length;
+    const char *text;
+    if (decode_field(type, field, typed_width(type), &pos, out, out_size, &text, &text_length) != 0) return NULL;
+    return text;
+}
+
+/**
+ * @brief Reads the primary key (first column) of a record.
+ * @param types Storage type of each column.
+ * @param column_count Number of columns.
+ * @param record Start of the record.
+ * @param length Bytes available at record (the whole record).
+ * @param key Output: the key.
+ * @return 0 on success, -1 if the record is malformed or the key is null.
+ */
+int record_primary_key(const ColumnType *types, int column_count, const unsigned char *record,
+                       size_t length, int *key) {
+    size_t pos = check_record(column_count, record, length);
+    if (pos == 0 || (record[pos] & 1)) return -1;
+    pos += (column_count + 7) / 8;
+
+    if (types[0] == COLUMN_INT) {
+        int32_t value;
+        if (length - pos < sizeof(value)) return -1;
+        memcpy(&value, record + pos, sizeof(value));
+        *key = value;
+        return 0;
+    }
+
+    // Keys kept in columns of other types are parsed the way the ORM does, with atoi
+    char number[32], copy[32];
+    const char *text;
+    size_t text_length;
+    if (decode_field(types[0], record, length, &pos, number, sizeof(number), &text, &text_length) != 0) return -1;
+    size_t n = text_length < sizeof(copy) - 1 ? text_length : sizeof(copy) - 1;
+    memcpy(copy, text, n);
+    copy[n] = '\0';
+    *key = atoi(copy);
+    return 0;
+}
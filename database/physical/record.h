@@ -0,0 +1,109 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stddef.h> // For size_t
+#include <stdint.h> // For fixed-width on-disk fields
+
+// --- Data File Layout ---
+// A data file starts with a RECORD_FILE_HEADER_SIZE byte header (magic, format
+// version, column count and a signature of the column types) followed by
+// records appended back to back. Every record is:
+//
+//   uint8  flags         RECORD_FLAG_DELETED once the row is deleted
+//   varint length        bytes of the record after this header
+//   null bitmap          one bit per column, (column_count + 7) / 8 bytes
+//   fields               in column order, nothing stored for null columns
+//   varint previous      optional: bytes back to the version of the row this
+//                        record replaced, when it was written by an update
+//
+// Typed columns are stored at the width of the C type the scaffolder gives
+// them (int: int32, float: float, double: double, boolean: uint8, date: int32
+// days since 1970-01-01); strings are a varint length followed by the bytes.
+// Varints are LEB128 (7 bits per byte, low bits first) and other integers are
+// in host byte order, like the index file. Decoding walks the fields in place;
+// nothing is tokenized, so strings may contain any byte.
+//
+// The previous field chains the versions of a row back through the file, so
+// a reader working from a snapshot (the file size when it started) can find
+// the version that was current then: the file is append-only, so a record's
+// offset is also the order it was committed in. Version 1 files are the same
+// without the field.
+
+#define RECORD_FILE_MAGIC "CRVDAT1"         // 8 bytes with the terminator
+#define RECORD_FORMAT_VERSION 2
+#define RECORD_FILE_HEADER_SIZE 16
+#define RECORD_HEADER_MAX_SIZE 6            // Flags byte and a varint of up to 5 bytes
+#define RECORD_FLAGS_OFFSET 0               // Byte rewritten in place to delete a record
+#define RECORD_FLAG_DELETED 0x01
+
+// Storage type of a column, from the model's Field.type hint
+typedef enum {
+    COLUMN_STRING = 0,                      // string, text, char and anything unknown
+    COLUMN_INT,                             // int, integer
+    COLUMN_FLOAT,                           // float
+    COLUMN_BOOL,                            // boolean, bool
+    COLUMN_DATE,                            // date, "YYYY-MM-DD"
+    COLUMN_DOUBLE                           // double
+} ColumnType;
+
+// Maps a type hint such as "int" or "date" to its storage type
+ColumnType column_type_from_name(const char *type_name);
+
+// --- File Header ---
+
+// Fills header with the file header for the given column layout
+void record_file_header(unsigned char header[RECORD_FILE_HEADER_SIZE], const ColumnType *types, int column_count);
+
+// Checks a file header against the expected column layout.
+// Returns 0 if it matches, 1 if it matches but was written by format version
+// 1 (whose records read the same: rewrite the header with record_file_header),
+// -1 if the bytes are not a record file header at all (e.g. a pipe-delimited
+// text file), -2 if the columns differ.
+int record_check_file_header(const unsigned char *header, size_t length, const ColumnType *types, int column_count);
+
+// --- Records ---
+
+// Encodes one string value per column into *buffer, growing it as needed.
+// NULL or empty values of typed columns (and "null") are stored as null.
+// previous is the distance in bytes back to the version the record replaces,
+// or 0 for a new row. Returns the record length, or -1 if a value does not
+// parse as its column's type (with *bad_column set to that column) or on
+// allocation failure.
+long record_encode(const ColumnType *types, int column_count, char **values, uint64_t previous,
+                   unsigned char **buffer, size_t *capacity, int *bad_column);
+
+// Reads the header of the record starting at record, of which available
+// bytes are present. Returns the header size and sets *length to the size of
+// the whole record, or returns 0 if the header is incomplete or malformed.
+size_t record_header(const unsigned char *record, size_t available, size_t *length);
+
+// Whether the record starting at record has been deleted
+int record_is_deleted(const unsigned char *record);
+
+// Distance in bytes back to the previous version of a complete record's row,
+// or 0 if the record has none (or is malformed)
+uint64_t record_previous(const ColumnType *types, int column_count, const unsigned char *record, size_t length);
+
+// Decodes a complete record (length bytes) into newly allocated strings, one
+// per column; null columns decode as "". Returns NULL if the record is
+// malformed or does not match the columns, or on allocation failure.
+char **record_decode(const ColumnType *types, int column_count, const unsigned char *record, size_t length);
+
+// Decodes a complete record into values[0..column_count), which point into
+// *buffer (grown as needed, reused across calls). Returns 0, or -1 if the
+// record is malformed or on allocation failure.
+int record_decode_into(const ColumnType *types, int column_count, const unsigned char *record, size_t length,
+                       char **values, char **buffer, size_t *capacity);
+
+// Renders value the way a column of the given type decodes ("007" -> "7" for
+// an int, "" for a null), so it can be compared with decoded values. Returns
+// value for string columns, out (at least 32 bytes) for typed ones, or NULL
+// if value does not parse as the type.
+const char *record_canonical_value(ColumnType type, const char *value, char *out, size_t out_size);
+
+// Reads the first column of a record as an integer primary key.
+// Returns 0 on success, -1 if the record is malformed or the column is null.
+int record_primary_key(const ColumnType *types, int column_count, const unsigned char *record,
+                       size_t length, int *key);
+
+#endif // RECORD_H
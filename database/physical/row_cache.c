@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "row_cache.h"
+
+/**
+ * @brief Mixes a key so consecutive keys spread over shards and buckets.
+ */
+static uint32_t hash_key(int key) {
+    uint32_t hash = (uint32_t)key * 2654435761u;
+    return hash ^ (hash >> 15);
+}
+
+/**
+ * @brief Shard holding a key (the top bits of its hash).
+ */
+static RowCacheShard *shard_for(RowCache *cache, uint32_t hash) {
+    return &cache->shards[hash >> 28 & (ROW_CACHE_SHARDS - 1)];
+}
+
+/**
+ * @brief Finds the entry holding key in a shard.
+ * @return The entry's index, or -1 if the key is not cached.
+ */
+static int find_entry(RowCacheShard *shard, int key, uint32_t hash) {
+    for (int i = shard->buckets[hash & shard->bucket_mask]; i >= 0; i = shard->entries[i].next) {
+        if (shard->entries[i].key == key) return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Frees an entry's value and its encoded form.
+ */
+static void free_values(RowCacheEntry *entry) {
+    free(entry->value);
+    free(entry->encoded);
+    entry->value = NULL;
+    entry->encoded = NULL;
+}
+
+/**
+ * @brief Removes an entry from its hash chain and frees its value.
+ */
+static void drop_entry(RowCacheShard *shard, int index) {
+    RowCacheEntry *entry = &shard->entries[index];
+    int *link = &shard->buckets[hash_key(entry->key) & shard->bucket_mask];
+    while (*link != index) link = &shard->entries[*link].next;
+    *link = entry->next;
+    free_values(entry);
+    shard->count--;
+}
+
+/**
+ * @brief Picks the entry for a new value with the CLOCK hand: a free entry,
+ * or the first one not referenced since the hand last passed it, which is
+ * evicted. Entries the hand passes lose their reference bit.
+ * @return Index of the (now free) entry.
+ */
+static int clock_victim(RowCacheShard *shard) {
+    while (1) {
+        int index = shard->hand;
+        RowCacheEntry *entry = &shard->entries[index];
+        shard->hand = (shard->hand + 1) % shard->capacity;
+        if (!entry->value) return index;
+        if (entry->referenced) {
+            entry->referenced = 0;
+            continue;
+        }
+        drop_entry(shard, index);
+        return index;
+    }
+}
+
+/**
+ * @brief Creates a cache of about capacity values split over the shards.
+ * @param capacity Total number of values.
+ * @return The cache, or NULL on allocation failure.
+ */
+RowCache *row_cache_create(int capacity) {
+    RowCache *cache = calloc(1, sizeof(RowCache));
+    if (!cache) {
+        perror("Failed to allocate row cache");
+        return NULL;
+    }
+    int per_shard = (capacity + ROW_CACHE_SHARDS - 1) / ROW_CACHE_SHARDS;
+    if (per_shard < 1) per_shard = 1;
+    int buckets = 1;
+    while (buckets < per_shard) buckets *= 2;
+
+    for (int s = 0; s < ROW_CACHE_SHARDS; s++) pthread_mutex_init(&cache->shards[s].lock, NULL);
+    for (int s = 0; s < ROW_CACHE_SHARDS; s++) {
+        RowCacheShard *shard = &cache->shards[s];
+        shard->entries = calloc(per_shard, sizeof(RowCacheEntry));
+        shard->buckets = malloc(buckets * sizeof(int));
+        if (!shard->entries || !shard->buckets) {
+            perror("Failed to allocate row cache shard");
+            row_cache_destroy(cache);
+            return NULL;
+        }
+        shard->capacity = per_shard;
+        shard->bucket_mask = buckets - 1;
+        for (int b = 0; b < buckets; b++) shard->buckets[b] = -1;
+    }
+    return cache;
+}
+
+/**
+ * @brief Frees the cache and every cached value.
+ */
+void row_cache_destroy(RowCache *cache) {
+    if (!cache) return;
+    for (int s = 0; s < ROW_CACHE_SHARDS; s++) {
+        RowCacheShard *shard = &cache->shards[s];
+        if (shard->entries) {
+            for (int i = 0; i < shard->capacity; i++) free_values(&shard->entries[i]);
+        }
+        free(shard->entries);
+        free(shard->buckets);
+        pthread_mutex_destroy(&shard->lock);
+    }
+    free(cache);
+}
+
+/**
+ * @brief Looks a key up and copies its value out under the shard lock.
+ * @param cache Pointer to the cache.
+ * @param key Primary key.
+ * @param arena Arena for the copy, or NULL for malloc.
+ * @param length Output: length of the value.
+ * @param ticket Output: fill ticket for row_cache_put after a miss.
+ * @return The NUL-terminated copy, or NULL on a miss.
+ */
+char *row_cache_get(RowCache *cache, int key, Arena *arena, size_t *length, uint64_t *ticket) {
+    uint32_t hash = hash_key(key);
+    RowCacheShard *shard = shard_for(cache, hash);
+    pthread_mutex_lock(&shard->lock);
+    *ticket = shard->version;
+    int index = find_entry(shard, key, hash);
+    if (index < 0) {
+        shard->misses++;
+        pthread_mutex_unlock(&shard->lock);
+        return NULL;
+    }
+    RowCacheEntry *entry = &shard->entries[index];
+    entry->referenced = 1;
+    shard->hits++;
+    char *copy = arena ? arena_alloc(arena, entry->length + 1) : malloc(entry->length + 1);
+    if (copy) {
+        memcpy(copy, entry->value, entry->length);
+        copy[entry->length] = '\0';
+        *length = entry->length;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return copy;
+}
+
+/**
+ * @brief Caches a value after a miss, unless the shard changed since the miss.
+ * @param cache Pointer to the cache.
+ * @param key Primary key.
+ * @param value The value to copy in.
+ * @param length Length of value.
+ * @param ticket Ticket row_cache_get returned with the miss.
+ */
+void row_cache_put(RowCache *cache, int key, const char *value, size_t length, uint64_t ticket) {
+    if (length > ROW_CACHE_MAX_VALUE) return;
+    char *copy = malloc(length + 1);
+    if (!copy) return;
+    memcpy(copy, value, length);
+    copy[length] = '\0';
+
+    uint32_t hash = hash_key(key);
+    RowCacheShard *shard = shard_for(cache, hash);
+    pthread_mutex_lock(&shard->lock);
+    if (shard->version != ticket) {
+        // The row may have changed after it was read
+        pthread_mutex_unlock(&shard->lock);
+        free(copy);
+        return;
+    }
+    int index = find_entry(shard, key, hash);
+    if (index >= 0) {
+        free_values(&shard->entries[index]);
+    } else {
+        index = clock_victim(shard);
+        RowCacheEntry *entry = &shard->entries[index];
+        entry->key = key;
+        entry->next = shard->buckets[hash & shard->bucket_mask];
+        shard->buckets[hash & shard->bucket_mask] = index;
+        shard->count++;
+    }
+    RowCacheEntry *entry = &shard->entries[index];
+    entry->value = copy;
+    entry->length = length;
+    entry->referenced = 0; // Earns its bit on the first hit
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/**
+ * @brief Looks up the encoded form of a key's value and copies it out.
+ * @param cache Pointer to the cache.
+ * @param key Primary key.
+ * @param arena Arena for the copy, or NULL for malloc.
+ * @param length Output: length of the encoded form.
+ * @param ticket Output: fill ticket for row_cache_put_encoded after a miss.
+ * @return The copy, or NULL on a miss.
+ */
+char *row_cache_get_encoded(RowCache *cache, int key, Arena *arena, size_t *length, uint64_t *ticket) {
+    uint32_t hash = hash_key(key);
+    RowCacheShard *shard = shard_for(cache, hash);
+    pthread_mutex_lock(&shard->lock);
+    *ticket = shard->version;
+    int index = find_entry(shard, key, hash);
+    if (index < 0 || !shard->entries[index].encoded) {
+        // Not counted: the row_cache_get that follows a miss counts it
+        pthread_mutex_unlock(&shard->lock);
+        return NULL;
+    }
+    RowCacheEntry *entry = &shard->entries[index];
+    entry->referenced = 1;
+    shard->hits++;
+    char *copy = arena ? arena_alloc(arena, entry->encoded_length) : malloc(entry->encoded_length);
+    if (copy) {
+        memcpy(copy, entry->encoded, entry->encoded_length);
+        *length = entry->encoded_length;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return copy;
+}
+
+/**
+ * @brief Attaches the encoded form of a cached value after a miss, unless the
+ * shard changed since the miss or the value is no longer cached.
+ * @param cache Pointer to the cache.
+ * @param key Primary key.
+ * @param encoded The encoded form to copy in.
+ * @param length Length of encoded.
+ * @param ticket Ticket row_cache_get_encoded returned with the miss.
+ */
+void row_cache_put_encoded(RowCache *cache, int key, const char *encoded, size_t length, uint64_t ticket) {
+    if (length == 0 || length > ROW_CACHE_MAX_VALUE) return;
+    char *copy = malloc(length);
+    if (!copy) return;
+    memcpy(copy, encoded, length);
+
+    uint32_t hash = hash_key(key);
+    RowCacheShard *shard = shard_for(cache, hash);
+    pthread_mutex_lock(&shard->lock);
+    int index = shard->version == ticket ? find_entry(shard, key, hash) : -1;
+    if (index < 0) {
+        pthread_mutex_unlock(&shard->lock);
+        free(copy);
+        return;
+    }
+    RowCacheEntry *entry = &shard->entries[index];
+    free(entry->encoded);
+    entry->encoded = copy;
+    entry->encoded_length = length;
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/**
+ * @brief Drops a key's value and invalidates fills in flight for its shard.
+ */
+void row_cache_invalidate(RowCache *cache, int key) {
+    uint32_t hash = hash_key(key);
+    RowCacheShard *shard = shard_for(cache, hash);
+    pthread_mutex_lock(&shard->lock);
+    shard->version++;
+    int index = find_entry(shard, key, hash);
+    if (index >= 0) drop_entry(shard, index);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/**
+ * @brief Drops every value and invalidates every fill in flight.
+ */
+void row_cache_clear(RowCache *cache) {
+    for (int s = 0; s < ROW_CACHE_SHARDS; s++) {
+        RowCacheShard *shard = &cache->shards[s];
+        pthread_mutex_lock(&shard->lock);
+        shard->version++;
+        for (int i = 0; i < shard->capacity; i++) free_values(&shard->entries[i]);
+        for (int b = 0; b <= shard->bucket_mask; b++) shard->buckets[b] = -1;
+        shard->count = 0;
+        shard->hand = 0;
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+/**
+ * @brief Sums the counters of every shard.
+ */
+void row_cache_stats(RowCache *cache, uint64_t *hits, uint64_t *misses, int *count) {
+    *hits = 0;
+    *misses = 0;
+    *count = 0;
+    for (int s = 0; s < ROW_CACHE_SHARDS; s++) {
+        RowCacheShard *shard = &cache->shards[s];
+        pthread_mutex_lock(&shard->lock);
+        *hits += shard->hits;
+        *misses += shard->misses;
+        *count += shard->count;
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
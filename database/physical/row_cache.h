@@ -0,0 +1,88 @@
+#ifndef ROW_CACHE_H
+#define ROW_CACHE_H
+
+#include <stddef.h>  // For size_t
+#include <stdint.h>  // For fill tickets and counters
+#include <pthread.h> // For the shard locks
+#include "../../utils/arena.h"
+
+// --- Row Cache ---
+// Bounded in-memory cache from a primary key to an opaque value (the JSON of
+// the row, rendered once), in front of a table's point reads. Keys are
+// spread over ROW_CACHE_SHARDS shards, each with its own lock, hash chains
+// and CLOCK eviction: a hit sets the entry's reference bit, and the clock
+// hand evicts the first entry whose bit is clear, clearing bits as it passes.
+//
+// Writers call row_cache_invalidate after changing a row, under the table's
+// write lock. Since a reader renders the value after reading the row, a fill
+// carries the ticket row_cache_get handed out on the miss, and is dropped if
+// the shard was invalidated since; a stale row can't be cached that way.
+//
+// An entry may also hold an encoded form of its value (the gzip'd JSON), so
+// a compressed response is not compressed again for every read. It is filled
+// the same way, with a ticket, and goes whenever the value does.
+
+#define ROW_CACHE_SHARDS 16                 // Power of two
+#define ROW_CACHE_MAX_VALUE 65536           // Larger values are not cached
+
+typedef struct {
+    int key;
+    int next;                               // Next entry in the hash chain, -1 at the end
+    int referenced;                         // CLOCK reference bit
+    char *value;                            // NULL for a free entry
+    size_t length;
+    char *encoded;                          // Encoded form of value, NULL until filled
+    size_t encoded_length;
+} RowCacheEntry;
+
+typedef struct {
+    pthread_mutex_t lock;
+    RowCacheEntry *entries;
+    int capacity;
+    int count;
+    int *buckets;                           // Head entry of each chain, -1 if empty
+    int bucket_mask;
+    int hand;                               // CLOCK hand
+    uint64_t version;                       // Bumped by every invalidation
+    uint64_t hits;
+    uint64_t misses;
+} RowCacheShard;
+
+typedef struct RowCache {
+    RowCacheShard shards[ROW_CACHE_SHARDS];
+} RowCache;
+
+// Creates a cache holding up to capacity values (at least one per shard), or NULL on failure
+RowCache *row_cache_create(int capacity);
+
+// Frees the cache and every value
+void row_cache_destroy(RowCache *cache);
+
+// Returns a copy of the value cached for key, in arena (NULL: malloc'd), with
+// *length set, or NULL on a miss. *ticket (set either way) is passed to
+// row_cache_put to fill the entry after a miss.
+char *row_cache_get(RowCache *cache, int key, Arena *arena, size_t *length, uint64_t *ticket);
+
+// Caches a copy of value for key, replacing any old value, unless the key's
+// shard was invalidated after ticket was handed out or value is too large
+void row_cache_put(RowCache *cache, int key, const char *value, size_t length, uint64_t ticket);
+
+// Returns a copy of the encoded form cached for key, like row_cache_get (the
+// copy is not NUL-terminated), or NULL if the key or its encoded form is
+// missing. Only hits are counted; the caller falls back to row_cache_get.
+char *row_cache_get_encoded(RowCache *cache, int key, Arena *arena, size_t *length, uint64_t *ticket);
+
+// Caches a copy of the encoded form of key's value, if the value is still
+// cached and its shard was not invalidated after ticket was handed out
+void row_cache_put_encoded(RowCache *cache, int key, const char *encoded, size_t length, uint64_t ticket);
+
+// Drops the value of key and fails fills in flight for its shard
+void row_cache_invalidate(RowCache *cache, int key);
+
+// Drops every value (after a truncation)
+void row_cache_clear(RowCache *cache);
+
+// Hit and miss counts since creation, and the number of cached values
+void row_cache_stats(RowCache *cache, uint64_t *hits, uint64_t *misses, int *count);
+
+#endif // ROW_CACHE_H
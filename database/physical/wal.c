@@ -0,0 +1,458 @@
+#define _GNU_SOURCE // For fdatasync
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "wal.h"
+
+#define WAL_RECORD_HEADER_SIZE 8        // Length and checksum
+#define WAL_BUFFER_INITIAL_CAPACITY 65536
+
+// --- Checksum ---
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Fills the CRC-32 (IEEE) lookup table.
+ */
+static void build_crc_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[i] = c;
+    }
+}
+
+/**
+ * @brief CRC-32 of a byte range.
+ */
+static uint32_t crc32(const unsigned char *data, size_t length) {
+    pthread_once(&crc_once, build_crc_table);
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; i++) c = crc_table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+/**
+ * @brief Microseconds on the monotonic clock.
+ */
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Writes the whole buffer to the log file, retrying short writes.
+ * @return 0 on success, -1 on an I/O error.
+ */
+static int write_all(int fd, const unsigned char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += written;
+        length -= written;
+    }
+    return 0;
+}
+
+// --- Flusher ---
+
+/**
+ * @brief Writes out and fsyncs everything appended so far. Called by the
+ * flusher with the lock held; the lock is released during the I/O so writers
+ * keep appending to the other buffer meanwhile.
+ */
+static void flush_batch(Wal *wal) {
+    // Swap buffers: writers fill the empty one while this batch is written
+    unsigned char *batch = wal->buffer;
+    size_t batch_capacity = wal->capacity;
+    size_t length = wal->length;
+    uint64_t target = wal->appended_lsn;
+    wal->buffer = wal->flush_buffer;
+    wal->capacity = wal->flush_capacity;
+    wal->length = 0;
+    wal->flush_buffer = batch;
+    wal->flush_capacity = batch_capacity;
+    wal->flushing = 1;
+    pthread_mutex_unlock(&wal->lock);
+
+    int status = 0;
+    if (length > 0 && write_all(wal->fd, batch, length) != 0) {
+        perror("Failed to write write-ahead log");
+        status = -1;
+    }
+    if (status == 0 && fdatasync(wal->fd) != 0) {
+        perror("Failed to fsync write-ahead log");
+        status = -1;
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    wal->flushing = 0;
+    if (status == 0) {
+        wal->file_size += length;
+        wal->durable_lsn = target;
+    } else {
+        wal->failed = 1;
+    }
+    pthread_cond_broadcast(&wal->synced);
+}
+
+/**
+ * @brief Flusher thread: syncs right away when a writer is waiting, otherwise
+ * once the oldest unflushed record is flush_interval_us old.
+ */
+static void *flusher_main(void *arg) {
+    Wal *wal = arg;
+    pthread_mutex_lock(&wal->lock);
+    while (1) {
+        if (wal->appended_lsn == wal->durable_lsn && !wal->failed) {
+            if (wal->stopping) break;
+            pthread_cond_wait(&wal->work, &wal->lock);
+            continue;
+        }
+        if (wal->failed) {
+            // Release waiters (they see the failure) and stop syncing a broken log
+            pthread_cond_broadcast(&wal->synced);
+            if (wal->stopping) break;
+            pthread_cond_wait(&wal->work, &wal->lock);
+            continue;
+        }
+        if (wal->waiters == 0 && !wal->stopping) {
+            uint64_t deadline = wal->batch_start_us + wal->flush_interval_us;
+            uint64_t now = now_us();
+            if (now < deadline) {
+                struct timespec ts;
+                clock_gettime(CLOCK_MONOTONIC, &ts);
+                uint64_t wait_ns = (deadline - now) * 1000 + ts.tv_nsec;
+                ts.tv_sec += wait_ns / 1000000000u;
+                ts.tv_nsec = wait_ns % 1000000000u;
+                pthread_cond_timedwait(&wal->work, &wal->lock, &ts);
+                continue; // Recheck: a waiter may have arrived
+            }
+        }
+        flush_batch(wal);
+    }
+    pthread_mutex_unlock(&wal->lock);
+    return NULL;
+}
+
+// --- Public API ---
+
+/**
+ * @brief Opens or creates a log file and starts its flusher.
+ * @param path Path of the log file.
+ * @param durability WAL_DURABILITY_BATCH or WAL_DURABILITY_COMMIT.
+ * @param flush_interval_us Longest a batch waits for its fsync when no writer is waiting.
+ * @return The log, or NULL on failure.
+ */
+Wal *wal_open(const char *path, WalDurability durability, int flush_interval_us) {
+    if (!path || durability == WAL_DURABILITY_OFF) return NULL;
+
+    Wal *wal = calloc(1, sizeof(Wal));
+    if (!wal) {
+        perror("Failed to allocate write-ahead log");
+        return NULL;
+    }
+    wal->durability = durability;
+    wal->flush_interval_us = flush_interval_us > 0 ? flush_interval_us : 1;
+    wal->fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (wal->fd < 0) {
+        perror("Failed to open write-ahead log");
+        free(wal);
+        return NULL;
+    }
+
+    off_t size = lseek(wal->fd, 0, SEEK_END);
+    if (size < WAL_FILE_HEADER_SIZE) {
+        // New (or torn before its header was complete): start the file over
+        unsigned char header[WAL_FILE_HEADER_SIZE] = {0};
+        memcpy(header, WAL_FILE_MAGIC, sizeof(WAL_FILE_MAGIC));
+        if (ftruncate(wal->fd, 0) != 0 || write_all(wal->fd, header, sizeof(header)) != 0 || fdatasync(wal->fd) != 0) {
+            perror("Failed to write write-ahead log header");
+            close(wal->fd);
+            free(wal);
+            return NULL;
+        }
+        size = WAL_FILE_HEADER_SIZE;
+    }
+    wal->file_size = size;
+
+    wal->buffer = malloc(WAL_BUFFER_INITIAL_CAPACITY);
+    wal->flush_buffer = malloc(WAL_BUFFER_INITIAL_CAPACITY);
+    if (!wal->buffer || !wal->flush_buffer) {
+        perror("Failed to allocate write-ahead log buffers");
+        free(wal->buffer);
+        free(wal->flush_buffer);
+        close(wal->fd);
+        free(wal);
+        return NULL;
+    }
+    wal->capacity = wal->flush_capacity = WAL_BUFFER_INITIAL_CAPACITY;
+
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC); // The flusher's deadlines use now_us
+    pthread_mutex_init(&wal->lock, NULL);
+    pthread_cond_init(&wal->work, &cond_attr);
+    pthread_cond_init(&wal->synced, NULL);
+    pthread_condattr_destroy(&cond_attr);
+
+    if (pthread_create(&wal->flusher, NULL, flusher_main, wal) != 0) {
+        perror("Failed to start write-ahead log flusher");
+        pthread_mutex_destroy(&wal->lock);
+        pthread_cond_destroy(&wal->work);
+        pthread_cond_destroy(&wal->synced);
+        free(wal->buffer);
+        free(wal->flush_buffer);
+        close(wal->fd);
+        free(wal);
+        return NULL;
+    }
+    return wal;
+}
+
+/**
+ * @brief Syncs the rest of the log, stops the flusher and frees the log.
+ * @param wal The log (may be NULL).
+ */
+void wal_close(Wal *wal) {
+    if (!wal) return;
+    pthread_mutex_lock(&wal->lock);
+    wal->stopping = 1;
+    pthread_cond_signal(&wal->work);
+    pthread_mutex_unlock(&wal->lock);
+    pthread_join(wal->flusher, NULL);
+
+    pthread_mutex_destroy(&wal->lock);
+    pthread_cond_destroy(&wal->work);
+    pthread_cond_destroy(&wal->synced);
+    free(wal->buffer);
+    free(wal->flush_buffer);
+    close(wal->fd);
+    free(wal);
+}
+
+/**
+ * @brief Appends a record to the log buffer.
+ * @param wal The log.
+ * @param type WAL_RECORD_WRITE or WAL_RECORD_TABLE_SYNCED.
+ * @param table Name of the table the writes apply to.
+ * @param writes The writes, in the order they are made.
+ * @param count Number of writes (0 to WAL_MAX_WRITES).
+ * @return Log position at the end of the record (pass it to wal_commit), or 0 on failure.
+ */
+uint64_t wal_append(Wal *wal, int type, const char *table, const WalWrite *writes, int count) {
+    size_t name_length = strlen(table);
+    if (name_length > WAL_MAX_TABLE_NAME || count < 0 || count > WAL_MAX_WRITES) {
+        fprintf(stderr, "Error: Invalid write-ahead log record for table '%s'.\n", table);
+        return 0;
+    }
+    size_t payload = 3 + name_length;
+    for (int i = 0; i < count; i++) payload += sizeof(int64_t) + sizeof(uint32_t) + writes[i].length;
+    size_t record_length = WAL_RECORD_HEADER_SIZE + payload;
+
+    pthread_mutex_lock(&wal->lock);
+    if (wal->failed) {
+        pthread_mutex_unlock(&wal->lock);
+        return 0; // Nothing logged from now on could be made durable
+    }
+    if (wal->length + record_length > wal->capacity) {
+        size_t capacity = wal->capacity ? wal->capacity : WAL_BUFFER_INITIAL_CAPACITY;
+        while (capacity < wal->length + record_length) capacity *= 2;
+        unsigned char *buffer = realloc(wal->buffer, capacity);
+        if (!buffer) {
+            perror("Failed to grow write-ahead log buffer");
+            pthread_mutex_unlock(&wal->lock);
+            return 0;
+        }
+        wal->buffer = buffer;
+        wal->capacity = capacity;
+    }
+
+    unsigned char *out = wal->buffer + wal->length;
+    unsigned char *body = out + WAL_RECORD_HEADER_SIZE;
+    unsigned char *p = body;
+    uint32_t payload32 = (uint32_t)payload;
+    *p++ = (unsigned char)type;
+    *p++ = (unsigned char)name_length;
+    memcpy(p, table, name_length);
+    p += name_length;
+    *p++ = (unsigned char)count;
+    for (int i = 0; i < count; i++) {
+        memcpy(p, &writes[i].offset, sizeof(int64_t));
+        p += sizeof(int64_t);
+        memcpy(p, &writes[i].length, sizeof(uint32_t));
+        p += sizeof(uint32_t);
+        memcpy(p, writes[i].data, writes[i].length);
+        p += writes[i].length;
+    }
+    uint32_t checksum = crc32(body, payload);
+    memcpy(out, &payload32, sizeof(uint32_t));
+    memcpy(out + sizeof(uint32_t), &checksum, sizeof(uint32_t));
+
+    if (wal->length == 0) {
+        wal->batch_start_us = now_us();
+        pthread_cond_signal(&wal->work); // The flusher may be idle
+    }
+    wal->length += record_length;
+    wal->appended_lsn += record_length;
+    uint64_t lsn = wal->appended_lsn;
+    pthread_mutex_unlock(&wal->lock);
+    return lsn;
+}
+
+/**
+ * @brief Waits for the fsync covering the record ending at lsn. Writers that
+ * arrive while a sync is running share the next one.
+ * @param wal The log.
+ * @param lsn Position returned by wal_append.
+ * @return 0 once it is durable, -1 if the log could not be written.
+ */
+int wal_commit(Wal *wal, uint64_t lsn) {
+    pthread_mutex_lock(&wal->lock);
+    wal->waiters++;
+    pthread_cond_signal(&wal->work);
+    while (wal->durable_lsn < lsn && !wal->failed) {
+        pthread_cond_wait(&wal->synced, &wal->lock);
+    }
+    wal->waiters--;
+    int status = wal->durable_lsn >= lsn ? 0 : -1;
+    pthread_mutex_unlock(&wal->lock);
+    return status;
+}
+
+/**
+ * @brief Waits until everything appended so far is durable.
+ * @param wal The log.
+ * @return 0 on success, -1 if the log could not be written.
+ */
+int wal_sync(Wal *wal) {
+    pthread_mutex_lock(&wal->lock);
+    uint64_t lsn = wal->appended_lsn;
+    pthread_mutex_unlock(&wal->lock);
+    return wal_commit(wal, lsn);
+}
+
+/**
+ * @brief Empties the log after a checkpoint. Records still buffered are
+ * dropped: the caller has made their writes durable in the data files.
+ * @param wal The log.
+ * @return 0 on success, -1 if the file could not be truncated.
+ */
+int wal_reset(Wal *wal) {
+    pthread_mutex_lock(&wal->lock);
+    while (wal->flushing) pthread_cond_wait(&wal->synced, &wal->lock);
+    int status = 0;
+    if (ftruncate(wal->fd, WAL_FILE_HEADER_SIZE) != 0 || fdatasync(wal->fd) != 0) {
+        perror("Failed to truncate write-ahead log");
+        status = -1;
+    } else {
+        wal->file_size = WAL_FILE_HEADER_SIZE;
+    }
+    wal->length = 0;
+    wal->durable_lsn = wal->appended_lsn;
+    pthread_cond_broadcast(&wal->synced);
+    pthread_mutex_unlock(&wal->lock);
+    return status;
+}
+
+/**
+ * @brief Size of the log including records not yet written.
+ * @param wal The log.
+ * @return Bytes.
+ */
+uint64_t wal_size(Wal *wal) {
+    pthread_mutex_lock(&wal->lock);
+    uint64_t size = wal->file_size + (wal->appended_lsn - wal->durable_lsn);
+    pthread_mutex_unlock(&wal->lock);
+    return size;
+}
+
+/**
+ * @brief Decodes one record payload into entry (pointing into payload).
+ * @return 0 on success, -1 if the payload is malformed.
+ */
+static int parse_payload(const unsigned char *payload, size_t length, WalEntry *entry, char *name) {
+    const unsigned char *p = payload, *end = payload + length;
+    if (end - p < 2) return -1;
+    entry->type = *p++;
+    size_t name_length = *p++;
+    if ((size_t)(end - p) < name_length + 1) return -1;
+    memcpy(name, p, name_length);
+    name[name_length] = '\0';
+    entry->table = name;
+    p += name_length;
+    entry->write_count = *p++;
+    if (entry->write_count > WAL_MAX_WRITES) return -1;
+    for (int i = 0; i < entry->write_count; i++) {
+        if ((size_t)(end - p) < sizeof(int64_t) + sizeof(uint32_t)) return -1;
+        memcpy(&entry->writes[i].offset, p, sizeof(int64_t));
+        p += sizeof(int64_t);
+        memcpy(&entry->writes[i].length, p, sizeof(uint32_t));
+        p += sizeof(uint32_t);
+        if ((size_t)(end - p) < entry->writes[i].length || entry->writes[i].offset < 0) return -1;
+        entry->writes[i].data = p;
+        p += entry->writes[i].length;
+    }
+    return p == end ? 0 : -1;
+}
+
+/**
+ * @brief Reads back the intact records of a log file.
+ * @param path Path of the log file.
+ * @param apply Called for each record with its position; nonzero stops the replay.
+ * @param context Passed to apply.
+ * @return Number of records read, or -1 if the file exists but can't be read.
+ */
+int wal_replay(const char *path, int (*apply)(void *context, int position, const WalEntry *entry), void *context) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        if (errno == ENOENT) return 0;
+        perror("Failed to open write-ahead log for recovery");
+        return -1;
+    }
+
+    unsigned char header[WAL_FILE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, WAL_FILE_MAGIC, sizeof(WAL_FILE_MAGIC)) != 0) {
+        fclose(file);
+        return 0; // Empty or never completed: nothing was logged
+    }
+
+    unsigned char *payload = NULL;
+    size_t capacity = 0;
+    char name[WAL_MAX_TABLE_NAME + 1];
+    int position = 0;
+    unsigned char record_header[WAL_RECORD_HEADER_SIZE];
+    while (fread(record_header, 1, sizeof(record_header), file) == sizeof(record_header)) {
+        uint32_t length, checksum;
+        memcpy(&length, record_header, sizeof(uint32_t));
+        memcpy(&checksum, record_header + sizeof(uint32_t), sizeof(uint32_t));
+        if (length > capacity) {
+            unsigned char *grown = realloc(payload, length);
+            if (!grown) {
+                perror("Failed to allocate write-ahead log record");
+                break;
+            }
+            payload = grown;
+            capacity = length;
+        }
+        // A short read or bad checksum is a record torn by the crash: the end of the log
+        if (fread(payload, 1, length, file) != length || crc32(payload, length) != checksum) break;
+
+        WalEntry entry;
+        if (parse_payload(payload, length, &entry, name) != 0) break;
+        if (apply(context, position++, &entry) != 0) break;
+    }
+    free(payload);
+    fclose(file);
+    return position;
+}
@@ -0,0 +1,116 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <stddef.h>  // For size_t
+#include <stdint.h>  // For log positions and on-disk fields
+#include <pthread.h> // For the log buffer lock and the flusher thread
+
+// --- Write-Ahead Log ---
+// One log per database records every change to a data file before it is
+// made, as the bytes to write at an offset of a table's .dat file.
+// Concurrent writers append records to a shared buffer; a single flusher
+// thread writes the buffer out and fsyncs once for everything appended since
+// its last sync (group commit). After a crash the records are written to the
+// data files again (replaying one twice is harmless), so a change that reached
+// the log is never lost or half applied.
+//
+// The file is WAL_FILE_MAGIC followed by records:
+//
+//   uint32 length        bytes of the payload
+//   uint32 checksum      CRC-32 of the payload
+//   payload:
+//     uint8  type        WAL_RECORD_WRITE or WAL_RECORD_TABLE_SYNCED
+//     uint8  name length, then the table name
+//     uint8  write count, then for each write:
+//       int64  offset in the table's data file
+//       uint32 length, then the bytes
+//
+// A WAL_RECORD_TABLE_SYNCED record says the table's data file was made
+// durable by other means (compaction, truncation), so earlier records for
+// it must not be replayed. Replay stops at the first torn or corrupt record.
+
+#define WAL_FILE_MAGIC "CRVWAL1"                // 8 bytes with the terminator
+#define WAL_FILE_HEADER_SIZE 8
+#define WAL_MAX_WRITES 4                        // Writes in one record
+#define WAL_MAX_TABLE_NAME 255
+
+// When a row write is durable
+typedef enum {
+    WAL_DURABILITY_OFF = 0,     // No log; data files are flushed to the OS only
+    WAL_DURABILITY_BATCH,       // Logged and fsynced within the flush interval; writers don't wait
+    WAL_DURABILITY_COMMIT       // Writers wait for the group fsync covering their record
+} WalDurability;
+
+#define WAL_RECORD_WRITE 1
+#define WAL_RECORD_TABLE_SYNCED 2
+
+// One write of a record: length bytes at offset of the table's data file
+typedef struct {
+    int64_t offset;
+    const unsigned char *data;
+    uint32_t length;
+} WalWrite;
+
+// A record as read back by wal_replay
+typedef struct {
+    int type;
+    const char *table;                          // Table name
+    WalWrite writes[WAL_MAX_WRITES];
+    int write_count;
+} WalEntry;
+
+typedef struct Wal {
+    int fd;                                     // Log file, opened O_APPEND
+    WalDurability durability;
+    int flush_interval_us;                      // Longest a batch waits before its fsync
+    pthread_mutex_t lock;                       // Guards everything below
+    pthread_cond_t work;                        // Records appended, a sync requested or closing
+    pthread_cond_t synced;                      // A flush finished
+    unsigned char *buffer;                      // Records not yet handed to the flusher
+    size_t length;
+    size_t capacity;
+    unsigned char *flush_buffer;                // Records being written by the flusher
+    size_t flush_capacity;
+    uint64_t appended_lsn;                      // Log position after the last appended record
+    uint64_t durable_lsn;                       // Log position covered by the last fsync
+    uint64_t file_size;                         // Bytes in the log file
+    uint64_t batch_start_us;                    // When the oldest unflushed record was appended
+    int waiters;                                // Writers waiting in wal_commit
+    int flushing;                               // Flusher is writing flush_buffer
+    int failed;                                 // A write or fsync of the log failed
+    int stopping;
+    pthread_t flusher;
+} Wal;
+
+// Opens (or creates) the log at path and starts its flusher thread. durability
+// must not be WAL_DURABILITY_OFF. Existing records are kept: replay them with
+// wal_replay and call wal_reset first. Returns NULL on failure.
+Wal *wal_open(const char *path, WalDurability durability, int flush_interval_us);
+
+// Flushes and fsyncs what is left, stops the flusher and frees the log
+void wal_close(Wal *wal);
+
+// Appends a record of count writes (at most WAL_MAX_WRITES) for table.
+// Returns the log position that makes it durable, or 0 on failure.
+uint64_t wal_append(Wal *wal, int type, const char *table, const WalWrite *writes, int count);
+
+// Waits until the record ending at position lsn has been fsynced.
+// Returns 0, or -1 if the log could not be written.
+int wal_commit(Wal *wal, uint64_t lsn);
+
+// Waits until everything appended so far has been fsynced. Returns 0 or -1.
+int wal_sync(Wal *wal);
+
+// Empties the log. Only valid when every logged write has been made durable
+// in the data files and no record is being appended.
+int wal_reset(Wal *wal);
+
+// Bytes of log written or waiting to be written (drives checkpointing)
+uint64_t wal_size(Wal *wal);
+
+// Calls apply for each intact record of the log file at path, with its
+// position in the log (0, 1, 2...), in order. A missing file has no records.
+// Returns the number of records, or -1 if the file can't be read.
+int wal_replay(const char *path, int (*apply)(void *context, int position, const WalEntry *entry), void *context);
+
+#endif // WAL_H
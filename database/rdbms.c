@@ -1,4 +1,5 @@
 #include "rdbms.h"
+#include "logical/replication.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,8 +8,8 @@
 #define MAX_REGISTERED_MODELS 50 // Maximum number of models the API can register
 
 // --- Model Registry ---
-// Simple static registry to map model names to their schema pointers.
-// A more robust implementation might use a hash map.
+// Static registry mapping model names to their schema pointers, with a hash
+// map of the names so a lookup doesn't compare against every model.
 typedef struct {
     char *name;
     Model *schema;
@@ -16,6 +17,7 @@ typedef struct {
 
 static ModelRegistryEntry model_registry[MAX_REGISTERED_MODELS];
 static int registered_model_count = 0;
+static NameMap model_names; // Model name -> index in model_registry
 static int db_initialized = 0; // Flag to track initialization status
 
 
@@ -28,28 +30,8 @@ static int db_initialized = 0; // Flag to track initialization status
  */
 static Model* find_model_schema_by_name(const char* model_name) {
     if (!model_name) return NULL;
-    for (int i = 0; i < registered_model_count; ++i) {
-        if (model_registry[i].name && strcmp(model_registry[i].name, model_name) == 0) {
-            return model_registry[i].schema;
-        }
-    }
-    return NULL; // Not found
-}
-
-/**
- * @brief Finds the index of a field within a model schema by its name.
- * @param schema Pointer to the Model schema.
- * @param field_name The name of the field to find.
- * @return The index of the field, or -1 if not found.
- */
-static int find_field_index_by_name(const Model* schema, const char* field_name) {
-    if (!schema || !schema->fields || !field_name) return -1;
-    for (int i = 0; i < schema->field_count; ++i) {
-        if (schema->fields[i].name && strcmp(schema->fields[i].name, field_name) == 0) {
-            return i;
-        }
-    }
-    return -1; // Not found
+    int index = name_map_get(&model_names, model_name, strlen(model_name));
+    return index >= 0 ? model_registry[index].schema : NULL; // NULL if not found
 }
 
 
@@ -73,6 +55,7 @@ int db_system_init(const char* db_name) {
 
     // Initialize the model registry
     registered_model_count = 0;
+    name_map_init(&model_names);
     for(int i=0; i<MAX_REGISTERED_MODELS; ++i) {
         model_registry[i].name = NULL;
         model_registry[i].schema = NULL;
@@ -91,6 +74,9 @@ void db_system_shutdown() {
 
     printf("Database API: Shutting down...\n");
 
+    // Replication threads use the tables, so they stop first
+    replication_stop();
+
     // Destroy the database via the logical layer (closes files, destroys tables/indexes)
     if (global_db) {
         destroy_database(global_db);
@@ -109,6 +95,7 @@ void db_system_shutdown() {
         model_registry[i].schema = NULL;
     }
     registered_model_count = 0;
+    name_map_destroy(&model_names);
 
     db_initialized = 0;
     printf("Database API: System shutdown complete.\n");
@@ -137,6 +124,10 @@ Model* db_define_model(const char *name, Field *fields, int field_count, Associa
 
     if (new_model_schema) {
         // Register the successfully created model schema
+        if (name_map_put(&model_names, new_model_schema->name, registered_model_count) != 0) {
+            fprintf(stderr, "Database API: Failed to register model '%s'.\n", name);
+            return NULL;
+        }
         model_registry[registered_model_count].name = new_model_schema->name; // Point to name within schema
         model_registry[registered_model_count].schema = new_model_schema;
         registered_model_count++;
@@ -176,7 +167,7 @@ int db_set_field(ModelInstance* instance, const char* field_name, const char* va
         return -1;
     }
     // Find the index corresponding to the field name
-    int field_index = find_field_index_by_name(instance->model_schema, field_name);
+    int field_index = model_field_index(instance->model_schema, field_name);
     if (field_index == -1) {
         fprintf(stderr, "Error: Field '%s' not found in model '%s' for db_set_field.\n", field_name, instance->model_schema->name);
         return -1;
@@ -196,7 +187,7 @@ const char* db_get_field(ModelInstance* instance, const char* field_name) {
         return NULL;
     }
     // Find the index corresponding to the field name
-    int field_index = find_field_index_by_name(instance->model_schema, field_name);
+    int field_index = model_field_index(instance->model_schema, field_name);
     if (field_index == -1) {
         // fprintf(stderr, "Error: Field '%s' not found in model '%s' for db_get_field.\n", field_name, instance->model_schema->name); // Reduce noise
         return NULL;
@@ -246,6 +237,47 @@ int db_delete(ModelInstance* instance) {
     return delete_model_instance(instance);
 }
 
+int db_find_range(const char* model_name, int lo, int hi, ModelInstanceCallback callback, void *context) {
+     if (!db_initialized) {
+        fprintf(stderr, "Error: Database system not initialized in db_find_range.\n");
+        return -1;
+    }
+    Model* schema = find_model_schema_by_name(model_name);
+    if (!schema) {
+        fprintf(stderr, "Error: Model schema '%s' not found in db_find_range.\n", model_name);
+        return -1;
+    }
+    // Delegate to the ORM function
+    return find_models_in_range(schema, lo, hi, callback, context);
+}
+
+int db_create_index(const char* model_name, const char* field_name) {
+    if (!db_initialized) {
+        fprintf(stderr, "Error: Database system not initialized in db_create_index.\n");
+        return -1;
+    }
+    Model* schema = find_model_schema_by_name(model_name);
+    if (!schema) {
+        fprintf(stderr, "Error: Model schema '%s' not found in db_create_index.\n", model_name);
+        return -1;
+    }
+    return create_model_index(schema, field_name);
+}
+
+int db_find_where(const char* model_name, const char* field_name, const char* value, int lo, int hi,
+                  ModelInstanceCallback callback, void *context) {
+    if (!db_initialized) {
+        fprintf(stderr, "Error: Database system not initialized in db_find_where.\n");
+        return -1;
+    }
+    Model* schema = find_model_schema_by_name(model_name);
+    if (!schema) {
+        fprintf(stderr, "Error: Model schema '%s' not found in db_find_where.\n", model_name);
+        return -1;
+    }
+    return find_models_where(schema, field_name, value, lo, hi, callback, context);
+}
+
 // --- Utility ---
 
 int db_compact_table(const char* model_name) {
@@ -263,9 +295,82 @@ int db_compact_table(const char* model_name) {
          return -1;
     }
 
-    // Call the logical layer function
-    compact_table(schema->table_ref);
-    // compact_table prints its own messages. We assume success if it returns,
-    // but ideally, it should return a status code.
-    return 0; // Assuming success if function returns
+    // Call the logical layer function (it prints its own messages)
+    return compact_table(schema->table_ref);
+}
+
+int db_set_mmap(int enabled) {
+    if (!db_initialized || !global_db) {
+        fprintf(stderr, "Error: Database system not initialized in db_set_mmap.\n");
+        return -1;
+    }
+    global_db->mmap_tables = enabled ? 1 : 0;
+    return 0;
+}
+
+int db_set_row_cache(int entries) {
+    if (!db_initialized || !global_db) {
+        fprintf(stderr, "Error: Database system not initialized in db_set_row_cache.\n");
+        return -1;
+    }
+    global_db->row_cache_entries = entries > 0 ? entries : 0;
+    return 0;
+}
+
+int db_set_table_shards(int shards) {
+    if (!db_initialized || !global_db) {
+        fprintf(stderr, "Error: Database system not initialized in db_set_table_shards.\n");
+        return -1;
+    }
+    if (shards < 1 || shards > MAX_TABLE_SHARDS) {
+        fprintf(stderr, "Error: A table can have 1 to %d shards.\n", MAX_TABLE_SHARDS);
+        return -1;
+    }
+    global_db->table_shards = shards;
+    return 0;
+}
+
+int db_set_io(DataIoBackend backend) {
+    if (!db_initialized || !global_db) {
+        fprintf(stderr, "Error: Database system not initialized in db_set_io.\n");
+        return -1;
+    }
+    if (backend == DATA_IO_URING && !data_io_probe()) {
+        global_db->io_backend = DATA_IO_STDIO;
+        return -1;
+    }
+    global_db->io_backend = backend;
+    return 0;
+}
+
+int db_set_durability(WalDurability durability, int flush_interval_us) {
+    if (!db_initialized || !global_db) {
+        fprintf(stderr, "Error: Database system not initialized in db_set_durability.\n");
+        return -1;
+    }
+    return open_database_log(global_db, durability, flush_interval_us);
+}
+
+int db_start_compactor(double dead_ratio, long bytes_per_second) {
+    if (!db_initialized || !global_db) {
+        fprintf(stderr, "Error: Database system not initialized in db_start_compactor.\n");
+        return -1;
+    }
+    return start_compactor(global_db, dead_ratio, bytes_per_second);
+}
+
+int db_start_replication(int port) {
+    if (!db_initialized || !global_db) {
+        fprintf(stderr, "Error: Database system not initialized in db_start_replication.\n");
+        return -1;
+    }
+    return replication_start_primary(global_db, port);
+}
+
+int db_replicate_from(const char* host, int port) {
+    if (!db_initialized || !global_db) {
+        fprintf(stderr, "Error: Database system not initialized in db_replicate_from.\n");
+        return -1;
+    }
+    return replication_start_replica(global_db, host, port);
 }
@@ -104,18 +104,152 @@ ModelInstance* db_find_by_pk(const char* model_name, int primary_key);
  */
 int db_delete(ModelInstance* instance);
 
+/**
+ * @brief Visits every instance of a model whose primary key is in [lo, hi], in
+ * ascending key order, without copying rows. A range of k rows costs one index
+ * lookup plus k row reads, whatever the table size.
+ * Wrapper around the ORM's find_models_in_range.
+ * @param model_name The name of the model to scan.
+ * @param lo Smallest primary key to visit (inclusive).
+ * @param hi Largest primary key to visit (inclusive).
+ * @param callback Called with each instance, which is only valid during the call:
+ * copy any values to keep (db_get_field works on it), and do not save, delete or
+ * free it. Return nonzero to stop early.
+ * @param context Passed to callback.
+ * @return Number of instances visited, or -1 on failure (e.g., model not found).
+ */
+int db_find_range(const char* model_name, int lo, int hi, ModelInstanceCallback callback, void *context);
+
+/**
+ * @brief Creates a secondary index on a field so db_find_where can look values
+ * up in O(1) instead of scanning. The index is kept in memory (and current
+ * across saves and deletes); call this at startup, after db_define_model.
+ * Wrapper around the ORM's create_model_index.
+ * @param model_name The name of the model.
+ * @param field_name The field to index.
+ * @return 0 on success, -1 on failure (e.g., model or field not found).
+ */
+int db_create_index(const char* model_name, const char* field_name);
+
+/**
+ * @brief Visits the instances of a model (primary key in [lo, hi], ascending)
+ * whose field equals value. Uses the field's index when db_create_index was
+ * called for it, and a filtered range scan otherwise. Same callback rules as
+ * db_find_range. Wrapper around the ORM's find_models_where.
+ * @param model_name The name of the model to scan.
+ * @param field_name The field to match.
+ * @param value The value to match, compared as the field's type ("" matches nulls).
+ * @param lo Smallest primary key to visit (inclusive).
+ * @param hi Largest primary key to visit (inclusive).
+ * @param callback Called with each matching instance.
+ * @param context Passed to callback.
+ * @return Number of instances visited, or -1 on failure.
+ */
+int db_find_where(const char* model_name, const char* field_name, const char* value, int lo, int hi,
+                  ModelInstanceCallback callback, void *context);
+
 
 // --- Utility (Optional) ---
-// You might add other API functions here, e.g., for querying based on non-PK fields (would require significant extension),
-// or for triggering table compaction.
+// Table maintenance.
 
 /**
  * @brief Triggers compaction for a specific table.
- * Rewrites the table's data file to remove deleted rows. Expensive operation.
+ * Rewrites the table's data file to remove deleted rows. The table stays
+ * readable and writable except for a short lock at the end.
  * @param model_name The name of the model whose table should be compacted.
  * @return 0 on success, -1 on failure (e.g., model not found).
  */
 int db_compact_table(const char* model_name);
 
+/**
+ * @brief Chooses how tables defined from now on read their rows: through a
+ * read-only memory map of the data file (mmap mode) or with pread (default).
+ * Call after db_system_init() and before defining models.
+ * @param enabled 1 for mmap mode, 0 for pread.
+ * @return 0 on success, -1 if the system is not initialized.
+ */
+int db_set_mmap(int enabled);
+
+/**
+ * @brief Sizes the row cache of tables defined from now on: the JSON of up to
+ * entries recently viewed rows per table, kept until the row is updated or
+ * deleted. Call after db_system_init() and before defining models.
+ * @param entries Rows cached per table, 0 for no cache.
+ * @return 0 on success, -1 if the system is not initialized.
+ */
+int db_set_row_cache(int entries);
+
+/**
+ * @brief Hash-partitions tables defined from now on into shards by primary
+ * key: each shard has its own data file, index and lock, so writes to
+ * different shards run in parallel. A table keeps the layout it was first
+ * created with. Call after db_system_init() and before defining models.
+ * @param shards Shards per table (1 to MAX_TABLE_SHARDS), 1 for none.
+ * @return 0 on success, -1 if the system is not initialized or shards is out of range.
+ */
+int db_set_table_shards(int shards);
+
+/**
+ * @brief Chooses how tables defined from now on read and append rows:
+ * DATA_IO_STDIO (pread, and the data file's stdio stream) or DATA_IO_URING
+ * (io_uring, with the rows of a range read in batches). Call after
+ * db_system_init() and before defining models.
+ * @param backend The I/O backend.
+ * @return 0 on success, -1 if the system is not initialized or io_uring is
+ * unavailable (tables then use DATA_IO_STDIO).
+ */
+int db_set_io(DataIoBackend backend);
+
+/**
+ * @brief Chooses when saves and deletes are durable, and recovers the changes
+ * a crash left in the write-ahead log. Call after db_system_init() and before
+ * defining models.
+ * - WAL_DURABILITY_OFF: no log; writes reach the OS but may be lost (or an
+ *   update half applied) in a power failure.
+ * - WAL_DURABILITY_BATCH: writes are logged and fsynced in groups at least
+ *   every flush_interval_us; a crash loses at most that window.
+ * - WAL_DURABILITY_COMMIT: each save or delete returns after the group fsync
+ *   covering it; concurrent writers share one fsync.
+ * @param durability The durability mode.
+ * @param flush_interval_us Longest a batched write waits for its fsync (microseconds).
+ * @return 0 on success, -1 on failure (e.g., recovery failed).
+ */
+int db_set_durability(WalDurability durability, int flush_interval_us);
+
+/**
+ * @brief Starts compacting tables in the background: a table is compacted once
+ * its deleted and superseded rows make up dead_ratio of its data file (and at
+ * least COMPACT_MIN_DEAD_BYTES). Call after defining models.
+ * @param dead_ratio Dead share of a data file that triggers compaction (> 0).
+ * @param bytes_per_second Limit on compaction reads and writes, 0 for none.
+ * @return 0 on success, -1 on failure.
+ */
+int db_start_compactor(double dead_ratio, long bytes_per_second);
+
+
+// --- Replication ---
+
+/**
+ * @brief Makes this server a replication primary: every save and delete from
+ * now on is recorded in an in-memory change stream, and replicas connecting
+ * on port get a snapshot of the tables and then the stream. Writers never
+ * wait for a replica. Call after defining models and before serving writes.
+ * @param port TCP port replicas connect to.
+ * @return 0 on success, -1 on failure (e.g., the port is taken).
+ */
+int db_start_replication(int port);
+
+/**
+ * @brief Makes this server a read replica of the primary at host:port. Its
+ * tables are emptied and copied from the primary, then kept up to date in
+ * the background; reconnects (resuming where the stream left off when the
+ * primary still has it) happen automatically. Models must be defined with the
+ * same fields as on the primary. Call after defining models.
+ * @param host Host name or address of the primary.
+ * @param port The primary's replication port.
+ * @return 0 on success, -1 on failure (e.g., the host can't be resolved).
+ */
+int db_replicate_from(const char* host, int port);
+
 
 #endif // RDBMS_H
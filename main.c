@@ -13,15 +13,149 @@
 #include "database/logical/database.h"
 #include "database/rdbms.h"
 #include "utils/path_utils.h"
+#include "utils/log.h"
+#include "utils/metrics.h"
 
 volatile sig_atomic_t running = 1;
 
 void handle_shutdown(int sig) {
+    (void)sig;
     printf("\nShutting down the server gracefully...\n");
     running = 0;
+    stop_server();
 }
 
-void scaffold_resource(const char* resource_name, const char* attributes[], const char* types[], int attr_count) {
+// Storage options from the command line
+typedef struct {
+    int use_mmap;
+    int row_cache_entries;      // Per table, 0 disables the row cache
+    DataIoBackend io_backend;
+    int table_shards;           // Shards of new tables, 1 for none
+    WalDurability durability;
+    int flush_interval_us;
+    double compact_ratio;       // 0 disables background compaction
+    long compact_rate;          // Bytes per second, 0 for no limit
+    int replication_port;       // Port replicas connect to, 0 when not a primary
+    char replica_host[256];     // Primary this server replicates, "" when not a replica
+    int replica_port;
+} StorageOptions;
+
+// Parse server options: --port N, --loops N (event loop threads), --workers N (worker pool size),
+// --keepalive-timeout S (idle seconds, 0 disables keep-alive), --max-requests N (per connection),
+// --max-connections N (open connections, 0 for the fd limit), --max-in-flight N (requests at the
+// workers before more are shed with 503, 0 for no cap), --read-timeout S / --write-timeout S
+// (request arrival and response progress deadlines, 0 disables),
+// --mmap (read table data files through a memory map), --row-cache N (rows cached per
+// table, 0 disables), --durability off|batch|commit
+// (when writes are fsynced), --wal-interval US (longest a batched write waits for its fsync),
+// --compact-ratio R (dead share of a table that triggers compaction, 0 disables),
+// --compact-rate MB (compaction I/O in MB per second, 0 for no limit),
+// --log-level debug|info|warn|error|off, --no-metrics (stop recording metrics),
+// --io uring|stdio (data file I/O; uring falls back to stdio where unavailable),
+// --shards N (hash-partition new tables into N shards by primary key),
+// --compress-level N (gzip/deflate level of responses, 0 disables),
+// --compress-min-size BYTES (smallest response body compressed),
+// --replication-port N (serve replicas on N), --replica-of HOST:PORT (follow that primary, read-only)
+static int parse_server_args(int argc, char *argv[], ServerConfig *config, StorageOptions *storage) {
+    server_config_defaults(config);
+    storage->use_mmap = 0;
+    storage->row_cache_entries = ROW_CACHE_DEFAULT_ENTRIES;
+    storage->io_backend = DATA_IO_URING;
+    storage->table_shards = 1;
+    storage->durability = WAL_DURABILITY_BATCH;
+    storage->flush_interval_us = WAL_DEFAULT_FLUSH_INTERVAL_US;
+    storage->compact_ratio = COMPACT_DEFAULT_DEAD_RATIO;
+    storage->compact_rate = COMPACT_DEFAULT_RATE;
+    storage->replication_port = 0;
+    storage->replica_host[0] = '\0';
+    storage->replica_port = 0;
+    int compress_level = COMPRESSION_DEFAULT_LEVEL;
+    long compress_min_size = COMPRESSION_DEFAULT_MIN_SIZE;
+    for (int i = 1; i < argc; i++) {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--mmap") == 0) {
+            storage->use_mmap = 1;
+            continue; // Takes no value
+        }
+        if (strcmp(argv[i], "--no-metrics") == 0) {
+            metrics_set_enabled(0);
+            continue;
+        }
+        LogLevel level;
+        if (strcmp(argv[i], "--log-level") == 0 && value && log_parse_level(value, &level) == 0) {
+            log_set_level(level);
+        } else if (strcmp(argv[i], "--durability") == 0 && value &&
+            (strcmp(value, "off") == 0 || strcmp(value, "batch") == 0 || strcmp(value, "commit") == 0)) {
+            storage->durability = strcmp(value, "off") == 0 ? WAL_DURABILITY_OFF
+                                : strcmp(value, "batch") == 0 ? WAL_DURABILITY_BATCH : WAL_DURABILITY_COMMIT;
+        } else if (strcmp(argv[i], "--io") == 0 && value &&
+                   (strcmp(value, "uring") == 0 || strcmp(value, "stdio") == 0)) {
+            storage->io_backend = strcmp(value, "uring") == 0 ? DATA_IO_URING : DATA_IO_STDIO;
+        } else if (strcmp(argv[i], "--shards") == 0 && value && atoi(value) >= 1 &&
+                   atoi(value) <= MAX_TABLE_SHARDS) {
+            storage->table_shards = atoi(value);
+        } else if (strcmp(argv[i], "--row-cache") == 0 && value && atoi(value) >= 0) {
+            storage->row_cache_entries = atoi(value);
+        } else if (strcmp(argv[i], "--wal-interval") == 0 && value && atoi(value) > 0) {
+            storage->flush_interval_us = atoi(value);
+        } else if (strcmp(argv[i], "--compact-ratio") == 0 && value && atof(value) >= 0) {
+            storage->compact_ratio = atof(value);
+        } else if (strcmp(argv[i], "--compact-rate") == 0 && value && atol(value) >= 0) {
+            storage->compact_rate = atol(value) << 20;
+        } else if (strcmp(argv[i], "--compress-level") == 0 && value && atoi(value) >= 0 && atoi(value) <= 9) {
+            compress_level = atoi(value);
+        } else if (strcmp(argv[i], "--compress-min-size") == 0 && value && atol(value) >= 0) {
+            compress_min_size = atol(value);
+        } else if (strcmp(argv[i], "--replication-port") == 0 && value && atoi(value) > 0) {
+            storage->replication_port = atoi(value);
+        } else if (strcmp(argv[i], "--replica-of") == 0 && value && strrchr(value, ':') &&
+                   atoi(strrchr(value, ':') + 1) > 0 &&
+                   (size_t)(strrchr(value, ':') - value) < sizeof(storage->replica_host)) {
+            size_t host_length = (size_t)(strrchr(value, ':') - value);
+            memcpy(storage->replica_host, value, host_length);
+            storage->replica_host[host_length] = '\0';
+            storage->replica_port = atoi(strrchr(value, ':') + 1);
+            config->read_only = 1;
+        } else if (strcmp(argv[i], "--port") == 0 && value) {
+            config->port = atoi(value);
+        } else if (strcmp(argv[i], "--loops") == 0 && value) {
+            config->event_loops = atoi(value);
+        } else if (strcmp(argv[i], "--workers") == 0 && value) {
+            config->worker_threads = atoi(value);
+        } else if (strcmp(argv[i], "--keepalive-timeout") == 0 && value) {
+            config->keepalive_timeout = atoi(value);
+        } else if (strcmp(argv[i], "--max-requests") == 0 && value) {
+            config->max_keepalive_requests = atoi(value);
+        } else if (strcmp(argv[i], "--max-connections") == 0 && value && atoi(value) >= 0) {
+            config->max_connections = atoi(value);
+        } else if (strcmp(argv[i], "--max-in-flight") == 0 && value && atoi(value) >= 0) {
+            config->max_in_flight = atoi(value);
+        } else if (strcmp(argv[i], "--read-timeout") == 0 && value && atoi(value) >= 0) {
+            config->read_timeout = atoi(value);
+        } else if (strcmp(argv[i], "--write-timeout") == 0 && value && atoi(value) >= 0) {
+            config->write_timeout = atoi(value);
+        } else {
+            fprintf(stderr, "Usage: %s [--port N] [--loops N] [--workers N] "
+                    "[--keepalive-timeout S] [--max-requests N] [--max-connections N] [--max-in-flight N] "
+                    "[--read-timeout S] [--write-timeout S] [--mmap] [--row-cache N] "
+                    "[--durability off|batch|commit] [--wal-interval US] "
+                    "[--compact-ratio R] [--compact-rate MB] "
+                    "[--log-level debug|info|warn|error|off] [--no-metrics] [--io uring|stdio] "
+                    "[--shards N] [--compress-level N] [--compress-min-size BYTES] "
+                    "[--replication-port N | --replica-of HOST:PORT]\n", argv[0]);
+            return -1;
+        }
+        i++; // Skip the option value
+    }
+    if (storage->replication_port && storage->replica_host[0]) {
+        fprintf(stderr, "Error: A server is either a primary (--replication-port) or a replica (--replica-of).\n");
+        return -1;
+    }
+    compression_configure(compress_level, (size_t)compress_min_size);
+    return 0;
+}
+
+void scaffold_resource(const char* resource_name, const char* attributes[], const char* types[], const int indexed[], int attr_count) {
     // Generate the scaffolding files
     scaffold_model(resource_name, attributes, types, attr_count);
     generate_controller_code(resource_name);
@@ -48,6 +182,13 @@ void scaffold_resource(const char* resource_name, const char* attributes[], cons
     Model* model = register_model(resource_name, fields, attr_count);
     if (!model) {
         fprintf(stderr, "Error: Failed to register model %s with the ORM\n", resource_name);
+    } else {
+        // Secondary indexes are in memory, so they are rebuilt from the table here
+        for (int i = 0; i < attr_count; i++) {
+            if (indexed[i] && create_model_index(model, attributes[i]) != 0) {
+                fprintf(stderr, "Warning: Could not index %s.%s\n", resource_name, attributes[i]);
+            }
+        }
     }
     
     // Register the routes for this resource
@@ -59,7 +200,13 @@ void scaffold_resource(const char* resource_name, const char* attributes[], cons
     // In a production app, there would be a cleanup function when shutting down
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+    ServerConfig server_config;
+    StorageOptions storage;
+    if (parse_server_args(argc, argv, &server_config, &storage) != 0) {
+        return 1;
+    }
+
     signal(SIGINT, handle_shutdown);
     
     // Initialize the database via the RDBMS API layer
@@ -68,6 +215,17 @@ int main() {
         fprintf(stderr, "Error: Failed to initialize database. Exiting.\n");
         return 1;
     }
+    db_set_mmap(storage.use_mmap);
+    db_set_row_cache(storage.row_cache_entries);
+    db_set_table_shards(storage.table_shards);
+    if (db_set_io(storage.io_backend) != 0) {
+        printf("io_uring is not available; table files use pread and stdio.\n");
+    }
+    if (db_set_durability(storage.durability, storage.flush_interval_us) != 0) {
+        fprintf(stderr, "Error: Failed to recover or open the write-ahead log. Exiting.\n");
+        db_system_shutdown();
+        return 1;
+    }
     
     // Initialize model registry without default models
     printf("Initializing model system...\n");
@@ -96,6 +254,7 @@ int main() {
     
     printf("Enter attribute format:\n");
     printf("  name:type,another_name:type,...\n");
+    printf("  (append :index to a type to look rows up by it, e.g. author:string:index)\n");
     printf("Example: id:int,title:string,price:float,description:text,published:date\n\n");
     
     printf("Enter the resource attributes: ");
@@ -103,6 +262,7 @@ int main() {
     input[strcspn(input, "\n")] = 0;
 
     const char *attributes[100], *types[100];
+    int indexed[100];
     int attr_count = 0;
 
     char *saveptr_outer, *saveptr_inner;
@@ -113,12 +273,14 @@ int main() {
 
         char *attribute = strtok_r(token, ":", &saveptr_inner);
         char *type      = strtok_r(NULL,  ":", &saveptr_inner);
-        if (attribute && type) {
+        char *option    = strtok_r(NULL,  ":", &saveptr_inner);
+        if (attribute && type && attr_count < 100) {
             // Trim whitespace from both sides
             while (*attribute == ' ') attribute++;
             while (*type == ' ') type++;
             attributes[attr_count] = strdup(attribute);
             types[attr_count]      = strdup(type);
+            indexed[attr_count]    = option && strncmp(option, "index", 5) == 0;
             attr_count++;
         }
         token = strtok_r(NULL, ",", &saveptr_outer);
@@ -137,7 +299,7 @@ int main() {
         printf("\nCreating resource '%s' with %d attributes...\n", resource_name, attr_count);
         
         // Scaffold the resource
-        scaffold_resource(resource_name, attributes, types, attr_count);
+        scaffold_resource(resource_name, attributes, types, indexed, attr_count);
 
         // Now that the model is registered in route_handlers, wire up the HTTP routes
         printf("Setting up routes...\n");
@@ -168,6 +330,7 @@ int main() {
         printf("  POST   /%s      - Create a new %s\n", lowercase_resource, lowercase_resource);
         printf("  PATCH  /%s/:id  - Update a %s\n", lowercase_resource, lowercase_resource);
         printf("  DELETE /%s/:id  - Delete a %s\n", lowercase_resource, lowercase_resource);
+        printf("  GET    /metrics - Server and table metrics (Prometheus text format)\n");
     }
     
     // Clean up
@@ -176,12 +339,37 @@ int main() {
         free((void*)types[i]);
     }
     
+    // From here on, log messages are written by a background thread
+    if (log_start() != 0) {
+        fprintf(stderr, "Warning: Logging synchronously.\n");
+    }
+
+    // Tables are defined now, so the compactor can watch them
+    if (storage.compact_ratio > 0 && db_start_compactor(storage.compact_ratio, storage.compact_rate) != 0) {
+        fprintf(stderr, "Warning: Background compaction is not running.\n");
+    }
+
+    // Replication starts once the tables exist and before any request can write
+    if (storage.replication_port && db_start_replication(storage.replication_port) != 0) {
+        fprintf(stderr, "Error: Failed to start serving replicas. Exiting.\n");
+        log_stop();
+        db_system_shutdown();
+        return 1;
+    }
+    if (storage.replica_host[0] && db_replicate_from(storage.replica_host, storage.replica_port) != 0) {
+        fprintf(stderr, "Error: Failed to start replicating. Exiting.\n");
+        log_stop();
+        db_system_shutdown();
+        return 1;
+    }
+
     // Start the server
-    printf("Starting server on port 3000...\n");
+    printf("Starting server on port %d...\n", server_config.port);
     printf("Server is now running. Press Ctrl+C to stop.\n");
-    start_server("3000");
+    start_server_with_config(&server_config);
     
-    // Clean up database resources
+    // Write out queued log messages, then clean up database resources
+    log_stop();
     db_system_shutdown();
 
     return 0;
@@ -4,10 +4,12 @@
 #include "model_setup.h"
 #include "../database/application/orm.h"
 
-// Global registry of models
+// Global registry of models. Models are registered at startup, before the
+// server runs; requests only look them up.
 #define MAX_MODELS 100
 static Model *model_registry[MAX_MODELS];
 static int model_count = 0;
+static NameMap model_names;  // Model name -> index in model_registry
 
 // Register a model with the ORM
 Model* register_model(const char* model_name, Field* fields, int field_count) {
@@ -30,6 +32,10 @@ Model* register_model(const char* model_name, Field* fields, int field_count) {
     }
     
     // Store the model in the registry
+    if (name_map_put(&model_names, model->name, model_count) != 0) {
+        fprintf(stderr, "Error: Failed to register model %s\n", model_name);
+        return NULL;
+    }
     model_registry[model_count++] = model;
     
     printf("Model '%s' registered with the ORM\n", model_name);
@@ -38,12 +44,21 @@ Model* register_model(const char* model_name, Field* fields, int field_count) {
 
 // Find a model by name
 Model* find_model_by_name(const char* model_name) {
-    for (int i = 0; i < model_count; i++) {
-        if (strcmp(model_registry[i]->name, model_name) == 0) {
-            return model_registry[i];
-        }
+    if (!model_name) return NULL;
+    int index = name_map_get(&model_names, model_name, strlen(model_name));
+    return index >= 0 ? model_registry[index] : NULL;
+}
+
+// Attach generated fast paths to a model
+int register_model_codec(const char* model_name, const ModelCodec *codec) {
+    Model *model = find_model_by_name(model_name);
+    if (!model) {
+        fprintf(stderr, "Error: Cannot register a codec for unknown model %s\n", model_name ? model_name : "(null)");
+        return -1;
     }
-    return NULL;
+    model->codec = codec;
+    printf("Codec registered for model '%s'\n", model_name);
+    return 0;
 }
 
 // Register all models with the ORM
@@ -12,4 +12,9 @@ Model* register_model(const char* model_name, Field* fields, int field_count);
 // Find a previously registered model by name. Returns NULL if not found.
 Model* find_model_by_name(const char* model_name);
 
+// Give a registered model the JSON fast paths generated for it (codec stays
+// owned by the caller and must outlive the model). Call before serving.
+// Returns 0, or -1 if no such model is registered.
+int register_model_codec(const char* model_name, const ModelCodec *codec);
+
 #endif
\ No newline at end of file
@@ -24,6 +24,145 @@ char* to_lowercase(const char* str) {
     return result;
 }
 
+// How the generated codec converts a field, from its declared type
+typedef enum { CODEC_INT, CODEC_FLOAT, CODEC_DOUBLE, CODEC_BOOL, CODEC_TEXT } CodecKind;
+
+static CodecKind codec_kind(const char *type) {
+    if (is_array_type(type)) return CODEC_TEXT;
+    if (strcmp(type, "float") == 0) return CODEC_FLOAT;
+    if (strcmp(type, "double") == 0) return CODEC_DOUBLE;
+    if (strcmp(type, "boolean") == 0 || strcmp(type, "bool") == 0) return CODEC_BOOL;
+    return CODEC_INT;
+}
+
+// Length of the JSON member name of attribute i as the codec writes it:
+// "{" or ", ", the quoted name, ": "
+static size_t codec_key_length(ScaffoldModel *model, int i) {
+    return (i == 0 ? 1 : 2) + strlen(model->attrs[i].name) + 4;
+}
+
+// Emit the codec of a model: a member name lookup that switches on length
+// and compares bytes instead of hashing, a JSON writer whose member names
+// are constants, the ModelCodec that hands both to the generic controllers,
+// and conversions between the typed struct and the row values and JSON
+static void generate_codec_code(FILE *file, ScaffoldModel *model) {
+    const char *name = model->name;
+    int count = model->attr_count;
+
+    fprintf(file, "// --- Codec ---\n");
+    fprintf(file, "// Generated from the declared field types. register_%s_codec (call it at\n", name);
+    fprintf(file, "// startup) makes the generic controllers use these JSON paths for %s.\n\n", name);
+
+    // Member name -> field index
+    fprintf(file, "static int %s_field_slot(void *context, const char *name, size_t length) {\n", name);
+    fprintf(file, "    (void)context;\n");
+    fprintf(file, "    switch (length) {\n");
+    for (int i = 0; i < count; i++) {
+        size_t length = strlen(model->attrs[i].name);
+        int seen = 0;
+        for (int j = 0; j < i; j++) seen |= strlen(model->attrs[j].name) == length;
+        if (seen) continue;
+        fprintf(file, "        case %zu:\n", length);
+        for (int j = i; j < count; j++) {
+            if (strlen(model->attrs[j].name) != length) continue;
+            fprintf(file, "            if (memcmp(name, \"%s\", %zu) == 0) return %d;\n",
+                    model->attrs[j].name, length, j);
+        }
+        fprintf(file, "            break;\n");
+    }
+    fprintf(file, "    }\n");
+    fprintf(file, "    return -1;\n");
+    fprintf(file, "}\n\n");
+
+    // Row values -> JSON
+    size_t overhead = 1;
+    fprintf(file, "static void %s_write_json(JsonWriter *writer, char **values) {\n", name);
+    for (int i = 0; i < count; i++) {
+        const char *field = model->attrs[i].name;
+        overhead += codec_key_length(model, i) + 2;
+        fprintf(file, "    json_write_raw(writer, \"%s\\\"%s\\\": \", %zu);\n",
+                i == 0 ? "{" : ", ", field, codec_key_length(model, i));
+        fprintf(file, "    json_write_string(writer, values[%d] ? values[%d] : \"\", values[%d] ? strlen(values[%d]) : 0);\n",
+                i, i, i, i);
+    }
+    fprintf(file, "    json_write_raw(writer, \"}\", 1);\n");
+    fprintf(file, "}\n\n");
+
+    fprintf(file, "static const ModelCodec %s_codec = { %s_field_slot, %s_write_json, %zu };\n\n",
+            name, name, name, overhead);
+    fprintf(file, "int register_%s_codec(void) {\n", name);
+    fprintf(file, "    return register_model_codec(\"%s\", &%s_codec);\n", name, name);
+    fprintf(file, "}\n\n");
+
+    // Row values -> struct
+    fprintf(file, "// Fill a %s from row values (as in ModelInstance data); absent values are zero\n", name);
+    fprintf(file, "void %s_from_values(char **values, %s *row) {\n", name, name);
+    fprintf(file, "    memset(row, 0, sizeof(*row));\n");
+    for (int i = 0; i < count; i++) {
+        const char *field = model->attrs[i].name;
+        fprintf(file, "    if (values[%d]) ", i);
+        switch (codec_kind(model->attrs[i].type)) {
+            case CODEC_FLOAT:
+                fprintf(file, "row->%s = strtof(values[%d], NULL);\n", field, i);
+                break;
+            case CODEC_DOUBLE:
+                fprintf(file, "row->%s = strtod(values[%d], NULL);\n", field, i);
+                break;
+            case CODEC_BOOL:
+                fprintf(file, "row->%s = strcmp(values[%d], \"true\") == 0 || strcmp(values[%d], \"1\") == 0;\n",
+                        field, i, i);
+                break;
+            case CODEC_TEXT:
+                fprintf(file, "strncpy(row->%s, values[%d], sizeof(row->%s) - 1);\n", field, i, field);
+                break;
+            default:
+                fprintf(file, "row->%s = (int)strtol(values[%d], NULL, 10);\n", field, i);
+                break;
+        }
+    }
+    fprintf(file, "}\n\n");
+
+    // Struct -> instance values
+    fprintf(file, "// Set every field of an instance from a %s. Returns 0, or -1 if out of memory.\n", name);
+    fprintf(file, "int %s_to_instance(const %s *row, ModelInstance *instance) {\n", name, name);
+    fprintf(file, "    char text[32];\n");
+    fprintf(file, "    int status = 0;\n");
+    for (int i = 0; i < count; i++) {
+        const char *field = model->attrs[i].name;
+        switch (codec_kind(model->attrs[i].type)) {
+            case CODEC_FLOAT:
+                fprintf(file, "    snprintf(text, sizeof(text), \"%%.9g\", row->%s);\n", field);
+                break;
+            case CODEC_DOUBLE:
+                fprintf(file, "    snprintf(text, sizeof(text), \"%%.17g\", row->%s);\n", field);
+                break;
+            case CODEC_BOOL:
+                fprintf(file, "    strcpy(text, row->%s ? \"true\" : \"false\");\n", field);
+                break;
+            case CODEC_TEXT:
+                fprintf(file, "    status |= set_instance_field(instance, %d, row->%s);\n", i, field);
+                continue;
+            default:
+                fprintf(file, "    snprintf(text, sizeof(text), \"%%d\", row->%s);\n", field);
+                break;
+        }
+        fprintf(file, "    status |= set_instance_field(instance, %d, text);\n", i);
+    }
+    fprintf(file, "    return status == 0 ? 0 : -1;\n");
+    fprintf(file, "}\n\n");
+
+    // JSON -> struct
+    fprintf(file, "// Parse a JSON object into a %s. Returns 0, or -1 if it is malformed.\n", name);
+    fprintf(file, "int %s_decode_json(const char *json, size_t length, %s *row) {\n", name, name);
+    fprintf(file, "    char *values[%d] = { 0 };\n", count);
+    fprintf(file, "    if (json_parse_object(json, length, %s_field_slot, NULL, values, %d, NULL) != 0) return -1;\n",
+            name, count);
+    fprintf(file, "    %s_from_values(values, row);\n", name);
+    fprintf(file, "    for (int i = 0; i < %d; i++) free(values[i]);\n", count);
+    fprintf(file, "    return 0;\n");
+    fprintf(file, "}\n\n");
+}
+
 // Function to create a new model
 void generate_model_code(ScaffoldModel *model) {
     // Convert model name to lowercase
@@ -44,9 +183,11 @@ void generate_model_code(ScaffoldModel *model) {
     snprintf(resource_dir, sizeof(resource_dir), "%s/%s", scaffolded_path, lowercase_name);
     
     // Create the directory (mkdir -p equivalent)
-    char mkdir_cmd[512];
-    snprintf(mkdir_cmd, sizeof(mkdir_cmd), "mkdir -p %s", resource_dir);
-    system(mkdir_cmd);
+    if (make_directories(resource_dir, 0755) != 0) {
+        perror("Failed to create resource directory");
+        free(lowercase_name);
+        return;
+    }
     
     // Create the model file inside the resource directory
     FILE *model_file;
@@ -66,7 +207,8 @@ void generate_model_code(ScaffoldModel *model) {
     fprintf(model_file, "#include <stdio.h>\n");
     fprintf(model_file, "#include <stdlib.h>\n");
     fprintf(model_file, "#include <string.h>\n");
-    fprintf(model_file, "#include \"../database/application/orm.h\"\n\n");
+    fprintf(model_file, "#include \"../database/application/orm.h\"\n");
+    fprintf(model_file, "#include \"../models/model_setup.h\"\n\n");
 
     // Define the model structure (for in-memory use)
     fprintf(model_file, "typedef struct {\n");
@@ -77,6 +219,8 @@ void generate_model_code(ScaffoldModel *model) {
     }
     fprintf(model_file, "} %s;\n\n", model->name);
 
+    generate_codec_code(model_file, model);
+
     // Create function
     fprintf(model_file, "int create_%s(%s *new_%s) {\n", model->name, model->name, model->name);
     fprintf(model_file, "    // Get model schema reference\n");
@@ -296,6 +440,14 @@ void generate_model_code(ScaffoldModel *model) {
             model->name);
     fprintf(header_file, "Model *get_model_schema(const char *model_name);\n\n");
 
+    // Codec prototypes
+    fprintf(header_file, "int register_%s_codec(void);\n", model->name);
+    fprintf(header_file, "void %s_from_values(char **values, %s *row);\n", model->name, model->name);
+    fprintf(header_file, "int %s_to_instance(const %s *row, ModelInstance *instance);\n",
+            model->name, model->name);
+    fprintf(header_file, "int %s_decode_json(const char *json, size_t length, %s *row);\n\n",
+            model->name, model->name);
+
     fprintf(header_file, "#endif /* %s_H */\n", model->name);
 
     fclose(header_file);
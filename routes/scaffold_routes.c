@@ -6,6 +6,8 @@
 #include "scaffold_routes.h"
 #include "../controllers/scaffold_controller.h"
 #include "../utils/path_utils.h"
+#include "../utils/metrics.h"
+#include "../models/model_setup.h"
 
 #define MAX_MODEL_NAME 100
 #define MAX_ROUTE_HANDLERS 100
@@ -13,6 +15,7 @@
 // Structure to hold model route handlers
 typedef struct {
     char model_name[MAX_MODEL_NAME];
+    Model *model;       // Resolved once here, then carried by every route as its data
     RouteHandler index_handler;
     RouteHandler view_handler;
     RouteHandler create_handler;
@@ -47,299 +50,294 @@ char* extract_request_body(HttpRequest *request) {
         return NULL;
     }
     
-    // Just return a copy of the body
-    return strdup(request->body);
+    // The parser NUL-terminates the body inside the connection's buffer, so
+    // it is used in place
+    return request->body;
 }
 
-// Handler for GET /<resource> (index action)
-void handle_index_route(HttpRequest *request, HttpResponse *response, const char *model_name) {
-    (void)request;
-    strcpy(response->content_type, "application/json");
+// Set a JSON body held in a string
+static void set_json_body(HttpResponse *response, const char *json) {
+    set_response_body(response, json, strlen(json));
+}
 
-    ControllerResult *result = indx(model_name);
-    if (result && result->success && result->data) {
-        response->body = strdup((char*)result->data);
+// Send a controller's JSON, as is when it is already in the request's arena
+static void set_result_body(HttpResponse *response, ControllerResult *result) {
+    if (result->arena && result->arena == response->arena) {
+        response->body = result->data;
+        response->body_length = result->data_size;
+        response->body_in_arena = 1;
     } else {
+        set_response_body(response, result->data, result->data_size);
+    }
+}
+
+// Parse a decimal query parameter into [min, INT_MAX]; 0 if valid, -1 otherwise
+static int parse_int_param(const char *value, int min, int *out) {
+    char *end;
+    errno = 0;
+    long number = strtol(value, &end, 10);
+    if (errno != 0 || end == value || *end != '\0' || number < min || number > INT_MAX) return -1;
+    *out = (int)number;
+    return 0;
+}
+
+// Read ?limit=N&after=ID and an optional field=value filter from an index
+// request into cursor; any other parameter must name one of the model's
+// fields, and at most one may be given. Returns 0 if all are valid.
+static int apply_index_params(const char *query_string, IndexCursor **cursor, Model *model) {
+    int count = 0, status = 0, filter = -1;
+    int limit = -1, after = INT_MIN;
+    UrlParam **params = parse_query_string(query_string, &count);
+    for (int i = 0; i < count; i++) {
+        if (strcmp(params[i]->name, "limit") == 0) {
+            if (parse_int_param(params[i]->value, 0, &limit) != 0) status = -1;
+        } else if (strcmp(params[i]->name, "after") == 0) {
+            if (parse_int_param(params[i]->value, INT_MIN, &after) != 0) status = -1;
+        } else if (filter >= 0) {
+            status = -1;
+        } else {
+            filter = i;
+        }
+    }
+
+    if (status == 0) {
+        *cursor = index_cursor_open(model, after, limit);
+        if (*cursor && filter >= 0 &&
+            index_cursor_filter(*cursor, params[filter]->name, params[filter]->value) != 0) {
+            index_cursor_close(*cursor);
+            *cursor = NULL;
+            status = -1;
+        }
+    }
+    free_url_params(params, count);
+    return status;
+}
+
+// ResponseStream callbacks over an IndexCursor
+static const char* index_stream_next(void *state, size_t *length) {
+    return index_cursor_next(state, length);
+}
+
+static void index_stream_release(void *state) {
+    index_cursor_close(state);
+}
+
+// Handler for GET /<resource>s (index action). ?limit=N returns at most N rows
+// and ?after=ID only those with a greater id, so a client pages through by
+// passing the last id it received. ?<field>=<value> only lists rows with that
+// value. The array is streamed while it is read.
+void handle_index_route(HttpRequest *request, HttpResponse *response, Model *model) {
+    strcpy(response->content_type, "application/json");
+
+    IndexCursor *cursor = NULL;
+    if (apply_index_params(request->query_string, &cursor, model) != 0) {
+        strcpy(response->status, "400 Bad Request");
+        set_json_body(response, "{\"error\":\"invalid limit, after or filter parameter\"}");
+        return;
+    }
+
+    if (!cursor) {
         strcpy(response->status, "500 Internal Server Error");
-        response->body = strdup("{\"error\":\"failed to retrieve resources\"}");
+        set_json_body(response, "{\"error\":\"failed to retrieve resources\"}");
+        return;
     }
-    response->body_length = strlen(response->body);
-    if (result) free_controller_result(result);
+    response->stream.next = index_stream_next;
+    response->stream.release = index_stream_release;
+    response->stream.state = cursor;
 }
 
 // Handler for GET /<resource>/:id (view action)
-void handle_view_route(HttpRequest *request, HttpResponse *response, const char *model_name) {
+void handle_view_route(HttpRequest *request, HttpResponse *response, Model *model) {
     int id = parse_id_from_path(request->path);
     strcpy(response->content_type, "application/json");
 
     if (id < 0) {
         strcpy(response->status, "400 Bad Request");
-        response->body = strdup("{\"error\":\"invalid resource ID\"}");
-        response->body_length = strlen(response->body);
+        set_json_body(response, "{\"error\":\"invalid resource ID\"}");
         return;
     }
 
-    ControllerResult *result = view(model_name, id);
+    ControllerResult *result = view_encoded(model, id, response->encoding, request->arena);
     if (result && result->success && result->data) {
-        response->body = strdup((char*)result->data);
+        set_result_body(response, result);
+        response->body_encoded = result->encoded;
     } else {
         strcpy(response->status, "404 Not Found");
-        response->body = strdup("{\"error\":\"resource not found\"}");
+        set_json_body(response, "{\"error\":\"resource not found\"}");
     }
-    response->body_length = strlen(response->body);
     if (result) free_controller_result(result);
 }
 
 // Handler for POST /<resource> (create action)
-void handle_create_route(HttpRequest *request, HttpResponse *response, const char *model_name) {
+void handle_create_route(HttpRequest *request, HttpResponse *response, Model *model) {
     strcpy(response->content_type, "application/json");
 
     char *body = extract_request_body(request);
     if (!body) {
         strcpy(response->status, "400 Bad Request");
-        response->body = strdup("{\"error\":\"missing request body\"}");
-        response->body_length = strlen(response->body);
+        set_json_body(response, "{\"error\":\"missing request body\"}");
         return;
     }
 
-    ControllerResult *result = create(model_name, body);
-    free(body);
+    ControllerResult *result = create(model, body, request->arena);
 
     if (result && result->success && result->data) {
         strcpy(response->status, "201 Created");
-        response->body = strdup((char*)result->data);
+        set_result_body(response, result);
     } else {
         strcpy(response->status, "422 Unprocessable Entity");
-        response->body = strdup("{\"error\":\"failed to create resource\"}");
+        set_json_body(response, "{\"error\":\"failed to create resource\"}");
+    }
+    if (result) free_controller_result(result);
+}
+
+// Handler for POST /<resource>s/bulk (bulk create action)
+void handle_bulk_create_route(HttpRequest *request, HttpResponse *response, Model *model) {
+    strcpy(response->content_type, "application/json");
+
+    char *body = extract_request_body(request);
+    if (!body) {
+        strcpy(response->status, "400 Bad Request");
+        set_json_body(response, "{\"error\":\"missing request body\"}");
+        return;
+    }
+
+    ControllerResult *result = bulk_create(model, body, request->arena);
+
+    if (result && result->success && result->data) {
+        strcpy(response->status, "201 Created");
+        set_result_body(response, result);
+    } else {
+        strcpy(response->status, "422 Unprocessable Entity");
+        set_json_body(response, "{\"error\":\"failed to create resources\"}");
     }
-    response->body_length = strlen(response->body);
     if (result) free_controller_result(result);
 }
 
 // Handler for PATCH /<resource>/:id (update action)
-void handle_update_route(HttpRequest *request, HttpResponse *response, const char *model_name) {
+void handle_update_route(HttpRequest *request, HttpResponse *response, Model *model) {
     int id = parse_id_from_path(request->path);
     strcpy(response->content_type, "application/json");
 
     if (id < 0) {
         strcpy(response->status, "400 Bad Request");
-        response->body = strdup("{\"error\":\"invalid resource ID\"}");
-        response->body_length = strlen(response->body);
+        set_json_body(response, "{\"error\":\"invalid resource ID\"}");
         return;
     }
 
     char *body = extract_request_body(request);
     if (!body) {
         strcpy(response->status, "400 Bad Request");
-        response->body = strdup("{\"error\":\"missing request body\"}");
-        response->body_length = strlen(response->body);
+        set_json_body(response, "{\"error\":\"missing request body\"}");
         return;
     }
 
-    ControllerResult *result = update(model_name, id, body);
-    free(body);
+    ControllerResult *result = update(model, id, body, request->arena);
 
     if (result && result->success && result->data) {
-        response->body = strdup((char*)result->data);
+        set_result_body(response, result);
     } else {
         strcpy(response->status, "404 Not Found");
-        response->body = strdup("{\"error\":\"resource not found\"}");
+        set_json_body(response, "{\"error\":\"resource not found\"}");
     }
-    response->body_length = strlen(response->body);
     if (result) free_controller_result(result);
 }
 
 // Handler for PUT /<resource>/:id (replace action)
-void handle_replace_route(HttpRequest *request, HttpResponse *response, const char *model_name) {
+void handle_replace_route(HttpRequest *request, HttpResponse *response, Model *model) {
     int id = parse_id_from_path(request->path);
     strcpy(response->content_type, "application/json");
 
     if (id < 0) {
         strcpy(response->status, "400 Bad Request");
-        response->body = strdup("{\"error\":\"invalid resource ID\"}");
-        response->body_length = strlen(response->body);
+        set_json_body(response, "{\"error\":\"invalid resource ID\"}");
         return;
     }
 
     char *body = extract_request_body(request);
     if (!body) {
         strcpy(response->status, "400 Bad Request");
-        response->body = strdup("{\"error\":\"missing request body\"}");
-        response->body_length = strlen(response->body);
+        set_json_body(response, "{\"error\":\"missing request body\"}");
         return;
     }
 
-    ControllerResult *result = replace(model_name, id, body);
-    free(body);
+    ControllerResult *result = replace(model, id, body, request->arena);
 
     if (result && result->success && result->data) {
-        response->body = strdup((char*)result->data);
+        set_result_body(response, result);
     } else {
         strcpy(response->status, "404 Not Found");
-        response->body = strdup("{\"error\":\"resource not found\"}");
+        set_json_body(response, "{\"error\":\"resource not found\"}");
     }
-    response->body_length = strlen(response->body);
     if (result) free_controller_result(result);
 }
 
 // Handler for DELETE /<resource>/:id (delete action)
-void handle_delete_route(HttpRequest *request, HttpResponse *response, const char *model_name) {
+void handle_delete_route(HttpRequest *request, HttpResponse *response, Model *model) {
     int id = parse_id_from_path(request->path);
     strcpy(response->content_type, "application/json");
 
     if (id < 0) {
         strcpy(response->status, "400 Bad Request");
-        response->body = strdup("{\"error\":\"invalid resource ID\"}");
-        response->body_length = strlen(response->body);
+        set_json_body(response, "{\"error\":\"invalid resource ID\"}");
         return;
     }
 
-    ControllerResult *result = destroy(model_name, id);
+    ControllerResult *result = destroy(model, id, request->arena);
     if (result && result->success) {
-        response->body = strdup("{\"message\":\"resource deleted successfully\"}");
+        set_json_body(response, "{\"message\":\"resource deleted successfully\"}");
     } else {
         strcpy(response->status, "404 Not Found");
-        response->body = strdup("{\"error\":\"resource not found\"}");
+        set_json_body(response, "{\"error\":\"resource not found\"}");
     }
-    response->body_length = strlen(response->body);
     if (result) free_controller_result(result);
 }
 
-// Closure implementation for HTTP route handlers
-// These wrapper functions allow us to pass the model name to the handler function
-
-struct IndexRouteContext {
-    const char *model_name;
-};
-
-struct ViewRouteContext {
-    const char *model_name;
-};
-
-struct CreateRouteContext {
-    const char *model_name;
-};
-
-struct UpdateRouteContext {
-    const char *model_name;
-};
-
-struct DeleteRouteContext {
-    const char *model_name;
-};
+// Route entry points. Each route is registered per model with the resolved
+// Model as its route data, so the router dispatches straight to the model.
 
 void index_route_handler(HttpRequest *request, HttpResponse *response) {
-    for (int i = 0; i < handler_count; i++) {
-        // Index route is plural: /students, /books, etc.
-        char model_path[MAX_MODEL_NAME + 3]; // +3 for '/', 's', null terminator
-        snprintf(model_path, sizeof(model_path), "/%ss", route_handlers[i].model_name);
-
-        if (strcmp(request->path, model_path) == 0) {
-            handle_index_route(request, response, route_handlers[i].model_name);
-            return;
-        }
-    }
-    
-    // If no match, return 404
-    strcpy(response->status, "404 Not Found");
-    const char *error_msg = "{ \"status\": \"error\", \"message\": \"Resource not found\" }";
-    response->body = strdup(error_msg);
-    response->body_length = strlen(error_msg);
-    strcpy(response->content_type, "application/json");
+    handle_index_route(request, response, request->route_data);
 }
 
 void view_route_handler(HttpRequest *request, HttpResponse *response) {
-    for (int i = 0; i < handler_count; i++) {
-        char model_base[MAX_MODEL_NAME + 1]; // +1 for '/' and null terminator
-        snprintf(model_base, sizeof(model_base), "/%s/", route_handlers[i].model_name);
-        
-        if (strncmp(request->path, model_base, strlen(model_base)) == 0) {
-            handle_view_route(request, response, route_handlers[i].model_name);
-            return;
-        }
-    }
-    
-    // If no match, return 404
-    strcpy(response->status, "404 Not Found");
-    const char *error_msg = "{ \"status\": \"error\", \"message\": \"Resource not found\" }";
-    response->body = strdup(error_msg);
-    response->body_length = strlen(error_msg);
-    strcpy(response->content_type, "application/json");
+    handle_view_route(request, response, request->route_data);
 }
 
 void create_route_handler(HttpRequest *request, HttpResponse *response) {
-    for (int i = 0; i < handler_count; i++) {
-        char model_path[MAX_MODEL_NAME + 2]; // +2 for '/' and null terminator
-        snprintf(model_path, sizeof(model_path), "/%s", route_handlers[i].model_name);
-        
-        if (strcmp(request->path, model_path) == 0) {
-            handle_create_route(request, response, route_handlers[i].model_name);
-            return;
-        }
-    }
-    
-    // If no match, return 404
-    strcpy(response->status, "404 Not Found");
-    const char *error_msg = "{ \"status\": \"error\", \"message\": \"Resource not found\" }";
-    response->body = strdup(error_msg);
-    response->body_length = strlen(error_msg);
-    strcpy(response->content_type, "application/json");
+    handle_create_route(request, response, request->route_data);
+}
+
+void bulk_create_route_handler(HttpRequest *request, HttpResponse *response) {
+    handle_bulk_create_route(request, response, request->route_data);
 }
 
 void update_route_handler(HttpRequest *request, HttpResponse *response) {
-    for (int i = 0; i < handler_count; i++) {
-        char model_base[MAX_MODEL_NAME + 1]; // +1 for '/' and null terminator
-        snprintf(model_base, sizeof(model_base), "/%s/", route_handlers[i].model_name);
-        
-        if (strncmp(request->path, model_base, strlen(model_base)) == 0) {
-            handle_update_route(request, response, route_handlers[i].model_name);
-            return;
-        }
-    }
-    
-    // If no match, return 404
-    strcpy(response->status, "404 Not Found");
-    const char *error_msg = "{ \"status\": \"error\", \"message\": \"Resource not found\" }";
-    response->body = strdup(error_msg);
-    response->body_length = strlen(error_msg);
-    strcpy(response->content_type, "application/json");
+    handle_update_route(request, response, request->route_data);
 }
 
 void replace_route_handler(HttpRequest *request, HttpResponse *response) {
-    for (int i = 0; i < handler_count; i++) {
-        char model_base[MAX_MODEL_NAME + 2];
-        snprintf(model_base, sizeof(model_base), "/%s/", route_handlers[i].model_name);
-
-        if (strncmp(request->path, model_base, strlen(model_base)) == 0) {
-            handle_replace_route(request, response, route_handlers[i].model_name);
-            return;
-        }
-    }
-
-    strcpy(response->status, "404 Not Found");
-    const char *error_msg = "{ \"status\": \"error\", \"message\": \"Resource not found\" }";
-    response->body = strdup(error_msg);
-    response->body_length = strlen(error_msg);
-    strcpy(response->content_type, "application/json");
+    handle_replace_route(request, response, request->route_data);
 }
 
 void delete_route_handler(HttpRequest *request, HttpResponse *response) {
-    for (int i = 0; i < handler_count; i++) {
-        char model_base[MAX_MODEL_NAME + 1]; // +1 for '/' and null terminator
-        snprintf(model_base, sizeof(model_base), "/%s/", route_handlers[i].model_name);
-        
-        if (strncmp(request->path, model_base, strlen(model_base)) == 0) {
-            handle_delete_route(request, response, route_handlers[i].model_name);
-            return;
-        }
+    handle_delete_route(request, response, request->route_data);
+}
+
+// Handler for GET /metrics: every counter and histogram in the Prometheus text format
+void metrics_route_handler(HttpRequest *request, HttpResponse *response) {
+    (void)request;
+    size_t length;
+    char *text = metrics_render(&length);
+    if (!text) {
+        const char *error = "500 Internal Server Error - Failed to render metrics";
+        strcpy(response->status, "500 Internal Server Error");
+        set_response_body(response, error, strlen(error));
+        return;
     }
-    
-    // If no match, return 404
-    strcpy(response->status, "404 Not Found");
-    const char *error_msg = "{ \"status\": \"error\", \"message\": \"Resource not found\" }";
-    response->body = strdup(error_msg);
-    response->body_length = strlen(error_msg);
-    strcpy(response->content_type, "application/json");
+    strcpy(response->content_type, "text/plain; version=0.0.4");
+    response->body = text; // malloc'd, freed with the response
+    response->body_length = length;
 }
 
 // Register a model with its routes
@@ -349,8 +347,16 @@ void register_model_routes(const char *model_name) {
         return;
     }
     
+    // Resolve the model now, so requests don't look it up by name
+    Model *model = find_model_by_name(model_name);
+    if (!model) {
+        fprintf(stderr, "Cannot register routes of unknown model %s\n", model_name);
+        return;
+    }
+
     // Store the model name
     strncpy(route_handlers[handler_count].model_name, model_name, MAX_MODEL_NAME - 1);
+    route_handlers[handler_count].model = model;
     
     // Increment handler count
     handler_count++;
@@ -387,9 +393,11 @@ void generate_routes_code(const char *model_name) {
     snprintf(resource_dir, sizeof(resource_dir), "%s/%s", scaffolded_path, lowercase_name);
     
     // Create the directory (mkdir -p equivalent)
-    char mkdir_cmd[512];
-    snprintf(mkdir_cmd, sizeof(mkdir_cmd), "mkdir -p %s", resource_dir);
-    system(mkdir_cmd);
+    if (make_directories(resource_dir, 0755) != 0) {
+        perror("Failed to create resource directory");
+        free(lowercase_name);
+        return;
+    }
     
     // Create the routes file inside the resource directory
     FILE *routes_file;
@@ -413,13 +421,13 @@ void generate_routes_code(const char *model_name) {
     fprintf(routes_file, "#include <ctype.h>\n");
     fprintf(routes_file, "#include \"../../../controllers/scaffold_controller.h\"\n");
     fprintf(routes_file, "#include \"../../../server/http_server.h\"\n");
-    fprintf(routes_file, "#include \"../../../routes/scaffold_routes.h\"\n\n");
+    fprintf(routes_file, "#include \"../../../routes/scaffold_routes.h\"\n");
+    fprintf(routes_file, "#include \"../../../models/model_setup.h\"\n\n");
 
     // GET /<model> — index handler
     fprintf(routes_file, "// GET /%s — list all %s resources\n", lowercase_name, lowercase_name);
     fprintf(routes_file, "static void %s_index_handler(HttpRequest *req, HttpResponse *res) {\n", lowercase_name);
-    fprintf(routes_file, "    (void)req;\n");
-    fprintf(routes_file, "    ControllerResult *result = indx(\"%s\");\n", model_name);
+    fprintf(routes_file, "    ControllerResult *result = indx(req->route_data, req->arena);\n");
     fprintf(routes_file, "    res->body = result && result->data ? strdup((char*)result->data) : strdup(\"[]\");\n");
     fprintf(routes_file, "    res->body_length = strlen(res->body);\n");
     fprintf(routes_file, "    strcpy(res->content_type, \"application/json\");\n");
@@ -437,7 +445,7 @@ void generate_routes_code(const char *model_name) {
     fprintf(routes_file, "        strcpy(res->content_type, \"application/json\");\n");
     fprintf(routes_file, "        return;\n");
     fprintf(routes_file, "    }\n");
-    fprintf(routes_file, "    ControllerResult *result = view(\"%s\", id);\n", model_name);
+    fprintf(routes_file, "    ControllerResult *result = view(req->route_data, id, req->arena);\n");
     fprintf(routes_file, "    res->body = result && result->data ? strdup((char*)result->data) : strdup(\"{}\");\n");
     fprintf(routes_file, "    res->body_length = strlen(res->body);\n");
     fprintf(routes_file, "    strcpy(res->content_type, \"application/json\");\n");
@@ -455,7 +463,25 @@ void generate_routes_code(const char *model_name) {
     fprintf(routes_file, "        strcpy(res->content_type, \"application/json\");\n");
     fprintf(routes_file, "        return;\n");
     fprintf(routes_file, "    }\n");
-    fprintf(routes_file, "    ControllerResult *result = create(\"%s\", req->body);\n", model_name);
+    fprintf(routes_file, "    ControllerResult *result = create(req->route_data, req->body, req->arena);\n");
+    fprintf(routes_file, "    strcpy(res->status, result && result->success ? \"201 Created\" : \"422 Unprocessable Entity\");\n");
+    fprintf(routes_file, "    res->body = result && result->data ? strdup((char*)result->data) : strdup(\"{}\");\n");
+    fprintf(routes_file, "    res->body_length = strlen(res->body);\n");
+    fprintf(routes_file, "    strcpy(res->content_type, \"application/json\");\n");
+    fprintf(routes_file, "    if (result) free_controller_result(result);\n");
+    fprintf(routes_file, "}\n\n");
+
+    // POST /<model>s/bulk — bulk create handler
+    fprintf(routes_file, "// POST /%ss/bulk — create many %s resources (JSON array or NDJSON)\n", lowercase_name, lowercase_name);
+    fprintf(routes_file, "static void %s_bulk_create_handler(HttpRequest *req, HttpResponse *res) {\n", lowercase_name);
+    fprintf(routes_file, "    if (!req->body) {\n");
+    fprintf(routes_file, "        strcpy(res->status, \"400 Bad Request\");\n");
+    fprintf(routes_file, "        res->body = strdup(\"{\\\"error\\\":\\\"missing body\\\"}\");\n");
+    fprintf(routes_file, "        res->body_length = strlen(res->body);\n");
+    fprintf(routes_file, "        strcpy(res->content_type, \"application/json\");\n");
+    fprintf(routes_file, "        return;\n");
+    fprintf(routes_file, "    }\n");
+    fprintf(routes_file, "    ControllerResult *result = bulk_create(req->route_data, req->body, req->arena);\n");
     fprintf(routes_file, "    strcpy(res->status, result && result->success ? \"201 Created\" : \"422 Unprocessable Entity\");\n");
     fprintf(routes_file, "    res->body = result && result->data ? strdup((char*)result->data) : strdup(\"{}\");\n");
     fprintf(routes_file, "    res->body_length = strlen(res->body);\n");
@@ -481,7 +507,7 @@ void generate_routes_code(const char *model_name) {
     fprintf(routes_file, "        strcpy(res->content_type, \"application/json\");\n");
     fprintf(routes_file, "        return;\n");
     fprintf(routes_file, "    }\n");
-    fprintf(routes_file, "    ControllerResult *result = update(\"%s\", id, req->body);\n", model_name);
+    fprintf(routes_file, "    ControllerResult *result = update(req->route_data, id, req->body, req->arena);\n");
     fprintf(routes_file, "    if (!result || !result->success) strcpy(res->status, \"404 Not Found\");\n");
     fprintf(routes_file, "    res->body = result && result->data ? strdup((char*)result->data) : strdup(\"{}\");\n");
     fprintf(routes_file, "    res->body_length = strlen(res->body);\n");
@@ -508,7 +534,7 @@ void generate_routes_code(const char *model_name) {
     fprintf(routes_file, "        strcpy(res->content_type, \"application/json\");\n");
     fprintf(routes_file, "        return;\n");
     fprintf(routes_file, "    }\n");
-    fprintf(routes_file, "    ControllerResult *result = replace(\"%s\", id, req->body);\n", model_name);
+    fprintf(routes_file, "    ControllerResult *result = replace(req->route_data, id, req->body, req->arena);\n");
     fprintf(routes_file, "    if (!result || !result->success) strcpy(res->status, \"404 Not Found\");\n");
     fprintf(routes_file, "    res->body = result && result->data ? strdup((char*)result->data) : strdup(\"{}\");\n");
     fprintf(routes_file, "    res->body_length = strlen(res->body);\n");
@@ -527,7 +553,7 @@ void generate_routes_code(const char *model_name) {
     fprintf(routes_file, "        strcpy(res->content_type, \"application/json\");\n");
     fprintf(routes_file, "        return;\n");
     fprintf(routes_file, "    }\n");
-    fprintf(routes_file, "    ControllerResult *result = destroy(\"%s\", id);\n", model_name);
+    fprintf(routes_file, "    ControllerResult *result = destroy(req->route_data, id, req->arena);\n");
     fprintf(routes_file, "    if (!result || !result->success) strcpy(res->status, \"404 Not Found\");\n");
     fprintf(routes_file, "    res->body = result && result->data ? strdup((char*)result->data) : strdup(\"{}\");\n");
     fprintf(routes_file, "    res->body_length = strlen(res->body);\n");
@@ -536,18 +562,24 @@ void generate_routes_code(const char *model_name) {
     fprintf(routes_file, "}\n\n");
 
     // Registration function
-    fprintf(routes_file, "// Call this at startup to register all %s routes\n", lowercase_name);
+    fprintf(routes_file, "// Call this at startup, once the model is registered, to register all %s routes.\n", lowercase_name);
+    fprintf(routes_file, "// Each route carries the resolved Model as its route data.\n");
     fprintf(routes_file, "void register_%s_routes() {\n", lowercase_name);
-    fprintf(routes_file, "    char index_path[128], id_path[128];\n");
+    fprintf(routes_file, "    Model *model = find_model_by_name(\"%s\");\n", model_name);
+    fprintf(routes_file, "    char index_path[128], bulk_path[128], id_path[128];\n");
     // Index route is plural: /students, /books, etc.
     fprintf(routes_file, "    snprintf(index_path, sizeof(index_path), \"/%ss\");\n", lowercase_name);
+    fprintf(routes_file, "    snprintf(bulk_path,  sizeof(bulk_path),  \"/%ss/bulk\");\n", lowercase_name);
     fprintf(routes_file, "    snprintf(id_path,    sizeof(id_path),    \"/%s/:id\");\n", lowercase_name);
-    fprintf(routes_file, "    register_route(\"GET\",    index_path, %s_index_handler);\n", lowercase_name);
-    fprintf(routes_file, "    register_route(\"GET\",    id_path,    %s_view_handler);\n", lowercase_name);
-    fprintf(routes_file, "    register_route(\"POST\",   index_path, %s_create_handler);\n", lowercase_name);
-    fprintf(routes_file, "    register_route(\"PATCH\",  id_path,    %s_update_handler);\n", lowercase_name);
-    fprintf(routes_file, "    register_route(\"PUT\",    id_path,    %s_replace_handler);\n", lowercase_name);
-    fprintf(routes_file, "    register_route(\"DELETE\", id_path,    %s_destroy_handler);\n", lowercase_name);
+    fprintf(routes_file, "    register_route_with_data(\"GET\",    index_path, %s_index_handler, model);\n", lowercase_name);
+    fprintf(routes_file, "    register_route_with_data(\"HEAD\",   index_path, %s_index_handler, model);\n", lowercase_name);
+    fprintf(routes_file, "    register_route_with_data(\"GET\",    id_path,    %s_view_handler, model);\n", lowercase_name);
+    fprintf(routes_file, "    register_route_with_data(\"HEAD\",   id_path,    %s_view_handler, model);\n", lowercase_name);
+    fprintf(routes_file, "    register_route_with_data(\"POST\",   index_path, %s_create_handler, model);\n", lowercase_name);
+    fprintf(routes_file, "    register_route_with_data(\"POST\",   bulk_path,  %s_bulk_create_handler, model);\n", lowercase_name);
+    fprintf(routes_file, "    register_route_with_data(\"PATCH\",  id_path,    %s_update_handler, model);\n", lowercase_name);
+    fprintf(routes_file, "    register_route_with_data(\"PUT\",    id_path,    %s_replace_handler, model);\n", lowercase_name);
+    fprintf(routes_file, "    register_route_with_data(\"DELETE\", id_path,    %s_destroy_handler, model);\n", lowercase_name);
     fprintf(routes_file, "}\n");
 
     fclose(routes_file);
@@ -557,11 +589,29 @@ void generate_routes_code(const char *model_name) {
 
 // Function to setup all routes with the HTTP server
 void setup_routes() {
-    // Register all route handlers with the HTTP server
-    register_route("GET", "/*", index_route_handler); // Wildcard for GET index routes
-    register_route("GET", "/*/*", view_route_handler); // Wildcard for GET view routes
-    register_route("POST", "/*", create_route_handler); // Wildcard for POST create routes
-    register_route("PATCH", "/*/*", update_route_handler); // Wildcard for PATCH update routes
-    register_route("PUT",    "/*/*", replace_route_handler); // Wildcard for PUT replace routes
-    register_route("DELETE", "/*/*", delete_route_handler); // Wildcard for DELETE destroy routes
+    // Register the REST routes of every model; the router builds its trie from these
+    for (int i = 0; i < handler_count; i++) {
+        char *model_name = route_handlers[i].model_name;
+        Model *model = route_handlers[i].model;
+        char index_path[MAX_MODEL_NAME + 3]; // Index route is plural: /students, /books, etc.
+        char bulk_path[MAX_MODEL_NAME + 8];
+        char base_path[MAX_MODEL_NAME + 2];
+        char id_path[MAX_MODEL_NAME + 6];
+        snprintf(index_path, sizeof(index_path), "/%ss", model_name);
+        snprintf(bulk_path, sizeof(bulk_path), "/%ss/bulk", model_name);
+        snprintf(base_path, sizeof(base_path), "/%s", model_name);
+        snprintf(id_path, sizeof(id_path), "/%s/:id", model_name);
+
+        register_route_with_data("GET",    index_path, index_route_handler, model);
+        register_route_with_data("HEAD",   index_path, index_route_handler, model);
+        register_route_with_data("GET",    id_path,    view_route_handler, model);
+        register_route_with_data("HEAD",   id_path,    view_route_handler, model);
+        register_route_with_data("POST",   base_path,  create_route_handler, model);
+        register_route_with_data("POST",   bulk_path,  bulk_create_route_handler, model);
+        register_route_with_data("PATCH",  id_path,    update_route_handler, model);
+        register_route_with_data("PUT",    id_path,    replace_route_handler, model);
+        register_route_with_data("DELETE", id_path,    delete_route_handler, model);
+    }
+    register_route_with_data("GET", "/metrics", metrics_route_handler, NULL);
+    register_route_with_data("HEAD", "/metrics", metrics_route_handler, NULL);
 }
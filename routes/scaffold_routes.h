@@ -15,14 +15,19 @@ void register_model_routes(const char *model_name);
 
 // Helper functions for route handlers
 int parse_id_from_path(const char *path);
+// Request body (NUL-terminated, not a copy: valid as long as the request), or NULL
 char* extract_request_body(HttpRequest *request);
 
 // Generic route handler prototypes
-void handle_index_route(HttpRequest *request, HttpResponse *response, const char *model_name);
-void handle_view_route(HttpRequest *request, HttpResponse *response, const char *model_name);
-void handle_create_route(HttpRequest *request, HttpResponse *response, const char *model_name);
-void handle_update_route(HttpRequest *request, HttpResponse *response, const char *model_name);
-void handle_delete_route(HttpRequest *request, HttpResponse *response, const char *model_name);
+void handle_index_route(HttpRequest *request, HttpResponse *response, Model *model);
+void handle_view_route(HttpRequest *request, HttpResponse *response, Model *model);
+void handle_create_route(HttpRequest *request, HttpResponse *response, Model *model);
+void handle_bulk_create_route(HttpRequest *request, HttpResponse *response, Model *model);
+void handle_update_route(HttpRequest *request, HttpResponse *response, Model *model);
+void handle_delete_route(HttpRequest *request, HttpResponse *response, Model *model);
+
+// GET /metrics, registered by setup_routes
+void metrics_route_handler(HttpRequest *request, HttpResponse *response);
 
 // Handler registration function - used after generating model-specific routes
 void setup_routes();
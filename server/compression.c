@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <zlib.h>
+#include "compression.h"
+
+static int compression_level = 0;
+static size_t minimum_size = COMPRESSION_DEFAULT_MIN_SIZE;
+
+struct Compressor {
+    z_stream zlib;
+    unsigned char *output;      // Compressed bytes not handed out yet
+    size_t used;
+    size_t capacity;
+    int handed_out;             // output was returned, so the next call starts it over
+};
+
+// zlib windowBits for an encoding: 16 + 15 asks for the gzip wrapper
+static int window_bits(ContentEncoding encoding) {
+    return encoding == CONTENT_ENCODING_GZIP ? 16 + MAX_WBITS : MAX_WBITS;
+}
+
+void compression_configure(int level, size_t min_size) {
+    compression_level = level < 0 ? 0 : level > 9 ? 9 : level;
+    minimum_size = min_size;
+}
+
+int compression_enabled() {
+    return compression_level > 0;
+}
+
+size_t compression_min_size() {
+    return minimum_size;
+}
+
+// Parses the q-value of one Accept-Encoding item ("gzip;q=0.5"), 1 if none
+static double item_quality(const char *params, const char *end) {
+    while (params < end) {
+        while (params < end && (*params == ';' || isspace((unsigned char)*params))) params++;
+        if (end - params >= 2 && tolower((unsigned char)params[0]) == 'q' && params[1] == '=') {
+            return strtod(params + 2, NULL);
+        }
+        while (params < end && *params != ';') params++;
+    }
+    return 1.0;
+}
+
+ContentEncoding compression_negotiate(const char *accept_encoding) {
+    if (!compression_enabled() || !accept_encoding) return CONTENT_ENCODING_IDENTITY;
+
+    // -1: not mentioned; "*" stands for any encoding not mentioned
+    double gzip = -1, deflate = -1, any = -1;
+    const char *item = accept_encoding;
+    while (*item) {
+        while (*item == ',' || isspace((unsigned char)*item)) item++;
+        const char *end = item;
+        while (*end && *end != ',') end++;
+        const char *name_end = item;
+        while (name_end < end && *name_end != ';' && !isspace((unsigned char)*name_end)) name_end++;
+
+        size_t name_length = (size_t)(name_end - item);
+        double quality = item_quality(name_end, end);
+        if ((name_length == 4 && strncasecmp(item, "gzip", 4) == 0) ||
+            (name_length == 6 && strncasecmp(item, "x-gzip", 6) == 0)) {
+            gzip = quality;
+        } else if (name_length == 7 && strncasecmp(item, "deflate", 7) == 0) {
+            deflate = quality;
+        } else if (name_length == 1 && *item == '*') {
+            any = quality;
+        }
+        item = end;
+    }
+    if (gzip < 0) gzip = any;
+    if (deflate < 0) deflate = any;
+
+    if (gzip > 0 && gzip >= deflate) return CONTENT_ENCODING_GZIP;
+    if (deflate > 0) return CONTENT_ENCODING_DEFLATE;
+    return CONTENT_ENCODING_IDENTITY;
+}
+
+const char *compression_encoding_name(ContentEncoding encoding) {
+    switch (encoding) {
+        case CONTENT_ENCODING_GZIP: return "gzip";
+        case CONTENT_ENCODING_DEFLATE: return "deflate";
+        default: return NULL;
+    }
+}
+
+static int init_deflate(z_stream *zlib, ContentEncoding encoding) {
+    memset(zlib, 0, sizeof(*zlib));
+    return deflateInit2(zlib, compression_level, Z_DEFLATED, window_bits(encoding), 8,
+                        Z_DEFAULT_STRATEGY) == Z_OK ? 0 : -1;
+}
+
+int compress_buffer(ContentEncoding encoding, const char *data, size_t length, Arena *arena,
+                    char **out, size_t *out_length) {
+    if (encoding == CONTENT_ENCODING_IDENTITY || length == 0) return -1;
+    z_stream zlib;
+    if (init_deflate(&zlib, encoding) != 0) return -1;
+
+    // Only a smaller result is any use, so the output never needs to grow past the input
+    size_t capacity = length;
+    unsigned char *buffer = arena ? arena_alloc(arena, capacity) : malloc(capacity);
+    if (!buffer) {
+        deflateEnd(&zlib);
+        return -1;
+    }
+    zlib.next_in = (unsigned char *)data;
+    zlib.avail_in = (uInt)length;
+    zlib.next_out = buffer;
+    zlib.avail_out = (uInt)capacity;
+    int result = deflate(&zlib, Z_FINISH);
+    size_t produced = capacity - zlib.avail_out;
+    deflateEnd(&zlib);
+
+    if (result != Z_STREAM_END) {
+        if (!arena) free(buffer);
+        return -1;
+    }
+    *out = (char *)buffer;
+    *out_length = produced;
+    return 0;
+}
+
+Compressor *compressor_create(ContentEncoding encoding) {
+    Compressor *compressor = calloc(1, sizeof(Compressor));
+    if (!compressor) return NULL;
+    compressor->capacity = COMPRESSION_CHUNK_SIZE;
+    compressor->output = malloc(compressor->capacity);
+    if (!compressor->output || init_deflate(&compressor->zlib, encoding) != 0) {
+        free(compressor->output);
+        free(compressor);
+        return NULL;
+    }
+    return compressor;
+}
+
+const char *compressor_push(Compressor *compressor, const char *data, size_t length, int finish,
+                            size_t *out_length) {
+    if (compressor->handed_out) {
+        compressor->used = 0;
+        compressor->handed_out = 0;
+    }
+    z_stream *zlib = &compressor->zlib;
+    zlib->next_in = (unsigned char *)data;
+    zlib->avail_in = (uInt)length;
+    int flush = finish ? Z_FINISH : Z_NO_FLUSH;
+    while (1) {
+        if (compressor->used == compressor->capacity) {
+            unsigned char *grown = realloc(compressor->output, compressor->capacity * 2);
+            if (!grown) return NULL;
+            compressor->output = grown;
+            compressor->capacity *= 2;
+        }
+        zlib->next_out = compressor->output + compressor->used;
+        zlib->avail_out = (uInt)(compressor->capacity - compressor->used);
+        int result = deflate(zlib, flush);
+        compressor->used = compressor->capacity - zlib->avail_out;
+        if (result == Z_STREAM_ERROR) return NULL;
+        if (finish ? result == Z_STREAM_END : zlib->avail_in == 0 && zlib->avail_out > 0) break;
+    }
+
+    // Small pieces are gathered into one, so chunk framing stays cheap
+    if (!finish && compressor->used < COMPRESSION_CHUNK_SIZE) {
+        *out_length = 0;
+        return (const char *)compressor->output;
+    }
+    compressor->handed_out = 1;
+    *out_length = compressor->used;
+    return (const char *)compressor->output;
+}
+
+void compressor_destroy(Compressor *compressor) {
+    if (!compressor) return;
+    deflateEnd(&compressor->zlib);
+    free(compressor->output);
+    free(compressor);
+}
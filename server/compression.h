@@ -0,0 +1,65 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <stddef.h>  // For size_t
+#include "../utils/arena.h"
+
+// --- Response Compression ---
+// gzip and deflate (zlib) encoding of response bodies with zlib, negotiated
+// from the request's Accept-Encoding. Whole bodies are compressed in one go
+// when they reach the minimum size (small ones don't shrink enough to pay
+// for it); a streamed body goes through a Compressor piece by piece, since
+// its size isn't known up front. Compression is off until compression_configure
+// sets a level.
+
+#define COMPRESSION_DEFAULT_LEVEL 6         // zlib's default trade-off, used by the server unless told otherwise
+#define COMPRESSION_DEFAULT_MIN_SIZE 1024   // Bodies below this many bytes are sent as is
+#define COMPRESSION_CHUNK_SIZE 16384        // Output a Compressor gathers before handing a piece out
+
+typedef enum {
+    CONTENT_ENCODING_IDENTITY = 0,  // Not encoded
+    CONTENT_ENCODING_GZIP,          // gzip (RFC 1952)
+    CONTENT_ENCODING_DEFLATE        // zlib stream (RFC 1950), which is what HTTP calls deflate
+} ContentEncoding;
+
+// Compressor of a streamed body (see compressor_create)
+typedef struct Compressor Compressor;
+
+// Sets the zlib level (1 fastest to 9 smallest; 0 turns compression off) and
+// the minimum body size. Called once at startup.
+void compression_configure(int level, size_t min_size);
+
+// Returns 1 if responses may be compressed at all
+int compression_enabled();
+
+// Smallest body compressed
+size_t compression_min_size();
+
+// Picks the encoding for a response from an Accept-Encoding value (NULL if
+// the header is absent): gzip or deflate, whichever has the higher q-value
+// (gzip on a tie), or identity if neither is acceptable or compression is off
+ContentEncoding compression_negotiate(const char *accept_encoding);
+
+// Content-Encoding token of an encoding ("gzip", "deflate"), NULL for identity
+const char *compression_encoding_name(ContentEncoding encoding);
+
+// Compresses length bytes of data into arena (NULL: malloc'd) and sets *out
+// and *out_length. Returns 0, or -1 if out of memory or the result would be
+// no smaller than data (then nothing is allocated with malloc).
+int compress_buffer(ContentEncoding encoding, const char *data, size_t length, Arena *arena,
+                    char **out, size_t *out_length);
+
+// Creates a compressor for a stream in the given encoding, or NULL on failure
+Compressor *compressor_create(ContentEncoding encoding);
+
+// Feeds length bytes of input (finish set: the last of it, possibly none) and
+// returns the compressed bytes ready so far with *length set; the piece stays
+// valid until the next call. Returns an empty piece while output builds up
+// below COMPRESSION_CHUNK_SIZE, and NULL on a zlib error.
+const char *compressor_push(Compressor *compressor, const char *data, size_t length, int finish,
+                            size_t *out_length);
+
+// Frees a compressor
+void compressor_destroy(Compressor *compressor);
+
+#endif // COMPRESSION_H
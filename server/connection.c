@@ -0,0 +1,263 @@
+#include <sys/uio.h>
+#include "connection.h"
+#include "../utils/metrics.h"
+
+#define BUFFER_SIZE 8192
+#define HEADER_BUFFER_SIZE 512  // Typical status line + headers; grows when needed
+
+static int received_bytes_metric = -1;
+static int sent_bytes_metric = -1;
+
+// Register the network byte counters
+void connection_metrics_init() {
+    received_bytes_metric = metrics_counter("cerver_http_received_bytes_total",
+                                            "Bytes read from client connections.", NULL);
+    sent_bytes_metric = metrics_counter("cerver_http_sent_bytes_total",
+                                        "Bytes written to client connections.", NULL);
+}
+
+// Allocate a connection for an accepted socket
+Connection* connection_create(int fd, struct EventLoop *loop) {
+    Connection *conn = calloc(1, sizeof(Connection));
+    if (!conn) return NULL;
+
+    conn->in_buffer = malloc(BUFFER_SIZE);
+    if (!conn->in_buffer) {
+        free(conn);
+        return NULL;
+    }
+    conn->in_capacity = BUFFER_SIZE;
+
+    conn->out_headers = malloc(HEADER_BUFFER_SIZE);
+    if (!conn->out_headers) {
+        free(conn->in_buffer);
+        free(conn);
+        return NULL;
+    }
+    conn->out_headers_capacity = HEADER_BUFFER_SIZE;
+    arena_init(&conn->arena, ARENA_DEFAULT_BLOCK_SIZE);
+    conn->fd = fd;
+    conn->loop = loop;
+    conn->state = CONN_READING;
+    http_parser_reset(&conn->parser);
+    return conn;
+}
+
+// Release the producer of a streamed body, if any
+static void release_stream(Connection *conn) {
+    if (conn->out_stream.next && conn->out_stream.release) {
+        conn->out_stream.release(conn->out_stream.state);
+    }
+    memset(&conn->out_stream, 0, sizeof(conn->out_stream));
+}
+
+// Close the socket and free all buffers
+void connection_free(Connection *conn) {
+    if (!conn) return;
+    release_stream(conn);
+    if (conn->fd >= 0) close(conn->fd);
+    free(conn->in_buffer);
+    free(conn->out_headers);
+    if (conn->out_body_owned) free(conn->out_body);
+    arena_destroy(&conn->arena);
+    free(conn);
+}
+
+// Resize the input buffer; the parser only keeps offsets so moving it is safe
+static int resize_input(Connection *conn, size_t capacity) {
+    char *buffer = realloc(conn->in_buffer, capacity);
+    if (!buffer) return -1;
+    conn->in_buffer = buffer;
+    conn->in_capacity = capacity;
+    return 0;
+}
+
+// Read until the socket would block, the peer closes or the buffer is full.
+// One byte is always kept free so the parser can NUL-terminate the request.
+ssize_t connection_fill(Connection *conn, size_t expected) {
+    ssize_t total = 0;
+
+    // Make room for a declared body in one step instead of doubling towards it
+    if (expected + 1 > conn->in_capacity && expected <= MAX_REQUEST_SIZE) {
+        resize_input(conn, expected + 1);
+    }
+
+    while (1) {
+        if (conn->in_length + 1 >= conn->in_capacity) {
+            if (conn->in_capacity > MAX_REQUEST_SIZE) break;
+            size_t capacity = conn->in_capacity * 2;
+            if (capacity > MAX_REQUEST_SIZE + 1) capacity = MAX_REQUEST_SIZE + 1;
+            if (resize_input(conn, capacity) < 0) break;
+        }
+        ssize_t n = read(conn->fd, conn->in_buffer + conn->in_length,
+                         conn->in_capacity - conn->in_length - 1);
+        if (n > 0) {
+            conn->in_length += n;
+            total += n;
+        } else if (n == 0) {
+            conn->peer_closed = 1;
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            return -1;
+        }
+    }
+    if (total > 0) metrics_count(received_bytes_metric, (uint64_t)total);
+    return total;
+}
+
+// Replace out_body with the stream's next piece, framed as a chunk if needed.
+// At the end of the body the last chunk is queued and the stream released.
+// Returns 0 on success, -1 if out of memory.
+static int next_stream_piece(Connection *conn) {
+    size_t length = 0;
+    const char *piece;
+    do {
+        piece = conn->out_stream.next(conn->out_stream.state, &length);
+    } while (piece && length == 0); // An empty chunk would end the body
+
+    if (!piece) {
+        release_stream(conn);
+        piece = conn->out_chunked ? "0\r\n\r\n" : "";
+        length = strlen(piece);
+        conn->out_chunked = 0;
+    }
+
+    size_t needed = length + 16 + 2; // Chunk size line and trailing CRLF at most
+    if (needed > conn->out_body_capacity) {
+        char *body = realloc(conn->out_body, needed);
+        if (!body) return -1;
+        conn->out_body = body;
+        conn->out_body_capacity = needed;
+    }
+
+    size_t offset = 0;
+    if (conn->out_chunked) offset = sprintf(conn->out_body, "%zx\r\n", length);
+    memcpy(conn->out_body + offset, piece, length);
+    offset += length;
+    if (conn->out_chunked) {
+        memcpy(conn->out_body + offset, "\r\n", 2);
+        offset += 2;
+    }
+    conn->out_body_length = offset;
+    return 0;
+}
+
+// Produce the next piece of a streamed body (on a worker, never on the loop)
+void connection_next_piece(Connection *conn) {
+    // Once a piece has gone out the headers stay counted and the body restarts
+    if (conn->out_sent > 0) conn->out_sent = conn->out_headers_length;
+    if (next_stream_piece(conn) < 0) {
+        // Out of memory: end the body here and drop the connection
+        release_stream(conn);
+        conn->out_body_length = 0;
+        conn->keep_alive = 0;
+    }
+}
+
+// Send pending headers and body together, handling partial writes. Stops
+// after each piece of a streamed body for the next one to be produced.
+int connection_flush(Connection *conn) {
+    size_t total = conn->out_headers_length + conn->out_body_length;
+
+    while (conn->out_sent < total) {
+        struct iovec iov[2];
+        int count = 0;
+        if (conn->out_sent < conn->out_headers_length) {
+            iov[count].iov_base = conn->out_headers + conn->out_sent;
+            iov[count].iov_len = conn->out_headers_length - conn->out_sent;
+            count++;
+            if (conn->out_body_length > 0) {
+                iov[count].iov_base = conn->out_body;
+                iov[count].iov_len = conn->out_body_length;
+                count++;
+            }
+        } else {
+            size_t body_sent = conn->out_sent - conn->out_headers_length;
+            iov[count].iov_base = conn->out_body + body_sent;
+            iov[count].iov_len = conn->out_body_length - body_sent;
+            count++;
+        }
+
+        // sendmsg rather than writev for MSG_NOSIGNAL
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+
+        ssize_t n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+        if (n > 0) {
+            conn->out_sent += n;
+            metrics_count(sent_bytes_metric, (uint64_t)n);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        } else {
+            return -1;
+        }
+    }
+    return conn->out_stream.next ? 2 : 1;
+}
+
+// Grow the header buffer
+int connection_reserve_headers(Connection *conn, size_t capacity) {
+    if (capacity <= conn->out_headers_capacity) return 0;
+
+    char *headers = realloc(conn->out_headers, capacity);
+    if (!headers) return -1;
+    conn->out_headers = headers;
+    conn->out_headers_capacity = capacity;
+    return 0;
+}
+
+// Queue a response whose headers are already in out_headers
+void connection_set_output(Connection *conn, size_t headers_length, char *body, size_t body_length, int owned) {
+    release_stream(conn);
+    conn->out_chunked = 0;
+    if (conn->out_body_owned) free(conn->out_body);
+    conn->out_headers_length = headers_length;
+    conn->out_body = body;
+    conn->out_body_owned = owned;
+    conn->out_body_length = body ? body_length : 0;
+    conn->out_body_capacity = conn->out_body_length;
+    conn->out_sent = 0;
+}
+
+// Queue a streamed response; the first piece is produced by the caller's thread
+void connection_set_stream(Connection *conn, size_t headers_length, const ResponseStream *stream, int chunked) {
+    connection_set_output(conn, headers_length, NULL, 0, 1);
+    conn->out_stream = *stream;
+    conn->out_chunked = chunked;
+    connection_next_piece(conn);
+}
+
+// Drop the pending response
+void connection_clear_output(Connection *conn) {
+    connection_set_output(conn, 0, NULL, 0, 1);
+}
+
+// Drop the bytes of the request just answered, keeping any pipelined data behind it
+void connection_consume_request(Connection *conn) {
+    http_parser_release(&conn->parser, conn->in_buffer);
+    http_parser_reset(&conn->parser);
+    conn->error_status = NULL;
+
+    size_t consumed = conn->request_length;
+    if (consumed > conn->in_length) consumed = conn->in_length;
+
+    conn->in_length -= consumed;
+    if (conn->in_length > 0) {
+        memmove(conn->in_buffer, conn->in_buffer + consumed, conn->in_length);
+    }
+    conn->request_length = 0;
+    arena_reset(&conn->arena);
+
+    // Give back the memory of a large body once it has been answered
+    if (conn->in_capacity > BUFFER_SIZE && conn->in_length < BUFFER_SIZE) {
+        resize_input(conn, BUFFER_SIZE);
+    }
+}
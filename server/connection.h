@@ -0,0 +1,103 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "http_server.h"
+#include "http_parser.h"
+#include "../utils/arena.h"
+
+struct EventLoop;
+
+// Lifecycle of a client connection, driven by handle_request
+typedef enum {
+    CONN_READING,       // Waiting for the rest of a request
+    CONN_PROCESSING,    // Request (or a streamed body's next piece) handed to the worker pool;
+                        // the loop must not touch it
+    CONN_WRITING,       // Flushing the serialized response
+    CONN_CLOSING        // Finished; the loop closes and frees it
+} ConnectionState;
+
+// Per-client connection state owned by one event loop
+struct Connection {
+    int fd;                         // Non-blocking client socket
+    ConnectionState state;
+    struct EventLoop *loop;         // Loop that owns this connection
+    int peer_closed;                // Client shut down its write side
+    int keep_alive;                 // Keep the connection open after the current response
+    int requests_served;            // Responses produced on this connection
+    long long last_active_ms;       // Loop clock at the last event, for the idle sweep
+    long long request_started_ms;   // Loop clock when the pending request's first byte arrived, 0 if none
+
+    char *in_buffer;                // Bytes received; may hold several pipelined requests
+    size_t in_length;
+    size_t in_capacity;             // Grows up to MAX_REQUEST_SIZE for large bodies
+    size_t request_length;          // Bytes of in_buffer taken by the request being served
+    HttpParser parser;              // Progress on the request at the front of in_buffer
+    HttpRequest request;            // Parsed request; points into in_buffer
+    const char *error_status;       // Set when the request can't be parsed (answered, then closed)
+    Arena arena;                    // Memory of the request being served; reset once it is answered
+
+    char *out_headers;              // Status line + headers, reused across responses
+    size_t out_headers_length;
+    size_t out_headers_capacity;
+    char *out_body;                 // Response body, sent right after the headers
+    int out_body_owned;             // out_body is malloc'd (freed with the response), not in the arena
+    size_t out_body_length;
+    size_t out_sent;                // Bytes of headers + body already sent
+    size_t out_body_capacity;       // Allocated size of out_body while streaming
+    ResponseStream out_stream;      // Producer of the rest of a streamed body (next is NULL otherwise)
+    int out_chunked;                // Frame the stream's pieces as HTTP chunks
+
+    struct Connection *prev;        // Loop's list of open connections
+    struct Connection *next;
+    struct Connection *next_completed; // Worker -> loop handoff queue link
+};
+
+// Register the network byte counters (call once before serving)
+void connection_metrics_init();
+
+// Allocate a connection for an accepted socket
+Connection* connection_create(int fd, struct EventLoop *loop);
+
+// Close the socket and free all buffers
+void connection_free(Connection *conn);
+
+// Read everything currently available into the input buffer, growing it as
+// needed up to MAX_REQUEST_SIZE (and at once to expected, when known).
+// Returns the number of bytes read (0 if nothing was pending), or -1 on a socket error.
+// Sets peer_closed when the client has shut down its side.
+ssize_t connection_fill(Connection *conn, size_t expected);
+
+// Send as much of the pending headers and body as the socket accepts, both in
+// one sendmsg() per attempt. Only bytes already produced are sent, so this is
+// cheap enough for the loop thread. Returns 1 once everything is sent, 2 once
+// a piece of a streamed body is sent and the next one must be produced
+// (connection_next_piece), 0 if the socket would block, -1 on error.
+int connection_flush(Connection *conn);
+
+// Replace the piece of a streamed body just sent with the next one. Reads and
+// encodes rows, so it runs on a worker. Out of memory ends the body early and
+// clears keep_alive.
+void connection_next_piece(Connection *conn);
+
+// Make sure out_headers can hold at least capacity bytes. Returns 0 on success.
+int connection_reserve_headers(Connection *conn, size_t capacity);
+
+// Queue a response whose headers are already in out_headers. With owned set,
+// body was malloc'd and is taken over; otherwise it must stay valid until the
+// request is consumed (memory from the connection's arena, or static)
+void connection_set_output(Connection *conn, size_t headers_length, char *body, size_t body_length, int owned);
+
+// Queue a response whose headers are already in out_headers and whose body
+// comes from stream (taken over: released when done); produces the first piece
+void connection_set_stream(Connection *conn, size_t headers_length, const ResponseStream *stream, int chunked);
+
+// Drop the pending response (keeps the header buffer for the next one)
+void connection_clear_output(Connection *conn);
+
+// Drop the bytes of the request just answered, keeping any pipelined data
+// behind it, and free everything allocated in the arena for it
+void connection_consume_request(Connection *conn);
+
+#endif // CONNECTION_H
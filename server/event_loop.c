@@ -0,0 +1,360 @@
+#define _GNU_SOURCE // For accept4
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/tcp.h>
+#include <time.h>
+#include "event_loop.h"
+#include "../utils/metrics.h"
+
+#define MAX_EVENTS 256
+#define SWEEP_INTERVAL_MS 1000  // How often idle connections and deadlines are checked
+
+// Open connections of every loop, against config.max_connections
+static int open_connections = 0;
+
+static int rejected_metric = -1;
+static int read_timeout_metric = -1;
+static int write_timeout_metric = -1;
+
+// Register the connection limit and deadline counters
+void event_loop_metrics_init() {
+    rejected_metric = metrics_counter("cerver_http_connections_rejected_total",
+                                      "Connections answered 503 and closed because too many were open.", NULL);
+    read_timeout_metric = metrics_counter("cerver_http_timeouts_total",
+                                          "Connections dropped for missing a read or write deadline.",
+                                          "kind=\"read\"");
+    write_timeout_metric = metrics_counter("cerver_http_timeouts_total",
+                                           "Connections dropped for missing a read or write deadline.",
+                                           "kind=\"write\"");
+}
+
+// Open connections across all loops
+int event_loop_open_connections() {
+    return __atomic_load_n(&open_connections, __ATOMIC_RELAXED);
+}
+
+// Best-effort final answer on a connection that is about to be closed; the
+// socket is non-blocking, so a full send buffer just loses it
+static void send_final_response(int fd, const char *response) {
+    ssize_t ignored = send(fd, response, strlen(response), MSG_NOSIGNAL);
+    (void)ignored;
+}
+
+// Monotonic clock in milliseconds
+static long long loop_clock_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Create the per-loop listening socket. SO_REUSEPORT lets every loop bind the
+// same port so the kernel spreads incoming connections across the loops.
+static int create_listener(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("SO_REUSEPORT failed");
+        close(fd);
+        return -1;
+    }
+
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    server_addr.sin_port = htons(port);
+
+    if (bind(fd, (struct sockaddr *) &server_addr, sizeof(server_addr)) < 0) {
+        perror("Bind failed");
+        close(fd);
+        return -1;
+    }
+
+    if (listen(fd, MAX_CONNECTIONS) < 0) {
+        perror("Listen failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Create a loop listening on config->port
+EventLoop* event_loop_create(int id, const ServerConfig *config, ThreadPool *workers) {
+    EventLoop *loop = calloc(1, sizeof(EventLoop));
+    if (!loop) return NULL;
+
+    loop->id = id;
+    loop->workers = workers;
+    loop->config = *config;
+    loop->now_ms = loop_clock_ms();
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    loop->listen_fd = create_listener(config->port);
+    if (loop->epoll_fd < 0 || loop->wake_fd < 0 || loop->listen_fd < 0) {
+        if (loop->epoll_fd >= 0) close(loop->epoll_fd);
+        if (loop->wake_fd >= 0) close(loop->wake_fd);
+        if (loop->listen_fd >= 0) close(loop->listen_fd);
+        free(loop);
+        return NULL;
+    }
+    pthread_mutex_init(&loop->completed_lock, NULL);
+
+    // The listener is tagged with NULL and the wake fd with the loop itself;
+    // every other registration carries its Connection pointer.
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->listen_fd, &ev);
+    ev.events = EPOLLIN;
+    ev.data.ptr = loop;
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wake_fd, &ev);
+
+    return loop;
+}
+
+// Remove a connection from the activity list
+static void unlink_connection(EventLoop *loop, Connection *conn) {
+    if (conn->prev) conn->prev->next = conn->next;
+    else loop->connections = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+    else loop->connections_tail = conn->prev;
+    conn->prev = conn->next = NULL;
+}
+
+// Put a connection at the head of the activity list
+static void push_connection(EventLoop *loop, Connection *conn) {
+    conn->prev = NULL;
+    conn->next = loop->connections;
+    if (loop->connections) loop->connections->prev = conn;
+    else loop->connections_tail = conn;
+    loop->connections = conn;
+}
+
+// Record activity: the list stays ordered by last_active_ms, newest first
+static void touch_connection(EventLoop *loop, Connection *conn) {
+    conn->last_active_ms = loop->now_ms;
+    if (loop->connections != conn) {
+        unlink_connection(loop, conn);
+        push_connection(loop, conn);
+    }
+}
+
+// Unlink, close and free a finished connection
+static void close_connection(EventLoop *loop, Connection *conn) {
+    unlink_connection(loop, conn);
+    loop->connection_count--;
+    __atomic_sub_fetch(&open_connections, 1, __ATOMIC_RELAXED);
+    connection_free(conn); // close() also removes the fd from the epoll set
+}
+
+// Close connections that are idle or past a deadline: waiting longer than
+// the keep-alive timeout for their next request (or the next byte of it), a
+// request still arriving read_timeout after it started (a client trickling
+// it in byte by byte), or a response the client has taken none of for
+// write_timeout. Connections owned by a worker are never timed out, and a
+// stream whose next piece found the worker queue full is handed over again.
+static void sweep_connections(EventLoop *loop) {
+    long long idle_ms = (long long)loop->config.keepalive_timeout * 1000;
+    long long read_ms = (long long)loop->config.read_timeout * 1000;
+    long long write_ms = (long long)loop->config.write_timeout * 1000;
+
+    Connection *conn = loop->connections_tail;
+    while (conn) {
+        Connection *newer = conn->prev;
+        long long idle = loop->now_ms - conn->last_active_ms;
+        if (conn->state == CONN_READING) {
+            if (read_ms > 0 && conn->request_started_ms && loop->now_ms - conn->request_started_ms >= read_ms) {
+                send_final_response(conn->fd, "HTTP/1.1 408 Request Timeout\r\n"
+                                              "Connection: close\r\nContent-Length: 0\r\n\r\n");
+                metrics_count(read_timeout_metric, 1);
+                close_connection(loop, conn);
+            } else if (idle_ms > 0 && idle >= idle_ms) {
+                close_connection(loop, conn);
+            }
+        } else if (conn->state == CONN_WRITING && conn->out_stream.next &&
+                   conn->out_sent == conn->out_headers_length + conn->out_body_length) {
+            handle_request(conn); // Nothing to send until a worker produces the next piece
+        } else if (conn->state == CONN_WRITING && write_ms > 0 && idle >= write_ms) {
+            metrics_count(write_timeout_metric, 1);
+            close_connection(loop, conn);
+        }
+        conn = newer;
+    }
+}
+
+// Accept every pending connection on the listener
+static void accept_connections(EventLoop *loop) {
+    while (1) {
+        int fd = accept4(loop->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("Accept failed");
+            return;
+        }
+
+        // Over the limit: say so and hang up, rather than take on what can't be served
+        int limit = loop->config.max_connections;
+        if (limit > 0 && __atomic_load_n(&open_connections, __ATOMIC_RELAXED) >= limit) {
+            char refusal[128];
+            snprintf(refusal, sizeof(refusal), "HTTP/1.1 503 Service Unavailable\r\nRetry-After: %d\r\n"
+                     "Connection: close\r\nContent-Length: 0\r\n\r\n", RETRY_AFTER_SECONDS);
+            send_final_response(fd, refusal);
+            metrics_count(rejected_metric, 1);
+            close(fd);
+            continue;
+        }
+
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+        Connection *conn = connection_create(fd, loop);
+        if (!conn) {
+            close(fd);
+            continue;
+        }
+
+        // Edge-triggered for both directions: registered once, never modified.
+        // handle_request always reads/writes until EAGAIN.
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = conn;
+        if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("epoll_ctl failed");
+            connection_free(conn);
+            continue;
+        }
+
+        conn->last_active_ms = loop->now_ms;
+        push_connection(loop, conn);
+        loop->connection_count++;
+        __atomic_add_fetch(&open_connections, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Resume connections whose request has been processed by a worker
+static void drain_completions(EventLoop *loop) {
+    uint64_t counter;
+    while (read(loop->wake_fd, &counter, sizeof(counter)) > 0) {
+        // Drain the eventfd
+    }
+
+    pthread_mutex_lock(&loop->completed_lock);
+    Connection *conn = loop->completed_head;
+    loop->completed_head = loop->completed_tail = NULL;
+    pthread_mutex_unlock(&loop->completed_lock);
+
+    while (conn) {
+        Connection *next = conn->next_completed;
+        conn->next_completed = NULL;
+        conn->state = CONN_WRITING;
+        touch_connection(loop, conn);
+        handle_request(conn);
+        if (conn->state == CONN_CLOSING) close_connection(loop, conn);
+        conn = next;
+    }
+}
+
+// Loop thread body
+static void *event_loop_run(void *arg) {
+    EventLoop *loop = arg;
+    struct epoll_event events[MAX_EVENTS];
+    long long last_sweep_ms = loop->now_ms;
+
+    while (loop->running) {
+        // Woken at least once per sweep even with every deadline off, for stalled streams
+        int n = epoll_wait(loop->epoll_fd, events, MAX_EVENTS, SWEEP_INTERVAL_MS);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait failed");
+            break;
+        }
+        loop->now_ms = loop_clock_ms();
+
+        int woken = 0;
+        for (int i = 0; i < n; i++) {
+            void *tag = events[i].data.ptr;
+            if (tag == NULL) {
+                accept_connections(loop);
+            } else if (tag == loop) {
+                woken = 1;
+            } else {
+                Connection *conn = tag;
+                // A worker owns the connection; it comes back via the completion queue
+                if (conn->state == CONN_PROCESSING) continue;
+                touch_connection(loop, conn);
+                handle_request(conn);
+                if (conn->state == CONN_CLOSING) close_connection(loop, conn);
+            }
+        }
+
+        // Completions are handled after the batch so no event above can refer
+        // to a connection that was freed while draining.
+        if (woken) drain_completions(loop);
+
+        if (loop->now_ms - last_sweep_ms >= SWEEP_INTERVAL_MS) {
+            sweep_connections(loop);
+            last_sweep_ms = loop->now_ms;
+        }
+    }
+    return NULL;
+}
+
+// Start the loop thread
+int event_loop_start(EventLoop *loop) {
+    loop->running = 1;
+    if (pthread_create(&loop->thread, NULL, event_loop_run, loop) != 0) {
+        perror("Event loop thread creation failed");
+        loop->running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+// Ask the loop to exit; only touches a flag and the eventfd so it is safe in signal handlers
+void event_loop_stop(EventLoop *loop) {
+    uint64_t one = 1;
+    loop->running = 0;
+    ssize_t ignored = write(loop->wake_fd, &one, sizeof(one));
+    (void)ignored;
+}
+
+// Wait for the loop thread
+void event_loop_join(EventLoop *loop) {
+    pthread_join(loop->thread, NULL);
+}
+
+// Hand a processed connection back to its loop
+void event_loop_complete(EventLoop *loop, Connection *conn) {
+    uint64_t one = 1;
+
+    pthread_mutex_lock(&loop->completed_lock);
+    conn->next_completed = NULL;
+    if (loop->completed_tail) loop->completed_tail->next_completed = conn;
+    else loop->completed_head = conn;
+    loop->completed_tail = conn;
+    pthread_mutex_unlock(&loop->completed_lock);
+
+    ssize_t ignored = write(loop->wake_fd, &one, sizeof(one));
+    (void)ignored;
+}
+
+// Close all connections and free the loop
+void event_loop_destroy(EventLoop *loop) {
+    if (!loop) return;
+
+    while (loop->connections) {
+        close_connection(loop, loop->connections);
+    }
+
+    close(loop->listen_fd);
+    close(loop->wake_fd);
+    close(loop->epoll_fd);
+    pthread_mutex_destroy(&loop->completed_lock);
+    free(loop);
+}
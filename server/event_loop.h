@@ -0,0 +1,55 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <pthread.h>
+#include "connection.h"
+#include "../utils/thread_pool.h"
+
+// One epoll-driven loop thread with its own SO_REUSEPORT listener.
+// Connections accepted by a loop stay on that loop for their whole life.
+typedef struct EventLoop {
+    int id;
+    int epoll_fd;
+    int listen_fd;
+    int wake_fd;                        // eventfd: worker completions and shutdown
+    pthread_t thread;
+    ThreadPool *workers;                // Shared worker pool (not owned)
+    ServerConfig config;                // Keep-alive, connection and deadline limits
+
+    Connection *connections;            // Open connections, most recently active first
+    Connection *connections_tail;       // Least recently active; the idle sweep starts here
+    int connection_count;
+    long long now_ms;                   // Monotonic clock sampled once per wakeup
+
+    pthread_mutex_t completed_lock;     // Protects the completion queue below
+    Connection *completed_head;
+    Connection *completed_tail;
+
+    volatile int running;
+} EventLoop;
+
+// Create a loop listening on config->port. Returns NULL on failure.
+EventLoop* event_loop_create(int id, const ServerConfig *config, ThreadPool *workers);
+
+// Start the loop thread. Returns 0 on success.
+int event_loop_start(EventLoop *loop);
+
+// Ask the loop to exit (async-signal-safe)
+void event_loop_stop(EventLoop *loop);
+
+// Wait for the loop thread to exit
+void event_loop_join(EventLoop *loop);
+
+// Close all connections and free the loop. The loop must not be running.
+void event_loop_destroy(EventLoop *loop);
+
+// Hand a processed connection back to its loop (called from worker threads)
+void event_loop_complete(EventLoop *loop, Connection *conn);
+
+// Register the counters of refused connections and missed deadlines (call once before serving)
+void event_loop_metrics_init();
+
+// Open connections across all loops
+int event_loop_open_connections();
+
+#endif // EVENT_LOOP_H
@@ -0,0 +1,278 @@
+#define _GNU_SOURCE // For memmem
+#include "http_parser.h"
+
+#define MAX_CHUNK_LINE 1024     // Chunk-size line, including extensions
+
+// Index of the next CRLF at or after from, or -1
+static long find_crlf(const char *buffer, size_t from, size_t length) {
+    if (from >= length) return -1;
+    const char *crlf = memmem(buffer + from, length - from, "\r\n", 2);
+    return crlf ? crlf - buffer : -1;
+}
+
+// Fail the request with the given status line
+static ParseResult parse_fail(HttpParser *parser, const char *status) {
+    parser->error_status = status;
+    return PARSE_ERROR;
+}
+
+// Copy [start, end) into a fixed-size field; fails if it does not fit
+static int copy_token(char *dest, size_t dest_size, const char *start, const char *end) {
+    size_t length = end - start;
+    if (length == 0 || length >= dest_size) return -1;
+    memcpy(dest, start, length);
+    dest[length] = '\0';
+    return 0;
+}
+
+// Parse "METHOD target VERSION" into the request
+static ParseResult parse_request_line(HttpParser *parser, const char *line, const char *line_end,
+                                      HttpRequest *request) {
+    const char *method_end = memchr(line, ' ', line_end - line);
+    if (!method_end) return parse_fail(parser, "400 Bad Request");
+
+    const char *target = method_end + 1;
+    const char *target_end = memchr(target, ' ', line_end - target);
+    if (!target_end) return parse_fail(parser, "400 Bad Request");
+
+    const char *version = target_end + 1;
+    if (copy_token(request->method, sizeof(request->method), line, method_end) < 0 ||
+        copy_token(request->version, sizeof(request->version), version, line_end) < 0 ||
+        strncmp(request->version, "HTTP/1.", 7) != 0) {
+        return parse_fail(parser, "400 Bad Request");
+    }
+
+    const char *query = memchr(target, '?', target_end - target);
+    const char *path_end = query ? query : target_end;
+    if (copy_token(request->path, sizeof(request->path), target, path_end) < 0) {
+        return parse_fail(parser, path_end == target ? "400 Bad Request" : "414 URI Too Long");
+    }
+    if (query && (size_t)(target_end - query - 1) >= sizeof(request->query_string)) {
+        return parse_fail(parser, "414 URI Too Long");
+    }
+    if (query) {
+        memcpy(request->query_string, query + 1, target_end - query - 1);
+        request->query_string[target_end - query - 1] = '\0';
+    }
+    return PARSE_COMPLETE;
+}
+
+// Header names compared case-insensitively against a NUL-terminated candidate
+static int header_is(const char *name, const char *candidate) {
+    return strcasecmp(name, candidate) == 0;
+}
+
+// Parse the request line and header block once it is fully buffered.
+// Header names and values are NUL-terminated in place (over ':' and CR) and
+// only their offsets are kept, since the buffer may still be reallocated
+// while the body arrives.
+static ParseResult parse_head(HttpParser *parser, char *buffer, HttpRequest *request) {
+    size_t head_end = parser->header_length - 2; // Offset of the final CRLF
+    long line_end = find_crlf(buffer, parser->start, head_end + 2);
+
+    ParseResult result = parse_request_line(parser, buffer + parser->start, buffer + line_end, request);
+    if (result != PARSE_COMPLETE) return result;
+
+    int has_length = 0;
+    size_t pos = line_end + 2;
+    while (pos < head_end) {
+        line_end = find_crlf(buffer, pos, head_end + 2);
+        char *line = buffer + pos;
+        char *end = buffer + line_end;
+        pos = line_end + 2;
+
+        // No obs-fold continuation lines and no whitespace in or after the name
+        // (RFC 9112 section 5), which another parser might read as a different header
+        char *colon = memchr(line, ':', end - line);
+        if (!colon || colon == line || memchr(line, ' ', colon - line) || memchr(line, '\t', colon - line)) {
+            return parse_fail(parser, "400 Bad Request");
+        }
+
+        char *value = colon + 1;
+        while (value < end && (*value == ' ' || *value == '\t')) value++;
+        char *value_end = end;
+        while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) value_end--;
+        *colon = '\0';
+        *value_end = '\0';
+
+        if (header_is(line, "Content-Length")) {
+            char *digits_end = NULL;
+            errno = 0;
+            unsigned long long length = strtoull(value, &digits_end, 10);
+            if (!isdigit((unsigned char)*value) || *digits_end || errno ||
+                (has_length && length != parser->content_length)) {
+                return parse_fail(parser, "400 Bad Request");
+            }
+            parser->content_length = length;
+            has_length = 1;
+        } else if (header_is(line, "Transfer-Encoding")) {
+            if (strcasecmp(value, "chunked") != 0) return parse_fail(parser, "501 Not Implemented");
+            parser->chunked = 1;
+        } else if (header_is(line, "Expect")) {
+            parser->expect_continue = strcasecmp(value, "100-continue") == 0;
+        }
+
+        if (parser->header_count < MAX_HEADERS) {
+            parser->header_offsets[parser->header_count].name = line - buffer;
+            parser->header_offsets[parser->header_count].value = value - buffer;
+            parser->header_count++;
+        }
+    }
+
+    // A message framed both ways is a smuggling attempt or a broken proxy; RFC 9112
+    // section 6.1 allows rejecting it, and the error closes the connection
+    if (has_length && parser->chunked) return parse_fail(parser, "400 Bad Request");
+    if (parser->content_length > MAX_REQUEST_SIZE - parser->header_length) {
+        return parse_fail(parser, "413 Payload Too Large");
+    }
+    return PARSE_COMPLETE;
+}
+
+// Decode chunked data in place: chunk payloads are moved down so the body is
+// contiguous from header_length to body_end. scan_offset is the raw read cursor.
+static ParseResult parse_chunks(HttpParser *parser, char *buffer, size_t length) {
+    while (1) {
+        switch (parser->stage) {
+        case PARSER_CHUNK_SIZE: {
+            long line_end = find_crlf(buffer, parser->scan_offset, length);
+            if (line_end < 0) {
+                if (length - parser->scan_offset > MAX_CHUNK_LINE) return parse_fail(parser, "400 Bad Request");
+                return PARSE_INCOMPLETE;
+            }
+            // chunk-size = 1*HEXDIG (RFC 9112 section 7.1); strtoull would also take
+            // a sign, leading spaces or a 0x prefix, which other parsers may read differently
+            const char *digits = buffer + parser->scan_offset;
+            const char *digits_end = digits;
+            size_t size = 0, limit = MAX_REQUEST_SIZE - parser->body_end;
+            while (isxdigit((unsigned char)*digits_end)) {
+                int c = (unsigned char)*digits_end;
+                size_t digit = isdigit(c) ? (size_t)(c - '0') : (size_t)(tolower(c) - 'a' + 10);
+                if (digit > limit || size > (limit - digit) / 16) {
+                    return parse_fail(parser, "413 Payload Too Large");
+                }
+                size = size * 16 + digit;
+                digits_end++;
+            }
+            if (digits_end == digits ||
+                (digits_end != buffer + line_end && *digits_end != ';' &&
+                 *digits_end != ' ' && *digits_end != '\t')) {
+                return parse_fail(parser, "400 Bad Request");
+            }
+
+            parser->scan_offset = line_end + 2;
+            parser->chunk_remaining = size;
+            parser->stage = size == 0 ? PARSER_TRAILERS : PARSER_CHUNK_DATA;
+            break;
+        }
+        case PARSER_CHUNK_DATA: {
+            size_t available = length - parser->scan_offset;
+            size_t n = parser->chunk_remaining < available ? parser->chunk_remaining : available;
+            memmove(buffer + parser->body_end, buffer + parser->scan_offset, n);
+            parser->body_end += n;
+            parser->scan_offset += n;
+            parser->chunk_remaining -= n;
+            if (parser->chunk_remaining > 0) return PARSE_INCOMPLETE;
+            parser->stage = PARSER_CHUNK_DATA_END;
+            break;
+        }
+        case PARSER_CHUNK_DATA_END:
+            if (length - parser->scan_offset < 2) return PARSE_INCOMPLETE;
+            if (memcmp(buffer + parser->scan_offset, "\r\n", 2) != 0) return parse_fail(parser, "400 Bad Request");
+            parser->scan_offset += 2;
+            parser->stage = PARSER_CHUNK_SIZE;
+            break;
+        case PARSER_TRAILERS: {
+            long line_end = find_crlf(buffer, parser->scan_offset, length);
+            if (line_end < 0) {
+                if (length - parser->scan_offset > MAX_HEADER_SIZE) return parse_fail(parser, "431 Request Header Fields Too Large");
+                return PARSE_INCOMPLETE;
+            }
+            int blank = (size_t)line_end == parser->scan_offset;
+            parser->scan_offset = line_end + 2;
+            if (blank) {
+                parser->request_length = parser->scan_offset;
+                return PARSE_COMPLETE;
+            }
+            break;
+        }
+        default:
+            return parse_fail(parser, "400 Bad Request");
+        }
+    }
+}
+
+// Prepare the parser for a new request
+void http_parser_reset(HttpParser *parser) {
+    memset(parser, 0, sizeof(HttpParser));
+    parser->stage = PARSER_HEADERS;
+}
+
+// Continue parsing buffer[0, length)
+ParseResult http_parser_execute(HttpParser *parser, char *buffer, size_t length, HttpRequest *request) {
+    ParseResult result = PARSE_INCOMPLETE;
+
+    if (parser->stage == PARSER_DONE) return PARSE_COMPLETE;
+
+    if (parser->stage == PARSER_HEADERS) {
+        // Tolerate stray CRLFs between pipelined requests (RFC 9112 section 2.2)
+        while (parser->start + 1 < length && buffer[parser->start] == '\r' && buffer[parser->start + 1] == '\n') {
+            parser->start += 2;
+        }
+        // Resume the search a few bytes back in case the terminator straddles reads
+        size_t from = parser->scan_offset > parser->start + 3 ? parser->scan_offset - 3 : parser->start;
+        const char *head_end = length > from ? memmem(buffer + from, length - from, "\r\n\r\n", 4) : NULL;
+        if (!head_end) {
+            parser->scan_offset = length;
+            if (length - parser->start > MAX_HEADER_SIZE) return parse_fail(parser, "431 Request Header Fields Too Large");
+            return PARSE_INCOMPLETE;
+        }
+        if ((size_t)(head_end - buffer) - parser->start > MAX_HEADER_SIZE) {
+            return parse_fail(parser, "431 Request Header Fields Too Large");
+        }
+
+        memset(request, 0, sizeof(HttpRequest));
+        parser->header_length = (head_end - buffer) + 4;
+        result = parse_head(parser, buffer, request);
+        if (result != PARSE_COMPLETE) return result;
+
+        parser->body_end = parser->header_length;
+        parser->scan_offset = parser->header_length;
+        parser->stage = parser->chunked ? PARSER_CHUNK_SIZE : PARSER_BODY;
+    }
+
+    if (parser->stage == PARSER_BODY) {
+        if (length < parser->header_length + parser->content_length) return PARSE_INCOMPLETE;
+        parser->body_end = parser->header_length + parser->content_length;
+        parser->request_length = parser->body_end;
+        result = PARSE_COMPLETE;
+    } else {
+        result = parse_chunks(parser, buffer, length);
+        if (result != PARSE_COMPLETE) return result;
+    }
+
+    // Point the request into the buffer now that it will no longer move
+    for (int i = 0; i < parser->header_count; i++) {
+        request->headers[i].name = buffer + parser->header_offsets[i].name;
+        request->headers[i].value = buffer + parser->header_offsets[i].value;
+    }
+    request->header_count = parser->header_count;
+
+    request->body_length = parser->body_end - parser->header_length;
+    request->body = request->body_length > 0 ? buffer + parser->header_length : NULL;
+    parser->saved_byte = buffer[parser->body_end];
+    buffer[parser->body_end] = '\0';
+
+    parser->stage = PARSER_DONE;
+    return PARSE_COMPLETE;
+}
+
+// Total bytes needed for the current request, when already known
+size_t http_parser_expected_length(const HttpParser *parser) {
+    if (parser->stage == PARSER_BODY) return parser->header_length + parser->content_length;
+    return 0;
+}
+
+// Put back the byte replaced by the body terminator
+void http_parser_release(HttpParser *parser, char *buffer) {
+    if (parser->stage == PARSER_DONE) buffer[parser->body_end] = parser->saved_byte;
+}
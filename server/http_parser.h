@@ -0,0 +1,68 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "http_server.h"
+
+// Resumable HTTP/1.x request parser.
+//
+// The parser never copies headers or the body: it works on the connection's
+// input buffer and only remembers offsets between calls, so the buffer may be
+// grown (and moved) while a request is still arriving. Once a request is
+// complete, HttpRequest header names/values and the body point into that
+// buffer and stay valid until the bytes are consumed.
+
+typedef enum {
+    PARSER_HEADERS,         // Looking for the blank line ending the header block
+    PARSER_BODY,            // Waiting for Content-Length body bytes
+    PARSER_CHUNK_SIZE,      // Reading a chunk-size line
+    PARSER_CHUNK_DATA,      // Moving chunk data down into the decoded body
+    PARSER_CHUNK_DATA_END,  // Expecting the CRLF after chunk data
+    PARSER_TRAILERS,        // Skipping trailer lines after the last chunk
+    PARSER_DONE
+} HttpParserStage;
+
+typedef enum {
+    PARSE_INCOMPLETE = 0,   // Need more bytes
+    PARSE_COMPLETE = 1,     // Request is ready; see request_length
+    PARSE_ERROR = -1        // Malformed or too large; see error_status
+} ParseResult;
+
+typedef struct {
+    HttpParserStage stage;
+    size_t start;               // Offset of the request line (leading CRLFs skipped)
+    size_t scan_offset;         // Raw bytes already examined
+    size_t header_length;       // Offset where the body starts
+    size_t content_length;      // Declared Content-Length
+    size_t chunk_remaining;     // Bytes left in the current chunk
+    size_t body_end;            // Offset just past the (decoded) body
+    size_t request_length;      // Raw bytes taken by the request once complete
+    int chunked;                // Transfer-Encoding: chunked
+    int expect_continue;        // Client sent Expect: 100-continue
+    const char *error_status;   // Status line for the error response on PARSE_ERROR
+
+    int header_count;
+    struct {
+        uint32_t name;
+        uint32_t value;
+    } header_offsets[MAX_HEADERS];
+
+    char saved_byte;            // Byte overwritten by the body's terminating NUL
+} HttpParser;
+
+// Prepare the parser for a new request
+void http_parser_reset(HttpParser *parser);
+
+// Continue parsing buffer[0, length). The buffer must have one writable byte
+// past length. On PARSE_COMPLETE the request is filled in and its body is
+// NUL-terminated in place; call http_parser_release before reusing the bytes.
+ParseResult http_parser_execute(HttpParser *parser, char *buffer, size_t length, HttpRequest *request);
+
+// Total bytes needed for the current request, when already known (0 otherwise)
+size_t http_parser_expected_length(const HttpParser *parser);
+
+// Put back the byte replaced by the body terminator (pipelined data may start there)
+void http_parser_release(HttpParser *parser, char *buffer);
+
+#endif // HTTP_PARSER_H
@@ -1,70 +1,16 @@
+#define _GNU_SOURCE // For memmem
+#include <signal.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
+#include <ctype.h>
 #include "http_server.h"
-
-#define PORT 3000
-#define MAX_CONNECTIONS 1000
-#define BUFFER_SIZE 8192
-#define MAX_ROUTES 100
-#define MAX_HEADERS 20
-
-// Route structure
-typedef struct {
-    char method[10];
-    char pattern[256];
-    RouteHandler handler;
-} Route;
-
-// Global route registry
-static Route *routes = NULL;
-static int route_count = 0;
-
-// Compare function for string matching with wildcards and :id parameters.
-//
-// Supported pattern forms:
-//   /foo          exact match
-//   /foo/:id      matches /foo/123  (numeric id segment)
-//   /*            matches any single-segment path  e.g. /foo
-//   /*/*          matches any two-segment path     e.g. /foo/123
-int match_pattern(const char *pattern, const char *path) {
-    if (!pattern || !path) return 0;
-
-    // 1. Exact match
-    if (strcmp(pattern, path) == 0) return 1;
-
-    // 2. Wildcard: "/*"  — matches exactly one path segment, no trailing slash
-    //    e.g. pattern "/*" matches "/book" but NOT "/book/1"
-    if (strcmp(pattern, "/*") == 0) {
-        // Path must start with '/' and contain no further '/' after position 0
-        if (path[0] != '/') return 0;
-        const char *second_slash = strchr(path + 1, '/');
-        return (second_slash == NULL) ? 1 : 0;
-    }
-
-    // 3. Wildcard: "/*/*" — matches exactly two path segments
-    //    e.g. pattern "/*/*" matches "/book/1" but NOT "/book"
-    if (strcmp(pattern, "/*/*") == 0) {
-        if (path[0] != '/') return 0;
-        const char *second_slash = strchr(path + 1, '/');
-        if (!second_slash) return 0;              // only one segment
-        const char *third_slash = strchr(second_slash + 1, '/');
-        return (third_slash == NULL) ? 1 : 0;     // must be exactly two segments
-    }
-
-    // 4. Explicit /:id pattern  e.g. "/book/:id" matches "/book/42"
-    const char *param_pos = strstr(pattern, "/:id");
-    if (param_pos) {
-        size_t prefix_len = (size_t)(param_pos - pattern);
-        // prefix of path must match prefix of pattern
-        if (strncmp(pattern, path, prefix_len) != 0) return 0;
-        // next char in path must be '/'
-        if (path[prefix_len] != '/') return 0;
-        // segment after '/' must be a non-empty numeric string
-        const char *id_start = path + prefix_len + 1;
-        if (!isdigit((unsigned char)*id_start)) return 0;
-        return 1;
-    }
-
-    return 0;
-}
+#include "connection.h"
+#include "http_parser.h"
+#include "router.h"
+#include "event_loop.h"
+#include "../utils/thread_pool.h"
+#include "../utils/metrics.h"
 
 // Extract parameter from path
 char* extract_path_parameter(const char *path, const char *pattern, const char *param_name) {
@@ -100,7 +46,24 @@ char* extract_path_parameter(const char *path, const char *pattern, const char *
     return value;
 }
 
-// Parse query string
+// Decode %XX escapes and '+' (a space in form encoding) in place
+static void url_decode(char *text) {
+    char *out = text;
+    for (char *in = text; *in; in++) {
+        if (*in == '+') {
+            *out++ = ' ';
+        } else if (*in == '%' && isxdigit((unsigned char)in[1]) && isxdigit((unsigned char)in[2])) {
+            char hex[3] = { in[1], in[2], '\0' };
+            *out++ = (char)strtol(hex, NULL, 16);
+            in += 2;
+        } else {
+            *out++ = *in;
+        }
+    }
+    *out = '\0';
+}
+
+// Parse query string; names and values are URL-decoded
 UrlParam** parse_query_string(const char *query_string, int *param_count) {
     if (!query_string || !*query_string) {
         *param_count = 0;
@@ -130,8 +93,9 @@ UrlParam** parse_query_string(const char *query_string, int *param_count) {
         return NULL;
     }
     
-    // Parse parameters
-    char *token = strtok(query_copy, "&");
+    // Parse parameters (strtok_r: handlers run on several workers at once)
+    char *saveptr;
+    char *token = strtok_r(query_copy, "&", &saveptr);
     while (token) {
         // Find '=' separator
         char *sep = strchr(token, '=');
@@ -153,13 +117,15 @@ UrlParam** parse_query_string(const char *query_string, int *param_count) {
             
             // Split name and value
             *sep = '\0';
+            url_decode(token);
+            url_decode(sep + 1);
             param->name = strdup(token);
             param->value = strdup(sep + 1);
             
             params[(*param_count)++] = param;
         }
         
-        token = strtok(NULL, "&");
+        token = strtok_r(NULL, "&", &saveptr);
     }
     
     free(query_copy);
@@ -179,162 +145,103 @@ void free_url_params(UrlParam **params, int param_count) {
     free(params);
 }
 
-// Initialize HTTP response
-HttpResponse* create_response() {
-    HttpResponse *response = malloc(sizeof(HttpResponse));
-    if (!response) return NULL;
-    
-    // Initialize with default values
+// Initialize a response in place, allocating from arena (or malloc if NULL)
+void init_response(HttpResponse *response, Arena *arena) {
     strcpy(response->status, "200 OK");
-    response->headers = malloc(MAX_HEADERS * sizeof(char*));
-    if (!response->headers) {
-        free(response);
-        return NULL;
-    }
-    
     response->header_count = 0;
     response->body = NULL;
     response->body_length = 0;
+    response->body_in_arena = 0;
     strcpy(response->content_type, "text/plain");
-    
+    memset(&response->stream, 0, sizeof(response->stream));
+    response->encoding = CONTENT_ENCODING_IDENTITY;
+    response->body_encoded = 0;
+    response->arena = arena;
+}
+
+// Initialize HTTP response
+HttpResponse* create_response() {
+    HttpResponse *response = malloc(sizeof(HttpResponse));
+    if (!response) return NULL;
+    init_response(response, NULL);
     return response;
 }
 
-// Free HTTP response
-void free_response(HttpResponse *response) {
-    if (!response) return;
-    
-    // Free headers
-    for (int i = 0; i < response->header_count; i++) {
-        free(response->headers[i]);
+// Free what a response owns; arena memory goes with the arena
+void release_response(HttpResponse *response) {
+    if (!response->arena) {
+        for (int i = 0; i < response->header_count; i++) {
+            free(response->headers[i]);
+        }
     }
-    free(response->headers);
-    
+    response->header_count = 0;
+
     // Free body if allocated
-    if (response->body) {
+    if (response->body && !response->body_in_arena) {
         free(response->body);
     }
-    
+    response->body = NULL;
+
+    // Release a stream that was never handed to a connection
+    if (response->stream.next && response->stream.release) {
+        response->stream.release(response->stream.state);
+    }
+    memset(&response->stream, 0, sizeof(response->stream));
+}
+
+// Free HTTP response
+void free_response(HttpResponse *response) {
+    if (!response) return;
+    release_response(response);
     free(response);
 }
 
-// Parse HTTP request
+// Set the response body to a copy of data
+int set_response_body(HttpResponse *response, const char *data, size_t length) {
+    char *body = response->arena ? arena_alloc(response->arena, length + 1) : malloc(length + 1);
+    if (!body) return -1;
+    memcpy(body, data, length);
+    body[length] = '\0';
+
+    if (response->body && !response->body_in_arena) free(response->body);
+    response->body = body;
+    response->body_length = (int)length;
+    response->body_in_arena = response->arena != NULL;
+    return 0;
+}
+
+// Parse a complete HTTP request held in buffer, without copying headers or body
 HttpRequest* parse_request(char *buffer, int buffer_size) {
     if (!buffer || buffer_size <= 0) return NULL;
     
     HttpRequest *request = malloc(sizeof(HttpRequest));
     if (!request) return NULL;
     
-    // Initialize with default values
-    memset(request->method, 0, sizeof(request->method));
-    memset(request->path, 0, sizeof(request->path));
-    memset(request->version, 0, sizeof(request->version));
-    memset(request->query_string, 0, sizeof(request->query_string));
-    request->headers = malloc(MAX_HEADERS * sizeof(char*));
-    if (!request->headers) {
-        free(request);
-        return NULL;
-    }
-    request->header_count = 0;
-    request->body = NULL;
-    request->body_length = 0;
-    
-    // Parse request line
-    char *line_end = strstr(buffer, "\r\n");
-    if (!line_end) {
-        free(request->headers);
+    HttpParser parser;
+    http_parser_reset(&parser);
+    if (http_parser_execute(&parser, buffer, buffer_size, request) != PARSE_COMPLETE) {
         free(request);
         return NULL;
     }
     
-    *line_end = '\0';
-    char *request_line = buffer;
-    
-    // Parse method, path, version
-    char *method_end = strchr(request_line, ' ');
-    if (!method_end) {
-        free(request->headers);
-        free(request);
-        return NULL;
-    }
-    
-    *method_end = '\0';
-    strncpy(request->method, request_line, sizeof(request->method) - 1);
-    
-    char *path_start = method_end + 1;
-    char *path_end = strchr(path_start, ' ');
-    if (!path_end) {
-        free(request->headers);
-        free(request);
-        return NULL;
-    }
-    
-    *path_end = '\0';
-    
-    // Check for query string
-    char *query_start = strchr(path_start, '?');
-    if (query_start) {
-        *query_start = '\0';
-        strncpy(request->path, path_start, sizeof(request->path) - 1);
-        strncpy(request->query_string, query_start + 1, sizeof(request->query_string) - 1);
-    } else {
-        strncpy(request->path, path_start, sizeof(request->path) - 1);
-    }
-    
-    char *version_start = path_end + 1;
-    strncpy(request->version, version_start, sizeof(request->version) - 1);
-    
-    // Parse headers
-    char *header_start = line_end + 2; // Skip \r\n
-    while (1) {
-        line_end = strstr(header_start, "\r\n");
-        if (!line_end) break;
-        
-        if (header_start == line_end) {
-            // Empty line, end of headers
-            header_start = line_end + 2;
-            break;
-        }
-        
-        *line_end = '\0';
-        
-        // Only process if we haven't reached our header limit
-        if (request->header_count < MAX_HEADERS) {
-            request->headers[request->header_count++] = strdup(header_start);
-        }
-        
-        header_start = line_end + 2;
-    }
-    
-    // Parse body if present
-    if (*header_start) {
-        request->body_length = buffer + buffer_size - header_start;
-        request->body = malloc(request->body_length + 1);
-        if (request->body) {
-            memcpy(request->body, header_start, request->body_length);
-            request->body[request->body_length] = '\0';
-        }
-    }
-    
     return request;
 }
 
-// Free HTTP request
+// Free HTTP request (headers and body live in the caller's buffer)
 void free_request(HttpRequest *request) {
-    if (!request) return;
-    
-    // Free headers
+    free(request);
+}
+
+// Look up a request header value by name (case-insensitive)
+const char* get_request_header(HttpRequest *request, const char *name) {
+    if (!request || !name) return NULL;
+
     for (int i = 0; i < request->header_count; i++) {
-        free(request->headers[i]);
-    }
-    free(request->headers);
-    
-    // Free body if allocated
-    if (request->body) {
-        free(request->body);
+        if (strcasecmp(request->headers[i].name, name) == 0) {
+            return request->headers[i].value;
+        }
     }
-    
-    free(request);
+    return NULL;
 }
 
 // Add header to response
@@ -345,53 +252,189 @@ void add_response_header(HttpResponse *response, const char *name, const char *v
     
     // Allocate memory for the full header line
     size_t header_len = strlen(name) + strlen(value) + 3; // name + ': ' + value + '\0'
-    char *header = malloc(header_len);
+    char *header = response->arena ? arena_alloc(response->arena, header_len) : malloc(header_len);
     if (!header) return;
     
     snprintf(header, header_len, "%s: %s", name, value);
     response->headers[response->header_count++] = header;
 }
 
-// Send HTTP response
-void send_response(int client_socket, HttpResponse *response) {
-    if (!response) return;
-    
-    // Create response buffer
-    size_t response_size = 1024; // Start with reasonable size
-    char *response_buffer = malloc(response_size);
-    if (!response_buffer) return;
-    
-    // Format status line
-    int offset = snprintf(response_buffer, response_size, "HTTP/1.1 %s\r\n", response->status);
-    
+// Full status lines for the statuses handlers use, so the common case is one memcpy
+#define STATUS_LINE(text) { text, "HTTP/1.1 " text "\r\n", sizeof("HTTP/1.1 " text "\r\n") - 1 }
+static const struct {
+    const char *status;
+    const char *line;
+    size_t length;
+} status_lines[] = {
+    STATUS_LINE("200 OK"),
+    STATUS_LINE("201 Created"),
+    STATUS_LINE("204 No Content"),
+    STATUS_LINE("400 Bad Request"),
+    STATUS_LINE("404 Not Found"),
+    STATUS_LINE("405 Method Not Allowed"),
+    STATUS_LINE("409 Conflict"),
+    STATUS_LINE("413 Payload Too Large"),
+    STATUS_LINE("414 URI Too Long"),
+    STATUS_LINE("422 Unprocessable Entity"),
+    STATUS_LINE("431 Request Header Fields Too Large"),
+    STATUS_LINE("500 Internal Server Error"),
+    STATUS_LINE("501 Not Implemented"),
+    STATUS_LINE("503 Service Unavailable"),
+};
+#define STATUS_LINE_COUNT (sizeof(status_lines) / sizeof(status_lines[0]))
+
+// Precomputed status line for a status, or -1 if it has to be formatted
+static int find_status_line(const char *status) {
+    for (size_t i = 0; i < STATUS_LINE_COUNT; i++) {
+        if (strcmp(status_lines[i].status, status) == 0) return (int)i;
+    }
+    return -1;
+}
+
+// "Date: ...\r\n" for the current second, formatted at most once per second per thread
+static const char* date_header(size_t *length) {
+    static __thread time_t cached_second = 0;
+    static __thread char cached_line[64];
+    static __thread size_t cached_length = 0;
+
+    time_t now = time(NULL);
+    if (now != cached_second) {
+        struct tm tm;
+        gmtime_r(&now, &tm);
+        cached_length = strftime(cached_line, sizeof(cached_line),
+                                 "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+        cached_second = now;
+    }
+    *length = cached_length;
+    return cached_line;
+}
+
+// Decimal digits of value into buffer (no terminator); returns the digit count
+static size_t format_size(char *buffer, size_t value) {
+    char digits[24];
+    size_t count = 0;
+    do {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    for (size_t i = 0; i < count; i++) buffer[i] = digits[count - 1 - i];
+    return count;
+}
+
+// Append bytes at *offset
+static void put(char *buffer, size_t *offset, const char *data, size_t length) {
+    memcpy(buffer + *offset, data, length);
+    *offset += length;
+}
+
+// Body length passed to write_response_headers for a streamed body: no Content-Length
+#define BODY_LENGTH_STREAMED ((size_t)-1)
+
+// Exact size of the header block write_response_headers produces
+static size_t response_headers_size(HttpResponse *response, const char *extra) {
+    int status_index = find_status_line(response->status);
+    size_t date_length = 0;
+    date_header(&date_length);
+
+    size_t size = status_index >= 0 ? status_lines[status_index].length
+                                    : strlen("HTTP/1.1 \r\n") + strlen(response->status);
+    size += date_length;
+    if (response->content_type[0]) size += strlen("Content-Type: \r\n") + strlen(response->content_type);
+    size += strlen("Content-Length: \r\n") + 20;
+    for (int i = 0; i < response->header_count; i++) {
+        size += strlen(response->headers[i]) + 2;
+    }
+    if (extra) size += strlen(extra);
+    return size + 2;
+}
+
+// Write status line, Date, Content-Type, Content-Length, the response's own
+// headers and any preformatted extra lines; returns the length. dest must hold
+// response_headers_size() bytes.
+static size_t write_response_headers(char *dest, HttpResponse *response, size_t body_length, const char *extra) {
+    size_t offset = 0;
+
+    int status_index = find_status_line(response->status);
+    if (status_index >= 0) {
+        put(dest, &offset, status_lines[status_index].line, status_lines[status_index].length);
+    } else {
+        put(dest, &offset, "HTTP/1.1 ", 9);
+        put(dest, &offset, response->status, strlen(response->status));
+        put(dest, &offset, "\r\n", 2);
+    }
+
+    size_t date_length = 0;
+    const char *date = date_header(&date_length);
+    put(dest, &offset, date, date_length);
+
     // Add Content-Type header if not empty
     if (response->content_type[0]) {
-        offset += snprintf(response_buffer + offset, response_size - offset, 
-                          "Content-Type: %s\r\n", response->content_type);
+        put(dest, &offset, "Content-Type: ", 14);
+        put(dest, &offset, response->content_type, strlen(response->content_type));
+        put(dest, &offset, "\r\n", 2);
     }
-    
-    // Add Content-Length header
-    offset += snprintf(response_buffer + offset, response_size - offset, 
-                      "Content-Length: %d\r\n", response->body_length);
-    
+
+    if (body_length != BODY_LENGTH_STREAMED) {
+        put(dest, &offset, "Content-Length: ", 16);
+        offset += format_size(dest + offset, body_length);
+        put(dest, &offset, "\r\n", 2);
+    }
+
     // Add other headers
     for (int i = 0; i < response->header_count; i++) {
-        offset += snprintf(response_buffer + offset, response_size - offset, 
-                          "%s\r\n", response->headers[i]);
+        put(dest, &offset, response->headers[i], strlen(response->headers[i]));
+        put(dest, &offset, "\r\n", 2);
     }
-    
+    if (extra) put(dest, &offset, extra, strlen(extra));
+
     // Add the empty line to mark end of headers
-    offset += snprintf(response_buffer + offset, response_size - offset, "\r\n");
-    
-    // Send the headers
-    send(client_socket, response_buffer, offset, 0);
-    
-    // Send the body separately (if any)
-    if (response->body && response->body_length > 0) {
-        send(client_socket, response->body, response->body_length, 0);
+    put(dest, &offset, "\r\n", 2);
+    return offset;
+}
+
+// Body bytes a response will send
+static size_t response_body_length(HttpResponse *response) {
+    return (response->body && response->body_length > 0) ? (size_t)response->body_length : 0;
+}
+
+// Send HTTP response on a blocking socket: headers and body in one sendmsg
+void send_response(int client_socket, HttpResponse *response) {
+    if (!response) return;
+
+    char stack_headers[1024];
+    size_t size = response_headers_size(response, NULL);
+    char *headers = size <= sizeof(stack_headers) ? stack_headers : malloc(size);
+    if (!headers) return;
+
+    size_t body_length = response_body_length(response);
+    size_t headers_length = write_response_headers(headers, response, body_length, NULL);
+
+    size_t total = headers_length + body_length;
+    size_t sent = 0;
+    while (sent < total) {
+        struct iovec iov[2];
+        int count = 0;
+        if (sent < headers_length) {
+            iov[count].iov_base = headers + sent;
+            iov[count++].iov_len = headers_length - sent;
+        }
+        if (body_length > 0) {
+            size_t body_sent = sent > headers_length ? sent - headers_length : 0;
+            iov[count].iov_base = response->body + body_sent;
+            iov[count++].iov_len = body_length - body_sent;
+        }
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t n = sendmsg(client_socket, &msg, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        sent += n;
     }
-    
-    free(response_buffer);
+
+    if (headers != stack_headers) free(headers);
 }
 
 // Send a simple text response (convenience method)
@@ -414,154 +457,493 @@ void send_json_response(int client_socket, const char *status, const char *body)
     send_simple_response(client_socket, status, "application/json", body);
 }
 
-// Initialize the routing system
+// Initialize the routing system (the trie is created by the first registration)
 void init_router() {
-    if (routes) return; // Already initialized
-    
-    routes = malloc(MAX_ROUTES * sizeof(Route));
-    if (!routes) {
-        fprintf(stderr, "Failed to allocate memory for routes\n");
-        exit(EXIT_FAILURE);
-    }
-    
-    route_count = 0;
 }
 
 // Register a route
 void register_route(const char *method, const char *pattern, RouteHandler handler) {
-    if (!routes) {
-        init_router();
+    register_route_with_data(method, pattern, handler, NULL);
+}
+
+// Register a route with handler data
+void register_route_with_data(const char *method, const char *pattern, RouteHandler handler, void *data) {
+    if (router_add(method, pattern, handler, data) != 0) {
+        fprintf(stderr, "Failed to register route %s %s\n", method, pattern);
     }
-    
-    if (route_count >= MAX_ROUTES) {
-        fprintf(stderr, "Maximum route limit reached\n");
-        return;
+}
+
+// Copy a captured route parameter
+int get_route_param(const HttpRequest *request, const char *name, char *out, size_t out_size) {
+    for (int i = 0; i < request->param_count; i++) {
+        if (strcmp(request->params[i].name, name) == 0) {
+            size_t length = request->params[i].length;
+            if (length >= out_size) return -1;
+            memcpy(out, request->params[i].value, length);
+            out[length] = '\0';
+            return (int)length;
+        }
     }
-    
-    strncpy(routes[route_count].method, method, sizeof(routes[route_count].method) - 1);
-    strncpy(routes[route_count].pattern, pattern, sizeof(routes[route_count].pattern) - 1);
-    routes[route_count].handler = handler;
-    
-    route_count++;
+    return -1;
 }
 
+// Duration series for requests no route matched
+static int unmatched_metric = -1;
+
 // Route the request to the appropriate handler
 void route_request(HttpRequest *request, HttpResponse *response) {
-    if (!routes || !request || !response) return;
-    
-    // Find matching route
-    for (int i = 0; i < route_count; i++) {
-        if (strcasecmp(routes[i].method, request->method) == 0 &&
-            match_pattern(routes[i].pattern, request->path)) {
-            // Found a matching route
-            routes[i].handler(request, response);
-            return;
-        }
+    if (!request || !response) return;
+    
+    uint64_t start = metrics_start();
+    int metric = -1;
+    RouteHandler handler = router_match(request, &metric);
+    if (handler) {
+        handler(request, response);
+        metrics_observe_since(metric, start);
+        return;
     }
     
     // No matching route found
     strcpy(response->status, "404 Not Found");
     const char *not_found = "404 Not Found - Resource not available";
-    response->body_length = strlen(not_found);
-    response->body = strdup(not_found);
+    set_response_body(response, not_found, strlen(not_found));
+    metrics_observe_since(unmatched_metric, start);
 }
 
-// Handle request - main client connection handler
-void *handle_request(void *client_socket) {
-    int socket = (intptr_t) client_socket;
-    char buffer[BUFFER_SIZE];
-    ssize_t bytes_read;
+// Set a plain-text status and body on a response
+static void set_simple_response(HttpResponse *response, const char *status, const char *body) {
+    strcpy(response->status, status);
+    strcpy(response->content_type, "text/plain");
+    set_response_body(response, body, strlen(body));
+}
 
-    bytes_read = read(socket, buffer, sizeof(buffer) - 1);
-    if (bytes_read > 0) {
-        buffer[bytes_read] = '\0';
-        
-        // Parse the request
-        HttpRequest *request = parse_request(buffer, bytes_read);
-        if (request) {
-            // Create a response object
-            HttpResponse *response = create_response();
-            if (response) {
-                // Route the request
-                route_request(request, response);
-                
-                // Send the response
-                send_response(socket, response);
-                
-                // Clean up
-                free_response(response);
-            } else {
-                // Failed to create response
-                send_simple_response(socket, "500 Internal Server Error", "text/plain", 
-                                     "Internal server error: Could not create response");
-            }
-            
-            free_request(request);
+// Decide whether the connection survives this request. HTTP/1.1 is persistent
+// unless the client says "close"; HTTP/1.0 only when it asks for keep-alive.
+static int wants_keep_alive(HttpRequest *request) {
+    const char *connection = get_request_header(request, "Connection");
+    if (strcmp(request->version, "HTTP/1.0") == 0) {
+        return connection && strcasestr(connection, "keep-alive") != NULL;
+    }
+    return !(connection && strcasestr(connection, "close") != NULL);
+}
+
+// A streamed body passed through a Compressor
+typedef struct {
+    ResponseStream source;
+    Compressor *compressor;
+    int finished;
+} CompressedStream;
+
+static const char* compressed_stream_next(void *state, size_t *length) {
+    CompressedStream *stream = state;
+    while (!stream->finished) {
+        size_t piece_length = 0;
+        const char *piece = stream->source.next(stream->source.state, &piece_length);
+        stream->finished = piece == NULL;
+        const char *out = compressor_push(stream->compressor, piece, piece ? piece_length : 0,
+                                          stream->finished, length);
+        if (!out) {
+            // zlib failed: end the body here
+            stream->finished = 1;
+            return NULL;
+        }
+        if (*length > 0) return out;
+    }
+    return NULL;
+}
+
+static void compressed_stream_release(void *state) {
+    CompressedStream *stream = state;
+    if (stream->source.release) stream->source.release(stream->source.state);
+    compressor_destroy(stream->compressor);
+    free(stream);
+}
+
+// Put the body of a response into the encoding negotiated for it. A body
+// below the minimum size, or one that doesn't shrink, is left as it is.
+static void compress_response(HttpResponse *response) {
+    if (response->encoding == CONTENT_ENCODING_IDENTITY || response->body_encoded) return;
+
+    if (response->stream.next) {
+        CompressedStream *stream = malloc(sizeof(CompressedStream));
+        Compressor *compressor = stream ? compressor_create(response->encoding) : NULL;
+        if (!compressor) {
+            free(stream);
+            response->encoding = CONTENT_ENCODING_IDENTITY;
+            return;
+        }
+        stream->source = response->stream;
+        stream->compressor = compressor;
+        stream->finished = 0;
+        response->stream.next = compressed_stream_next;
+        response->stream.release = compressed_stream_release;
+        response->stream.state = stream;
+        return;
+    }
+
+    char *compressed;
+    size_t compressed_length;
+    size_t body_length = response_body_length(response);
+    if (body_length < compression_min_size() ||
+        compress_buffer(response->encoding, response->body, body_length, response->arena,
+                        &compressed, &compressed_length) != 0) {
+        response->encoding = CONTENT_ENCODING_IDENTITY;
+        return;
+    }
+    if (response->body && !response->body_in_arena) free(response->body);
+    response->body = compressed;
+    response->body_length = (int)compressed_length;
+    response->body_in_arena = response->arena != NULL;
+}
+
+// "Connection: keep-alive" plus the Keep-Alive hint, formatted once at startup
+static char keep_alive_lines[64] = "Connection: keep-alive\r\n";
+
+// Requests handed to the worker pool and not finished yet, against config.max_in_flight
+static int requests_in_flight = 0;
+static int shed_metric = -1;
+
+// Parse, route and serialize the request at the front of a connection's
+// buffer. With shed set the server is saturated: the request is answered
+// 503 with a Retry-After instead of being routed.
+static void process_request(Connection *conn, int shed) {
+    const ServerConfig *config = &conn->loop->config;
+
+    HttpRequest *request = conn->error_status ? NULL : &conn->request;
+
+    conn->requests_served++;
+    // Everything the request allocates comes from the connection's arena,
+    // which is reset once the response has been sent
+    HttpResponse response_storage;
+    HttpResponse *response = &response_storage;
+    init_response(response, &conn->arena);
+
+    if (request) {
+        request->arena = &conn->arena;
+        conn->keep_alive = conn->keep_alive && config->keepalive_timeout > 0 &&
+                           conn->requests_served < config->max_keepalive_requests &&
+                           wants_keep_alive(request);
+        response->encoding = compression_negotiate(get_request_header(request, "Accept-Encoding"));
+        if (shed) {
+            char retry_after[16];
+            snprintf(retry_after, sizeof(retry_after), "%d", RETRY_AFTER_SECONDS);
+            set_simple_response(response, "503 Service Unavailable", "Server busy, retry later");
+            add_response_header(response, "Retry-After", retry_after);
+            metrics_count(shed_metric, 1);
+        } else if (config->read_only && strcmp(request->method, "GET") != 0 &&
+                   strcmp(request->method, "HEAD") != 0) {
+            // A replica's tables only change through replication
+            set_simple_response(response, "405 Method Not Allowed", "Read-only replica: send writes to the primary");
+            add_response_header(response, "Allow", "GET, HEAD");
+        } else {
+            // Route the request
+            route_request(request, response);
+        }
+
+        compress_response(response);
+        if (response->encoding != CONTENT_ENCODING_IDENTITY) {
+            add_response_header(response, "Content-Encoding", compression_encoding_name(response->encoding));
+        }
+        if (compression_enabled()) add_response_header(response, "Vary", "Accept-Encoding");
+    } else {
+        // Failed to parse request; the rest of the stream can't be trusted
+        conn->keep_alive = 0;
+        const char *status = conn->error_status ? conn->error_status : "400 Bad Request";
+        set_simple_response(response, status, strncmp(status, "400", 3) == 0 ?
+                            "Bad request: Could not parse request" : status);
+    }
+
+    // A streamed body is chunked for HTTP/1.1; HTTP/1.0 has no chunked
+    // encoding, so the body runs until the connection closes
+    int streamed = response->stream.next != NULL;
+    int chunked = streamed && request && strcmp(request->version, "HTTP/1.0") != 0;
+    // HEAD is routed to the GET handler and answered with its headers alone
+    int head = request && strcmp(request->method, "HEAD") == 0;
+    if (streamed && !chunked && !head) conn->keep_alive = 0;
+
+    // Headers go into the connection's reusable buffer; the body is handed
+    // over as is and sent right behind them
+    char stream_lines[sizeof(keep_alive_lines) + 32];
+    const char *connection_lines = conn->keep_alive ? keep_alive_lines : "Connection: close\r\n";
+    if (chunked) {
+        snprintf(stream_lines, sizeof(stream_lines), "%sTransfer-Encoding: chunked\r\n", connection_lines);
+        connection_lines = stream_lines;
+    }
+    size_t body_length = response_body_length(response);
+    if (connection_reserve_headers(conn, response_headers_size(response, connection_lines)) < 0) {
+        conn->keep_alive = 0;
+        connection_clear_output(conn);
+    } else if (streamed) {
+        size_t headers_length = write_response_headers(conn->out_headers, response, BODY_LENGTH_STREAMED,
+                                                       connection_lines);
+        if (head) {
+            connection_set_output(conn, headers_length, NULL, 0, 1); // The stream goes with the response
         } else {
-            // Failed to parse request
-            send_simple_response(socket, "400 Bad Request", "text/plain", 
-                                 "Bad request: Could not parse request");
+            // The connection takes the stream over and produces the first piece here, on the worker
+            connection_set_stream(conn, headers_length, &response->stream, chunked);
+            memset(&response->stream, 0, sizeof(response->stream));
         }
     } else {
-        // Failed to read request
-        send_simple_response(socket, "400 Bad Request", "text/plain", 
-                             "Bad request: Empty or invalid request");
+        // A HEAD response keeps the Content-Length of the body it leaves out
+        size_t headers_length = write_response_headers(conn->out_headers, response, body_length,
+                                                       connection_lines);
+        size_t sent_length = head ? 0 : body_length;
+        connection_set_output(conn, headers_length, sent_length ? response->body : NULL, sent_length,
+                              !response->body_in_arena);
+        if (sent_length) response->body = NULL;
     }
 
-    close(socket);
-    return NULL;
+    release_response(response);
 }
 
-// Start the server
-void start_server(const char *port) {
-    // Initialize router
-    init_router();
-    
-    // Set up socket
-    int server_socket, client_socket;
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t client_len = sizeof(client_addr);
-    int port_number = atoi(port);
-
-    if ((server_socket = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
-        perror("Socket creation failed");
-        exit(EXIT_FAILURE);
+// Worker pool job: process the request, then hand the connection back to its loop
+static void process_request_job(void *arg) {
+    Connection *conn = arg;
+    process_request(conn, 0);
+    __atomic_sub_fetch(&requests_in_flight, 1, __ATOMIC_RELAXED);
+    event_loop_complete(conn->loop, conn);
+}
+
+// Hand a request to the worker pool, unless max_in_flight requests are
+// already there or its queue is full. Returns 0 if it was queued.
+static int submit_request(Connection *conn) {
+    int limit = conn->loop->config.max_in_flight;
+    int in_flight = __atomic_add_fetch(&requests_in_flight, 1, __ATOMIC_RELAXED);
+    if ((limit <= 0 || in_flight <= limit) &&
+        thread_pool_submit(conn->loop->workers, process_request_job, conn) == 0) {
+        return 0;
+    }
+    __atomic_sub_fetch(&requests_in_flight, 1, __ATOMIC_RELAXED);
+    return -1;
+}
+
+// Worker pool job: produce the next piece of a streamed body, then hand the
+// connection back to its loop to send it
+static void next_piece_job(void *arg) {
+    Connection *conn = arg;
+    connection_next_piece(conn);
+    event_loop_complete(conn->loop, conn);
+}
+
+// Hand the next piece of a streamed body to the worker pool. A piece is part
+// of a request already admitted, so max_in_flight does not apply. Returns 0 if
+// it was queued; with the queue full the loop's sweep tries again.
+static int submit_next_piece(Connection *conn) {
+    conn->state = CONN_PROCESSING;
+    if (thread_pool_submit(conn->loop->workers, next_piece_job, conn) == 0) return 0;
+    conn->state = CONN_WRITING;
+    return -1;
+}
+
+// Answer "Expect: 100-continue" once the headers are in, so the client sends the body
+static void send_continue(Connection *conn) {
+    static const char interim[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    if (!conn->parser.expect_continue || conn->parser.stage == PARSER_HEADERS) return;
+
+    conn->parser.expect_continue = 0;
+    ssize_t ignored = send(conn->fd, interim, sizeof(interim) - 1, MSG_NOSIGNAL);
+    (void)ignored;
+}
+
+// Handle request - per-connection state machine, driven by the owning event loop.
+// Pipelined requests are served one at a time from the same buffer, so
+// responses always leave in request order.
+void handle_request(Connection *conn) {
+    while (1) {
+        if (conn->state == CONN_READING) {
+            if (!conn->peer_closed &&
+                connection_fill(conn, http_parser_expected_length(&conn->parser)) < 0) {
+                conn->state = CONN_CLOSING;
+                return;
+            }
+            // The read deadline runs from the request's first byte
+            if (conn->in_length > 0 && !conn->request_started_ms) conn->request_started_ms = conn->loop->now_ms;
+
+            ParseResult result = http_parser_execute(&conn->parser, conn->in_buffer,
+                                                     conn->in_length, &conn->request);
+            conn->keep_alive = 1;
+            if (result == PARSE_COMPLETE) {
+                conn->request_length = conn->parser.request_length;
+            } else if (result == PARSE_ERROR) {
+                conn->error_status = conn->parser.error_status;
+            } else if (conn->peer_closed || conn->in_length + 1 >= conn->in_capacity) {
+                // The client stopped sending (or overran the buffer) mid-request
+                if (conn->in_length == 0) {
+                    conn->state = CONN_CLOSING;
+                    return;
+                }
+                conn->error_status = conn->in_length + 1 >= conn->in_capacity ?
+                                     "413 Payload Too Large" : "400 Bad Request";
+            } else {
+                send_continue(conn);
+                return;
+            }
+            if (conn->error_status) {
+                conn->request_length = conn->in_length;
+                conn->keep_alive = 0;
+            }
+
+            conn->state = CONN_PROCESSING;
+            conn->request_started_ms = 0;
+            if (submit_request(conn) == 0) {
+                return; // The worker hands the connection back via event_loop_complete
+            }
+
+            // Saturated: answer 503 right here rather than queue without bound
+            // or hold the loop up running the request
+            process_request(conn, 1);
+            conn->state = CONN_WRITING;
+        }
+
+        if (conn->state != CONN_WRITING) return;
+
+        int result = connection_flush(conn);
+        if (result == 0) return; // Socket full; EPOLLOUT resumes the flush
+        if (result == 2) {
+            // Piece sent: reading and encoding the next one is worker work
+            submit_next_piece(conn);
+            return;
+        }
+        if (result < 0 || !conn->keep_alive) {
+            conn->state = CONN_CLOSING;
+            return;
+        }
+
+        // Response sent: move on to the next (possibly already buffered) request
+        connection_clear_output(conn);
+        connection_consume_request(conn);
+        conn->state = CONN_READING;
+        conn->request_started_ms = conn->in_length > 0 ? conn->loop->now_ms : 0;
     }
+}
 
-    int opt = 1;
-    setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+// Running event loops, kept so stop_server() can reach them
+static EventLoop **server_loops = NULL;
+static int server_loop_count = 0;
+
+// Fill a configuration with the defaults
+void server_config_defaults(ServerConfig *config) {
+    config->port = PORT;
+    config->event_loops = 0;
+    config->worker_threads = 0;
+    config->worker_queue = WORKER_QUEUE_SIZE;
+    config->keepalive_timeout = KEEPALIVE_TIMEOUT;
+    config->max_keepalive_requests = MAX_KEEPALIVE_REQUESTS;
+    config->max_connections = MAX_OPEN_CONNECTIONS;
+    config->max_in_flight = 0;
+    config->read_timeout = READ_TIMEOUT;
+    config->write_timeout = WRITE_TIMEOUT;
+    config->read_only = 0;
+}
 
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(port_number);
+// Gauges of the server's load, for /metrics
+static void collect_server_metrics(void *context, MetricsText *out) {
+    ThreadPool *workers = context;
+    metrics_text_printf(out, "# HELP cerver_http_connections_open Client connections open.\n"
+                             "# TYPE cerver_http_connections_open gauge\n"
+                             "cerver_http_connections_open %d\n", event_loop_open_connections());
+    metrics_text_printf(out, "# HELP cerver_http_requests_in_flight Requests queued for or running on a worker.\n"
+                             "# TYPE cerver_http_requests_in_flight gauge\n"
+                             "cerver_http_requests_in_flight %d\n",
+                        __atomic_load_n(&requests_in_flight, __ATOMIC_RELAXED));
+    metrics_text_printf(out, "# HELP cerver_http_worker_queue_depth Requests waiting for a worker.\n"
+                             "# TYPE cerver_http_worker_queue_depth gauge\n"
+                             "cerver_http_worker_queue_depth %d\n", thread_pool_queue_depth(workers));
+}
 
-    if (bind(server_socket, (struct sockaddr *) &server_addr, sizeof(server_addr)) < 0) {
-        perror("Bind failed");
+#define FD_RESERVE 64           // Descriptors kept back from the connection limit
+
+// Keep the connection limit under the process's file descriptor limit, with
+// room for table files and the loops' own descriptors, so accept never fails
+// with EMFILE on a listener that stays ready
+static int clamp_connection_limit(int requested) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY) return requested;
+    long usable = (long)limit.rlim_cur - FD_RESERVE;
+    if (usable < 1) usable = 1;
+    if (requested > 0 && requested <= usable) return requested;
+    printf("Note: Serving at most %ld connections (open file limit %ld).\n", usable, (long)limit.rlim_cur);
+    return (int)usable;
+}
+
+// Start the server with default settings
+void start_server(const char *port) {
+    ServerConfig config;
+    server_config_defaults(&config);
+    config.port = atoi(port);
+    start_server_with_config(&config);
+}
+
+// Start the server: one SO_REUSEPORT listener per event loop, all sharing one worker pool
+void start_server_with_config(const ServerConfig *config) {
+    // Initialize router; the route trie is read-only from here on
+    init_router();
+    router_seal();
+    unmatched_metric = router_metric("any", "unmatched");
+    shed_metric = metrics_counter("cerver_http_requests_shed_total",
+                                  "Requests answered 503 because the workers were saturated.", NULL);
+    connection_metrics_init();
+    event_loop_metrics_init();
+
+    snprintf(keep_alive_lines, sizeof(keep_alive_lines),
+             "Connection: keep-alive\r\nKeep-Alive: timeout=%d\r\n", config->keepalive_timeout);
+
+    // A client that disconnects mid-response must not kill the process
+    signal(SIGPIPE, SIG_IGN);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) cpus = 1;
+    int loop_count = config->event_loops > 0 ? config->event_loops : (int)cpus;
+    int worker_count = config->worker_threads > 0 ? config->worker_threads : (int)cpus;
+    int queue_size = config->worker_queue > 0 ? config->worker_queue : WORKER_QUEUE_SIZE;
+
+    ThreadPool *workers = thread_pool_create(worker_count, queue_size);
+    if (!workers) {
+        fprintf(stderr, "Failed to create worker pool\n");
         exit(EXIT_FAILURE);
     }
 
-    if (listen(server_socket, MAX_CONNECTIONS) < 0) {
-        perror("Listen failed");
+    EventLoop **loops = calloc(loop_count, sizeof(EventLoop*));
+    if (!loops) {
+        fprintf(stderr, "Failed to allocate event loops\n");
         exit(EXIT_FAILURE);
     }
 
-    printf("Server is listening on port %s...\n", port);
+    ServerConfig loop_config = *config;
+    loop_config.max_connections = clamp_connection_limit(config->max_connections);
+    metrics_add_collector(collect_server_metrics, workers);
 
-    while (1) {
-        client_socket = accept(server_socket, (struct sockaddr *) &client_addr, &client_len);
-        if (client_socket < 0) {
-            perror("Accept failed");
-            continue;
+    for (int i = 0; i < loop_count; i++) {
+        loops[i] = event_loop_create(i, &loop_config, workers);
+        if (!loops[i] || event_loop_start(loops[i]) != 0) {
+            fprintf(stderr, "Failed to start event loop %d\n", i);
+            exit(EXIT_FAILURE);
         }
+    }
+    server_loops = loops;
+    server_loop_count = loop_count;
 
-        pthread_t thread_id;
-        if (pthread_create(&thread_id, NULL, handle_request, (void *) (intptr_t) client_socket) != 0) {
-            perror("Thread creation failed");
-            close(client_socket);
-        } else {
-            pthread_detach(thread_id);
-        }
+    printf("Server is listening on port %d (%d event loops, %d workers)...\n",
+           config->port, loop_count, worker_count);
+
+    for (int i = 0; i < loop_count; i++) {
+        event_loop_join(loops[i]);
     }
 
-    close(server_socket);
+    // Let in-flight requests finish before tearing down their connections
+    server_loop_count = 0;
+    metrics_remove_collector(collect_server_metrics, workers);
+    thread_pool_destroy(workers);
+    for (int i = 0; i < loop_count; i++) {
+        event_loop_destroy(loops[i]);
+    }
+    server_loops = NULL;
+    free(loops);
+}
+
+// Stop all event loops so start_server returns
+void stop_server() {
+    for (int i = 0; i < server_loop_count; i++) {
+        if (server_loops && server_loops[i]) event_loop_stop(server_loops[i]);
+    }
 }
@@ -12,27 +12,97 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <ctype.h>
+#include "../utils/arena.h"
+#include "compression.h"
+
+#define PORT 3000
+#define MAX_CONNECTIONS 1000    // Listen backlog per event loop
+#define WORKER_QUEUE_SIZE 1024  // Requests allowed to wait for a worker
+#define KEEPALIVE_TIMEOUT 5     // Seconds an idle keep-alive connection stays open
+#define MAX_KEEPALIVE_REQUESTS 100 // Requests served on one connection before it is closed
+#define MAX_HEADERS 20          // Headers kept per request/response; extra request headers are ignored
+#define MAX_HEADER_SIZE (64 * 1024)        // Request line + headers
+#define MAX_REQUEST_SIZE (8 * 1024 * 1024) // Headers + body
+#define MAX_ROUTE_PARAMS 8      // ":name" segments captured per request
+#define MAX_OPEN_CONNECTIONS 10000 // Open connections across all loops before new ones are turned away
+#define READ_TIMEOUT 10         // Seconds a request may take to arrive once its first byte is in
+#define WRITE_TIMEOUT 10        // Seconds a response may go without the client taking any of it
+#define RETRY_AFTER_SECONDS 1   // Retry-After of a 503 sent while the server is saturated
+
+// Server configuration (see server_config_defaults)
+typedef struct {
+    int port;              // TCP port to listen on
+    int event_loops;       // Number of epoll loop threads (0 = one per online CPU)
+    int worker_threads;    // Number of worker pool threads (0 = one per online CPU)
+    int worker_queue;      // Max requests waiting for a worker before loops run them inline
+    int keepalive_timeout; // Idle seconds before a persistent connection is closed (0 = no keep-alive)
+    int max_keepalive_requests; // Requests per connection before the server sends Connection: close
+    int max_connections;   // Open connections; more are answered 503 and closed (0 = up to the fd limit)
+    int max_in_flight;     // Requests queued for or running on a worker; more are shed with 503 (0 = no cap
+                           // beyond worker_queue)
+    int read_timeout;      // Seconds a started request may take to arrive in full (0 = no limit)
+    int write_timeout;     // Seconds a response may make no progress before the connection is dropped (0 = no limit)
+    int read_only;         // Refuse requests that write (replicas): only GET and HEAD are routed
+} ServerConfig;
+
+// A client connection owned by an event loop (see connection.h)
+typedef struct Connection Connection;
+
+// Request header; both strings point into the connection's input buffer
+typedef struct {
+    const char *name;
+    const char *value;
+} HttpHeader;
+
+// Path segment captured by a ":name" route pattern; value points into request->path
+typedef struct {
+    const char *name;
+    const char *value;
+    size_t length;
+} RouteParam;
 
 // HTTP request structure
 typedef struct {
     char method[10];       // GET, POST, PUT, DELETE, PATCH
     char path[256];        // URL path
     char version[10];      // HTTP version
-    char **headers;        // Array of headers
+    HttpHeader headers[MAX_HEADERS]; // Headers, in arrival order
     int header_count;      // Number of headers
-    char *body;            // Request body (if any)
+    char *body;            // Request body (if any), NUL-terminated inside the input buffer
     int body_length;       // Length of body data
     char query_string[256]; // Query parameters
+    RouteParam params[MAX_ROUTE_PARAMS]; // Set by the router
+    int param_count;
+    void *route_data;      // Data registered with the matched route
+    Arena *arena;          // Per-request memory, freed once the response is sent (NULL outside the server)
 } HttpRequest;
 
+// Response body produced piece by piece, so it never has to be held in memory
+// at once. The server sends it with chunked transfer encoding (to HTTP/1.0
+// clients: unframed, then closes the connection). next is called each time the
+// previous piece has been sent and returns the next one (owned by the producer,
+// valid until the following call), or NULL once the body is complete. release
+// is called exactly once, when the response is finished or abandoned.
+typedef struct {
+    const char* (*next)(void *state, size_t *length);
+    void (*release)(void *state);
+    void *state;
+} ResponseStream;
+
 // HTTP response structure
 typedef struct {
     char status[30];       // Status code and message
-    char **headers;        // Array of headers
+    char *headers[MAX_HEADERS]; // Header lines ("Name: value")
     int header_count;      // Number of headers
-    char *body;            // Response body
+    char *body;            // Response body (malloc'd unless body_in_arena)
     int body_length;       // Length of body data
+    int body_in_arena;     // body belongs to arena and must not be freed
     char content_type[50]; // Content type header value
+    ResponseStream stream; // Streamed body, used instead of body when stream.next is set
+    ContentEncoding encoding; // Encoding the client accepts, set before routing; the server
+                              // compresses the body into it unless body_encoded is set
+    int body_encoded;      // The handler already put body in encoding
+    Arena *arena;          // Where headers and set_response_body copies go; NULL for malloc
 } HttpResponse;
 
 // Function to initialize a new HTTP response
@@ -41,19 +111,35 @@ HttpResponse* create_response();
 // Function to free an HTTP response
 void free_response(HttpResponse *response);
 
-// Function to parse HTTP request
+// Initialize a response in place whose headers and body are allocated in
+// arena (NULL: with malloc, released by release_response)
+void init_response(HttpResponse *response, Arena *arena);
+
+// Free what a response initialized with init_response owns, but not the struct
+void release_response(HttpResponse *response);
+
+// Function to set the response body to a copy of data (in the response's
+// arena, if it has one). Returns 0 on success, -1 if out of memory.
+int set_response_body(HttpResponse *response, const char *data, size_t length);
+
+// Function to parse a complete HTTP request held in buffer (modified in place; it
+// must have one writable byte past buffer_size). The request points into buffer.
 HttpRequest* parse_request(char *buffer, int buffer_size);
 
 // Function to free an HTTP request
 void free_request(HttpRequest *request);
 
+// Function to look up a request header value by name (case-insensitive); NULL if absent
+const char* get_request_header(HttpRequest *request, const char *name);
+
 // Function to add header to response
 void add_response_header(HttpResponse *response, const char *name, const char *value);
 
-// Function to handle client connection
-void *handle_request(void *client_socket);
+// Advance a connection's state machine: read, dispatch to a worker, write.
+// Called by the owning event loop whenever the socket is ready or a worker finishes.
+void handle_request(Connection *conn);
 
-// Function to send HTTP response
+// Function to send HTTP response (blocking; a streamed body is not supported here)
 void send_response(int client_socket, HttpResponse *response);
 
 // Function to send a simple text response (convenience method)
@@ -65,6 +151,10 @@ void send_json_response(int client_socket, const char *status, const char *body)
 // Function to extract parameter from URL path
 char* extract_path_parameter(const char *path, const char *pattern, const char *param_name);
 
+// Function to copy a route parameter captured by the router into out;
+// returns its length, or -1 if absent or it doesn't fit
+int get_route_param(const HttpRequest *request, const char *name, char *out, size_t out_size);
+
 // URL parameter structure
 typedef struct {
     char *name;
@@ -77,15 +167,28 @@ UrlParam** parse_query_string(const char *query_string, int *param_count);
 // Function to free URL parameters
 void free_url_params(UrlParam **params, int param_count);
 
-// Function to start the HTTP server
+// Function to fill a configuration with the defaults
+void server_config_defaults(ServerConfig *config);
+
+// Function to start the HTTP server with default settings on the given port
 void start_server(const char *port);
 
+// Function to start the HTTP server; returns after stop_server() is called
+void start_server_with_config(const ServerConfig *config);
+
+// Function to make start_server return (async-signal-safe)
+void stop_server();
+
 // Typedef for a route handler function
 typedef void (*RouteHandler)(HttpRequest *request, HttpResponse *response);
 
-// Register a route with the server
+// Register a route with the server. Patterns may contain ":name" segments
+// (captured into request->params) and "*" segments (any single segment).
 void register_route(const char *method, const char *pattern, RouteHandler handler);
 
+// Register a route whose handler receives data as request->route_data
+void register_route_with_data(const char *method, const char *pattern, RouteHandler handler, void *data);
+
 // Initialize the routing system
 void init_router();
 
@@ -0,0 +1,311 @@
+#include "router.h"
+#include "../utils/metrics.h"
+
+// Methods with a handler slot on every node
+typedef enum {
+    METHOD_GET,
+    METHOD_HEAD,
+    METHOD_POST,
+    METHOD_PUT,
+    METHOD_PATCH,
+    METHOD_DELETE,
+    METHOD_OPTIONS,
+    METHOD_COUNT
+} RouteMethod;
+
+static const char *method_names[METHOD_COUNT] = {
+    "GET", "HEAD", "POST", "PUT", "PATCH", "DELETE", "OPTIONS"
+};
+
+typedef struct {
+    RouteHandler handler;
+    void *data;
+    int metric;                         // Request duration histogram of the route
+} RouteSlot;
+
+typedef struct RouterNode {
+    char *prefix;                       // Static text on the edge into this node
+    size_t prefix_length;
+
+    struct RouterNode **children;       // Static children, sorted by prefix[0]
+    int child_count;
+    struct RouterNode *param_child;     // ":name" segment
+    char *param_name;                   // Name captured by param_child
+    struct RouterNode *wildcard_child;  // "*" segment
+
+    RouteSlot slots[METHOD_COUNT];
+} RouterNode;
+
+static RouterNode *root = NULL;
+static int route_count = 0;
+static int sealed = 0;
+
+// Map a method name to its slot, or -1
+static int method_index(const char *method) {
+    for (int i = 0; i < METHOD_COUNT; i++) {
+        if (strcasecmp(method_names[i], method) == 0) return i;
+    }
+    return -1;
+}
+
+// Allocate a node for the given static edge text
+static RouterNode* create_node(const char *prefix, size_t length) {
+    RouterNode *node = calloc(1, sizeof(RouterNode));
+    if (!node) return NULL;
+
+    node->prefix = malloc(length + 1);
+    if (!node->prefix) {
+        free(node);
+        return NULL;
+    }
+    memcpy(node->prefix, prefix, length);
+    node->prefix[length] = '\0';
+    node->prefix_length = length;
+    return node;
+}
+
+// Binary search of the static children by first byte
+static RouterNode* find_child(RouterNode *node, char first) {
+    int low = 0, high = node->child_count - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        char c = node->children[mid]->prefix[0];
+        if (c == first) return node->children[mid];
+        if (c < first) low = mid + 1;
+        else high = mid - 1;
+    }
+    return NULL;
+}
+
+// Insert a static child keeping the array sorted
+static int add_child(RouterNode *node, RouterNode *child) {
+    RouterNode **children = realloc(node->children, (node->child_count + 1) * sizeof(RouterNode*));
+    if (!children) return -1;
+    node->children = children;
+
+    int pos = node->child_count;
+    while (pos > 0 && children[pos - 1]->prefix[0] > child->prefix[0]) {
+        children[pos] = children[pos - 1];
+        pos--;
+    }
+    children[pos] = child;
+    node->child_count++;
+    return 0;
+}
+
+// Split child so its edge is only the first length bytes; returns the new parent
+static RouterNode* split_child(RouterNode *parent, RouterNode *child, size_t length) {
+    RouterNode *middle = create_node(child->prefix, length);
+    if (!middle) return NULL;
+
+    // The existing child keeps the tail of its edge under the new node
+    size_t tail_length = child->prefix_length - length;
+    memmove(child->prefix, child->prefix + length, tail_length + 1);
+    child->prefix_length = tail_length;
+
+    middle->children = malloc(sizeof(RouterNode*));
+    if (!middle->children) {
+        free(middle->prefix);
+        free(middle);
+        return NULL;
+    }
+    middle->children[0] = child;
+    middle->child_count = 1;
+
+    for (int i = 0; i < parent->child_count; i++) {
+        if (parent->children[i] == child) parent->children[i] = middle;
+    }
+    return middle;
+}
+
+// Static text up to the next ":" or "*" segment, which starts right after a '/'
+static size_t static_run(const char *pattern) {
+    size_t length = 0;
+    while (pattern[length]) {
+        if ((pattern[length] == ':' || pattern[length] == '*') &&
+            length > 0 && pattern[length - 1] == '/') break;
+        length++;
+    }
+    return length;
+}
+
+// Request duration series of a route, labelled by its pattern rather than
+// the path, so there is one series per route whatever the ids requested
+int router_metric(const char *method, const char *pattern) {
+    char labels[512];
+    char escaped[256];
+    size_t length = 0;
+    for (const char *c = pattern; *c && length + 2 < sizeof(escaped); c++) {
+        if (*c == '"' || *c == '\\') escaped[length++] = '\\';
+        escaped[length++] = *c;
+    }
+    escaped[length] = '\0';
+    snprintf(labels, sizeof(labels), "method=\"%s\",route=\"%s\"", method, escaped);
+    return metrics_histogram("cerver_http_request_duration_seconds",
+                             "Time spent handling HTTP requests, by route.", labels);
+}
+
+// Add a route
+int router_add(const char *method, const char *pattern, RouteHandler handler, void *data) {
+    if (!method || !pattern || !handler || pattern[0] != '/') return -1;
+    if (sealed) {
+        fprintf(stderr, "Router: routes can't be added once the server is running (%s %s)\n", method, pattern);
+        return -1;
+    }
+
+    int slot = method_index(method);
+    if (slot < 0) {
+        fprintf(stderr, "Router: unsupported method %s\n", method);
+        return -1;
+    }
+
+    if (!root) {
+        root = create_node("", 0);
+        if (!root) return -1;
+    }
+
+    RouterNode *node = root;
+    const char *rest = pattern;
+    while (*rest) {
+        if ((*rest == ':' || *rest == '*') && rest[-1] == '/') {
+            // Parameter or wildcard segment
+            const char *end = strchr(rest, '/');
+            if (!end) end = rest + strlen(rest);
+
+            RouterNode **next = *rest == ':' ? &node->param_child : &node->wildcard_child;
+            if (!*next) {
+                *next = create_node("", 0);
+                if (!*next) return -1;
+                if (*rest == ':') {
+                    node->param_name = strndup(rest + 1, end - rest - 1);
+                    if (!node->param_name) return -1;
+                }
+            } else if (*rest == ':' && (strlen(node->param_name) != (size_t)(end - rest - 1) ||
+                                        strncmp(node->param_name, rest + 1, end - rest - 1) != 0)) {
+                fprintf(stderr, "Router: %s reuses parameter ':%s' under a different name\n",
+                        pattern, node->param_name);
+            }
+            node = *next;
+            rest = end;
+            continue;
+        }
+
+        size_t run = static_run(rest);
+        RouterNode *child = find_child(node, rest[0]);
+        if (!child) {
+            child = create_node(rest, run);
+            if (!child || add_child(node, child) < 0) return -1;
+            node = child;
+            rest += run;
+            continue;
+        }
+
+        size_t common = 0;
+        while (common < run && common < child->prefix_length && rest[common] == child->prefix[common]) {
+            common++;
+        }
+        if (common < child->prefix_length) {
+            child = split_child(node, child, common);
+            if (!child) return -1;
+        }
+        node = child;
+        rest += common;
+    }
+
+    if (node->slots[slot].handler) {
+        fprintf(stderr, "Router: %s %s registered twice; keeping the newer handler\n", method, pattern);
+    } else {
+        route_count++;
+    }
+    node->slots[slot].handler = handler;
+    node->slots[slot].data = data;
+    node->slots[slot].metric = router_metric(method, pattern);
+    return 0;
+}
+
+// Depth-first match of the rest of the path below node, backtracking from
+// static edges to parameters to wildcards
+static RouteSlot* match_node(RouterNode *node, const char *path, int slot, HttpRequest *request) {
+    if (*path == '\0') {
+        return node->slots[slot].handler ? &node->slots[slot] : NULL;
+    }
+
+    RouterNode *child = find_child(node, *path);
+    if (child && strncmp(path, child->prefix, child->prefix_length) == 0) {
+        RouteSlot *found = match_node(child, path + child->prefix_length, slot, request);
+        if (found) return found;
+    }
+
+    if (!node->param_child && !node->wildcard_child) return NULL;
+
+    const char *end = strchr(path, '/');
+    if (!end) end = path + strlen(path);
+    if (end == path) return NULL; // Segments can't be empty
+
+    if (node->param_child) {
+        int index = request->param_count;
+        if (index < MAX_ROUTE_PARAMS) {
+            request->params[index].name = node->param_name;
+            request->params[index].value = path;
+            request->params[index].length = end - path;
+            request->param_count++;
+        }
+        RouteSlot *found = match_node(node->param_child, end, slot, request);
+        if (found) return found;
+        request->param_count = index;
+    }
+
+    if (node->wildcard_child) {
+        return match_node(node->wildcard_child, end, slot, request);
+    }
+    return NULL;
+}
+
+// Find the handler for a request
+RouteHandler router_match(HttpRequest *request, int *metric) {
+    request->param_count = 0;
+    request->route_data = NULL;
+    if (!root) return NULL;
+
+    int slot = method_index(request->method);
+    if (slot < 0) return NULL;
+
+    RouteSlot *found = match_node(root, request->path, slot, request);
+    if (!found) return NULL;
+
+    request->route_data = found->data;
+    if (metric) *metric = found->metric;
+    return found->handler;
+}
+
+// Stop accepting routes
+void router_seal() {
+    sealed = 1;
+}
+
+// Number of routes registered
+int router_route_count() {
+    return route_count;
+}
+
+// Free a node and everything below it
+static void destroy_node(RouterNode *node) {
+    if (!node) return;
+    for (int i = 0; i < node->child_count; i++) {
+        destroy_node(node->children[i]);
+    }
+    destroy_node(node->param_child);
+    destroy_node(node->wildcard_child);
+    free(node->children);
+    free(node->param_name);
+    free(node->prefix);
+    free(node);
+}
+
+// Free the trie
+void router_destroy() {
+    destroy_node(root);
+    root = NULL;
+    route_count = 0;
+    sealed = 0;
+}
@@ -0,0 +1,36 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include "http_server.h"
+
+// Radix-trie router.
+//
+// Static path text is stored on compressed edges whose children are kept
+// sorted by first byte, so a lookup walks the path once whatever the number
+// of registered routes. A segment written as ":name" captures that segment
+// into request->params, and "*" matches any single segment. Static edges win
+// over parameters, and parameters win over "*". Each node has one handler slot
+// per method.
+
+// Add a route; method is one of GET, HEAD, POST, PUT, PATCH, DELETE, OPTIONS.
+// data is handed to the handler as request->route_data. Returns 0 on success.
+int router_add(const char *method, const char *pattern, RouteHandler handler, void *data);
+
+// Find the handler for a request, filling request->params and route_data,
+// and *metric (if not NULL) with the route's duration series.
+// Returns NULL when no route matches the method and path.
+RouteHandler router_match(HttpRequest *request, int *metric);
+
+// Duration series for requests of a method and route pattern (see metrics.h)
+int router_metric(const char *method, const char *pattern);
+
+// Stop accepting routes; lookups after this are safe from any thread
+void router_seal();
+
+// Number of routes registered
+int router_route_count();
+
+// Free the trie
+void router_destroy();
+
+#endif // ROUTER_H
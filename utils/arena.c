@@ -0,0 +1,124 @@
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_ALIGN(size) (((size) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t size;            // Usable bytes in data
+    size_t used;
+    _Alignas(ARENA_ALIGNMENT) unsigned char data[];
+};
+
+// Prepare an empty arena
+void arena_init(Arena *arena, size_t block_size) {
+    arena->blocks = NULL;
+    arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+}
+
+// Allocate a block of size usable bytes and put it at the front of the list
+static ArenaBlock* arena_grow(Arena *arena, size_t size) {
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + size);
+    if (!block) return NULL;
+    block->size = size;
+    block->used = 0;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    return block;
+}
+
+// Allocate size bytes from the current block, or a new one when it is full
+void* arena_alloc(Arena *arena, size_t size) {
+    size = ARENA_ALIGN(size);
+    if (size == 0) size = ARENA_ALIGNMENT;
+
+    ArenaBlock *block = arena->blocks;
+    if (!block || block->size - block->used < size) {
+        if (size > arena->block_size / 2) {
+            // Big allocation: a block of its own, behind the current one so
+            // the space left in that block is still used
+            ArenaBlock *current = arena->blocks;
+            if (current) arena->blocks = current->next;
+            block = arena_grow(arena, size);
+            if (current) {
+                current->next = arena->blocks;
+                arena->blocks = current;
+            }
+            if (!block) return NULL;
+            block->used = size;
+            return block->data;
+        }
+        block = arena_grow(arena, arena->block_size);
+        if (!block) return NULL;
+    }
+
+    void *memory = block->data + block->used;
+    block->used += size;
+    return memory;
+}
+
+// Resize an allocation, in place when it is the latest in the current block
+void* arena_realloc(Arena *arena, void *ptr, size_t old_size, size_t new_size) {
+    if (!ptr) return arena_alloc(arena, new_size);
+
+    ArenaBlock *block = arena->blocks;
+    size_t old_aligned = ARENA_ALIGN(old_size);
+    size_t new_aligned = ARENA_ALIGN(new_size);
+    if (block && (unsigned char*)ptr + old_aligned == block->data + block->used &&
+        block->used - old_aligned + new_aligned <= block->size) {
+        block->used = block->used - old_aligned + new_aligned;
+        return ptr;
+    }
+
+    void *memory = arena_alloc(arena, new_size);
+    if (!memory) return NULL;
+    memcpy(memory, ptr, old_size < new_size ? old_size : new_size);
+    return memory;
+}
+
+// Copy the first length bytes of str into the arena
+char* arena_strndup(Arena *arena, const char *str, size_t length) {
+    char *copy = arena_alloc(arena, length + 1);
+    if (!copy) return NULL;
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+// Copy a string into the arena
+char* arena_strdup(Arena *arena, const char *str) {
+    return str ? arena_strndup(arena, str, strlen(str)) : NULL;
+}
+
+// Free every allocation, keeping one regular block for the next request
+void arena_reset(Arena *arena) {
+    ArenaBlock *kept = NULL;
+    ArenaBlock *block = arena->blocks;
+    while (block) {
+        ArenaBlock *next = block->next;
+        if (!kept && block->size == arena->block_size) {
+            kept = block;
+        } else {
+            free(block);
+        }
+        block = next;
+    }
+    if (kept) {
+        kept->used = 0;
+        kept->next = NULL;
+    }
+    arena->blocks = kept;
+}
+
+// Free every block
+void arena_destroy(Arena *arena) {
+    ArenaBlock *block = arena->blocks;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+}
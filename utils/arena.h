@@ -0,0 +1,41 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Bump allocator for memory that lives exactly as long as one unit of work
+// (a request). Allocations are never freed one by one: arena_reset drops them
+// all at once and keeps the first block for the next unit, so a steady stream
+// of similar requests allocates nothing after the first one.
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock *blocks;     // Newest block first; the last one is kept on reset
+    size_t block_size;      // Usable bytes of a regular block
+} Arena;
+
+#define ARENA_DEFAULT_BLOCK_SIZE 16384
+
+// Prepare an empty arena; no memory is allocated until the first arena_alloc
+void arena_init(Arena *arena, size_t block_size);
+
+// Allocate size bytes aligned for any type. Requests larger than a block get a
+// block of their own. Returns NULL only when out of memory.
+void* arena_alloc(Arena *arena, size_t size);
+
+// Grow (or shrink) the allocation ptr of old_size bytes to new_size: in
+// place when it is the latest one in the current block and there is room,
+// otherwise by copying it. Returns NULL if out of memory (ptr stays valid).
+void* arena_realloc(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+
+// Copy a string, or its first length bytes, into the arena (NUL-terminated)
+char* arena_strdup(Arena *arena, const char *str);
+char* arena_strndup(Arena *arena, const char *str, size_t length);
+
+// Free everything allocated so far, keeping one block for reuse
+void arena_reset(Arena *arena);
+
+// Free every block
+void arena_destroy(Arena *arena);
+
+#endif // ARENA_H
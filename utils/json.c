@@ -0,0 +1,383 @@
+#include <stdlib.h>
+#include <string.h>
+#include "json.h"
+
+#define JSON_MAX_DEPTH 64           // Nesting accepted inside a value
+#define JSON_MAX_NAME 256           // Longest escaped member name looked up
+
+// --- Reading ---
+
+static const char* skip_whitespace(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    return p;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Validate the string whose opening quote is at p. Sets *after past the
+// closing quote and *escaped if it holds escape sequences. Returns 0 or -1.
+static int scan_string(const char *p, const char *end, const char **after, int *escaped) {
+    *escaped = 0;
+    for (p++; p < end; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c == '"') {
+            *after = p + 1;
+            return 0;
+        }
+        if (c < 0x20) return -1;
+        if (c != '\\') continue;
+
+        *escaped = 1;
+        if (++p >= end) return -1;
+        if (*p == 'u') {
+            if (end - p < 5) return -1;
+            for (int i = 1; i <= 4; i++) {
+                if (hex_value(p[i]) < 0) return -1;
+            }
+            p += 4;
+        } else if (!strchr("\"\\/bfnrt", *p)) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+static unsigned read_hex4(const char *p) {
+    return (unsigned)(hex_value(p[0]) << 12 | hex_value(p[1]) << 8 | hex_value(p[2]) << 4 | hex_value(p[3]));
+}
+
+// Decode the validated string body [p, stop) into dest, which needs stop - p
+// bytes at most (an escape never decodes to more bytes than it takes).
+// Returns the decoded length.
+static size_t unescape_string(const char *p, const char *stop, char *dest) {
+    char *out = dest;
+    while (p < stop) {
+        if (*p != '\\') {
+            *out++ = *p++;
+            continue;
+        }
+        p++;
+        char c = *p++;
+        switch (c) {
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case 'u': {
+                unsigned code = read_hex4(p);
+                p += 4;
+                if (code >= 0xD800 && code <= 0xDBFF && stop - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                    unsigned low = read_hex4(p + 2);
+                    if (low >= 0xDC00 && low <= 0xDFFF) {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        p += 6;
+                    }
+                }
+                if (code >= 0xD800 && code <= 0xDFFF) code = 0xFFFD; // Unpaired surrogate
+
+                if (code < 0x80) {
+                    *out++ = (char)code;
+                } else if (code < 0x800) {
+                    *out++ = (char)(0xC0 | code >> 6);
+                    *out++ = (char)(0x80 | (code & 0x3F));
+                } else if (code < 0x10000) {
+                    *out++ = (char)(0xE0 | code >> 12);
+                    *out++ = (char)(0x80 | (code >> 6 & 0x3F));
+                    *out++ = (char)(0x80 | (code & 0x3F));
+                } else {
+                    *out++ = (char)(0xF0 | code >> 18);
+                    *out++ = (char)(0x80 | (code >> 12 & 0x3F));
+                    *out++ = (char)(0x80 | (code >> 6 & 0x3F));
+                    *out++ = (char)(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default: *out++ = c; break; // \" \\ \/
+        }
+    }
+    return (size_t)(out - dest);
+}
+
+static const char* skip_digits(const char *p, const char *end) {
+    while (p < end && *p >= '0' && *p <= '9') p++;
+    return p;
+}
+
+// Validate a number starting at p; returns the end of it, or NULL
+static const char* scan_number(const char *p, const char *end) {
+    if (p < end && *p == '-') p++;
+    if (p >= end || *p < '0' || *p > '9') return NULL;
+    p = *p == '0' ? p + 1 : skip_digits(p, end);
+    if (p < end && *p == '.') {
+        const char *digits = ++p;
+        p = skip_digits(p, end);
+        if (p == digits) return NULL;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < end && (*p == '+' || *p == '-')) p++;
+        const char *digits = p;
+        p = skip_digits(p, end);
+        if (p == digits) return NULL;
+    }
+    return p;
+}
+
+static int matches_literal(const char *p, const char *end, const char *literal, size_t length) {
+    return (size_t)(end - p) >= length && memcmp(p, literal, length) == 0;
+}
+
+// Validate the value starting at p; returns the end of it, or NULL
+static const char* skip_value(const char *p, const char *end, int depth) {
+    if (p >= end) return NULL;
+    switch (*p) {
+        case '"': {
+            const char *after;
+            int escaped;
+            return scan_string(p, end, &after, &escaped) == 0 ? after : NULL;
+        }
+        case '{':
+        case '[': {
+            char close = *p == '{' ? '}' : ']';
+            if (depth >= JSON_MAX_DEPTH) return NULL;
+            p = skip_whitespace(p + 1, end);
+            if (p < end && *p == close) return p + 1;
+            while (1) {
+                if (close == '}') {
+                    const char *after;
+                    int escaped;
+                    if (p >= end || *p != '"' || scan_string(p, end, &after, &escaped) != 0) return NULL;
+                    p = skip_whitespace(after, end);
+                    if (p >= end || *p != ':') return NULL;
+                    p = skip_whitespace(p + 1, end);
+                }
+                p = skip_value(p, end, depth + 1);
+                if (!p) return NULL;
+                p = skip_whitespace(p, end);
+                if (p < end && *p == ',') {
+                    p = skip_whitespace(p + 1, end);
+                } else if (p < end && *p == close) {
+                    return p + 1;
+                } else {
+                    return NULL;
+                }
+            }
+        }
+        case 't': return matches_literal(p, end, "true", 4) ? p + 4 : NULL;
+        case 'f': return matches_literal(p, end, "false", 5) ? p + 5 : NULL;
+        case 'n': return matches_literal(p, end, "null", 4) ? p + 4 : NULL;
+        default:  return scan_number(p, end);
+    }
+}
+
+// Allocate length + 1 bytes in arena, or with malloc
+static char* allocate_value(Arena *arena, size_t length) {
+    return arena ? arena_alloc(arena, length + 1) : malloc(length + 1);
+}
+
+// Parse a JSON object in one pass, storing the members lookup asks for
+int json_parse_object(const char *text, size_t length, JsonSlotLookup lookup, void *context,
+                      char **values, int slot_count, Arena *arena) {
+    const char *p = text, *end = text + length;
+    for (int i = 0; i < slot_count; i++) values[i] = NULL;
+
+    p = skip_whitespace(p, end);
+    if (p >= end || *p != '{') return -1;
+    p = skip_whitespace(p + 1, end);
+    int empty = p < end && *p == '}';
+    if (empty) p++;
+
+    while (!empty) {
+        // Member name
+        const char *name_end;
+        int escaped;
+        if (p >= end || *p != '"' || scan_string(p, end, &name_end, &escaped) != 0) goto fail;
+        const char *name = p + 1;
+        size_t name_length = (size_t)(name_end - 1 - name);
+        char decoded[JSON_MAX_NAME];
+        int slot = -1;
+        if (!escaped) {
+            slot = lookup(context, name, name_length);
+        } else if (name_length <= sizeof(decoded)) {
+            slot = lookup(context, decoded, unescape_string(name, name_end - 1, decoded));
+        }
+
+        p = skip_whitespace(name_end, end);
+        if (p >= end || *p != ':') goto fail;
+        p = skip_whitespace(p + 1, end);
+
+        // Value
+        const char *value = p;
+        p = skip_value(p, end, 0);
+        if (!p) goto fail;
+        if (slot >= 0 && slot < slot_count) {
+            char *copy;
+            if (*value == '"') {
+                copy = allocate_value(arena, (size_t)(p - value - 2));
+                if (!copy) goto fail;
+                copy[unescape_string(value + 1, p - 1, copy)] = '\0';
+            } else if (*value == 'n') {
+                copy = allocate_value(arena, 0); // null clears the field
+                if (!copy) goto fail;
+                copy[0] = '\0';
+            } else {
+                copy = allocate_value(arena, (size_t)(p - value));
+                if (!copy) goto fail;
+                memcpy(copy, value, (size_t)(p - value));
+                copy[p - value] = '\0';
+            }
+            if (!arena) free(values[slot]);
+            values[slot] = copy;
+        }
+
+        p = skip_whitespace(p, end);
+        if (p < end && *p == ',') {
+            p = skip_whitespace(p + 1, end);
+        } else if (p < end && *p == '}') {
+            p++;
+            break;
+        } else {
+            goto fail;
+        }
+    }
+
+    // Nothing but whitespace may follow the object
+    if (skip_whitespace(p, end) != end) goto fail;
+    return 0;
+
+fail:
+    for (int i = 0; i < slot_count; i++) {
+        if (!arena) free(values[i]);
+        values[i] = NULL;
+    }
+    return -1;
+}
+
+// Walk a JSON array, handing each element's text to callback
+int json_parse_array(const char *text, size_t length, JsonElementCallback callback, void *context) {
+    const char *p = text, *end = text + length;
+    p = skip_whitespace(p, end);
+    if (p >= end || *p != '[') return -1;
+    p = skip_whitespace(p + 1, end);
+
+    int count = 0;
+    if (p < end && *p == ']') {
+        p++;
+    } else {
+        while (1) {
+            const char *element = p;
+            p = skip_value(p, end, 0);
+            if (!p) return -1;
+            if (callback(context, element, (size_t)(p - element)) != 0) return -1;
+            count++;
+
+            p = skip_whitespace(p, end);
+            if (p < end && *p == ',') {
+                p = skip_whitespace(p + 1, end);
+            } else if (p < end && *p == ']') {
+                p++;
+                break;
+            } else {
+                return -1;
+            }
+        }
+    }
+    return skip_whitespace(p, end) == end ? count : -1;
+}
+
+// --- Writing ---
+
+// Make room for extra more bytes plus the terminator
+static int writer_reserve(JsonWriter *writer, size_t extra) {
+    if (writer->failed) return -1;
+    size_t needed = writer->length + extra + 1;
+    if (needed <= writer->capacity) return 0;
+
+    size_t capacity = writer->capacity ? writer->capacity : 256;
+    while (capacity < needed) capacity *= 2;
+    char *data = writer->arena ? arena_realloc(writer->arena, writer->data, writer->capacity, capacity)
+                               : realloc(writer->data, capacity);
+    if (!data) {
+        writer->failed = 1;
+        return -1;
+    }
+    writer->data = data;
+    writer->capacity = capacity;
+    return 0;
+}
+
+// Start an empty writer
+void json_writer_init(JsonWriter *writer, Arena *arena, size_t capacity) {
+    writer->data = NULL;
+    writer->length = 0;
+    writer->capacity = 0;
+    writer->arena = arena;
+    writer->failed = 0;
+    if (capacity > 0) writer_reserve(writer, capacity - 1);
+}
+
+// Append bytes as they are
+void json_write_raw(JsonWriter *writer, const char *data, size_t length) {
+    if (writer_reserve(writer, length) != 0) return;
+    memcpy(writer->data + writer->length, data, length);
+    writer->length += length;
+}
+
+// Append a quoted JSON string, escaping quotes, backslashes and control characters
+void json_write_string(JsonWriter *writer, const char *value, size_t length) {
+    static const char hex[] = "0123456789abcdef";
+    json_write_raw(writer, "\"", 1);
+
+    size_t run = 0; // Start of the characters not yet written
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)value[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        json_write_raw(writer, value + run, i - run);
+        run = i + 1;
+        char escape[6] = { '\\', 0 };
+        size_t escape_length = 2;
+        switch (c) {
+            case '"':  escape[1] = '"'; break;
+            case '\\': escape[1] = '\\'; break;
+            case '\b': escape[1] = 'b'; break;
+            case '\f': escape[1] = 'f'; break;
+            case '\n': escape[1] = 'n'; break;
+            case '\r': escape[1] = 'r'; break;
+            case '\t': escape[1] = 't'; break;
+            default:
+                memcpy(escape + 1, "u00", 3);
+                escape[4] = hex[c >> 4];
+                escape[5] = hex[c & 0xF];
+                escape_length = 6;
+                break;
+        }
+        json_write_raw(writer, escape, escape_length);
+    }
+    json_write_raw(writer, value + run, length - run);
+    json_write_raw(writer, "\"", 1);
+}
+
+// NUL-terminate and return the output
+char* json_writer_finish(JsonWriter *writer) {
+    if (writer_reserve(writer, 0) != 0) {
+        json_writer_free(writer);
+        return NULL;
+    }
+    writer->data[writer->length] = '\0';
+    return writer->data;
+}
+
+// Free a malloc'd writer's buffer
+void json_writer_free(JsonWriter *writer) {
+    if (!writer->arena) free(writer->data);
+    writer->data = NULL;
+    writer->length = 0;
+    writer->capacity = 0;
+}
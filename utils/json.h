@@ -0,0 +1,60 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stddef.h>
+#include "arena.h"
+
+// --- Reading ---
+
+// Called by json_parse_object for each member name; returns the slot the
+// value goes into (0..slot_count-1), or -1 to skip the member
+typedef int (*JsonSlotLookup)(void *context, const char *name, size_t length);
+
+// Parses a JSON object in one pass and stores the value of every member
+// lookup assigns a slot to in values[slot]: strings unescaped, numbers,
+// true and false as their text, null as "", and nested objects or arrays as
+// their JSON text. Slots of absent members are left NULL; a repeated member
+// keeps its last value. Values are allocated in arena (NULL: malloc, freed
+// by the caller). Returns 0, or -1 if text is not a well-formed object (the
+// values already set are then freed, or stay in the arena).
+int json_parse_object(const char *text, size_t length, JsonSlotLookup lookup, void *context,
+                      char **values, int slot_count, Arena *arena);
+
+// Called by json_parse_array with the JSON text of each element (not
+// NUL-terminated); returns 0 to go on, nonzero to stop with an error
+typedef int (*JsonElementCallback)(void *context, const char *element, size_t length);
+
+// Validates a JSON array and passes each element to callback in order.
+// Returns the number of elements, or -1 if text is not a well-formed array
+// or callback stopped
+int json_parse_array(const char *text, size_t length, JsonElementCallback callback, void *context);
+
+// --- Writing ---
+
+// Growing output buffer, in an arena or malloc'd. Appends never truncate:
+// a failed allocation marks the writer failed and later appends do nothing.
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    Arena *arena;
+    int failed;
+} JsonWriter;
+
+// Start an empty writer with room for about capacity bytes
+void json_writer_init(JsonWriter *writer, Arena *arena, size_t capacity);
+
+// Append bytes as they are (JSON punctuation, or already encoded JSON)
+void json_write_raw(JsonWriter *writer, const char *data, size_t length);
+
+// Append a string as a quoted, escaped JSON string
+void json_write_string(JsonWriter *writer, const char *value, size_t length);
+
+// NUL-terminate the output and return it (length in writer->length), or NULL
+// if an append failed (the buffer is then freed, or left to the arena)
+char* json_writer_finish(JsonWriter *writer);
+
+// Free a malloc'd writer's buffer (no-op in an arena)
+void json_writer_free(JsonWriter *writer);
+
+#endif // JSON_H
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <strings.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include "log.h"
+
+int log_threshold = LOG_LEVEL_INFO;
+
+static const char *level_names[LOG_LEVEL_OFF] = { "DEBUG", "INFO", "WARN", "ERROR" };
+
+// Queued message: this header, then length bytes of text
+typedef struct {
+    uint32_t length;
+    uint32_t level;
+    struct timespec time;
+} LogRecord;
+
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ring_ready = PTHREAD_COND_INITIALIZER;
+static char *ring;              // LOG_RING_SIZE bytes, used from head (wrapping around)
+static size_t ring_head;
+static size_t ring_used;
+static unsigned long dropped;   // Messages lost to a full ring since the writer last reported
+static int running;
+static int stopping;
+static pthread_t writer;
+
+// Prints one message with its timestamp and level
+static void write_line(FILE *stream, const LogRecord *record, const char *text) {
+    struct tm local;
+    char stamp[32];
+    localtime_r(&record->time.tv_sec, &local);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+    fprintf(stream, "%s.%03ld %-5s %.*s\n", stamp, record->time.tv_nsec / 1000000,
+            level_names[record->level], (int)record->length, text);
+}
+
+static FILE *stream_for(uint32_t level) {
+    return level >= LOG_LEVEL_WARN ? stderr : stdout;
+}
+
+// Copies length bytes into the ring at its end (the caller checked the room)
+static void ring_put(const void *data, size_t length) {
+    size_t tail = (ring_head + ring_used) % LOG_RING_SIZE;
+    size_t first = length < LOG_RING_SIZE - tail ? length : LOG_RING_SIZE - tail;
+    memcpy(ring + tail, data, first);
+    memcpy(ring, (const char *)data + first, length - first);
+    ring_used += length;
+}
+
+static void *writer_main(void *arg) {
+    (void)arg;
+    char *batch = malloc(LOG_RING_SIZE);
+    pthread_mutex_lock(&ring_lock);
+    while (1) {
+        while (ring_used == 0 && !dropped && !stopping) pthread_cond_wait(&ring_ready, &ring_lock);
+        if (ring_used == 0 && !dropped && stopping) break;
+
+        // Take everything queued, then print it without holding the lock
+        size_t length = ring_used;
+        size_t first = length < LOG_RING_SIZE - ring_head ? length : LOG_RING_SIZE - ring_head;
+        if (batch) {
+            memcpy(batch, ring + ring_head, first);
+            memcpy(batch + first, ring, length - first);
+        }
+        ring_head = (ring_head + length) % LOG_RING_SIZE;
+        ring_used = 0;
+        unsigned long lost = dropped;
+        dropped = 0;
+        pthread_mutex_unlock(&ring_lock);
+
+        for (size_t offset = 0; batch && offset < length; ) {
+            LogRecord record;
+            memcpy(&record, batch + offset, sizeof(record));
+            write_line(stream_for(record.level), &record, batch + offset + sizeof(record));
+            offset += sizeof(record) + record.length;
+        }
+        if (lost) fprintf(stderr, "Warning: %lu log messages dropped (log buffer full)\n", lost);
+        fflush(stdout);
+        fflush(stderr);
+        pthread_mutex_lock(&ring_lock);
+    }
+    pthread_mutex_unlock(&ring_lock);
+    free(batch);
+    return NULL;
+}
+
+void log_message(LogLevel level, const char *format, ...) {
+    if (level < LOG_LEVEL_DEBUG || level >= LOG_LEVEL_OFF) return;
+    char text[LOG_LINE_MAX];
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (written < 0) return;
+
+    LogRecord record;
+    record.length = (uint32_t)(written < LOG_LINE_MAX ? written : LOG_LINE_MAX - 1);
+    while (record.length > 0 && text[record.length - 1] == '\n') record.length--;
+    record.level = (uint32_t)level;
+    clock_gettime(CLOCK_REALTIME, &record.time);
+
+    pthread_mutex_lock(&ring_lock);
+    if (!running) {
+        pthread_mutex_unlock(&ring_lock);
+        write_line(stream_for(record.level), &record, text);
+        return;
+    }
+    if (LOG_RING_SIZE - ring_used < sizeof(record) + record.length) {
+        dropped++;
+    } else {
+        ring_put(&record, sizeof(record));
+        ring_put(text, record.length);
+    }
+    pthread_cond_signal(&ring_ready);
+    pthread_mutex_unlock(&ring_lock);
+}
+
+void log_set_level(LogLevel level) {
+    __atomic_store_n(&log_threshold, (int)level, __ATOMIC_RELAXED);
+}
+
+int log_parse_level(const char *name, LogLevel *level) {
+    static const char *names[] = { "debug", "info", "warn", "error", "off" };
+    for (int i = 0; i <= LOG_LEVEL_OFF; i++) {
+        if (strcasecmp(name, names[i]) == 0) {
+            *level = (LogLevel)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int log_start(void) {
+    pthread_mutex_lock(&ring_lock);
+    if (running) {
+        pthread_mutex_unlock(&ring_lock);
+        return 0;
+    }
+    if (!ring) ring = malloc(LOG_RING_SIZE);
+    if (!ring) {
+        pthread_mutex_unlock(&ring_lock);
+        perror("Failed to allocate log buffer");
+        return -1;
+    }
+    fflush(stdout); // Keep what was printed before in front of the queued messages
+    stopping = 0;
+    if (pthread_create(&writer, NULL, writer_main, NULL) != 0) {
+        pthread_mutex_unlock(&ring_lock);
+        perror("Failed to start log writer");
+        return -1;
+    }
+    running = 1;
+    pthread_mutex_unlock(&ring_lock);
+    return 0;
+}
+
+void log_stop(void) {
+    pthread_mutex_lock(&ring_lock);
+    if (!running) {
+        pthread_mutex_unlock(&ring_lock);
+        return;
+    }
+    stopping = 1;
+    pthread_cond_signal(&ring_ready);
+    pthread_mutex_unlock(&ring_lock);
+    pthread_join(writer, NULL);
+
+    pthread_mutex_lock(&ring_lock);
+    running = 0;
+    pthread_mutex_unlock(&ring_lock);
+    free(ring);
+    ring = NULL;
+}
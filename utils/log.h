@@ -0,0 +1,48 @@
+#ifndef LOG_H
+#define LOG_H
+
+// --- Logging ---
+// Leveled logger with a background writer. A message below the threshold
+// costs one load and a compare (the arguments are not even evaluated). Any
+// other message is formatted by the caller into a shared ring buffer, and a
+// writer thread prints it with a timestamp and its level: debug and info to
+// stdout, warnings and errors to stderr. The caller never waits on the
+// terminal or a pipe; if the ring is full the message is dropped and counted.
+// Before log_start and after log_stop, messages are written directly.
+
+typedef enum {
+    LOG_LEVEL_DEBUG,                        // Every request and row write
+    LOG_LEVEL_INFO,                         // Background work (compaction), startup
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_OFF
+} LogLevel;
+
+#define LOG_RING_SIZE (1 << 20)             // Bytes of messages waiting for the writer
+#define LOG_LINE_MAX 1024                   // Longer messages are truncated
+
+extern int log_threshold;                   // Messages below this level are skipped
+
+#define LOG_AT(level, ...) \
+    do { if ((level) >= log_threshold) log_message((level), __VA_ARGS__); } while (0)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+// Formats and queues a message (use the macros, which check the level first)
+void log_message(LogLevel level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// Sets the threshold (LOG_LEVEL_OFF silences everything)
+void log_set_level(LogLevel level);
+
+// Parses "debug", "info", "warn", "error" or "off". Returns 0, or -1 if unknown.
+int log_parse_level(const char *name, LogLevel *level);
+
+// Starts the writer thread. Returns 0, or -1 (messages are then written directly).
+int log_start(void);
+
+// Writes out every queued message and stops the writer thread
+void log_stop(void);
+
+#endif // LOG_H
@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+#include "metrics.h"
+
+#define METRICS_MAX_COLLECTORS 16
+#define METRICS_FIRST_BOUND_BITS 10         // Smallest exported bucket bound: 2^10 ns (about 1 us)
+#define METRICS_LAST_BOUND_BITS 36          // Largest: 2^36 ns (about 69 s), then +Inf
+
+typedef enum { SERIES_COUNTER, SERIES_HISTOGRAM } SeriesKind;
+
+typedef struct {
+    char *name;
+    char *help;
+    char *labels;                           // "" for none
+    SeriesKind kind;
+} Series;
+
+typedef struct {
+    uint64_t buckets[METRICS_BUCKETS];
+    uint64_t sum;                           // Nanoseconds
+} Histogram;
+
+// One thread's values, indexed by series id
+typedef struct MetricsShard {
+    uint64_t counters[METRICS_MAX_SERIES];
+    Histogram *histograms[METRICS_MAX_SERIES]; // Allocated on the thread's first observation
+    struct MetricsShard *next;
+} MetricsShard;
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static Series series[METRICS_MAX_SERIES];
+static int series_count;                    // Published after the series is filled in
+static struct {
+    MetricsCollector collector;
+    void *context;
+} collectors[METRICS_MAX_COLLECTORS];
+static int collector_count;
+
+static MetricsShard *shards;                // Every thread's shard, newest first
+static __thread MetricsShard *local_shard;
+static int enabled = 1;
+
+// Single writer per shard: a relaxed load and store is enough for readers to
+// see whole values, without the cost of an atomic read-modify-write
+static inline void shard_add(uint64_t *value, uint64_t amount) {
+    __atomic_store_n(value, __atomic_load_n(value, __ATOMIC_RELAXED) + amount, __ATOMIC_RELAXED);
+}
+
+// The calling thread's shard, created on first use (NULL if out of memory)
+static MetricsShard *thread_shard(void) {
+    if (local_shard) return local_shard;
+    MetricsShard *shard = calloc(1, sizeof(MetricsShard));
+    if (!shard) return NULL;
+    pthread_mutex_lock(&registry_lock);
+    shard->next = shards;
+    __atomic_store_n(&shards, shard, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&registry_lock);
+    local_shard = shard;
+    return shard;
+}
+
+// Bucket of a value: exact below METRICS_SUB_BUCKETS, then the top
+// METRICS_SUB_BUCKET_BITS + 1 bits of the value pick it
+static int bucket_index(uint64_t value) {
+    if (value < METRICS_SUB_BUCKETS) return (int)value;
+    int top_bit = 63 - __builtin_clzll(value);
+    if (top_bit >= METRICS_MAX_BITS) return METRICS_BUCKETS - 1;
+    int shift = top_bit - METRICS_SUB_BUCKET_BITS;
+    return (shift + 1) * METRICS_SUB_BUCKETS + (int)((value >> shift) - METRICS_SUB_BUCKETS);
+}
+
+// Bucket holding the values just below 2^bits (the last with an upper bound of 2^bits)
+static int last_bucket_below(int bits) {
+    return bucket_index((1ull << bits) - 1);
+}
+
+void metrics_set_enabled(int on) {
+    __atomic_store_n(&enabled, on ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+static int register_series(const char *name, const char *help, const char *labels, SeriesKind kind) {
+    if (!labels) labels = "";
+    pthread_mutex_lock(&registry_lock);
+    for (int i = 0; i < series_count; i++) {
+        if (strcmp(series[i].name, name) == 0 && strcmp(series[i].labels, labels) == 0) {
+            pthread_mutex_unlock(&registry_lock);
+            return series[i].kind == kind ? i : -1;
+        }
+    }
+    if (series_count == METRICS_MAX_SERIES) {
+        pthread_mutex_unlock(&registry_lock);
+        fprintf(stderr, "Warning: Too many metric series; %s{%s} is not recorded.\n", name, labels);
+        return -1;
+    }
+    Series *entry = &series[series_count];
+    entry->name = strdup(name);
+    entry->help = strdup(help ? help : "");
+    entry->labels = strdup(labels);
+    entry->kind = kind;
+    if (!entry->name || !entry->help || !entry->labels) {
+        free(entry->name);
+        free(entry->help);
+        free(entry->labels);
+        pthread_mutex_unlock(&registry_lock);
+        return -1;
+    }
+    int id = series_count;
+    __atomic_store_n(&series_count, series_count + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&registry_lock);
+    return id;
+}
+
+int metrics_counter(const char *name, const char *help, const char *labels) {
+    return register_series(name, help, labels, SERIES_COUNTER);
+}
+
+int metrics_histogram(const char *name, const char *help, const char *labels) {
+    return register_series(name, help, labels, SERIES_HISTOGRAM);
+}
+
+void metrics_count(int id, uint64_t amount) {
+    if (id < 0 || !__atomic_load_n(&enabled, __ATOMIC_RELAXED)) return;
+    MetricsShard *shard = thread_shard();
+    if (shard) shard_add(&shard->counters[id], amount);
+}
+
+void metrics_observe(int id, uint64_t nanoseconds) {
+    if (id < 0 || !__atomic_load_n(&enabled, __ATOMIC_RELAXED)) return;
+    MetricsShard *shard = thread_shard();
+    if (!shard) return;
+    Histogram *histogram = shard->histograms[id];
+    if (!histogram) {
+        histogram = calloc(1, sizeof(Histogram));
+        if (!histogram) return;
+        __atomic_store_n(&shard->histograms[id], histogram, __ATOMIC_RELEASE);
+    }
+    shard_add(&histogram->buckets[bucket_index(nanoseconds)], 1);
+    shard_add(&histogram->sum, nanoseconds);
+}
+
+uint64_t metrics_start(void) {
+    if (!__atomic_load_n(&enabled, __ATOMIC_RELAXED)) return 0;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+void metrics_observe_since(int id, uint64_t start) {
+    if (start == 0 || id < 0) return;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t end = (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+    metrics_observe(id, end > start ? end - start : 0);
+}
+
+int metrics_add_collector(MetricsCollector collector, void *context) {
+    pthread_mutex_lock(&registry_lock);
+    if (collector_count == METRICS_MAX_COLLECTORS) {
+        pthread_mutex_unlock(&registry_lock);
+        return -1;
+    }
+    collectors[collector_count].collector = collector;
+    collectors[collector_count].context = context;
+    collector_count++;
+    pthread_mutex_unlock(&registry_lock);
+    return 0;
+}
+
+void metrics_remove_collector(MetricsCollector collector, void *context) {
+    pthread_mutex_lock(&registry_lock);
+    for (int i = 0; i < collector_count; i++) {
+        if (collectors[i].collector == collector && collectors[i].context == context) {
+            collectors[i] = collectors[--collector_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+}
+
+void metrics_text_printf(MetricsText *text, const char *format, ...) {
+    if (text->failed) return;
+    while (1) {
+        va_list args;
+        va_start(args, format);
+        size_t room = text->capacity - text->length;
+        int written = vsnprintf(text->data ? text->data + text->length : NULL, room, format, args);
+        va_end(args);
+        if (written < 0) {
+            text->failed = 1;
+            return;
+        }
+        if ((size_t)written < room) {
+            text->length += written;
+            return;
+        }
+        size_t capacity = text->capacity ? text->capacity * 2 : 16384;
+        while (capacity - text->length <= (size_t)written) capacity *= 2;
+        char *data = realloc(text->data, capacity);
+        if (!data) {
+            text->failed = 1;
+            return;
+        }
+        text->data = data;
+        text->capacity = capacity;
+    }
+}
+
+// Writes a series name with its labels, plus extra labels (e.g. le="...")
+static void write_series_name(MetricsText *out, const char *name, const char *suffix,
+                              const char *labels, const char *extra) {
+    int has_labels = labels[0] != '\0', has_extra = extra && extra[0] != '\0';
+    metrics_text_printf(out, "%s%s", name, suffix);
+    if (has_labels || has_extra) {
+        metrics_text_printf(out, "{%s%s%s}", labels, has_labels && has_extra ? "," : "", has_extra ? extra : "");
+    }
+}
+
+static void render_counter(MetricsText *out, const Series *entry, int id, MetricsShard *first) {
+    uint64_t total = 0;
+    for (MetricsShard *shard = first; shard; shard = shard->next) {
+        total += __atomic_load_n(&shard->counters[id], __ATOMIC_RELAXED);
+    }
+    write_series_name(out, entry->name, "", entry->labels, NULL);
+    metrics_text_printf(out, " %llu\n", (unsigned long long)total);
+}
+
+static void render_histogram(MetricsText *out, const Series *entry, int id, MetricsShard *first) {
+    uint64_t buckets[METRICS_BUCKETS] = { 0 };
+    uint64_t sum = 0;
+    for (MetricsShard *shard = first; shard; shard = shard->next) {
+        Histogram *histogram = __atomic_load_n(&shard->histograms[id], __ATOMIC_ACQUIRE);
+        if (!histogram) continue;
+        for (int b = 0; b < METRICS_BUCKETS; b++) {
+            buckets[b] += __atomic_load_n(&histogram->buckets[b], __ATOMIC_RELAXED);
+        }
+        sum += __atomic_load_n(&histogram->sum, __ATOMIC_RELAXED);
+    }
+
+    uint64_t cumulative = 0;
+    int next = 0;
+    char le[48];
+    for (int bits = METRICS_FIRST_BOUND_BITS; bits <= METRICS_LAST_BOUND_BITS; bits++) {
+        for (int last = last_bucket_below(bits); next <= last; next++) cumulative += buckets[next];
+        snprintf(le, sizeof(le), "le=\"%.9g\"", (double)(1ull << bits) / 1e9);
+        write_series_name(out, entry->name, "_bucket", entry->labels, le);
+        metrics_text_printf(out, " %llu\n", (unsigned long long)cumulative);
+    }
+    for (; next < METRICS_BUCKETS; next++) cumulative += buckets[next];
+    write_series_name(out, entry->name, "_bucket", entry->labels, "le=\"+Inf\"");
+    metrics_text_printf(out, " %llu\n", (unsigned long long)cumulative);
+    write_series_name(out, entry->name, "_sum", entry->labels, NULL);
+    metrics_text_printf(out, " %.9f\n", (double)sum / 1e9);
+    write_series_name(out, entry->name, "_count", entry->labels, NULL);
+    metrics_text_printf(out, " %llu\n", (unsigned long long)cumulative);
+}
+
+char *metrics_render(size_t *length) {
+    MetricsText out = { NULL, 0, 0, 0 };
+    MetricsShard *first = __atomic_load_n(&shards, __ATOMIC_ACQUIRE);
+    int count = __atomic_load_n(&series_count, __ATOMIC_ACQUIRE);
+
+    // Series of one name must be written together, under one # HELP and # TYPE
+    char *written = calloc(count ? count : 1, 1);
+    if (!written) return NULL;
+    for (int i = 0; i < count; i++) {
+        if (written[i]) continue;
+        metrics_text_printf(&out, "# HELP %s %s\n# TYPE %s %s\n", series[i].name, series[i].help,
+                            series[i].name, series[i].kind == SERIES_COUNTER ? "counter" : "histogram");
+        for (int j = i; j < count; j++) {
+            if (written[j] || strcmp(series[j].name, series[i].name) != 0) continue;
+            if (series[j].kind == SERIES_COUNTER) render_counter(&out, &series[j], j, first);
+            else render_histogram(&out, &series[j], j, first);
+            written[j] = 1;
+        }
+    }
+    free(written);
+
+    // Collectors run under the registry lock, so they must not register series
+    pthread_mutex_lock(&registry_lock);
+    for (int i = 0; i < collector_count; i++) collectors[i].collector(collectors[i].context, &out);
+    pthread_mutex_unlock(&registry_lock);
+
+    if (!out.data && !out.failed) metrics_text_printf(&out, "%s", ""); // Nothing registered yet
+    if (out.failed) {
+        free(out.data);
+        return NULL;
+    }
+    *length = out.length;
+    return out.data;
+}
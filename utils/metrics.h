@@ -0,0 +1,74 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// --- Metrics ---
+// Counters and latency histograms kept per thread and merged when they are
+// read, so recording one is a few plain stores into memory only the calling
+// thread writes: no lock, no shared cache line. Each thread's values live in
+// a shard created the first time the thread records anything; shards are
+// never freed, which suits the fixed loop and worker threads of the server.
+//
+// Histograms are HDR-style (log-linear): every power of two of nanoseconds is
+// split into 2^METRICS_SUB_BUCKET_BITS buckets, so a value is kept within
+// 12.5% from 1 ns to about 18 minutes (longer values land in the last bucket).
+//
+// A series is a metric name plus its labels (Prometheus label text without
+// the braces, e.g. table="book",op="read"), registered once for an id that
+// the recording calls take. metrics_render merges every shard into the
+// Prometheus text exposition format, histograms as cumulative buckets at
+// each power of two nanoseconds.
+
+#define METRICS_MAX_SERIES 1024
+#define METRICS_SUB_BUCKET_BITS 3
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BUCKET_BITS)
+#define METRICS_MAX_BITS 40                 // Values of 2^40 ns and more share the last bucket
+#define METRICS_BUCKETS ((METRICS_MAX_BITS - METRICS_SUB_BUCKET_BITS + 1) * METRICS_SUB_BUCKETS)
+
+// Growing text buffer that collectors append exposition lines to
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    int failed;                             // An allocation failed; later appends do nothing
+} MetricsText;
+
+// Appends formatted text
+void metrics_text_printf(MetricsText *text, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// Called by metrics_render to append metrics computed on demand (sizes,
+// cache statistics), complete with their # HELP and # TYPE lines
+typedef void (*MetricsCollector)(void *context, MetricsText *out);
+
+// Turns recording on (the default) or off; rendering still works
+void metrics_set_enabled(int enabled);
+
+// Registers a counter or histogram series, or returns the id it already has.
+// Returns -1 if the table of series is full; recording with -1 does nothing.
+int metrics_counter(const char *name, const char *help, const char *labels);
+int metrics_histogram(const char *name, const char *help, const char *labels);
+
+// Adds amount to a counter
+void metrics_count(int series, uint64_t amount);
+
+// Records a latency in nanoseconds
+void metrics_observe(int series, uint64_t nanoseconds);
+
+// Start time for metrics_observe_since: the monotonic clock in nanoseconds,
+// or 0 while recording is off (so a disabled timer skips the clock reads)
+uint64_t metrics_start(void);
+
+// Records the time since start (from metrics_start); does nothing if start is 0
+void metrics_observe_since(int series, uint64_t start);
+
+// Adds or removes a collector
+int metrics_add_collector(MetricsCollector collector, void *context);
+void metrics_remove_collector(MetricsCollector collector, void *context);
+
+// Merges every thread's values and renders all series and collectors in the
+// Prometheus text format. Returns malloc'd text (length in *length), or NULL.
+char *metrics_render(size_t *length);
+
+#endif // METRICS_H
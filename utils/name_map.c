@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <string.h>
+#include "name_map.h"
+
+#define NAME_MAP_MIN_CAPACITY 16
+
+// FNV-1a hash of length bytes
+static uint32_t hash_name(const char *name, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Slot holding name, or the empty slot where it would go
+static size_t find_slot(const NameMapEntry *slots, size_t capacity, const char *name, size_t length, uint32_t hash) {
+    size_t mask = capacity - 1;
+    size_t slot = hash & mask;
+    while (slots[slot].name &&
+           (slots[slot].hash != hash || slots[slot].length != length ||
+            memcmp(slots[slot].name, name, length) != 0)) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Prepare an empty map
+void name_map_init(NameMap *map) {
+    map->slots = NULL;
+    map->capacity = 0;
+    map->count = 0;
+}
+
+// Double the number of slots (or allocate the first ones) and rehash
+static int grow(NameMap *map) {
+    size_t capacity = map->capacity ? map->capacity * 2 : NAME_MAP_MIN_CAPACITY;
+    NameMapEntry *slots = calloc(capacity, sizeof(NameMapEntry));
+    if (!slots) return -1;
+    for (size_t i = 0; i < map->capacity; i++) {
+        NameMapEntry *entry = &map->slots[i];
+        if (entry->name) slots[find_slot(slots, capacity, entry->name, entry->length, entry->hash)] = *entry;
+    }
+    free(map->slots);
+    map->slots = slots;
+    map->capacity = capacity;
+    return 0;
+}
+
+// Map name to value
+int name_map_put(NameMap *map, const char *name, int value) {
+    // Keep the load factor under 1/2 so probes stay short
+    if ((map->count + 1) * 2 > map->capacity && grow(map) != 0) return -1;
+
+    size_t length = strlen(name);
+    uint32_t hash = hash_name(name, length);
+    NameMapEntry *entry = &map->slots[find_slot(map->slots, map->capacity, name, length, hash)];
+    if (!entry->name) {
+        entry->name = name;
+        entry->length = length;
+        entry->hash = hash;
+        map->count++;
+    }
+    entry->value = value;
+    return 0;
+}
+
+// Value mapped to the first length bytes of name, or -1
+int name_map_get(const NameMap *map, const char *name, size_t length) {
+    if (map->count == 0) return -1;
+    uint32_t hash = hash_name(name, length);
+    const NameMapEntry *entry = &map->slots[find_slot(map->slots, map->capacity, name, length, hash)];
+    return entry->name ? entry->value : -1;
+}
+
+// Free the map's slots
+void name_map_destroy(NameMap *map) {
+    free(map->slots);
+    name_map_init(map);
+}
@@ -0,0 +1,38 @@
+#ifndef NAME_MAP_H
+#define NAME_MAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Hash table from names to small integers (array indexes), for resolving
+// model and field names without comparing against every name. Keys are not
+// copied: each name must stay valid, unchanged, as long as the map. Open
+// addressing with linear probing. Lookups may run concurrently with each
+// other, but not with name_map_put.
+
+typedef struct {
+    const char *name;           // NULL for an empty slot
+    size_t length;
+    uint32_t hash;
+    int value;
+} NameMapEntry;
+
+typedef struct {
+    NameMapEntry *slots;
+    size_t capacity;            // Number of slots, a power of two (0 before the first put)
+    size_t count;
+} NameMap;
+
+// Prepare an empty map
+void name_map_init(NameMap *map);
+
+// Map name to value, replacing an existing mapping. Returns 0, or -1 if out of memory.
+int name_map_put(NameMap *map, const char *name, int value);
+
+// Value of the first length bytes of name (which need not be NUL-terminated), or -1
+int name_map_get(const NameMap *map, const char *name, size_t length);
+
+// Free the map's slots (not the names)
+void name_map_destroy(NameMap *map);
+
+#endif // NAME_MAP_H
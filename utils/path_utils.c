@@ -3,6 +3,8 @@
 #include <string.h>
 #include <unistd.h>
 #include <limits.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include "path_utils.h"
 
 /**
@@ -46,3 +48,33 @@ int join_project_path(char *buffer, size_t size, const char *path) {
     snprintf(buffer, size, "%s/%s", root, path);
     return 0;
 }
+
+/**
+ * @brief Create a directory and any missing parent directories (mkdir -p)
+ * 
+ * @param path Directory to create
+ * @param mode Permissions of the directories created
+ * @return int 0 on success (including when the directory already exists), -1 on failure
+ */
+int make_directories(const char *path, mode_t mode) {
+    char temp[PATH_MAX];
+    size_t length = strlen(path);
+    if (length == 0 || length >= sizeof(temp)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memcpy(temp, path, length + 1);
+    
+    // Create each parent in turn; one that already exists (or was just
+    // created by another thread) is fine
+    for (char *slash = strchr(temp + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        if (mkdir(temp, mode) != 0 && errno != EEXIST) return -1;
+        *slash = '/';
+    }
+    if (mkdir(temp, mode) != 0) {
+        struct stat st;
+        if (errno != EEXIST || stat(temp, &st) != 0 || !S_ISDIR(st.st_mode)) return -1;
+    }
+    return 0;
+}
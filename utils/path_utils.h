@@ -2,6 +2,7 @@
 #define PATH_UTILS_H
 
 #include <stdio.h>
+#include <sys/types.h>
 
 /**
  * @brief Get the absolute path to the project root directory
@@ -22,4 +23,13 @@ int get_project_root(char *buffer, size_t size);
  */
 int join_project_path(char *buffer, size_t size, const char *path);
 
+/**
+ * @brief Create a directory and any missing parent directories (mkdir -p)
+ * 
+ * @param path Directory to create
+ * @param mode Permissions of the directories created
+ * @return int 0 on success (including when the directory already exists), -1 on failure
+ */
+int make_directories(const char *path, mode_t mode);
+
 #endif // PATH_UTILS_H
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "thread_pool.h"
+
+typedef struct {
+    ThreadPoolJob fn;
+    void *arg;
+} PoolJob;
+
+struct ThreadPool {
+    pthread_t *threads;
+    int thread_count;
+
+    PoolJob *queue;         // Ring buffer of pending jobs
+    int capacity;
+    int head;               // Index of the oldest pending job
+    int count;              // Number of pending jobs
+
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+};
+
+// Worker thread body: pop jobs until the pool is stopping and the queue is drained
+static void *pool_worker(void *arg) {
+    ThreadPool *pool = arg;
+
+    while (1) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->count == 0 && !pool->stopping) {
+            pthread_cond_wait(&pool->not_empty, &pool->lock);
+        }
+        if (pool->count == 0 && pool->stopping) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+
+        PoolJob job = pool->queue[pool->head];
+        pool->head = (pool->head + 1) % pool->capacity;
+        pool->count--;
+        pthread_mutex_unlock(&pool->lock);
+
+        job.fn(job.arg);
+    }
+    return NULL;
+}
+
+// Create a pool with a fixed number of workers and a bounded queue
+ThreadPool* thread_pool_create(int thread_count, int queue_capacity) {
+    if (thread_count <= 0 || queue_capacity <= 0) return NULL;
+
+    ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+    if (!pool) return NULL;
+
+    pool->queue = malloc(queue_capacity * sizeof(PoolJob));
+    pool->threads = malloc(thread_count * sizeof(pthread_t));
+    if (!pool->queue || !pool->threads) {
+        free(pool->queue);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+    pool->capacity = queue_capacity;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->not_empty, NULL);
+
+    for (int i = 0; i < thread_count; i++) {
+        if (pthread_create(&pool->threads[i], NULL, pool_worker, pool) != 0) {
+            perror("Worker thread creation failed");
+            break;
+        }
+        pool->thread_count++;
+    }
+
+    if (pool->thread_count == 0) {
+        thread_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+// Queue a job without blocking
+int thread_pool_submit(ThreadPool *pool, ThreadPoolJob fn, void *arg) {
+    if (!pool || !fn) return -1;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->stopping || pool->count == pool->capacity) {
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+    int tail = (pool->head + pool->count) % pool->capacity;
+    pool->queue[tail].fn = fn;
+    pool->queue[tail].arg = arg;
+    pool->count++;
+    pthread_cond_signal(&pool->not_empty);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+// Number of pending jobs
+int thread_pool_queue_depth(ThreadPool *pool) {
+    if (!pool) return 0;
+    pthread_mutex_lock(&pool->lock);
+    int depth = pool->count;
+    pthread_mutex_unlock(&pool->lock);
+    return depth;
+}
+
+// Drain, stop and free the pool
+void thread_pool_destroy(ThreadPool *pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->not_empty);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->not_empty);
+    free(pool->threads);
+    free(pool->queue);
+    free(pool);
+}
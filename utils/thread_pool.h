@@ -0,0 +1,24 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// Job function executed on a pool worker thread
+typedef void (*ThreadPoolJob)(void *arg);
+
+// Fixed-size pool of worker threads fed from a bounded FIFO queue
+typedef struct ThreadPool ThreadPool;
+
+// Creates a pool with thread_count workers and room for queue_capacity pending jobs.
+// Returns NULL on failure.
+ThreadPool* thread_pool_create(int thread_count, int queue_capacity);
+
+// Queues a job. Returns 0 on success, -1 if the queue is full or the pool is shutting down.
+// Never blocks: callers decide what to do when the pool is saturated.
+int thread_pool_submit(ThreadPool *pool, ThreadPoolJob fn, void *arg);
+
+// Returns the number of jobs currently waiting for a worker
+int thread_pool_queue_depth(ThreadPool *pool);
+
+// Runs every queued job to completion, stops the workers and frees the pool
+void thread_pool_destroy(ThreadPool *pool);
+
+#endif // THREAD_POOL_H